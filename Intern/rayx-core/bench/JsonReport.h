@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+// json reports of the benchmark executables (see --json of rayx-bench and rayx-bench-throughput)
+
+/// names are plain ascii, but quotes and backslashes are escaped anyway
+inline std::string jsonString(const std::string& str) {
+    auto result = std::string("\"");
+    for (const auto c : str) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+/// writes a report with the version of the layout and `label`, followed by the members written by `writeMembers`. each member written by
+/// `writeMembers` starts with ",\n", so that the members are separated like those written here
+template <typename WriteMembers>
+void writeJsonReport(const std::filesystem::path& filepath, const std::string& label, WriteMembers&& writeMembers) {
+    auto file = std::ofstream(filepath);
+    if (!file) throw std::runtime_error("unable to write json report: " + filepath.string());
+
+    file << std::setprecision(17);
+    file << "{\n";
+    file << "  \"version\": 1,\n";
+    file << "  \"label\": " << jsonString(label);
+    writeMembers(file);
+    file << "\n}\n";
+}
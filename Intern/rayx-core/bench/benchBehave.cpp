@@ -0,0 +1,137 @@
+#include <type_traits>
+#include <vector>
+
+#include "Rml/Importer.h"
+#include "Shader/Behave.h"
+#include "Shader/Collision.h"
+#include "Shader/Utils.h"
+#include "Tracer/Tracer.h"
+#include "setupBench.h"
+
+using namespace rayx;
+
+namespace {
+
+/// a ray on its hitpoint on an element, in element coordinates. detail::Ray can not be copied, so the rays are rebuilt from these for every run
+struct BehaveInput {
+    glm::dvec3 direction;
+    double energy;
+    ElectricField electric_field;
+    RandCounter randCounter;
+    CollisionPoint col;
+};
+
+detail::Ray makeRay(const BehaveInput& input) {
+    return detail::Ray{
+        .position            = input.col.hitpoint,
+        .direction           = input.direction,
+        .energy              = input.energy,
+        .optical_path_length = 0.0,
+        .electric_field      = input.electric_field,
+        .rand                = Rand(input.randCounter),
+        .path_id             = 0,
+        .path_event_id       = 0,
+        .order               = 0,
+        .object_id           = 0,
+        .source_id           = 0,
+        .event_type          = EventType::HitElement,
+    };
+}
+
+/// the rays emitted by the sources of `beamline` that hit `element`, moved to their hitpoints. the sources are traced once, outside of the
+/// measurement
+std::vector<BehaveInput> makeInputs(const Beamline& beamline, const OpticalElementAndTransform& element) {
+    auto tracer     = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+    const auto rays = tracer.trace(beamline, Sequential::Yes, ObjectMask::allSources(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt,
+                                   TraceControl{.seed = 42.0});
+
+    auto inputs = std::vector<BehaveInput>();
+    for (int i = 0; i < static_cast<int>(rays.size()); ++i) {
+        auto position       = rays.position(i);
+        auto direction      = rays.direction(i);
+        auto electric_field = rays.electric_field(i);
+        rayMatrixMult(element.transform.m_inTrans, position, direction, electric_field);
+
+        const auto col =
+            findCollisionInElementCoordsWithoutSlopeError(position, direction, element.element.m_surface, element.element.m_cutout, false);
+        if (!col) continue;
+
+        inputs.push_back(BehaveInput{
+            .direction      = direction,
+            .energy         = rays.energy[i],
+            .electric_field = electric_field,
+            .randCounter    = rays.rand_counter[i],
+            .col            = *col,
+        });
+    }
+    return inputs;
+}
+
+/// calls the behave routine of the behaviour type of `element` for every input
+template <bool UpdateElectricField>
+int64_t behaveInputs(const std::vector<BehaveInput>& inputs, const OpticalElement& element, const MaterialTables& materialTables) {
+    const auto* materialIndices = materialTables.indices.data();
+    const auto* materialTable   = materialTables.materials.data();
+
+    return element.m_behaviour.visit([&]<typename T>(const T& behaviour) {
+        double sum = 0;
+        for (const auto& input : inputs) {
+            auto ray = makeRay(input);
+            if constexpr (std::is_same_v<T, Behaviour::Mirror>) {
+                behaveMirror<UpdateElectricField>(ray, input.col, element.m_coating, element.m_material, materialIndices, materialTable);
+            } else if constexpr (std::is_same_v<T, Behaviour::Grating>) {
+                behaveGrating(ray, behaviour, input.col);
+            } else if constexpr (std::is_same_v<T, Behaviour::Slit>) {
+                behaveSlit(ray, behaviour);
+            } else if constexpr (std::is_same_v<T, Behaviour::RZP>) {
+                behaveRZP(ray, behaviour, input.col);
+            } else if constexpr (std::is_same_v<T, Behaviour::Crystal>) {
+                behaveCrystal<UpdateElectricField>(ray, behaviour, input.col);
+            } else if constexpr (std::is_same_v<T, Behaviour::ImagePlane>) {
+                behaveImagePlane(ray);
+            } else if constexpr (std::is_same_v<T, Behaviour::Foil>) {
+                behaveFoil<UpdateElectricField>(ray, behaviour, input.col, element.m_material, materialIndices, materialTable);
+            } else {
+                static_assert(!std::is_same_v<T, T>, "behaveInputs: unhandled behaviour type");
+            }
+            sum += ray.direction.x + ray.direction.y + ray.direction.z + static_cast<int>(ray.event_type);
+        }
+        return static_cast<int64_t>(sum * 1e6);
+    });
+}
+
+/// measures the behave routine of the first element in `rmlFilename`, on the rays of its sources that hit the element. mirror, crystal and foil
+/// are also measured without updating the electric field (see UpdateElectricField), as traced if the electric field is not recorded
+void benchBehaviour(const std::string& name, const std::string& rmlFilename) {
+    const auto benchName        = "behave/" + name;
+    const auto benchNameNoField = benchName + "/no_field";
+    if (!isBenchSelected(benchName) && !isBenchSelected(benchNameNoField)) return;
+
+    const auto beamline       = importBeamline(benchInputPath(rmlFilename));
+    const auto element        = beamline.compileElements().front();
+    const auto materialTables = beamline.calcMinimalMaterialTables();
+    const auto inputs         = makeInputs(beamline, element);
+    if (inputs.empty()) {
+        std::cout << benchName << ": skipped, no ray hits the element" << std::endl;
+        return;
+    }
+
+    const auto numInputs = static_cast<int64_t>(inputs.size());
+    measureItemsPerSecond(benchName, numInputs, [&] { return behaveInputs<true>(inputs, element.element, materialTables); });
+
+    const auto& behaviour = element.element.m_behaviour;
+    if (behaviour.is<Behaviour::Mirror>() || behaviour.is<Behaviour::Crystal>() || behaviour.is<Behaviour::Foil>())
+        measureItemsPerSecond(benchNameNoField, numInputs, [&] { return behaveInputs<false>(inputs, element.element, materialTables); });
+}
+
+}  // unnamed namespace
+
+void benchBehave() {
+    benchBehaviour("mirror", "PlaneMirror.rml");
+    benchBehaviour("grating", "PlaneGratingDeviationDefault.rml");
+    benchBehaviour("slit", "slit1_seeded.rml");
+    benchBehaviour("rzp", "ReflectionZonePlateDefault.rml");
+    benchBehaviour("image_plane", "ImagePlane.rml");
+    benchBehaviour("crystal", "crystal.rml");
+    benchBehaviour("foil", "Foil.rml");
+}
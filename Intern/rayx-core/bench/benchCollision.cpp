@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <vector>
+
+#include "Shader/Collision.h"
+#include "Shader/CollisionPacket.h"
+#include "Shader/CutoutFns.h"
+#include "Shader/Rand.h"
+#include "setupBench.h"
+
+using namespace rayx;
+
+namespace {
+
+constexpr int NUM_RAYS = 1 << 16;
+
+/// rays starting below the surfaces, pointing upwards with a random spread
+std::vector<RayPacket<RAY_PACKET_SIZE>> makeRayPackets() {
+    auto packets    = std::vector<RayPacket<RAY_PACKET_SIZE>>(NUM_RAYS / RAY_PACKET_SIZE);
+    RandCounter ctr = 42;
+    for (auto& packet : packets) {
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            const auto position  = glm::dvec3(squaresDoubleRNG(ctr) * 20 - 10, -10, squaresDoubleRNG(ctr) * 20 - 10);
+            const auto direction = glm::normalize(glm::dvec3(squaresDoubleRNG(ctr) * 0.2 - 0.1, 1, squaresDoubleRNG(ctr) * 0.2 - 0.1));
+            packet.set(lane, position, direction);
+        }
+    }
+    return packets;
+}
+
+/// calls `collisionFn` with the position and direction of every ray and counts the hits
+template <typename CollisionFn>
+int64_t traceSurface(const std::vector<RayPacket<RAY_PACKET_SIZE>>& packets, CollisionFn&& collisionFn) {
+    int64_t numHits = 0;
+    for (const auto& packet : packets) {
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) numHits += collisionFn(packet.position(lane), packet.direction(lane)) ? 1 : 0;
+    }
+    return numHits;
+}
+
+int64_t traceScalar(const std::vector<RayPacket<RAY_PACKET_SIZE>>& packets, const Surface& surface, const Cutout& cutout) {
+    int64_t numHits = 0;
+    for (const auto& packet : packets) {
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            const auto col = findCollisionInElementCoordsWithoutSlopeError(packet.position(lane), packet.direction(lane), surface, cutout, false);
+            numHits += col ? 1 : 0;
+        }
+    }
+    return numHits;
+}
+
+int64_t tracePacket(const std::vector<RayPacket<RAY_PACKET_SIZE>>& packets, const Surface& surface, const Cutout& cutout) {
+    int64_t numHits = 0;
+    CollisionPacket<RAY_PACKET_SIZE> col;
+    for (const auto& packet : packets) {
+        findCollisionInElementCoordsWithoutSlopeErrorPacket(packet, surface, cutout, col);
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) numHits += col.found[lane] ? 1 : 0;
+    }
+    return numHits;
+}
+
+/// height of the toroid above the XZ plane, on the side of the vertex
+double toroidHeight(const Surface::Toroid& toroid, const double x, const double z) {
+    const double rx = toroid.m_longRadius - toroid.m_shortRadius + glm::sqrt(toroid.m_shortRadius * toroid.m_shortRadius - x * x);
+    return toroid.m_longRadius - glm::sqrt(rx * rx - z * z);
+}
+
+/// rays at grazing incidence onto the vertex region of a concave toroid, like on a toroidal mirror
+std::vector<std::pair<glm::dvec3, glm::dvec3>> makeGrazingRays(const Surface::Toroid& toroid) {
+    auto rays       = std::vector<std::pair<glm::dvec3, glm::dvec3>>(NUM_RAYS);
+    RandCounter ctr = 42;
+    for (auto& [position, direction] : rays) {
+        const double x     = squaresDoubleRNG(ctr) * 20 - 10;
+        const double z     = squaresDoubleRNG(ctr) * 200 - 100;
+        const auto target  = glm::dvec3(x, toroidHeight(toroid, x, z), z);
+        const double angle = glm::radians(2 + squaresDoubleRNG(ctr) * 2);
+        direction          = glm::normalize(glm::dvec3(squaresDoubleRNG(ctr) * 0.002 - 0.001, -glm::sin(angle), glm::cos(angle)));
+        position           = target - direction * 100.0;
+    }
+    return rays;
+}
+
+template <typename CollisionFn>
+int64_t traceToroid(const std::vector<std::pair<glm::dvec3, glm::dvec3>>& rays, const Surface::Toroid& toroid, CollisionFn&& collisionFn) {
+    int64_t numHits = 0;
+    for (const auto& [position, direction] : rays) {
+        int numIterations = 0;
+        const auto col    = collisionFn(position, direction, toroid, false, numIterations);
+        numHits += col ? 1 : 0;
+    }
+    return numHits;
+}
+
+/// sphere with radius 100, touching the origin
+constexpr auto SPHERE = Surface::Quadric{
+    .m_icurv = 1,
+    .m_a11   = 1,
+    .m_a12   = 0,
+    .m_a13   = 0,
+    .m_a14   = 0,
+    .m_a22   = 1,
+    .m_a23   = 0,
+    .m_a24   = -100,
+    .m_a33   = 1,
+    .m_a34   = 0,
+    .m_a44   = 0,
+};
+
+}  // unnamed namespace
+
+void benchCollision() {
+    const auto packets = makeRayPackets();
+
+    const auto cutout = Cutout(Cutout::Rect{.m_width = 16, .m_length = 16});
+
+    // the surface intersection, without cutout
+    measureItemsPerSecond("collision/quadric/surface", NUM_RAYS, [&] {
+        return traceSurface(packets, [](const glm::dvec3& position, const glm::dvec3& direction) {
+            return getQuadricCollision(position, direction, SPHERE);
+        });
+    });
+
+    for (const auto& [name, surface] : {std::pair<std::string, Surface>{"plane", Surface::Plane{}}, {"quadric", SPHERE}}) {
+        measureItemsPerSecond("collision/" + name + "/scalar", NUM_RAYS, [&] { return traceScalar(packets, surface, cutout); });
+        measureItemsPerSecond("collision/" + name + "/packet", NUM_RAYS, [&] { return tracePacket(packets, surface, cutout); });
+    }
+}
+
+void benchToroidCollision() {
+    const auto toroid = Surface::Toroid{
+        .m_longRadius  = 10470.4917,
+        .m_shortRadius = 315.723959,
+        .m_toroidType  = ToroidType::Concave,
+    };
+    const auto rays = makeGrazingRays(toroid);
+
+    // accuracy and iteration counts. the error is the distance of the hitpoint to the toroid, measured along the y axis
+    for (const auto& [name, collisionFn] : {std::pair<std::string, decltype(&getToroidCollisionNewton)>{"newton", &getToroidCollisionNewton},
+                                            {"halley", &getToroidCollisionHalley}}) {
+        if (!isBenchSelected("collision/toroid/" + name)) continue;
+
+        int64_t numIterationsTotal = 0;
+        int64_t numHits            = 0;
+        int maxIterations          = 0;
+        double maxError            = 0;
+        for (const auto& [position, direction] : rays) {
+            int numIterations = 0;
+            const auto col    = collisionFn(position, direction, toroid, false, numIterations);
+            numIterationsTotal += numIterations;
+            maxIterations = std::max(maxIterations, numIterations);
+            if (!col) continue;
+            ++numHits;
+            maxError = std::max(maxError, glm::abs(col->hitpoint.y - toroidHeight(toroid, col->hitpoint.x, col->hitpoint.z)));
+        }
+
+        std::cout << "collision/toroid/" << name << ": hits = " << numHits << "/" << NUM_RAYS
+                  << ", mean iterations = " << std::fixed << std::setprecision(2) << static_cast<double>(numIterationsTotal) / NUM_RAYS
+                  << ", max iterations = " << maxIterations << ", max error = " << std::scientific << maxError << std::defaultfloat << std::endl;
+
+        measureItemsPerSecond("collision/toroid/" + name, NUM_RAYS, [&] { return traceToroid(rays, toroid, collisionFn); });
+    }
+
+    // the method selected at compile time (see RAYX_FAST_TOROID_COLLISION)
+    measureItemsPerSecond("collision/toroid/default", NUM_RAYS, [&] {
+        int64_t numHits = 0;
+        for (const auto& [position, direction] : rays) numHits += getToroidCollision(position, direction, toroid, false) ? 1 : 0;
+        return numHits;
+    });
+}
+
+void benchCubicCollision() {
+    const auto packets = makeRayPackets();
+
+    // the sphere of benchCollision with small cubic terms
+    const auto cubic = Surface::Cubic{
+        .m_a11 = SPHERE.m_a11,
+        .m_a12 = SPHERE.m_a12,
+        .m_a13 = SPHERE.m_a13,
+        .m_a14 = SPHERE.m_a14,
+        .m_a22 = SPHERE.m_a22,
+        .m_a23 = SPHERE.m_a23,
+        .m_a24 = SPHERE.m_a24,
+        .m_a33 = SPHERE.m_a33,
+        .m_a34 = SPHERE.m_a34,
+        .m_a44 = SPHERE.m_a44,
+        .m_b12 = 1e-4,
+        .m_b13 = 1e-4,
+        .m_b21 = 1e-4,
+        .m_b23 = 1e-4,
+        .m_b31 = 1e-4,
+        .m_b32 = 1e-4,
+        .m_psi = 0,
+    };
+
+    measureItemsPerSecond("collision/cubic", NUM_RAYS, [&] {
+        return traceSurface(packets, [&](const glm::dvec3& position, const glm::dvec3& direction) {
+            return getCubicCollision(position, direction, cubic);
+        });
+    });
+}
+
+void benchCutout() {
+    // points in a square of 20x20, so that about half of them are inside the cutouts
+    auto points     = std::vector<glm::dvec2>(NUM_RAYS);
+    RandCounter ctr = 42;
+    for (auto& point : points) point = glm::dvec2(squaresDoubleRNG(ctr) * 20 - 10, squaresDoubleRNG(ctr) * 20 - 10);
+
+    const std::pair<std::string, Cutout> cutouts[] = {
+        {"unlimited", Cutout::Unlimited{}},
+        {"rect", Cutout::Rect{.m_width = 14, .m_length = 14}},
+        {"elliptical", Cutout::Elliptical{.m_diameter_x = 16, .m_diameter_z = 16}},
+        {"trapezoid", Cutout::Trapezoid{.m_widthA = 10, .m_widthB = 18, .m_length = 14}},
+    };
+
+    for (const auto& [name, cutout] : cutouts) {
+        measureItemsPerSecond("cutout/" + name, NUM_RAYS, [&] {
+            int64_t numInside = 0;
+            for (const auto& point : points) numInside += inCutout(cutout, point.x, point.y) ? 1 : 0;
+            return numInside;
+        });
+    }
+}
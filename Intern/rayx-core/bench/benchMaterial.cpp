@@ -0,0 +1,39 @@
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "Material/Material.h"
+#include "Shader/Rand.h"
+#include "Shader/RefractiveIndex.h"
+#include "setupBench.h"
+
+using namespace rayx;
+
+namespace {
+
+constexpr int NUM_ENERGIES = 1 << 16;
+
+}  // unnamed namespace
+
+void benchRefractiveIndex() {
+    const std::pair<std::string, Material> materials[] = {{"Cu", Material::Cu}, {"Au", Material::Au}, {"SiC", Material::SiC}};
+
+    auto relevantMaterials = std::array<bool, 133>();
+    relevantMaterials.fill(false);
+    for (const auto& [name, material] : materials) relevantMaterials[static_cast<int>(material) - 1] = true;
+    const auto tables = loadMaterialTables(relevantMaterials);
+
+    // photon energies between 10 eV and 10 keV, distributed logarithmically, so the lookup hits all parts of the tables
+    auto energies   = std::vector<double>(NUM_ENERGIES);
+    RandCounter ctr = 42;
+    for (auto& energy : energies) energy = 10.0 * glm::pow(1000.0, squaresDoubleRNG(ctr));
+
+    for (const auto& [name, material] : materials) {
+        measureItemsPerSecond("refractive_index/" + name, NUM_ENERGIES, [&] {
+            double sum = 0;
+            for (const auto energy : energies)
+                sum += getRefractiveIndex(energy, static_cast<int>(material), tables.indices.data(), tables.materials.data()).real();
+            return static_cast<int64_t>(sum);
+        });
+    }
+}
@@ -0,0 +1,65 @@
+#include <vector>
+
+#include "Rays.h"
+#include "RaysView.h"
+#include "Shader/Rand.h"
+#include "setupBench.h"
+
+using namespace rayx;
+
+namespace {
+
+constexpr int NUM_PATHS       = 1 << 17;
+constexpr int EVENTS_PER_PATH = 8;
+constexpr int NUM_OBJECTS     = 16;
+
+/// rays of all attributes, like the output of a trace. every path consists of EVENTS_PER_PATH events on random objects
+Rays makeRays() {
+    const auto numEvents = NUM_PATHS * EVENTS_PER_PATH;
+
+    auto rays = Rays();
+#define X(type, name, flag) rays.name.resize(numEvents);
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+    RandCounter ctr = 42;
+    for (int i = 0; i < numEvents; ++i) {
+        rays.path_id[i]       = i / EVENTS_PER_PATH;
+        rays.path_event_id[i] = i % EVENTS_PER_PATH;
+        rays.object_id[i]     = static_cast<int>(squaresDoubleRNG(ctr) * NUM_OBJECTS);
+        rays.energy[i]        = 100 + squaresDoubleRNG(ctr);
+    }
+    return rays;
+}
+
+}  // unnamed namespace
+
+void benchRays() {
+    if (!isBenchSelected("rays/")) return;
+
+    const auto rays      = makeRays();
+    const auto numEvents = static_cast<int64_t>(rays.size());
+
+    // concatenation of the batches of a trace
+    auto batches = std::vector<Rays>();
+    for (int i = 0; i < 4; ++i) batches.push_back(rays.filter([&](const int j) { return j % 4 == i; }));
+    measureItemsPerSecond("rays/concat", numEvents, [&] { return static_cast<int64_t>(Rays::concat(batches).size()); });
+
+    measureItemsPerSecond("rays/sort_by_object_id", numEvents, [&] { return static_cast<int64_t>(rays.sortByObjectId().object_id.back()); });
+
+    measureItemsPerSecond("rays/filter_by_object_id", numEvents, [&] { return static_cast<int64_t>(rays.filterByObjectId(NUM_OBJECTS / 2).size()); });
+
+    measureItemsPerSecond("rays/filter_by_last_event_in_path", numEvents,
+                          [&] { return static_cast<int64_t>(rays.filterByLastEventInPath().size()); });
+
+    // an analysis chain, materializing every step or only the result
+    const auto highEnergy = [&](const int64_t i) { return rays.energy[i] > 100.5; };
+    measureItemsPerSecond("rays/chain_eager", numEvents, [&] {
+        auto result = rays.filter(highEnergy).filterByObjectId(NUM_OBJECTS / 2).sortByPathIdAndPathEventId();
+        return static_cast<int64_t>(result.filterByAttrMask(RayAttrMask::Position).size());
+    });
+    measureItemsPerSecond("rays/chain_view", numEvents, [&] {
+        auto view = RaysView(rays).filter(highEnergy).filterByObjectId(NUM_OBJECTS / 2).sortByPathIdAndPathEventId();
+        return static_cast<int64_t>(view.project(RayAttrMask::Position).materialize().size());
+    });
+}
@@ -0,0 +1,76 @@
+#include <optional>
+#include <type_traits>
+#include <variant>
+
+#include "Rml/Importer.h"
+#include "Shader/LightSources/CircleSource.h"
+#include "Shader/LightSources/DipoleSource.h"
+#include "Shader/LightSources/EnergyDistributions/EnergyDistribution.h"
+#include "Shader/LightSources/MatrixSource.h"
+#include "Shader/LightSources/PixelSource.h"
+#include "Shader/LightSources/PointSource.h"
+#include "Shader/LightSources/SimpleUndulatorSource.h"
+#include "setupBench.h"
+
+using namespace rayx;
+
+namespace {
+
+constexpr int NUM_RAYS = 1 << 16;
+
+/// energy distribution of the source, if it can be used without device buffers. DatFile is not supported
+std::optional<EnergyDistributionDataVariant> compileEnergyDistribution(const DesignSource& designSource) {
+    return std::visit(
+        []<typename T>(const T& value) -> std::optional<EnergyDistributionDataVariant> {
+            if constexpr (std::is_same_v<T, HardEdge> || std::is_same_v<T, SoftEdge> || std::is_same_v<T, SeparateEnergies>) {
+                return value;
+            } else {
+                return std::nullopt;
+            }
+        },
+        designSource.getEnergyDistribution());
+}
+
+/// generates rays of the first source in `rmlFilename`, which must be of type `Source`
+template <typename Source>
+void benchSource(const std::string& name, const std::string& rmlFilename) {
+    const auto benchName = "source/" + name;
+    if (!isBenchSelected(benchName)) return;
+
+    const auto beamline      = importBeamline(benchInputPath(rmlFilename));
+    const auto& designSource = *beamline.getSources().front();
+    const auto source        = Source(designSource);
+
+    auto energyDistribution = std::optional<EnergyDistributionDataVariant>();
+    if constexpr (!std::is_same_v<Source, DipoleSource>) {
+        energyDistribution = compileEnergyDistribution(designSource);
+        if (!energyDistribution) {
+            std::cout << benchName << ": skipped, unsupported energy distribution" << std::endl;
+            return;
+        }
+    }
+
+    measureItemsPerSecond(benchName, NUM_RAYS, [&] {
+        double sum = 0;
+        for (int i = 0; i < NUM_RAYS; ++i) {
+            auto rand = Rand(i, NUM_RAYS, 42.0);
+            if constexpr (std::is_same_v<Source, DipoleSource>) {
+                sum += source.genRay(i, 0, rand).energy;
+            } else {
+                sum += source.genRay(i, 0, *energyDistribution, rand).energy;
+            }
+        }
+        return static_cast<int64_t>(sum);
+    });
+}
+
+}  // unnamed namespace
+
+void benchSources() {
+    benchSource<PointSource>("point", "PointSourceHardEdge.rml");
+    benchSource<MatrixSource>("matrix", "MatrixSource.rml");
+    benchSource<DipoleSource>("dipole", "dipole_plain.rml");
+    benchSource<CircleSource>("circle", "CircleSource_default.rml");
+    benchSource<PixelSource>("pixel", "PixelSource.rml");
+    benchSource<SimpleUndulatorSource>("simple_undulator", "simpleUndulator.rml");
+}
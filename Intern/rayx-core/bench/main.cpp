@@ -0,0 +1,93 @@
+#include <fstream>
+#include <optional>
+#include <string_view>
+
+#include "CanonicalizePath.h"
+#include "JsonReport.h"
+#include "setupBench.h"
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: rayx-bench [--filter TEXT] [--min-seconds SECONDS] [--json FILE] [--label TEXT]\n"
+    "  --filter TEXT          run only benchmarks whose name contains TEXT\n"
+    "  --min-seconds SECONDS  repeat every benchmark for at least this time (default: 0.5)\n"
+    "  --json FILE            write the results to FILE as json\n"
+    "  --label TEXT           label stored in the json report, e.g. a commit hash\n";
+
+/// the report lists the benchmarks in order of execution, which is fixed. tools can compare reports of different commits by name
+void writeJson(const std::filesystem::path& filepath, const std::string& label) {
+    writeJsonReport(filepath, label, [](std::ofstream& file) {
+        file << ",\n  \"min_seconds\": " << benchOptions().minSeconds;
+        file << ",\n  \"benchmarks\": [";
+        const auto& results = benchResults();
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            file << (i == 0 ? "\n" : ",\n");
+            file << "    {\"name\": " << jsonString(r.name) << ", \"items\": " << r.numItems << ", \"runs\": " << r.numRuns
+                 << ", \"seconds\": " << r.seconds << ", \"items_per_second\": " << r.itemsPerSecond << "}";
+        }
+        file << "\n  ]";
+    });
+}
+
+}  // unnamed namespace
+
+BenchOptions& benchOptions() {
+    static auto options = BenchOptions{};
+    return options;
+}
+
+std::vector<BenchResult>& benchResults() {
+    static auto results = std::vector<BenchResult>();
+    return results;
+}
+
+std::filesystem::path benchInputPath(const std::string& filename) {
+    return rayx::canonicalizeRepositoryPath("Intern/rayx-core/tests/input/" + filename);
+}
+
+// microbenchmarks of hot tracer functions. all benchmarks run single threaded, so the numbers are per core.
+int main(int argc, char** argv) {
+    auto jsonPath = std::optional<std::filesystem::path>();
+    auto label    = std::string();
+
+    for (int i = 1; i < argc; ++i) {
+        const auto arg   = std::string_view(argv[i]);
+        const auto value = [&]() -> std::string {
+            if (i + 1 == argc) {
+                std::cerr << "missing value for " << arg << "\n" << USAGE;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--filter") {
+            benchOptions().filter = value();
+        } else if (arg == "--min-seconds") {
+            benchOptions().minSeconds = std::stod(value());
+        } else if (arg == "--json") {
+            jsonPath = value();
+        } else if (arg == "--label") {
+            label = value();
+        } else {
+            std::cerr << (arg == "--help" || arg == "-h" ? "" : "unknown argument: " + std::string(arg) + "\n") << USAGE;
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    benchCollision();
+    benchToroidCollision();
+    benchCubicCollision();
+    benchCutout();
+    benchRefractiveIndex();
+    benchBehave();
+    benchSources();
+    benchRays();
+
+    if (jsonPath) {
+        writeJson(*jsonPath, label);
+        std::cout << "Wrote results to: " << *jsonPath << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// result of one benchmark, as written to the json report (see --json)
+struct BenchResult {
+    std::string name;
+    /// number of items processed per run
+    int64_t numItems;
+    int64_t numRuns;
+    double seconds;
+    double itemsPerSecond;
+};
+
+/// options of a benchmark run, set from the command line
+struct BenchOptions {
+    /// only benchmarks whose name contains this string are run
+    std::string filter;
+    /// every benchmark is repeated until at least this time has passed
+    double minSeconds = 0.5;
+};
+
+BenchOptions& benchOptions();
+/// results of all benchmarks run so far, in order of execution
+std::vector<BenchResult>& benchResults();
+
+inline bool isBenchSelected(const std::string& name) { return name.find(benchOptions().filter) != std::string::npos; }
+
+/// path of a file in the test inputs, e.g. an rml file
+std::filesystem::path benchInputPath(const std::string& filename);
+
+/// measures the throughput of `fn`, which processes `numItems` items per call.
+/// `fn` is repeated until at least BenchOptions::minSeconds have passed, to get a stable measurement.
+/// `fn` returns a checksum of its results, which keeps the compiler from optimizing the work away.
+/// benchmarks that are not selected by BenchOptions::filter are skipped and return 0
+template <typename Fn>
+inline double measureItemsPerSecond(const std::string& name, const int64_t numItems, Fn&& fn) {
+    using Clock = std::chrono::steady_clock;
+
+    if (!isBenchSelected(name)) return 0.0;
+
+    static volatile int64_t sink = 0;
+
+    // warm up caches and branch predictors
+    sink = sink + fn();
+
+    int64_t numRuns = 0;
+    const auto t0   = Clock::now();
+    auto seconds    = 0.0;
+    do {
+        sink = sink + fn();
+        ++numRuns;
+        seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    } while (seconds < benchOptions().minSeconds);
+
+    const auto itemsPerSecond = static_cast<double>(numItems * numRuns) / seconds;
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(16) << std::fixed << std::setprecision(0) << itemsPerSecond
+              << " items/s" << std::defaultfloat << std::endl;
+
+    benchResults().push_back(BenchResult{
+        .name           = name,
+        .numItems       = numItems,
+        .numRuns        = numRuns,
+        .seconds        = seconds,
+        .itemsPerSecond = itemsPerSecond,
+    });
+    return itemsPerSecond;
+}
+
+void benchCollision();
+void benchToroidCollision();
+void benchCubicCollision();
+void benchCutout();
+void benchRefractiveIndex();
+void benchBehave();
+void benchSources();
+void benchRays();
@@ -0,0 +1,180 @@
+#include "SyntheticBeamline.h"
+
+#include <format>
+#include <iterator>
+#include <memory>
+
+#include "Beamline/Definitions.h"
+#include "Design/DesignElement.h"
+#include "Design/DesignSource.h"
+#include "Material/Material.h"
+#include "Shader/Constants.h"
+
+using namespace rayx;
+
+namespace {
+
+constexpr double GRAZING_ANGLE    = 2.0 * PI / 180.0;
+constexpr double ELEMENT_DISTANCE = 1000.0;  // mm
+// the radii are large, so that the beam is focused only weakly. otherwise rays would get lost in long beamlines
+constexpr double SPHERE_RADIUS       = 1e6;
+constexpr double TOROID_LONG_RADIUS  = 1e6;
+constexpr double TOROID_SHORT_RADIUS = 1e4;
+
+/// orientation of an element, given by the directions of its local axes
+glm::dmat4 orientation(const glm::dvec3& x, const glm::dvec3& y, const glm::dvec3& z) {
+    auto o = glm::dmat4(1.0);
+    o[0]   = glm::dvec4(x, 0);
+    o[1]   = glm::dvec4(y, 0);
+    o[2]   = glm::dvec4(z, 0);
+    return o;
+}
+
+/// orientation of an element perpendicular to a beam with elevation angle `elevation`, e.g. a slit or an image plane
+glm::dmat4 perpendicularOrientation(const double elevation) {
+    return orientation({1, 0, 0}, {0, glm::cos(elevation), -glm::sin(elevation)}, {0, glm::sin(elevation), glm::cos(elevation)});
+}
+
+/// orientation of a reflecting element hit by a beam with elevation angle `elevation` at GRAZING_ANGLE. the beam is reflected upwards or downwards
+glm::dmat4 reflectingOrientation(const double elevation, const bool upwards) {
+    if (upwards) return perpendicularOrientation(elevation + GRAZING_ANGLE);
+
+    // rotated around the beam by 180 degrees
+    const double angle = elevation - GRAZING_ANGLE;
+    return orientation({-1, 0, 0}, {0, -glm::cos(angle), glm::sin(angle)}, {0, glm::sin(angle), glm::cos(angle)});
+}
+
+std::unique_ptr<DesignSource> makeSource(const int numRays) {
+    auto source = std::make_unique<DesignSource>("Matrix Source");
+    source->setType(ElementType::MatrixSource);
+    source->setNumberOfRays(numRays);
+    source->setStokeslin0(1);
+    source->setStokeslin45(0);
+    source->setStokescirc(0);
+    source->setEnergyDistributionType(EnergyDistributionType::Values);
+    source->setEnergySpreadType(SpreadType::HardEdge);
+    source->setEnergy(100);
+    source->setEnergySpread(0);
+    source->setSourceDepth(0);
+    source->setSourceHeight(0.1);
+    source->setSourceWidth(0.1);
+    source->setHorDivergence(1e-6);
+    source->setVerDivergence(1e-6);
+    return source;
+}
+
+std::unique_ptr<DesignElement> makeElement(const std::string& name, const ElementType type, const DesignPlane plane, const glm::dvec4& position,
+                                           const glm::dmat4& orientation) {
+    auto element = std::make_unique<DesignElement>(name);
+    element->setType(type);
+    element->setPosition(position);
+    element->setOrientation(orientation);
+    element->setSlopeError(SlopeError{});
+    element->setAzimuthalAngle(Rad(0));
+    element->setMaterial(Material::Au);
+    element->setSurfaceCoatingType(SurfaceCoatingType::SubstrateOnly);
+    element->setDesignPlane(plane);
+    element->setCutout(Cutout::Rect{.m_width = 50, .m_length = 200});
+    element->setCurvatureType(CurvatureType::Plane);
+    element->setBehaviourType(BehaviourType::Mirror);
+    return element;
+}
+
+/// the type of element `index` of the beamline
+ElementType elementType(const ElementMix mix, const int index) {
+    switch (mix) {
+        case ElementMix::Curved: {
+            constexpr ElementType types[] = {ElementType::SphereMirror, ElementType::ToroidMirror};
+            return types[index % std::size(types)];
+        }
+        case ElementMix::Mixed: {
+            constexpr ElementType types[] = {ElementType::PlaneMirror, ElementType::SphereMirror, ElementType::Slit, ElementType::ToroidMirror,
+                                             ElementType::PlaneGrating};
+            return types[index % std::size(types)];
+        }
+        case ElementMix::Plane:
+        default:
+            return ElementType::PlaneMirror;
+    }
+}
+
+}  // unnamed namespace
+
+std::string to_string(const ElementMix mix) {
+    switch (mix) {
+        case ElementMix::Curved:
+            return "curved";
+        case ElementMix::Mixed:
+            return "mixed";
+        case ElementMix::Plane:
+        default:
+            return "plane";
+    }
+}
+
+std::optional<ElementMix> elementMixFromString(const std::string& str) {
+    for (const auto mix : {ElementMix::Plane, ElementMix::Curved, ElementMix::Mixed})
+        if (to_string(mix) == str) return mix;
+    return std::nullopt;
+}
+
+Beamline makeSyntheticBeamline(const SyntheticBeamlineConfig& config) {
+    auto beamline = Beamline();
+    beamline.addChild(makeSource(config.numRays));
+
+    // the beam starts at the origin in z direction. every reflecting element changes its elevation angle by twice the grazing angle
+    auto position  = glm::dvec3(0);
+    auto elevation = 0.0;
+
+    for (int i = 0; i < config.numElements; ++i) {
+        position += ELEMENT_DISTANCE * glm::dvec3(0, glm::sin(elevation), glm::cos(elevation));
+
+        const auto type = elementType(config.mix, i);
+        const auto name = std::format("element_{}", i);
+
+        if (type == ElementType::Slit) {
+            auto slit = makeElement(name, type, DesignPlane::XY, glm::dvec4(position, 1), perpendicularOrientation(elevation));
+            slit->setBehaviourType(BehaviourType::Slit);
+            slit->setOpeningShape(CutoutType::Rect);
+            slit->setOpeningWidth(20);
+            slit->setOpeningHeight(20);
+            slit->setCentralBeamstop(CentralBeamstop::None);
+            slit->setStopWidth(0);
+            slit->setStopHeight(0);
+            slit->setTotalWidth(50);
+            slit->setTotalHeight(50);
+            slit->setCutout(Cutout::Rect{.m_width = 50, .m_length = 50});
+            beamline.addChild(std::move(slit));
+            continue;
+        }
+
+        // reflect upwards if the beam is horizontal, downwards otherwise
+        const bool upwards = elevation == 0.0;
+        auto element       = makeElement(name, type, DesignPlane::XZ, glm::dvec4(position, 1), reflectingOrientation(elevation, upwards));
+        if (type == ElementType::SphereMirror) {
+            element->setCurvatureType(CurvatureType::Spherical);
+            element->setRadius(SPHERE_RADIUS);
+        } else if (type == ElementType::ToroidMirror) {
+            element->setCurvatureType(CurvatureType::Toroidal);
+            element->setLongRadius(TOROID_LONG_RADIUS);
+            element->setShortRadius(TOROID_SHORT_RADIUS);
+        } else if (type == ElementType::PlaneGrating) {
+            element->setBehaviourType(BehaviourType::Grating);
+            element->setVLSParameters({0, 0, 0, 0, 0, 0});
+            element->setLineDensity(100);
+            element->setOrderOfDiffraction(0);
+        }
+        beamline.addChild(std::move(element));
+
+        elevation = upwards ? 2 * GRAZING_ANGLE : 0.0;
+    }
+
+    position += ELEMENT_DISTANCE * glm::dvec3(0, glm::sin(elevation), glm::cos(elevation));
+    auto imagePlane =
+        makeElement("ImagePlane", ElementType::ImagePlane, DesignPlane::XY, glm::dvec4(position, 1), perpendicularOrientation(elevation));
+    imagePlane->setBehaviourType(BehaviourType::ImagePlane);
+    imagePlane->setCutout(Cutout::Unlimited{});
+    beamline.addChild(std::move(imagePlane));
+
+    return beamline;
+}
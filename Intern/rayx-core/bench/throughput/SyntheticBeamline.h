@@ -0,0 +1,34 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "Beamline/Beamline.h"
+
+/// element types used by makeSyntheticBeamline
+enum class ElementMix {
+    /// plane mirrors only
+    Plane,
+    /// alternating sphere and toroid mirrors
+    Curved,
+    /// plane, sphere and toroid mirrors, plane gratings and slits
+    Mixed,
+};
+
+std::string to_string(ElementMix mix);
+std::optional<ElementMix> elementMixFromString(const std::string& str);
+
+struct SyntheticBeamlineConfig {
+    /// number of elements, excluding the image plane at the end of the beamline
+    int numElements;
+    ElementMix mix;
+    int numRays;
+};
+
+/**
+ * @brief Builds a beamline of a matrix source, `numElements` elements and an image plane
+ * The elements are placed one meter apart along the beam. Mirrors and gratings reflect at grazing incidence, alternately upwards and downwards,
+ * so the beam stays close to the z axis. Gratings diffract in zeroth order and slits are wider than the beam, so that most rays hit every element
+ * and the beamline is traced the same way in sequential and non-sequential mode.
+ */
+rayx::Beamline makeSyntheticBeamline(const SyntheticBeamlineConfig& config);
@@ -0,0 +1,334 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../JsonReport.h"
+#include "Debug/Instrumentor.h"
+#include "SyntheticBeamline.h"
+#include "Tracer/Tracer.h"
+#include "Writer/CsvWriter.h"
+#include "Writer/H5Writer.h"
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: rayx-bench-throughput [options]\n"
+    "traces synthetic beamlines for every combination of the given values and reports the throughput\n"
+    "  --elements LIST      number of elements (default: 1,10,100,1000)\n"
+    "  --mix LIST           element types: plane, curved, mixed (default: plane,mixed)\n"
+    "  --rays LIST          number of rays (default: 100000)\n"
+    "  --batch-size LIST    maximum batch size (default: 100000)\n"
+    "  --threads LIST       number of cpu threads, 0 for all (default: 0). ignored with --gpu\n"
+    "  --sequential LIST    yes, no (default: no,yes)\n"
+    "  --attrs LIST         recorded attributes: position, direction (position, direction and energy), all (default: all). the reduced sets\n"
+    "                       select trace kernels specialized on the record mask, e.g. --attrs position,all compares one with the full kernel\n"
+    "  --record last|all    record the image plane only, or all objects (default: last)\n"
+    "  --gpu                trace on the best gpu instead of the cpu\n"
+    "  --output DIR         write the rays of every run to DIR, to measure the write phase\n"
+    "  --json FILE          write the results to FILE as json\n"
+    "  --label TEXT         label stored in the json report, e.g. a commit hash\n"
+    "lists are comma separated, e.g. --elements 1,10,100\n";
+
+/// a named set of recorded attributes
+struct RecordAttrs {
+    std::string name;
+    rayx::RayAttrMask mask;
+};
+
+struct RunConfig {
+    int numElements;
+    ElementMix mix;
+    int numRays;
+    int batchSize;
+    /// 0 means all cpus
+    int numThreads;
+    rayx::Sequential sequential;
+    RecordAttrs attrs;
+};
+
+/// phase times are summed over all tracing threads
+struct RunResult {
+    RunConfig config;
+    int64_t numEvents;
+    /// wall time of the trace
+    double seconds;
+    double raysPerSecond;
+    double eventsPerSecond;
+    /// peak resident set size of the process during the run, 0 if unknown
+    int64_t peakMemoryBytes;
+    double generateSeconds;
+    double traceSeconds;
+    double compactSeconds;
+    double transferSeconds;
+    double writeSeconds;
+};
+
+template <typename T>
+std::vector<T> parseList(const std::string& str, T (*parse)(const std::string&)) {
+    auto values = std::vector<T>();
+    auto ss     = std::stringstream(str);
+    auto item   = std::string();
+    while (std::getline(ss, item, ',')) values.push_back(parse(item));
+    if (values.empty()) throw std::invalid_argument("empty list: " + str);
+    return values;
+}
+
+int parseInt(const std::string& str) { return std::stoi(str); }
+
+ElementMix parseMix(const std::string& str) {
+    const auto mix = elementMixFromString(str);
+    if (!mix) throw std::invalid_argument("unknown element mix: " + str);
+    return *mix;
+}
+
+rayx::Sequential parseSequential(const std::string& str) {
+    if (str == "yes") return rayx::Sequential::Yes;
+    if (str == "no") return rayx::Sequential::No;
+    throw std::invalid_argument("expected yes or no: " + str);
+}
+
+RecordAttrs parseAttrs(const std::string& str) {
+    using rayx::RayAttrMask;
+    // the ids are recorded in every set, so that the events of the runs can be told apart
+    constexpr auto ids = RayAttrMask::PathId | RayAttrMask::PathEventId | RayAttrMask::ObjectId | RayAttrMask::EventType;
+    if (str == "position") return {str, RayAttrMask::Position | ids};
+    if (str == "direction") return {str, RayAttrMask::Position | RayAttrMask::Direction | RayAttrMask::Energy | ids};
+    if (str == "all") return {str, RayAttrMask::All};
+    throw std::invalid_argument("expected position, direction or all: " + str);
+}
+
+/// resets the peak resident set size of the process, so that the peak of each run can be measured. only supported on linux
+void resetPeakMemory() {
+#if defined(__linux__)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+int64_t peakMemoryBytes() {
+#if defined(__linux__)
+    auto status = std::ifstream("/proc/self/status");
+    auto line   = std::string();
+    while (std::getline(status, line))
+        if (line.starts_with("VmHWM:")) return std::stoll(line.substr(6)) * 1024;
+#endif
+    return 0;
+}
+
+/// total time of the profiled function `name` (see RAYX_PROFILE_FUNCTION), over all its calls
+double profiledSeconds(const std::vector<rayx::ProfileStats>& stats, const std::string& name) {
+    double seconds = 0;
+    for (const auto& s : stats)
+        if (s.path.substr(s.path.rfind('/') + 1) == name) seconds += s.totalSeconds;
+    return seconds;
+}
+
+rayx::DeviceConfig makeDeviceConfig(const bool gpu, const int numThreads) {
+    using DeviceType  = rayx::DeviceConfig::DeviceType;
+    const auto type   = gpu ? DeviceType::Gpu : DeviceType::Cpu;
+    auto deviceConfig = rayx::DeviceConfig(type);
+    deviceConfig.enableBestDevice(type);
+
+    // pinning the tracing threads to the first cpus also sets the number of OpenMP threads
+    if (!gpu && numThreads > 0) {
+        for (auto& device : deviceConfig.devices) {
+            if (!device.enable) continue;
+            device.cpus.resize(numThreads);
+            std::iota(device.cpus.begin(), device.cpus.end(), 0);
+        }
+    }
+    return deviceConfig;
+}
+
+RunResult run(const RunConfig& config, const bool gpu, const bool recordAll, const std::optional<std::filesystem::path>& outputDir) {
+    using Clock = std::chrono::steady_clock;
+
+    const auto beamline = makeSyntheticBeamline(SyntheticBeamlineConfig{
+        .numElements = config.numElements,
+        .mix         = config.mix,
+        .numRays     = config.numRays,
+    });
+    auto tracer = rayx::Tracer(makeDeviceConfig(gpu, config.numThreads));
+
+    const auto lastObjectIndex = static_cast<int>(beamline.numSources() + beamline.numElements()) - 1;
+    const auto recordMask      = recordAll ? rayx::ObjectMask::all() : rayx::ObjectMask::byIndices({lastObjectIndex});
+
+    resetPeakMemory();
+    rayx::Profiler::get().clear();
+
+    const auto t0   = Clock::now();
+    const auto rays = tracer.trace(beamline, config.sequential, recordMask, config.attrs.mask, std::nullopt, config.batchSize, std::nullopt,
+                                   rayx::TraceControl{.seed = 42.0});
+    const auto seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    auto writeSeconds = 0.0;
+    if (outputDir) {
+        const auto t1 = Clock::now();
+#ifndef NO_H5
+        rayx::writeH5(*outputDir / "synthetic.h5", beamline.getObjectNames(), rays);
+#else
+        rayx::writeCsv(*outputDir / "synthetic.csv", rays);
+#endif
+        writeSeconds = std::chrono::duration<double>(Clock::now() - t1).count();
+    }
+
+    const auto stats     = rayx::Profiler::get().summary();
+    const auto numEvents = static_cast<int64_t>(rays.size());
+    return RunResult{
+        .config          = config,
+        .numEvents       = numEvents,
+        .seconds         = seconds,
+        .raysPerSecond   = config.numRays / seconds,
+        .eventsPerSecond = numEvents / seconds,
+        .peakMemoryBytes = peakMemoryBytes(),
+        .generateSeconds = profiledSeconds(stats, "genRaysBatch"),
+        .traceSeconds    = profiledSeconds(stats, "traceBatch"),
+        .compactSeconds  = profiledSeconds(stats, "compactEvents"),
+        .transferSeconds = profiledSeconds(stats, "transferEventsBatch"),
+        .writeSeconds    = writeSeconds,
+    };
+}
+
+void printHeader() {
+    std::cout << std::right << std::setw(8) << "elements" << std::setw(8) << "mix" << std::setw(10) << "rays" << std::setw(8) << "batch"
+              << std::setw(8) << "threads" << std::setw(5) << "seq" << std::setw(10) << "attrs" << std::setw(14) << "rays/s" << std::setw(14)
+              << "events/s" << std::setw(10) << "peak MiB" << std::setw(10) << "gen s" << std::setw(10) << "trace s" << std::setw(10) << "compact s"
+              << std::setw(10) << "transfer s" << std::setw(10) << "write s" << std::endl;
+}
+
+void printResult(const RunResult& r) {
+    const auto& c = r.config;
+    std::cout << std::right << std::setw(8) << c.numElements << std::setw(8) << to_string(c.mix) << std::setw(10) << c.numRays << std::setw(8)
+              << c.batchSize << std::setw(8) << (c.numThreads ? std::to_string(c.numThreads) : "all") << std::setw(5)
+              << (c.sequential == rayx::Sequential::Yes ? "yes" : "no") << std::setw(10) << c.attrs.name << std::fixed << std::setprecision(0)
+              << std::setw(14) << r.raysPerSecond << std::setw(14) << r.eventsPerSecond << std::setw(10) << r.peakMemoryBytes / (1024 * 1024)
+              << std::setprecision(3) << std::setw(10) << r.generateSeconds << std::setw(10) << r.traceSeconds << std::setw(10) << r.compactSeconds
+              << std::setw(10) << r.transferSeconds << std::setw(10) << r.writeSeconds << std::defaultfloat << std::endl;
+}
+
+void writeJson(const std::filesystem::path& filepath, const std::string& label, const std::vector<RunResult>& results) {
+    writeJsonReport(filepath, label, [&](std::ofstream& file) {
+        file << ",\n  \"runs\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            const auto& c = r.config;
+            file << (i == 0 ? "\n" : ",\n");
+            file << "    {\"elements\": " << c.numElements << ", \"mix\": " << jsonString(to_string(c.mix)) << ", \"rays\": " << c.numRays
+                 << ", \"batch_size\": " << c.batchSize << ", \"threads\": " << c.numThreads
+                 << ", \"sequential\": " << (c.sequential == rayx::Sequential::Yes ? "true" : "false")
+                 << ", \"attrs\": " << jsonString(c.attrs.name) << ", \"events\": " << r.numEvents
+                 << ", \"seconds\": " << r.seconds << ", \"rays_per_second\": " << r.raysPerSecond
+                 << ", \"events_per_second\": " << r.eventsPerSecond << ", \"peak_memory_bytes\": " << r.peakMemoryBytes
+                 << ", \"phase_seconds\": {\"generate\": " << r.generateSeconds << ", \"trace\": " << r.traceSeconds
+                 << ", \"compact\": " << r.compactSeconds << ", \"transfer\": " << r.transferSeconds << ", \"write\": " << r.writeSeconds
+                 << "}}";
+        }
+        file << "\n  ]";
+    });
+}
+
+}  // unnamed namespace
+
+// end-to-end throughput of the tracer on synthetic beamlines, to track scaling with the number of elements, rays and threads
+int main(int argc, char** argv) {
+    auto elements    = std::vector<int>{1, 10, 100, 1000};
+    auto mixes       = std::vector<ElementMix>{ElementMix::Plane, ElementMix::Mixed};
+    auto rays        = std::vector<int>{100000};
+    auto batchSizes  = std::vector<int>{rayx::DEFAULT_BATCH_SIZE};
+    auto threads     = std::vector<int>{0};
+    auto sequentials = std::vector<rayx::Sequential>{rayx::Sequential::No, rayx::Sequential::Yes};
+    auto attrs       = std::vector<RecordAttrs>{parseAttrs("all")};
+    auto recordAll   = false;
+    auto gpu         = false;
+    auto outputDir   = std::optional<std::filesystem::path>();
+    auto jsonPath    = std::optional<std::filesystem::path>();
+    auto label       = std::string();
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const auto arg   = std::string_view(argv[i]);
+            const auto value = [&]() -> std::string {
+                if (i + 1 == argc) throw std::invalid_argument("missing value for " + std::string(arg));
+                return argv[++i];
+            };
+
+            if (arg == "--elements") {
+                elements = parseList(value(), parseInt);
+            } else if (arg == "--mix") {
+                mixes = parseList(value(), parseMix);
+            } else if (arg == "--rays") {
+                rays = parseList(value(), parseInt);
+            } else if (arg == "--batch-size") {
+                batchSizes = parseList(value(), parseInt);
+            } else if (arg == "--threads") {
+                threads = parseList(value(), parseInt);
+            } else if (arg == "--sequential") {
+                sequentials = parseList(value(), parseSequential);
+            } else if (arg == "--attrs") {
+                attrs = parseList(value(), parseAttrs);
+            } else if (arg == "--record") {
+                const auto record = value();
+                if (record != "last" && record != "all") throw std::invalid_argument("expected last or all: " + record);
+                recordAll = record == "all";
+            } else if (arg == "--gpu") {
+                gpu = true;
+            } else if (arg == "--output") {
+                outputDir = value();
+            } else if (arg == "--json") {
+                jsonPath = value();
+            } else if (arg == "--label") {
+                label = value();
+            } else if (arg == "--help" || arg == "-h") {
+                std::cout << USAGE;
+                return 0;
+            } else {
+                throw std::invalid_argument("unknown argument: " + std::string(arg));
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n" << USAGE;
+        return 1;
+    }
+
+    if (gpu) threads = {0};
+    if (outputDir) std::filesystem::create_directories(*outputDir);
+
+    // phase times are taken from the profiler
+    rayx::BENCH_FLAG = true;
+
+    auto results = std::vector<RunResult>();
+    printHeader();
+    for (const auto numElements : elements)
+        for (const auto mix : mixes)
+            for (const auto numRays : rays)
+                for (const auto batchSize : batchSizes)
+                    for (const auto numThreads : threads)
+                        for (const auto sequential : sequentials)
+                            for (const auto& recordAttrs : attrs) {
+                                const auto config = RunConfig{
+                                    .numElements = numElements,
+                                    .mix         = mix,
+                                    .numRays     = numRays,
+                                    .batchSize   = batchSize,
+                                    .numThreads  = numThreads,
+                                    .sequential  = sequential,
+                                    .attrs       = recordAttrs,
+                                };
+                                results.push_back(run(config, gpu, recordAll, outputDir));
+                                printResult(results.back());
+                            }
+
+    if (jsonPath) {
+        writeJson(*jsonPath, label, results);
+        std::cout << "Wrote results to: " << *jsonPath << std::endl;
+    }
+    return 0;
+}
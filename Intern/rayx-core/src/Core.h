@@ -30,6 +30,16 @@
 #endif
 #endif
 
+/**
+ *  Internal functions that are exported only for the microbenchmarks of rayx-bench, if it is built (see RAYX_BUILD_RAYX_BENCH).
+ *  Otherwise they stay internal to the library.
+ */
+#ifdef RAYX_EXPORT_BENCH_API
+#define RAYX_BENCH_API RAYX_API
+#else
+#define RAYX_BENCH_API
+#endif
+
 #ifdef RAYX_BUILD_DLL
 #include <alpaka/core/Common.hpp>
 #define RAYX_FN_ACC ALPAKA_FN_ACC
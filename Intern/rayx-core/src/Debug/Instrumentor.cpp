@@ -1,4 +1,185 @@
 #include "Instrumentor.h"
 
+#include <iomanip>
+#include <unordered_map>
+
 // if true, benchmarking is active.
-bool rayx::BENCH_FLAG = false;
\ No newline at end of file
+bool rayx::BENCH_FLAG = false;
+
+namespace {
+
+int64_t toNanoseconds(const rayx::Profiler::Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+std::string escapeJson(const std::string& str) {
+    std::string result;
+    result.reserve(str.size());
+    for (const auto c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            result += ' ';
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+}  // unnamed namespace
+
+namespace rayx {
+
+Profiler::Profiler() : m_startTimepoint(Clock::now()) {}
+
+Profiler& Profiler::get() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::ThreadBuffer& Profiler::threadBuffer() {
+    // buffers are never freed, so the pointer stays valid for the lifetime of the thread
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        const auto lock = std::lock_guard(m_mutex);
+        m_threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer           = m_threadBuffers.back().get();
+        buffer->threadId = static_cast<int>(m_threadBuffers.size()) - 1;
+    }
+    return *buffer;
+}
+
+void Profiler::clear() {
+    const auto lock = std::lock_guard(m_mutex);
+    for (auto& threadBuffer : m_threadBuffers) threadBuffer->events.clear();
+}
+
+std::vector<ProfileStats> Profiler::summary() const {
+    const auto lock = std::lock_guard(m_mutex);
+
+    auto stats = std::vector<ProfileStats>();
+    // position of each path in the scope tree: the order of first calls of the path and all of its ancestors
+    auto orders    = std::vector<std::vector<int>>();
+    auto pathIndex = std::unordered_map<std::string, int>();
+
+    for (const auto& threadBuffer : m_threadBuffers) {
+        // events are recorded when a scope ends. ordering by start time restores the order in which the scopes were entered, and the enclosing
+        // scope of an event is the last entered scope with a smaller depth
+        auto events = threadBuffer->events;
+        std::ranges::sort(events, [](const Event& a, const Event& b) { return std::tie(a.startNs, a.depth) < std::tie(b.startNs, b.depth); });
+
+        auto paths      = std::vector<std::string>();
+        auto parents    = std::vector<int>();
+        auto parentEnds = std::vector<int64_t>();
+        for (const auto& event : events) {
+            paths.resize(event.depth + 1);
+            parents.resize(event.depth + 1, -1);
+            parentEnds.resize(event.depth + 1, 0);
+
+            // scopes that were still running when the events were read have no event. their children become roots
+            const auto endNs   = event.startNs + event.durationNs;
+            const auto parent  = event.depth > 0 && endNs <= parentEnds[event.depth - 1] ? parents[event.depth - 1] : -1;
+            paths[event.depth] = parent == -1 ? std::string(event.name) : paths[event.depth - 1] + "/" + event.name;
+
+            const auto seconds     = event.durationNs * 1e-9;
+            const auto [it, isNew] = pathIndex.try_emplace(paths[event.depth], static_cast<int>(stats.size()));
+            if (isNew) {
+                stats.push_back(ProfileStats{
+                    .path         = paths[event.depth],
+                    .depth        = parent == -1 ? 0 : stats[parent].depth + 1,
+                    .count        = 0,
+                    .totalSeconds = 0.0,
+                    .minSeconds   = seconds,
+                    .meanSeconds  = 0.0,
+                    .maxSeconds   = seconds,
+                });
+                orders.push_back(parent == -1 ? std::vector<int>() : orders[parent]);
+                orders.back().push_back(it->second);
+            }
+
+            auto& s = stats[it->second];
+            ++s.count;
+            s.totalSeconds += seconds;
+            s.minSeconds = std::min(s.minSeconds, seconds);
+            s.maxSeconds = std::max(s.maxSeconds, seconds);
+
+            parents[event.depth]    = it->second;
+            parentEnds[event.depth] = endNs;
+        }
+    }
+
+    for (auto& s : stats) s.meanSeconds = s.totalSeconds / s.count;
+
+    auto indices = std::vector<int>(stats.size());
+    for (int i = 0; i < static_cast<int>(indices.size()); ++i) indices[i] = i;
+    std::ranges::sort(indices, [&](const int a, const int b) { return orders[a] < orders[b]; });
+
+    auto sortedStats = std::vector<ProfileStats>();
+    sortedStats.reserve(stats.size());
+    for (const auto i : indices) sortedStats.push_back(std::move(stats[i]));
+    return sortedStats;
+}
+
+void Profiler::printSummary(std::ostream& os) const {
+    const auto stats = summary();
+
+    // scopes are indented by their depth and named by the last component of their path
+    const auto scopeName = [](const ProfileStats& s) { return std::string(2 * s.depth, ' ') + s.path.substr(s.path.rfind('/') + 1); };
+
+    auto nameWidth = std::string("scope").size();
+    for (const auto& s : stats) nameWidth = std::max(nameWidth, scopeName(s).size());
+
+    os << "profile summary:\n";
+    os << std::left << std::setw(nameWidth) << "scope" << std::right << std::setw(10) << "calls" << std::setw(14) << "total [s]" << std::setw(14)
+       << "min [s]" << std::setw(14) << "mean [s]" << std::setw(14) << "max [s]" << "\n";
+    for (const auto& s : stats) {
+        os << std::left << std::setw(nameWidth) << scopeName(s) << std::right << std::setw(10) << s.count << std::scientific << std::setprecision(4)
+           << std::setw(14) << s.totalSeconds << std::setw(14) << s.minSeconds << std::setw(14) << s.meanSeconds << std::setw(14) << s.maxSeconds
+           << std::defaultfloat << "\n";
+    }
+}
+
+void Profiler::writeChromeTrace(const std::filesystem::path& filepath) const {
+    const auto lock = std::lock_guard(m_mutex);
+
+    std::ofstream file(filepath);
+    if (!file) throw std::runtime_error("error: unable to write profile to file: " + filepath.string());
+
+    // complete events ("ph": "X") with timestamps in microseconds
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    auto first = true;
+    for (const auto& threadBuffer : m_threadBuffers) {
+        for (const auto& event : threadBuffer->events) {
+            if (!first) file << ",";
+            first = false;
+            file << "\n{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"rayx\",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadBuffer->threadId
+                 << std::fixed << std::setprecision(3) << ",\"ts\":" << event.startNs * 1e-3 << ",\"dur\":" << event.durationNs * 1e-3
+                 << std::defaultfloat << "}";
+        }
+    }
+    file << "\n]}\n";
+}
+
+void InstrumentationTimer::Start() {
+    m_threadBuffer   = &Profiler::get().threadBuffer();
+    m_depth          = m_threadBuffer->depth++;
+    m_StartTimepoint = Profiler::Clock::now();
+}
+
+void InstrumentationTimer::Stop() {
+    if (m_isStopped) return;
+
+    const auto endTimepoint = Profiler::Clock::now();
+    m_threadBuffer->events.push_back(Profiler::Event{
+        .name       = m_Name,
+        .startNs    = toNanoseconds(m_StartTimepoint - Profiler::get().startTimepoint()),
+        .durationNs = toNanoseconds(endTimepoint - m_StartTimepoint),
+        .depth      = m_depth,
+    });
+    --m_threadBuffer->depth;
+    m_isStopped = true;
+}
+
+}  // namespace rayx
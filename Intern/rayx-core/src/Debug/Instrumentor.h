@@ -1,63 +1,117 @@
 //
 // Basic instrumentation profiler by Cherno
+// extended to a hierarchical profiler with per-thread buffers, statistics and Chrome trace output
 
 #pragma once
 
 #include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "Core.h"
 
 namespace rayx {
 
+// if true, profiling scopes are recorded. otherwise the profiling macros only cost a branch
 extern bool RAYX_API BENCH_FLAG;
+
+/// statistics of all calls of a scope. scopes are identified by their path, the names of the enclosing scopes and the scope itself, joined by '/'
+struct RAYX_API ProfileStats {
+    std::string path;
+    int depth;
+    int64_t count;
+    double totalSeconds;
+    double minSeconds;
+    double meanSeconds;
+    double maxSeconds;
+};
+
+/**
+ * @brief Profiler collects the scopes recorded by InstrumentationTimer
+ * every thread records into its own buffer, so recording does not lock. the buffers are read by summary() and the write functions, which must
+ * not run concurrently with recording threads (e.g. call them after tracing has finished)
+ */
+class RAYX_API Profiler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static Profiler& get();
+
+    /// a completed scope. times are relative to the creation of the profiler
+    struct Event {
+        const char* name;
+        int64_t startNs;
+        int64_t durationNs;
+        /// nesting depth of the scope within its thread
+        int depth;
+    };
+
+    struct ThreadBuffer {
+        int threadId = 0;
+        int depth    = 0;
+        std::vector<Event> events;
+    };
+
+    /// buffer of the calling thread. created on first use
+    ThreadBuffer& threadBuffer();
+    Clock::time_point startTimepoint() const { return m_startTimepoint; }
+
+    /// discards all recorded scopes
+    void clear();
+
+    /// statistics per scope path, ordered like a depth-first traversal of the scopes, in order of their first call
+    std::vector<ProfileStats> summary() const;
+    void printSummary(std::ostream& os) const;
+    /// writes all recorded scopes in the Chrome trace event format, which can be opened in chrome://tracing or https://ui.perfetto.dev
+    void writeChromeTrace(const std::filesystem::path& filepath) const;
+
+  private:
+    Profiler();
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_threadBuffers;
+    const Clock::time_point m_startTimepoint;
+};
+
 class RAYX_API InstrumentationTimer {
   public:
-    InstrumentationTimer(const char* name, bool canPrint) : m_Name(name), m_isStopped(false), m_canPrint(canPrint) {
-        if (BENCH_FLAG) m_StartTimepoint = std::chrono::high_resolution_clock::now();
+    InstrumentationTimer(const char* name, [[maybe_unused]] bool canPrint) : m_Name(name), m_isStopped(!BENCH_FLAG) {
+        if (BENCH_FLAG) Start();
     }
 
     ~InstrumentationTimer() {
         if (!m_isStopped) Stop();
     }
 
-    void Stop() {
-        if (BENCH_FLAG) {
-            auto endTimepoint = std::chrono::high_resolution_clock::now();
-
-            long long start = std::chrono::time_point_cast<std::chrono::microseconds>(m_StartTimepoint).time_since_epoch().count();
-            long long end   = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch().count();
-
-            if (m_canPrint) {
-                long long duration = end - start;
-                double seconds     = duration * 0.000001;
-                std::cout << "BENCH: " << m_Name << ":" << std::endl << seconds << "s" << std::endl;
-            }
-
-            m_isStopped = true;
-        }
-    }
+    void Stop();
 
   private:
+    void Start();
+
     const char* m_Name;
-    std::chrono::time_point<std::chrono::high_resolution_clock> m_StartTimepoint;
+    Profiler::ThreadBuffer* m_threadBuffer = nullptr;
+    Profiler::Clock::time_point m_StartTimepoint;
+    int m_depth = 0;
     bool m_isStopped;
-    bool m_canPrint;
 };
 
 }  // namespace rayx
 
 // Define profiling macros
 #define RAYX_PROFILE_SCOPE(name) ::rayx::InstrumentationTimer timer##__LINE__(name, false)
-// Allows for printing of benchmarking results if BENCH_FLAG is set to true
+// Kept for compatibility. All scopes are part of the summary printed in benchmark mode
 #define RAYX_PROFILE_SCOPE_STDOUT(name) ::rayx::InstrumentationTimer timer##__LINE__(name, true)
 #if !defined(__PRETTY_FUNCTION__) && !defined(__GNUC__)
 #define __PRETTY_FUNCTION__ __FUNCSIG__
 #endif
 #define RAYX_PROFILE_FUNCTION() RAYX_PROFILE_SCOPE(__PRETTY_FUNCTION__)
-// Allows for printing of benchmarking results if BENCH_FLAG is set to true
+// Kept for compatibility. All scopes are part of the summary printed in benchmark mode
 #define RAYX_PROFILE_FUNCTION_STDOUT() RAYX_PROFILE_SCOPE_STDOUT(__func__)
@@ -295,4 +295,11 @@ void DesignSource::setRayList(std::shared_ptr<Rays>& rays) { m_elementParameters
 
 std::shared_ptr<Rays> DesignSource::getRayList() const { return m_elementParameters["rayList"].as_rayList(); }
 
+void DesignSource::setDeviceRayList(DeviceRays rays) { m_elementParameters["deviceRayList"] = std::make_shared<DeviceRays>(std::move(rays)); }
+
+std::shared_ptr<DeviceRays> DesignSource::getDeviceRayList() const {
+    if (!m_elementParameters.hasKey("deviceRayList")) return nullptr;
+    return m_elementParameters["deviceRayList"].as_deviceRayList();
+}
+
 }  // namespace rayx
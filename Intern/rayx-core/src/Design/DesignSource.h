@@ -144,6 +144,11 @@ class RAYX_API DesignSource : public BeamlineNode {
     void setRayList(Rays rays);
     void setRayList(std::shared_ptr<Rays>& rays);
     std::shared_ptr<Rays> getRayList() const;
+
+    /// rays of a RayListSource kept on the tracing device (see Tracer::traceToDevice). takes precedence over the ray list set by setRayList
+    void setDeviceRayList(DeviceRays rays);
+    /// nullptr if no device ray list is set
+    std::shared_ptr<DeviceRays> getDeviceRayList() const;
 };
 
 }  // namespace rayx
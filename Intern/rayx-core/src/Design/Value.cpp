@@ -1,6 +1,10 @@
 #include "Design/Value.h"
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
+
+#include "Hash.h"
 
 namespace rayx {
 
@@ -15,7 +19,7 @@ DesignMap DesignMap::clone() const {
     } else if (std::holds_alternative<std::shared_ptr<Rays>>(m_variant)) {
         copy.m_variant = std::make_shared<Rays>(std::get<std::shared_ptr<Rays>>(m_variant)->copy());
     } else {
-        // For all other types, the variant’s copy is sufficient.
+        // For all other types, the variant’s copy is sufficient. DeviceRays are immutable, so clones share them.
         copy.m_variant = m_variant;
     }
     return copy;
@@ -54,6 +58,7 @@ ValueType DesignMap::type() const {
         ValueType::DesignPlane,
         ValueType::SurfaceCoatingType,
         ValueType::RayList,
+        ValueType::DeviceRayList,
     };
     return types[m_variant.index()];
 }
@@ -203,6 +208,60 @@ std::shared_ptr<Rays> DesignMap::as_rayList() const {
     throw std::runtime_error("as_rayList() called on non-Rays!");
 }
 
+std::shared_ptr<DeviceRays> DesignMap::as_deviceRayList() const {
+    if (auto* x = std::get_if<std::shared_ptr<DeviceRays>>(&m_variant)) return *x;
+    throw std::runtime_error("as_deviceRayList() called on non-DeviceRays!");
+}
+
+std::optional<uint64_t> DesignMap::hash() const {
+    auto hasher = Hasher();
+    hasher.value(m_variant.index());
+
+    const auto hashable = std::visit(
+        [&]<typename T>(const T& x) -> bool {
+            if constexpr (std::is_same_v<T, Undefined>) {
+                return true;
+            } else if constexpr (std::is_same_v<T, Map>) {
+                // the entries are unordered, so they are hashed in order of their keys
+                auto keys = std::vector<std::string>();
+                for (const auto& [key, ptr] : x) keys.push_back(key);
+                std::sort(keys.begin(), keys.end());
+                for (const auto& key : keys) {
+                    const auto entryHash = x.at(key)->hash();
+                    if (!entryHash) return false;
+                    hasher.string(key).value(*entryHash);
+                }
+                return true;
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                hasher.string(x);
+                return true;
+            } else if constexpr (std::is_same_v<T, Rad>) {
+                hasher.value(x.rad);
+                return true;
+            } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, glm::dvec4> || std::is_same_v<T, glm::dmat4x4>) {
+                hasher.value(x);
+                return true;
+            } else if constexpr (std::is_same_v<T, std::shared_ptr<Rays>>) {
+                if (!x) return true;
+#define X(type, name, flag) hasher.value(x->name.size()).bytes(x->name.data(), x->name.size() * sizeof(type));
+                RAYX_X_MACRO_RAY_ATTR
+#undef X
+                return true;
+            } else if constexpr (std::is_same_v<T, std::shared_ptr<DeviceRays>>) {
+                // DeviceRays are immutable, so they are identified by their storage
+                hasher.value(x ? reinterpret_cast<uintptr_t>(x->storage()) : uintptr_t{0});
+                return true;
+            } else {
+                // Cutout and Surface may contain padding bytes, so they are not hashed
+                return false;
+            }
+        },
+        m_variant);
+
+    if (!hashable) return std::nullopt;
+    return hasher.get();
+}
+
 bool DesignMap::hasKey(const std::string& s) const {
     if (auto* m = std::get_if<Map>(&m_variant)) { return m->find(s) != m->end(); }
     return false;
@@ -2,6 +2,7 @@
 
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <variant>
@@ -11,6 +12,7 @@
 #include "Beamline/EnergyDistribution.h"
 #include "Core.h"
 #include "Debug/Debug.h"
+#include "DeviceRays.h"
 #include "Element/Cutout.h"
 #include "Element/Surface.h"
 #include "Material/Material.h"
@@ -50,6 +52,7 @@ enum class ValueType {
     DesignPlane,
     SurfaceCoatingType,
     RayList,
+    DeviceRayList,
 };
 
 class Undefined {};
@@ -100,6 +103,7 @@ class RAYX_API DesignMap {
     DesignMap(DesignPlane x) : m_variant(x) {}
     DesignMap(SurfaceCoatingType x) : m_variant(x) {}
     DesignMap(std::shared_ptr<Rays> x) : m_variant(x) {}
+    DesignMap(std::shared_ptr<DeviceRays> x) : m_variant(x) {}
 
     // Assignment operators
     void operator=(double x) { m_variant = x; }
@@ -132,6 +136,7 @@ class RAYX_API DesignMap {
     void operator=(DesignPlane x) { m_variant = x; }
     void operator=(SurfaceCoatingType x) { m_variant = x; }
     void operator=(std::shared_ptr<Rays> x) { m_variant = x; }
+    void operator=(std::shared_ptr<DeviceRays> x) { m_variant = x; }
 
     // Deep copy (clone) method.
     DesignMap clone() const;
@@ -168,6 +173,11 @@ class RAYX_API DesignMap {
     DesignPlane as_designPlane() const;
     SurfaceCoatingType as_surfaceCoatingType() const;
     std::shared_ptr<Rays> as_rayList() const;
+    std::shared_ptr<DeviceRays> as_deviceRayList() const;
+
+    /// hash of this value and all nested values, to detect changes of a design (see RetraceCache). Rays are hashed by content, DeviceRays by
+    /// identity. std::nullopt if a nested value is of a type that is not hashed (Cutout, Surface)
+    std::optional<uint64_t> hash() const;
 
     bool hasKey(const std::string& s) const;
 
@@ -247,7 +257,7 @@ class RAYX_API DesignMap {
     using Variant = std::variant<Undefined, double, int, ElectronEnergyOrientation, glm::dvec4, glm::dmat4x4, bool, EnergyDistributionType,
                                  CentralBeamstop, Cutout, CutoutType, EventType, CylinderDirection, FigureRotation, Map, Surface, CurvatureType,
                                  SourceDist, SpreadType, Rad, Material, EnergySpreadUnit, std::string, SigmaType, BehaviourType, ElementType,
-                                 GratingMount, CrystalType, DesignPlane, SurfaceCoatingType, std::shared_ptr<Rays>>;
+                                 GratingMount, CrystalType, DesignPlane, SurfaceCoatingType, std::shared_ptr<Rays>, std::shared_ptr<DeviceRays>>;
     static_assert(std::is_copy_constructible_v<Variant>);
 
     Variant m_variant;
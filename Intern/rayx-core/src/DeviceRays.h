@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+
+#include "Rays.h"
+
+namespace rayx {
+
+/// events in the memory of a tracing device. implemented by the device tracers
+class DeviceRaysStorage {
+  public:
+    virtual ~DeviceRaysStorage() = default;
+
+    virtual int64_t size() const = 0;
+    virtual Rays toHost() const  = 0;
+};
+
+/**
+ * @brief Events kept in the memory of the device they were traced on (see Tracer::traceToDevice)
+ * Set as ray list of a RayListSource (see DesignSource::setDeviceRayList), the events are traced through another beamline on the same device,
+ * without copying them to the host and back. All ray attributes are kept. Copies of a DeviceRays share the same device memory, which is released
+ * with the last copy.
+ */
+class RAYX_API DeviceRays {
+  public:
+    DeviceRays() = default;
+    explicit DeviceRays(std::shared_ptr<DeviceRaysStorage> storage) : m_storage(std::move(storage)) {}
+
+    /**
+     * @brief Get the number of events.
+     * @return The number of events.
+     */
+    int64_t size() const { return m_storage ? m_storage->size() : 0; }
+
+    /**
+     * @brief Check if there are no events.
+     * @return True if there are no events.
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief Copy the events to the host.
+     * @return A new Rays instance with all attributes recorded.
+     */
+    [[nodiscard]] Rays toHost() const { return m_storage ? m_storage->toHost() : Rays(); }
+
+    /// the device tracers access the events on the device through the storage
+    DeviceRaysStorage* storage() const { return m_storage.get(); }
+
+  private:
+    std::shared_ptr<DeviceRaysStorage> m_storage;
+};
+
+}  // namespace rayx
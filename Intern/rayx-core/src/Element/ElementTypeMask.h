@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "Behaviour.h"
+#include "Core.h"
+#include "Surface.h"
+
+namespace rayx {
+
+/**
+ * @brief Mask of surface and behaviour types.
+ * The tracer computes the mask of the element types occurring in a beamline, and selects trace kernels specialized on a mask containing it.
+ * Specialized kernels do not contain the code and the variant dispatch for the types outside of their mask.
+ */
+enum class ElementTypeMask : uint32_t {
+    SurfacePlane   = 1 << 0,
+    SurfaceQuadric = 1 << 1,
+    SurfaceToroid  = 1 << 2,
+    SurfaceCubic   = 1 << 3,
+
+    BehaviourMirror     = 1 << 8,
+    BehaviourGrating    = 1 << 9,
+    BehaviourSlit       = 1 << 10,
+    BehaviourRZP        = 1 << 11,
+    BehaviourImagePlane = 1 << 12,
+    BehaviourCrystal    = 1 << 13,
+    BehaviourFoil       = 1 << 14,
+
+    AllSurfaces   = SurfacePlane | SurfaceQuadric | SurfaceToroid | SurfaceCubic,
+    AllBehaviours = BehaviourMirror | BehaviourGrating | BehaviourSlit | BehaviourRZP | BehaviourImagePlane | BehaviourCrystal | BehaviourFoil,
+
+    None = 0,
+    All  = AllSurfaces | AllBehaviours,
+};
+
+RAYX_FN_ACC constexpr inline ElementTypeMask operator|(const ElementTypeMask lhs, const ElementTypeMask rhs) {
+    return static_cast<ElementTypeMask>(static_cast<std::underlying_type_t<ElementTypeMask>>(lhs) |
+                                        static_cast<std::underlying_type_t<ElementTypeMask>>(rhs));
+}
+RAYX_FN_ACC constexpr inline ElementTypeMask operator&(const ElementTypeMask lhs, const ElementTypeMask rhs) {
+    return static_cast<ElementTypeMask>(static_cast<std::underlying_type_t<ElementTypeMask>>(lhs) &
+                                        static_cast<std::underlying_type_t<ElementTypeMask>>(rhs));
+}
+RAYX_FN_ACC constexpr inline ElementTypeMask& operator|=(ElementTypeMask& lhs, const ElementTypeMask rhs) { return lhs = lhs | rhs; }
+RAYX_FN_ACC constexpr inline bool contains(const ElementTypeMask haystack, const ElementTypeMask needle) { return (haystack & needle) == needle; }
+
+/// returns the flag of a surface or behaviour type
+template <typename T>
+RAYX_FN_ACC constexpr inline ElementTypeMask elementTypeFlag() {
+    if constexpr (std::is_same_v<T, Surface::Plane>) return ElementTypeMask::SurfacePlane;
+    else if constexpr (std::is_same_v<T, Surface::Quadric>) return ElementTypeMask::SurfaceQuadric;
+    else if constexpr (std::is_same_v<T, Surface::Toroid>) return ElementTypeMask::SurfaceToroid;
+    else if constexpr (std::is_same_v<T, Surface::Cubic>) return ElementTypeMask::SurfaceCubic;
+    else if constexpr (std::is_same_v<T, Behaviour::Mirror>) return ElementTypeMask::BehaviourMirror;
+    else if constexpr (std::is_same_v<T, Behaviour::Grating>) return ElementTypeMask::BehaviourGrating;
+    else if constexpr (std::is_same_v<T, Behaviour::Slit>) return ElementTypeMask::BehaviourSlit;
+    else if constexpr (std::is_same_v<T, Behaviour::RZP>) return ElementTypeMask::BehaviourRZP;
+    else if constexpr (std::is_same_v<T, Behaviour::ImagePlane>) return ElementTypeMask::BehaviourImagePlane;
+    else if constexpr (std::is_same_v<T, Behaviour::Crystal>) return ElementTypeMask::BehaviourCrystal;
+    else if constexpr (std::is_same_v<T, Behaviour::Foil>) return ElementTypeMask::BehaviourFoil;
+    else return ElementTypeMask::None;
+}
+
+/// filter for Variant::visitFiltered, that passes the types contained in `Types`
+template <ElementTypeMask Types>
+struct ElementTypeFilter {
+    template <typename T>
+    struct Filter {
+        static constexpr bool value = contains(Types, elementTypeFlag<T>());
+    };
+};
+
+/// returns the mask of the surface and behaviour type of an element
+inline ElementTypeMask getElementTypeMask(const Surface& surface, const Behaviour& behaviour) {
+    const auto surfaceType   = surface.visit([]<typename T>(const T&) { return elementTypeFlag<T>(); });
+    const auto behaviourType = behaviour.visit([]<typename T>(const T&) { return elementTypeFlag<T>(); });
+    return surfaceType | behaviourType;
+}
+
+/// element type masks for which the trace functions are specialized, ordered from smallest to largest. the last one must be ElementTypeMask::All.
+/// the first mask covers the elements of most beamlines: mirrors, plane gratings, slits and image planes on planes, quadrics and toroids.
+constexpr ElementTypeMask TRACE_ELEMENT_TYPE_MASKS[] = {
+    ElementTypeMask::SurfacePlane | ElementTypeMask::SurfaceQuadric | ElementTypeMask::SurfaceToroid | ElementTypeMask::BehaviourMirror |
+        ElementTypeMask::BehaviourGrating | ElementTypeMask::BehaviourSlit | ElementTypeMask::BehaviourImagePlane,
+    ElementTypeMask::All,
+};
+
+}  // namespace rayx
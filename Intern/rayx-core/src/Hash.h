@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace rayx {
+
+/// incremental 64 bit FNV-1a hash. not cryptographic, only used to detect changes of the inputs of a trace (see RetraceCache)
+class Hasher {
+  public:
+    Hasher& bytes(const void* data, const size_t size) {
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            m_hash ^= p[i];
+            m_hash *= 0x100000001b3ull;
+        }
+        return *this;
+    }
+
+    /// `value` must not contain padding, otherwise the hash depends on uninitialized bytes
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    Hasher& value(const T& value) {
+        return bytes(&value, sizeof(T));
+    }
+
+    Hasher& string(const std::string_view s) { return value(s.size()).bytes(s.data(), s.size()); }
+
+    uint64_t get() const { return m_hash; }
+
+  private:
+    uint64_t m_hash = 0xcbf29ce484222325ull;
+};
+
+}  // namespace rayx
@@ -74,6 +74,23 @@ class RAYX_API ObjectIndexMask {
     int numElementsToRecord() const { return static_cast<int>(std::count(m_elementMask.begin(), m_elementMask.end(), true)); }
     int numObjectsToRecord() const { return numSourcesToRecord() + numElementsToRecord(); }
 
+    /// number of event slots per ray required to record one event per recorded object. all sources share one slot, because a ray path starts
+    /// at exactly one source
+    int numRecordSlots() const { return (numSourcesToRecord() > 0 ? 1 : 0) + numElementsToRecord(); }
+
+    /// slot of each object among the slots of the recorded objects (see numRecordSlots), or -1 if the object is not recorded. the slots are dense,
+    /// so that event buffers indexed by slot scale with the number of recorded objects, not with the number of objects
+    std::vector<int> recordSlots() const {
+        auto slots        = std::vector<int>(numObjects(), -1);
+        auto elementSlot  = numSourcesToRecord() > 0 ? 1 : 0;
+        const auto offset = numSources();
+        for (int i = 0; i < numSources(); ++i)
+            if (m_sourceMask[i]) slots[i] = 0;
+        for (int i = 0; i < numElements(); ++i)
+            if (m_elementMask[i]) slots[offset + i] = elementSlot++;
+        return slots;
+    }
+
     bool shouldRecordSource(int source_id) const { return m_sourceMask.at(source_id); }
     void setShouldRecordSource(int source_id, bool value) { m_sourceMask.at(source_id) = value; }
 
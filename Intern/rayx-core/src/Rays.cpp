@@ -2,9 +2,9 @@
 
 #include <algorithm>
 #include <bitset>
-#include <unordered_map>
 
 #include "Debug/Instrumentor.h"
+#include "RaysView.h"
 
 namespace rayx {
 
@@ -27,15 +27,15 @@ bool Rays::contains(const RayAttrMask attr) const { return (attrMask() & attr) =
 
 bool Rays::empty() const { return size() == 0; }
 
-int Rays::size() const {
+int64_t Rays::size() const {
 #define X(type, name, flag) \
-    if (name.size() != 0) return static_cast<int>(name.size());
+    if (name.size() != 0) return static_cast<int64_t>(name.size());
     RAYX_X_MACRO_RAY_ATTR
 #undef X
     return 0;
 }
 
-int Rays::numPaths() const {
+int64_t Rays::numPaths() const {
     auto path_id_copy = path_id;
     std::sort(path_id_copy.begin(), path_id_copy.end());
     return std::distance(path_id_copy.begin(), std::unique(path_id_copy.begin(), path_id_copy.end()));
@@ -65,12 +65,12 @@ Rays Rays::concat(const std::vector<Rays>& rays_list) {
         if (attr1 != attr2) throw std::runtime_error("Rays::concat requires all Rays to have the same attributes");
     }
 
-    auto n = 0;
+    auto n = int64_t{0};
     for (const auto& rays : rays_list) n += rays.size();
 
     Rays result;
 
-    auto offset = 0;
+    auto offset = int64_t{0};
     for (const auto& r : rays_list) {
 #define X(type, name, flag)                                                    \
     if (!!(r.attrMask() & RayAttrMask::flag)) {                                \
@@ -79,28 +79,15 @@ Rays Rays::concat(const std::vector<Rays>& rays_list) {
     }
         RAYX_X_MACRO_RAY_ATTR
 #undef X
-        offset += static_cast<int>(r.size());
+        offset += r.size();
     }
 
     return result;
 }
 
-Rays Rays::sortByObjectId() const {
-    if (!contains(RayAttrMask::ObjectId)) throw std::runtime_error("Rays::sortByObjectId() requires object_id attribute to be present");
-    return sort([&object_id = object_id](int lhs, int rhs) { return object_id[lhs] < object_id[rhs]; });
-}
-
-Rays Rays::sortByPathIdAndPathEventId() const {
-    if (!contains(RayAttrMask::PathId) || !contains(RayAttrMask::PathEventId))
-        throw std::runtime_error("Rays::sortByPathIdAndThenPathEventId() requires path_id and path_event_id attributes to be present");
+Rays Rays::sortByObjectId() const { return RaysView(*this).sortByObjectId().materialize(); }
 
-    return sort([&path_id = path_id, &path_event_id = path_event_id](int lhs, int rhs) {
-        if (path_id[lhs] != path_id[rhs])
-            return path_id[lhs] < path_id[rhs];
-        else
-            return path_event_id[lhs] < path_event_id[rhs];
-    });
-}
+Rays Rays::sortByPathIdAndPathEventId() const { return RaysView(*this).sortByPathIdAndPathEventId().materialize(); }
 
 Rays& Rays::filterByAttrMask(const RayAttrMask mask) {
 #define X(type, name, flag) \
@@ -110,51 +97,16 @@ Rays& Rays::filterByAttrMask(const RayAttrMask mask) {
     return *this;
 }
 
-Rays Rays::filterByObjectId(const int object_id) const {
-    if (!contains(RayAttrMask::ObjectId)) throw std::runtime_error("Rays::filterByObjectId requires object_id attribute to be present");
-    return filter([&](int i) { return this->object_id[i] == object_id; });
-}
-
-Rays Rays::filterByLastEventInPath() const {
-    RAYX_PROFILE_FUNCTION_STDOUT();
-
-    if (!contains(RayAttrMask::PathId) || !contains(RayAttrMask::PathEventId))
-        throw std::runtime_error("Rays::finalEventsPerPath requires path_id and path_event_id attributes to be present");
-
-    const auto n = size();
-    std::unordered_map<int32_t, int> bestIndex;  // path_id -> index of max path_event_id
-
-    for (int i = 0; i < n; ++i) {
-        auto pid   = path_id[i];
-        auto pevid = path_event_id[i];
-        auto it    = bestIndex.find(pid);
-        if (it == bestIndex.end() || pevid > path_event_id[it->second]) { bestIndex[pid] = i; }
-    }
-
-    // collect the selected indices
-    std::vector<int> indices;
-    indices.reserve(bestIndex.size());
-    for (auto& kv : bestIndex) { indices.push_back(kv.second); }
+Rays Rays::filterByObjectId(const int object_id) const { return RaysView(*this).filterByObjectId(object_id).materialize(); }
 
-    // build result Rays using selected indices
-    const auto attr = attrMask();
-    Rays result;
-#define X(type, name, flag)                                                                                           \
-    if (rayx::contains(attr, RayAttrMask::flag)) {                                                                    \
-        result.name.resize(indices.size());                                                                           \
-        std::transform(indices.begin(), indices.end(), result.name.begin(), [this](const int i) { return name[i]; }); \
-    }
-    RAYX_X_MACRO_RAY_ATTR
-#undef X
-    return result;
-}
+Rays Rays::filterByLastEventInPath() const { return RaysView(*this).filterByLastEventInPath().materialize(); }
 
 bool Rays::isValid() const {
     const auto attr = attrMask();
     const auto sz   = size();
 
 #define X(type, name, flag) \
-    if (rayx::contains(attr, RayAttrMask::flag) && static_cast<int>(name.size()) != sz) return false;
+    if (rayx::contains(attr, RayAttrMask::flag) && static_cast<int64_t>(name.size()) != sz) return false;
     RAYX_X_MACRO_RAY_ATTR
 #undef X
     return true;
@@ -13,6 +13,7 @@ namespace rayx {
  * Each attribute is stored as a vector, allowing for efficient storage and manipulation of multiple rays.
  * The Rays structure supports move semantics for efficient transfers, but disables copy semantics to prevent accidental costly copies.
  * Use the `copy()` method to create an explicit copy when needed.
+ * Every filter and sort copies all recorded attributes into a new Rays instance. To chain several of them, use a RaysView, which copies once.
  * @note Ensure that all attribute vectors are of the same length to maintain data integrity.
  */
 struct RAYX_API Rays {
@@ -85,14 +86,14 @@ struct RAYX_API Rays {
      * @brief Get the number of events in the ray list.
      * @return The number of events in the ray list.
      */
-    int size() const;
+    int64_t size() const;
 
     /**
      * @brief Get the number of unique paths in the ray list.
      * @return The number of unique path IDs in the ray list.
      * @note Requires that path_id is recorded.
      */
-    int numPaths() const;
+    int64_t numPaths() const;
 
     /**
      * @brief Append another Rays instance to this one.
@@ -112,6 +113,7 @@ struct RAYX_API Rays {
 
     /**
      * @brief Sort rays by object_id, so that rays interacting with the same object are grouped together.
+     * Rays with the same object_id keep their order.
      * @return A new Rays instance with rays sorted by object_id.
      * @note Requires that object_id is recorded.
      */
@@ -129,7 +131,7 @@ struct RAYX_API Rays {
 
     /**
      * @brief Sort rays using a custom comparison function.
-     * The comparison function should take two indices (int) and return true if the first index should come before the second.
+     * The comparison function should take two indices (int64_t) and return true if the first index should come before the second.
      * This method can be used to implement custom sorting logic, such as sorting by multiple attributes.
      * @tparam Compare A callable type that defines the comparison function.
      * @param comp The comparison function to use for sorting. Must satisfy the requirements of Compare, see
@@ -139,7 +141,7 @@ struct RAYX_API Rays {
      * @example
      * ```cpp
      * // sort by path_id.
-     * rays = rays.sort([&](int lhs, int rhs) { return rays.path_id[lhs] < rays.path_id[rhs]; });
+     * rays = rays.sort([&](int64_t lhs, int64_t rhs) { return rays.path_id[lhs] < rays.path_id[rhs]; });
      * // sort by path_id and then by path_event_id.
      * rays = rays.sort([&](int lhs, int rhs) { if (rays.path_id[lhs] == rays.path_id[rhs]) return rays.path_id[lhs] < rays.path_id[rhs]; else return
      * rays.path_event_id[lhs] < rays.path_event_id[rhs]; });
@@ -165,7 +167,7 @@ struct RAYX_API Rays {
 
     /**
      * @brief Filter the rays to only include the final event of each unique path.
-     * The final event is determined by the maximum path_event_id for each path_id.
+     * The final event is determined by the maximum path_event_id for each path_id. The events are in order of the first event of their path.
      * @return A new Rays instance containing only the final event of each path.
      * @note Requires that path_id and path_event_id are recorded.
      */
@@ -173,7 +175,7 @@ struct RAYX_API Rays {
 
     /**
      * @brief Filter the rays using a custom predicate function.
-     * The predicate function should take an index (int) and return true if the ray at that index should be included.
+     * The predicate function should take an index (int64_t) and return true if the ray at that index should be included.
      * This method can be used to implement custom filtering logic, such as filtering by multiple attributes or complex conditions.
      * @tparam Pred A callable type that defines the predicate function.
      * @param pred The predicate function to use for filtering.
@@ -181,7 +183,7 @@ struct RAYX_API Rays {
      * @note Requires that path_event_id is recorded.
      * @example
      * ```cpp
-     * rays = rays.filter([&](int i) { return rays.path_event_id[i] == 3; }); // to filter by path_event_id == 3.
+     * rays = rays.filter([&](int64_t i) { return rays.path_event_id[i] == 3; }); // to filter by path_event_id == 3.
      * ```
      */
     template <typename Pred>
@@ -189,17 +191,17 @@ struct RAYX_API Rays {
 
     /**
      * @brief Count the number of rays that satisfy a given predicate function.
-     * The predicate function should take an index (int) and return true if the ray at that index satisfies the condition.
+     * The predicate function should take an index (int64_t) and return true if the ray at that index satisfies the condition.
      * @tparam Pred A callable type that defines the predicate function.
      * @param pred The predicate function to use for counting.
      * @return The number of rays for which the predicate returns true.
      * @example
      * ```cpp
-     * int count = rays.count([&](int i) { return rays.object_id[i] == 3; }); // to count rays with object_id == 3.
+     * int64_t count = rays.count([&](int64_t i) { return rays.object_id[i] == 3; }); // to count rays with object_id == 3.
      * ```
      */
     template <typename Pred>
-    int count(Pred pred) const;
+    int64_t count(Pred pred) const;
 
     /**
      * @brief Check if the sizes of all recorded attribute vectors are valid (i.e., all the same length).
@@ -217,15 +219,15 @@ Rays Rays::sort(Compare comp) const {
     const auto attr = attrMask();
     const auto n    = size();
 
-    auto indices = std::vector<int>(n);
+    auto indices = std::vector<int64_t>(n);
     std::iota(indices.begin(), indices.end(), 0);
     std::sort(indices.begin(), indices.end(), comp);
 
     Rays result;
-#define X(type, name, flag)                                            \
-    if (!!(attr & RayAttrMask::flag)) {                                \
-        result.name.resize(name.size());                               \
-        for (int i = 0; i < n; ++i) result.name[i] = name[indices[i]]; \
+#define X(type, name, flag)                                                \
+    if (!!(attr & RayAttrMask::flag)) {                                    \
+        result.name.resize(name.size());                                   \
+        for (int64_t i = 0; i < n; ++i) result.name[i] = name[indices[i]]; \
     }
     RAYX_X_MACRO_RAY_ATTR
 #undef X
@@ -240,15 +242,15 @@ Rays Rays::filter(Pred pred) const {
     const auto attr = attrMask();
     const auto n    = size();
 
-    auto indices = std::vector<int>{};
-    for (int i = 0; i < n; ++i)
+    auto indices = std::vector<int64_t>{};
+    for (int64_t i = 0; i < n; ++i)
         if (pred(i)) indices.push_back(i);
 
     Rays result;
-#define X(type, name, flag)                                                                                           \
-    if (!!(attr & RayAttrMask::flag)) {                                                                               \
-        result.name.resize(indices.size());                                                                           \
-        std::transform(indices.begin(), indices.end(), result.name.begin(), [this](const int i) { return name[i]; }); \
+#define X(type, name, flag)                                                                                               \
+    if (!!(attr & RayAttrMask::flag)) {                                                                                   \
+        result.name.resize(indices.size());                                                                               \
+        std::transform(indices.begin(), indices.end(), result.name.begin(), [this](const int64_t i) { return name[i]; }); \
     }
     RAYX_X_MACRO_RAY_ATTR
 #undef X
@@ -257,10 +259,10 @@ Rays Rays::filter(Pred pred) const {
 }
 
 template <typename Pred>
-int Rays::count(Pred pred) const {
-    const int sz = size();
-    int count    = 0;
-    for (int i = 0; i < sz; ++i)
+int64_t Rays::count(Pred pred) const {
+    const auto sz = size();
+    auto count    = int64_t{0};
+    for (int64_t i = 0; i < sz; ++i)
         if (pred(i)) ++count;
     return count;
 }
@@ -0,0 +1,92 @@
+#include "RaysByPath.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "Debug/Instrumentor.h"
+
+namespace rayx {
+
+bool RaysByPath::isValid() const {
+    if (pathOffsets.empty() || pathOffsets.front() != 0) return false;
+    if (!std::is_sorted(pathOffsets.begin(), pathOffsets.end())) return false;
+    if (contains(rays.attrMask(), RayAttrMask::PathId) || contains(rays.attrMask(), RayAttrMask::PathEventId)) return false;
+    return rays.isValid() && (rays.empty() || rays.size() == numEvents());
+}
+
+Rays RaysByPath::toRays() const {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    Rays result = rays.copy();
+    result.path_id.resize(numEvents());
+    result.path_event_id.resize(numEvents());
+
+    for (int64_t i = 0; i < numPaths(); ++i) {
+        for (auto j = pathOffsets[i]; j < pathOffsets[i + 1]; ++j) {
+            result.path_id[j]       = firstPathId + i;
+            result.path_event_id[j] = static_cast<int32_t>(j - pathOffsets[i]);
+        }
+    }
+
+    return result;
+}
+
+RaysByPath RaysByPath::fromRays(const Rays& rays) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    if (!rays.contains(RayAttrMask::PathId) || !rays.contains(RayAttrMask::PathEventId))
+        throw std::runtime_error("RaysByPath::fromRays requires path_id and path_event_id attributes to be present");
+
+    RaysByPath result;
+    if (rays.empty()) return result;
+
+    auto sorted = rays.sortByPathIdAndPathEventId();
+
+    const auto [minPathId, maxPathId] = std::minmax_element(sorted.path_id.begin(), sorted.path_id.end());
+    result.firstPathId                = *minPathId;
+    result.pathOffsets.assign(*maxPathId - *minPathId + 2, 0);
+
+    // count the events per path and accumulate the counts to offsets
+    for (const auto pathId : sorted.path_id) ++result.pathOffsets[pathId - result.firstPathId + 1];
+    std::partial_sum(result.pathOffsets.begin(), result.pathOffsets.end(), result.pathOffsets.begin());
+
+    result.rays = std::move(sorted.filterByAttrMask(exclude(sorted.attrMask(), RayAttrMask::PathId | RayAttrMask::PathEventId)));
+    return result;
+}
+
+RaysByPath RaysByPath::concat(const std::vector<RaysByPath>& list) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    RaysByPath result;
+    if (list.empty()) return result;
+
+    result.firstPathId = list.front().firstPathId;
+
+    // instances without events have no attributes, so they are left out of the attribute check
+    auto attr = RayAttrMask::None;
+    for (const auto& r : list) {
+        if (r.firstPathId != result.firstPathId + result.numPaths())
+            throw std::runtime_error("RaysByPath::concat requires the paths of all instances to be consecutive");
+
+        const auto offset = result.numEvents();
+        for (int64_t i = 1; i <= r.numPaths(); ++i) result.pathOffsets.push_back(offset + r.pathOffsets[i]);
+
+        if (r.rays.empty()) continue;
+        if (attr != RayAttrMask::None && attr != r.rays.attrMask())
+            throw std::runtime_error("RaysByPath::concat requires all instances to have the same attributes");
+        attr = r.rays.attrMask();
+    }
+
+#define X(type, name, flag)                                                                                                 \
+    if (contains(attr, RayAttrMask::flag)) {                                                                                \
+        result.rays.name.reserve(result.numEvents());                                                                       \
+        for (const auto& r : list) result.rays.name.insert(result.rays.name.end(), r.rays.name.begin(), r.rays.name.end()); \
+    }
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+    return result;
+}
+
+}  // namespace rayx
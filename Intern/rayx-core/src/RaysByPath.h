@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include "Rays.h"
+
+namespace rayx {
+
+/// layout of the events returned by a trace
+enum class OutputLayout {
+    /// events in order of their record slots. every event stores its path_id and path_event_id (see Rays)
+    Events,
+    /// events grouped by path, in order of the path id and then of the record slot. path_id and path_event_id are implicit (see RaysByPath)
+    ByPath,
+};
+
+/**
+ * @brief Events grouped by their path, in compressed sparse row (CSR) layout.
+ * The events of path `firstPathId + i` are the events [pathOffsets[i], pathOffsets[i + 1]) of `rays`, in order of their event sequence. Paths
+ * without recorded events are empty ranges. The path_id and path_event_id attributes are implicit and not stored in `rays`, which saves two
+ * columns per event and makes regrouping the events by path unnecessary.
+ * @note path_event_id is reconstructed as the index of an event within its path. If events of a path were not recorded (e.g. because of an
+ * EventFilter or an ObjectMask), it differs from the path_event_id recorded in the Events layout, which counts all events of the path.
+ */
+struct RAYX_API RaysByPath {
+    RaysByPath()                        = default;
+    RaysByPath(RaysByPath&&)            = default;
+    RaysByPath& operator=(RaysByPath&&) = default;
+
+    /// path id of the first path
+    int64_t firstPathId = 0;
+    /// offsets of the paths into `rays`. has numPaths() + 1 elements, the last one is the number of events
+    std::vector<int64_t> pathOffsets = {0};
+    /// attributes of the events, without path_id and path_event_id
+    Rays rays;
+
+    /**
+     * @brief Get the number of paths, including paths without events.
+     * @return The number of paths.
+     */
+    int64_t numPaths() const { return static_cast<int64_t>(pathOffsets.size()) - 1; }
+
+    /**
+     * @brief Get the number of events of all paths.
+     * @return The number of events.
+     */
+    int64_t numEvents() const { return pathOffsets.back(); }
+
+    /**
+     * @brief Get the number of events of a path.
+     * @param i The index of the path, relative to firstPathId.
+     * @return The number of events of the path.
+     */
+    int64_t numEventsOfPath(const int64_t i) const { return pathOffsets[i + 1] - pathOffsets[i]; }
+
+    /**
+     * @brief Get the attributes recorded for the events, including the implicit path_id and path_event_id.
+     * @return A RayAttrMask indicating the recorded attributes.
+     */
+    RayAttrMask attrMask() const { return rays.attrMask() | RayAttrMask::PathId | RayAttrMask::PathEventId; }
+
+    /**
+     * @brief Check if the offsets are consistent with the recorded attributes.
+     * @return True if the offsets are non-decreasing, start at 0 and all recorded attribute vectors have numEvents() elements.
+     */
+    bool isValid() const;
+
+    /**
+     * @brief Convert to the Events layout, materializing path_id and path_event_id.
+     * @return A new Rays instance, with events ordered by path_id and path_event_id.
+     */
+    [[nodiscard]] Rays toRays() const;
+
+    /**
+     * @brief Group events in the Events layout by their path.
+     * The paths range from the minimum to the maximum path_id of the events. path_id and path_event_id are dropped.
+     * @param rays The events to group.
+     * @return A new RaysByPath instance.
+     * @note Requires that path_id and path_event_id are recorded.
+     */
+    [[nodiscard]] static RaysByPath fromRays(const Rays& rays);
+
+    /**
+     * @brief Concatenate the paths of multiple RaysByPath instances.
+     * @param list A vector of RaysByPath instances, whose paths are consecutive, i.e. every instance starts at the path following the last path
+     * of the previous instance.
+     * @return A new RaysByPath instance containing all paths of the input instances.
+     * @note Requires that all instances in list have the same attributes recorded.
+     */
+    [[nodiscard]] static RaysByPath concat(const std::vector<RaysByPath>& list);
+};
+
+static_assert(std::is_nothrow_move_constructible_v<RaysByPath>);
+
+}  // namespace rayx
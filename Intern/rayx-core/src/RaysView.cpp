@@ -0,0 +1,190 @@
+#include "RaysView.h"
+
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace rayx {
+
+namespace {
+
+/// below this number of events per thread, sorting and gathering run in fewer threads, because the overhead of the threads would dominate
+constexpr int64_t MIN_EVENTS_PER_THREAD = int64_t{1} << 15;
+
+/// number of bits of a key sorted per pass of the radix sort. 2^11 buckets per thread fit into the L1 cache
+constexpr int RADIX_BITS = 11;
+constexpr int RADIX_SIZE = 1 << RADIX_BITS;
+
+int numChunks(const int64_t n) {
+    const auto maxThreads = static_cast<int64_t>(std::max(1u, std::thread::hardware_concurrency()));
+    return static_cast<int>(std::clamp(n / MIN_EVENTS_PER_THREAD, int64_t{1}, maxThreads));
+}
+
+/// calls fn(chunk, begin, end) for `numChunks` contiguous chunks of [0, n), one thread per chunk if OpenMP is available
+template <typename Fn>
+void parallelForChunks(const int64_t n, const int numChunks, Fn fn) {
+#if !defined(NO_OMP)
+#pragma omp parallel for schedule(static) num_threads(numChunks) if (numChunks > 1)
+#endif
+    for (int chunk = 0; chunk < numChunks; ++chunk) fn(chunk, n * chunk / numChunks, n * (chunk + 1) / numChunks);
+}
+
+/**
+ * Sorts the selection stably by keys[selection[i]], using a parallel LSD radix sort. The keys are small integers, e.g. object_id or path_id, so
+ * the number of passes follows from the range of the selected keys. Keys within a range of RADIX_SIZE, e.g. object_id, are sorted by a single
+ * counting sort pass. Every thread counts the digits of its chunk, and scatters its chunk in order to the offsets of its digits, which keeps the
+ * sort stable.
+ */
+template <typename Key>
+void radixSortByKey(std::vector<int64_t>& selection, const std::vector<Key>& keys) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    const auto n = static_cast<int64_t>(selection.size());
+    if (n <= 1) return;
+    const auto chunks = numChunks(n);
+
+    // range of the selected keys
+    auto chunkMinKeys = std::vector<int64_t>(chunks);
+    auto chunkMaxKeys = std::vector<int64_t>(chunks);
+    parallelForChunks(n, chunks, [&](const int chunk, const int64_t begin, const int64_t end) {
+        auto minKey = std::numeric_limits<int64_t>::max();
+        auto maxKey = std::numeric_limits<int64_t>::min();
+        for (int64_t i = begin; i < end; ++i) {
+            const auto key = static_cast<int64_t>(keys[selection[i]]);
+            minKey         = std::min(minKey, key);
+            maxKey         = std::max(maxKey, key);
+        }
+        chunkMinKeys[chunk] = minKey;
+        chunkMaxKeys[chunk] = maxKey;
+    });
+    const auto minKey = static_cast<uint64_t>(*std::min_element(chunkMinKeys.begin(), chunkMinKeys.end()));
+    const auto maxKey = static_cast<uint64_t>(*std::max_element(chunkMaxKeys.begin(), chunkMaxKeys.end()));
+    if (minKey == maxKey) return;
+
+    const auto range = maxKey - minKey;
+    auto numPasses   = 1;
+    while (numPasses * RADIX_BITS < 64 && (range >> (numPasses * RADIX_BITS)) != 0) ++numPasses;
+
+    auto buffer     = std::vector<int64_t>(n);
+    auto histograms = std::vector<int64_t>(static_cast<size_t>(chunks) * RADIX_SIZE);
+    for (int pass = 0; pass < numPasses; ++pass) {
+        const auto shift = pass * RADIX_BITS;
+        const auto digit = [&](const int64_t j) { return ((static_cast<uint64_t>(keys[j]) - minKey) >> shift) & (RADIX_SIZE - 1); };
+
+        std::fill(histograms.begin(), histograms.end(), 0);
+        parallelForChunks(n, chunks, [&](const int chunk, const int64_t begin, const int64_t end) {
+            auto* histogram = histograms.data() + chunk * RADIX_SIZE;
+            for (int64_t i = begin; i < end; ++i) ++histogram[digit(selection[i])];
+        });
+
+        // exclusive prefix sum over the digits, and within a digit over the chunks in order
+        auto offset = int64_t{0};
+        for (int d = 0; d < RADIX_SIZE; ++d) {
+            for (int chunk = 0; chunk < chunks; ++chunk) {
+                const auto count                  = histograms[chunk * RADIX_SIZE + d];
+                histograms[chunk * RADIX_SIZE + d] = offset;
+                offset += count;
+            }
+        }
+
+        parallelForChunks(n, chunks, [&](const int chunk, const int64_t begin, const int64_t end) {
+            auto* offsets = histograms.data() + chunk * RADIX_SIZE;
+            for (int64_t i = begin; i < end; ++i) buffer[offsets[digit(selection[i])]++] = selection[i];
+        });
+        selection.swap(buffer);
+    }
+}
+
+/// dst[i] = src[selection[i]], gathered in parallel
+template <typename T>
+void gather(const std::vector<T>& src, const std::vector<int64_t>& selection, std::vector<T>& dst) {
+    const auto n = static_cast<int64_t>(selection.size());
+    dst.resize(n);
+    parallelForChunks(n, numChunks(n), [&](const int, const int64_t begin, const int64_t end) {
+        for (int64_t i = begin; i < end; ++i) dst[i] = src[selection[i]];
+    });
+}
+
+}  // unnamed namespace
+
+std::vector<int64_t>& RaysView::indices() {
+    if (!m_indices) {
+        m_indices.emplace(m_size);
+        std::iota(m_indices->begin(), m_indices->end(), 0);
+    }
+    return *m_indices;
+}
+
+RaysView& RaysView::filterByObjectId(const int objectId) & {
+    if (!m_rays->contains(RayAttrMask::ObjectId)) throw std::runtime_error("RaysView::filterByObjectId requires object_id attribute to be present");
+    return filter([&object_id = m_rays->object_id, objectId](const int64_t i) { return object_id[i] == objectId; });
+}
+
+RaysView& RaysView::filterByLastEventInPath() & {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    if (!m_rays->contains(RayAttrMask::PathId) || !m_rays->contains(RayAttrMask::PathEventId))
+        throw std::runtime_error("RaysView::filterByLastEventInPath requires path_id and path_event_id attributes to be present");
+
+    const auto& path_id       = m_rays->path_id;
+    const auto& path_event_id = m_rays->path_event_id;
+
+    // path_id -> position of the last event of the path in the new selection
+    std::unordered_map<int64_t, int64_t> lastEventPos;
+    auto selection = std::vector<int64_t>{};
+    for (int64_t i = 0; i < m_size; ++i) {
+        const auto j               = index(i);
+        const auto [it, isNewPath] = lastEventPos.try_emplace(path_id[j], static_cast<int64_t>(selection.size()));
+        if (isNewPath)
+            selection.push_back(j);
+        else if (path_event_id[j] > path_event_id[selection[it->second]])
+            selection[it->second] = j;
+    }
+
+    m_size    = static_cast<int64_t>(selection.size());
+    m_indices = std::move(selection);
+    return *this;
+}
+
+RaysView& RaysView::sortByObjectId() & {
+    if (!m_rays->contains(RayAttrMask::ObjectId)) throw std::runtime_error("RaysView::sortByObjectId requires object_id attribute to be present");
+    radixSortByKey(indices(), m_rays->object_id);
+    return *this;
+}
+
+RaysView& RaysView::sortByPathIdAndPathEventId() & {
+    if (!m_rays->contains(RayAttrMask::PathId) || !m_rays->contains(RayAttrMask::PathEventId))
+        throw std::runtime_error("RaysView::sortByPathIdAndPathEventId requires path_id and path_event_id attributes to be present");
+
+    // the radix sort is stable, so sorting by the minor key first yields the order of both keys
+    auto& selection = indices();
+    radixSortByKey(selection, m_rays->path_event_id);
+    radixSortByKey(selection, m_rays->path_id);
+    return *this;
+}
+
+Rays RaysView::materialize() const {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    Rays result;
+
+    // without a selection vector, the view selects all events in order, so the columns are copied as a whole
+    if (!m_indices) {
+#define X(type, name, flag) \
+    if (!!(m_attrMask & RayAttrMask::flag)) result.name = m_rays->name;
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+        return result;
+    }
+
+#define X(type, name, flag) \
+    if (!!(m_attrMask & RayAttrMask::flag)) gather(m_rays->name, *m_indices, result.name);
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+    return result;
+}
+
+}  // namespace rayx
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "Debug/Instrumentor.h"
+#include "Rays.h"
+
+namespace rayx {
+
+/**
+ * @brief A lazy view of selected events of a Rays instance, restricted to a set of attributes.
+ * A view consists of a selection vector of indices into the viewed rays and a mask of the projected attributes. Filtering and sorting a view only
+ * reorder its selection vector and never copy attribute columns, so a chain like filter, filterByObjectId, sort and project costs one pass over
+ * the selection per step and a single materialization at the end, or none if the events are read from the view directly.
+ * Predicates and comparison functions take indices into the viewed rays, the same as for Rays::filter and Rays::sort, so the same lambdas can
+ * be used for both.
+ * @note The view refers to the viewed rays, which must outlive the view and must not be modified while the view is in use.
+ * @example
+ * ```cpp
+ * // read the events on the image plane in order of their paths, without copying any attribute
+ * const auto view = RaysView(rays).filterByObjectId(imagePlaneId).sortByPathIdAndPathEventId();
+ * for (int64_t i = 0; i < view.size(); ++i) sum += view.energy(i);
+ * // or copy only their positions
+ * const auto positions = RaysView(rays).filterByObjectId(imagePlaneId).project(RayAttrMask::Position).materialize();
+ * ```
+ */
+class RAYX_API RaysView {
+  public:
+    /// view of all events and all recorded attributes of `rays`
+    explicit RaysView(const Rays& rays) : m_rays(&rays), m_attrMask(rays.attrMask()), m_size(rays.size()) {}
+    /// a view of a temporary would dangle
+    explicit RaysView(const Rays&&) = delete;
+
+    /// the viewed rays
+    const Rays& rays() const { return *m_rays; }
+
+    /**
+     * @brief Get a mask of the attributes of the view, i.e. the attributes recorded in the viewed rays, restricted by project().
+     * @return A RayAttrMask indicating the attributes of the view.
+     */
+    RayAttrMask attrMask() const { return m_attrMask; }
+
+    bool contains(const RayAttrMask attr) const { return rayx::contains(m_attrMask, attr); }
+
+    /// number of selected events
+    int64_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    /// index into the viewed rays of the i-th selected event
+    int64_t index(const int64_t i) const { return m_indices ? (*m_indices)[i] : i; }
+
+    // attributes of the i-th selected event. attributes that are projected out of the view must not be accessed
+#define X(type, name, flag) \
+    const type& name(const int64_t i) const { return m_rays->name[index(i)]; }
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+    glm::dvec3 position(const int64_t i) const {
+        const auto j = index(i);
+        return glm::dvec3(m_rays->position_x[j], m_rays->position_y[j], m_rays->position_z[j]);
+    }
+
+    glm::dvec3 direction(const int64_t i) const {
+        const auto j = index(i);
+        return glm::dvec3(m_rays->direction_x[j], m_rays->direction_y[j], m_rays->direction_z[j]);
+    }
+
+    ElectricField electric_field(const int64_t i) const {
+        const auto j = index(i);
+        return ElectricField(m_rays->electric_field_x[j], m_rays->electric_field_y[j], m_rays->electric_field_z[j]);
+    }
+
+    /**
+     * @brief Access an attribute of the i-th selected event by its RayAttrMask flag.
+     * @tparam Attr A single attribute (see isFlag).
+     * @example
+     * ```cpp
+     * const auto energy = view.attr<RayAttrMask::Energy>(i);
+     * ```
+     */
+    template <RayAttrMask Attr>
+    const auto& attr(const int64_t i) const;
+
+    /**
+     * @brief Keep only the selected events for which the predicate returns true, in their current order.
+     * @param pred Takes the index of an event in the viewed rays (int64_t) and returns true if the event should be kept.
+     */
+    template <typename Pred>
+    RaysView& filter(Pred pred) &;
+    template <typename Pred>
+    [[nodiscard]] RaysView&& filter(Pred pred) && { return std::move(filter(pred)); }
+
+    /**
+     * @brief Keep only the selected events on a specific object.
+     * @note Requires that object_id is recorded.
+     */
+    RaysView& filterByObjectId(const int objectId) &;
+    [[nodiscard]] RaysView&& filterByObjectId(const int objectId) && { return std::move(filterByObjectId(objectId)); }
+
+    /**
+     * @brief Keep only the selected event with the maximum path_event_id of each path.
+     * The kept events are in order of the first selected event of their path.
+     * @note Requires that path_id and path_event_id are recorded.
+     */
+    RaysView& filterByLastEventInPath() &;
+    [[nodiscard]] RaysView&& filterByLastEventInPath() && { return std::move(filterByLastEventInPath()); }
+
+    /**
+     * @brief Sort the selected events.
+     * @param comp Takes the indices of two events in the viewed rays (int64_t) and returns true if the first should come before the second. The
+     * same as for std::sort.
+     */
+    template <typename Compare>
+    RaysView& sort(Compare comp) &;
+    template <typename Compare>
+    [[nodiscard]] RaysView&& sort(Compare comp) && { return std::move(sort(comp)); }
+
+    /**
+     * @brief Sort the selected events by object_id, with a parallel radix sort. Events with the same object_id keep their order.
+     * @note Requires that object_id is recorded.
+     */
+    RaysView& sortByObjectId() &;
+    [[nodiscard]] RaysView&& sortByObjectId() && { return std::move(sortByObjectId()); }
+
+    /**
+     * @brief Sort the selected events by path_id and then by path_event_id, with a parallel radix sort.
+     * @note Requires that path_id and path_event_id are recorded.
+     */
+    RaysView& sortByPathIdAndPathEventId() &;
+    [[nodiscard]] RaysView&& sortByPathIdAndPathEventId() && { return std::move(sortByPathIdAndPathEventId()); }
+
+    /**
+     * @brief Restrict the attributes of the view to the given mask. Attributes that are not recorded in the viewed rays are ignored.
+     * This operation is deferred to materialize(), which copies only the projected attributes.
+     */
+    RaysView& project(const RayAttrMask mask) & {
+        m_attrMask &= mask;
+        return *this;
+    }
+    [[nodiscard]] RaysView&& project(const RayAttrMask mask) && { return std::move(project(mask)); }
+
+    /**
+     * @brief Count the selected events for which the predicate returns true.
+     * @param pred Takes the index of an event in the viewed rays (int64_t).
+     */
+    template <typename Pred>
+    int64_t count(Pred pred) const;
+
+    /**
+     * @brief Copy the projected attributes of the selected events into a new Rays instance, in order of the selection. The attributes are
+     * gathered in parallel.
+     * @return A new Rays instance containing the selected events.
+     */
+    [[nodiscard]] Rays materialize() const;
+
+  private:
+    /// the selection vector is created on the first filter or sort. until then, all events of the viewed rays are selected in order
+    std::vector<int64_t>& indices();
+
+    const Rays* m_rays;
+    RayAttrMask m_attrMask;
+    int64_t m_size;
+    std::optional<std::vector<int64_t>> m_indices;
+};
+
+template <RayAttrMask Attr>
+const auto& RaysView::attr(const int64_t i) const {
+#define X(type, name, flag)                    \
+    if constexpr (Attr == RayAttrMask::flag) { \
+        return m_rays->name[index(i)];         \
+    } else
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+    {
+        static_assert(Attr != Attr, "RaysView::attr requires a single attribute");
+    }
+}
+
+template <typename Pred>
+RaysView& RaysView::filter(Pred pred) & {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    if (!m_indices) {
+        auto& selection = m_indices.emplace();
+        for (int64_t i = 0; i < m_size; ++i)
+            if (pred(i)) selection.push_back(i);
+    } else {
+        std::erase_if(*m_indices, [&](const int64_t i) { return !pred(i); });
+    }
+
+    m_size = static_cast<int64_t>(m_indices->size());
+    return *this;
+}
+
+template <typename Compare>
+RaysView& RaysView::sort(Compare comp) & {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    auto& selection = indices();
+    std::sort(selection.begin(), selection.end(), comp);
+    return *this;
+}
+
+template <typename Pred>
+int64_t RaysView::count(Pred pred) const {
+    auto count = int64_t{0};
+    for (int64_t i = 0; i < m_size; ++i)
+        if (pred(index(i))) ++count;
+    return count;
+}
+
+}  // namespace rayx
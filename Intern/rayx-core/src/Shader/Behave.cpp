@@ -11,14 +11,19 @@
 #include "Refrac.h"
 #include "RefractiveIndex.h"
 #include "SphericalCoords.h"
-#include "Throw.h"
 #include "Transmission.h"
 #include "Utils.h"
 
 namespace rayx {
 
-RAYX_FN_ACC
-void behaveCrystal(detail::Ray& __restrict ray, const Behaviour::Crystal& __restrict crystal, const CollisionPoint& __restrict col) {
+template <bool UpdateElectricField>
+RAYX_FN_ACC void behaveCrystal(detail::Ray& __restrict ray, const Behaviour::Crystal& __restrict crystal, const CollisionPoint& __restrict col) {
+    if constexpr (!UpdateElectricField) {
+        ray.direction = glm::reflect(ray.direction, col.normal);
+        ray.order     = 0;
+        return;
+    }
+
     double theta0    = getTheta(ray.direction, col.normal, crystal.m_offsetAngle);
     double bragg     = getBraggAngle(ray.energy, crystal.m_dSpacing2);
     double asymmetry = -getAsymmetryFactor(bragg, crystal.m_offsetAngle);
@@ -88,9 +93,10 @@ void behaveSlit(detail::Ray& __restrict ray, const Behaviour::Slit& __restrict s
             } else if constexpr (std::is_same_v<T, Cutout::Elliptical>) {
                 bessel_diff(cutout.m_diameter_z, wavelength, dPhi, dPsi, ray.rand);
             } else {
-                _throw("encountered Slit with unsupported openingCutout!");
+                terminateRay(ray.event_type, EventType::FatalError);
             }
         });
+        if (isRayTerminated(ray.event_type)) return;
     }
 
     phi += dPhi;
@@ -109,7 +115,10 @@ void behaveRZP(detail::Ray& __restrict ray, const Behaviour::RZP& __restrict rzp
 
     // calculate the RZP line density for the position of the intersection on the RZP
     double DX, DZ;
-    RZPLineDensity(ray.position, col.normal, rzp, DX, DZ);
+    if (!RZPLineDensity(ray.position, col.normal, rzp, DX, DZ)) {
+        terminateRay(ray.event_type, EventType::FatalError);
+        return;
+    }
 
     // if additional zero order should be behaved, approx. half of the rays are randomly chosen to be behaved in order 0 (= ordinary reflection)
     // instead of the given order
@@ -139,32 +148,48 @@ void behaveGrating(detail::Ray& __restrict ray, const Behaviour::Grating& __rest
     refrac2D(ray, col.normal, adjustedLinedensity, 0);
 }
 
-RAYX_FN_ACC
-void behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const Coating& __restrict coating, const int material,
-                  const int* __restrict materialIndices, const double* __restrict materialTable) {
+template <bool UpdateElectricField>
+RAYX_FN_ACC void behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const Coating& __restrict coating, const int material,
+                              const int* __restrict materialIndices, const double* __restrict materialTable) {
     // calculate the new direction after the reflection
     const auto incident_vec = ray.direction;
     const auto reflect_vec  = glm::reflect(incident_vec, col.normal);
     ray.direction           = reflect_vec;
 
+    // the refractive indices are looked up even if the electric field is not updated, because a missing one terminates the ray
     if (coating.is<Coating::SubstrateOnly>()) {
         if (material != -2) {
+            const auto substrate_ior = getRefractiveIndex(ray.energy, material, materialIndices, materialTable);
+            if (!isRefractiveIndexFound(substrate_ior)) {
+                terminateRay(ray.event_type, EventType::FatalError);
+                return;
+            }
+
+            ray.order = 0;
+            if constexpr (!UpdateElectricField) return;
+
             constexpr int vacuum_material = -1;
             const auto vacuum_ior         = getRefractiveIndex(ray.energy, vacuum_material, materialIndices, materialTable);
-            const auto substrate_ior      = getRefractiveIndex(ray.energy, material, materialIndices, materialTable);
 
             const auto reflect_field = interceptReflect(ray.electric_field, incident_vec, reflect_vec, col.normal, vacuum_ior, substrate_ior);
 
             ray.electric_field = reflect_field;
-            ray.order          = 0;
         }
     } else if (coating.is<Coating::OneCoating>()) {
         Coating::OneCoating oneCoating = coating.get<Coating::OneCoating>();
 
+        const auto coating_ior   = getRefractiveIndex(ray.energy, oneCoating.material, materialIndices, materialTable);
+        const auto substrate_ior = getRefractiveIndex(ray.energy, material, materialIndices, materialTable);
+        if (!isRefractiveIndexFound(coating_ior) || !isRefractiveIndexFound(substrate_ior)) {
+            terminateRay(ray.event_type, EventType::FatalError);
+            return;
+        }
+
+        ray.order = 0;
+        if constexpr (!UpdateElectricField) return;
+
         constexpr int vacuum_material = -1;
         const auto vacuum_ior         = getRefractiveIndex(ray.energy, vacuum_material, materialIndices, materialTable);
-        const auto coating_ior        = getRefractiveIndex(ray.energy, oneCoating.material, materialIndices, materialTable);
-        const auto substrate_ior      = getRefractiveIndex(ray.energy, material, materialIndices, materialTable);
 
         const auto angle         = angleBetweenUnitVectors(-incident_vec, col.normal);
         const auto incidentAngle = complex::Complex(angle == 0.0 ? 1e-8 : angle, 0.0);
@@ -176,7 +201,6 @@ void behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict
 
         const auto polmat  = calcPolaririzationMatrix(incident_vec, reflect_vec, col.normal, amplitude);
         ray.electric_field = polmat * ray.electric_field;
-        ray.order          = 0;
     } else if (coating.is<Coating::MultilayerCoating>()) {
         Coating::MultilayerCoating mlCoating = coating.get<Coating::MultilayerCoating>();
         constexpr int vacuum_material        = -1;
@@ -186,9 +210,20 @@ void behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict
         const int n = mlCoating.numLayers;
         complex::Complex iors[1002];
 
-        iors[0] = vacuum_ior;
-        for (int i = 0; i < n; ++i) { iors[i + 1] = getRefractiveIndex(ray.energy, mlCoating.material[i], materialIndices, materialTable); }
+        iors[0]    = vacuum_ior;
+        auto found = isRefractiveIndexFound(substrate_ior);
+        for (int i = 0; i < n; ++i) {
+            iors[i + 1] = getRefractiveIndex(ray.energy, mlCoating.material[i], materialIndices, materialTable);
+            found       = found && isRefractiveIndexFound(iors[i + 1]);
+        }
         iors[n + 1] = substrate_ior;
+        if (!found) {
+            terminateRay(ray.event_type, EventType::FatalError);
+            return;
+        }
+
+        ray.order = 0;
+        if constexpr (!UpdateElectricField) return;
 
         const auto angle         = angleBetweenUnitVectors(-incident_vec, col.normal);
         const auto incidentAngle = complex::Complex(angle == 0.0 ? 1e-8 : angle, 0.0);
@@ -199,17 +234,25 @@ void behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict
 
         const auto polmat  = calcPolaririzationMatrix(incident_vec, reflect_vec, col.normal, amplitude);
         ray.electric_field = polmat * ray.electric_field;
-        ray.order          = 0;
     } else {
-        _throw("encountered Mirror with unsupported Coating type!");
+        terminateRay(ray.event_type, EventType::FatalError);
     }
 }
 
-RAYX_FN_ACC
-void behaveFoil(detail::Ray& __restrict ray, const Behaviour::Foil& __restrict foil, const CollisionPoint& __restrict col, const int material,
-                const int* __restrict materialIndices, const double* __restrict materialTable) {
-    const auto indexVacuum   = complex::Complex(1., 0.);
+template <bool UpdateElectricField>
+RAYX_FN_ACC void behaveFoil(detail::Ray& __restrict ray, const Behaviour::Foil& __restrict foil, const CollisionPoint& __restrict col,
+                            const int material, const int* __restrict materialIndices, const double* __restrict materialTable) {
+    // the refractive index is looked up even if the electric field is not updated, because a missing one terminates the ray
     const auto indexMaterial = getRefractiveIndex(ray.energy, material, materialIndices, materialTable);
+    if (!isRefractiveIndexFound(indexMaterial)) {
+        terminateRay(ray.event_type, EventType::FatalError);
+        return;
+    }
+
+    ray.order = 0;
+    if constexpr (!UpdateElectricField) return;
+
+    const auto indexVacuum = complex::Complex(1., 0.);
 
     double angle = angleBetweenUnitVectors(-ray.direction, col.normal);  // in rad
 
@@ -227,18 +270,18 @@ void behaveFoil(detail::Ray& __restrict ray, const Behaviour::Foil& __restrict f
 
     // calc efficiency
     ray.electric_field = interceptFoil(ray.electric_field, ray.direction, col.normal, totalTransmission);
-
-    ray.order = 0;
 }
 
 RAYX_FN_ACC void behaveImagePlane(detail::Ray& __restrict ray) { ray.order = 0; }
 
-RAYX_FN_ACC
-void behave(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const OpticalElement& __restrict element,
-            const int* __restrict materialIndices, const double* __restrict materialTable) {
-    element.m_behaviour.visit([&]<typename T>(const T& behaviour) {
+template <bool UpdateElectricField, ElementTypeMask ElementTypes>
+RAYX_FN_ACC void behave(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const OpticalElement& __restrict element,
+                        const int* __restrict materialIndices, const double* __restrict materialTable) {
+    using Filter = ElementTypeFilter<ElementTypes>;
+
+    element.m_behaviour.visitFiltered<Filter::template Filter>([&]<typename T>(const T& behaviour) {
         if constexpr (std::is_same_v<T, Behaviour::Mirror>) {
-            behaveMirror(ray, col, element.m_coating, element.m_material, materialIndices, materialTable);
+            behaveMirror<UpdateElectricField>(ray, col, element.m_coating, element.m_material, materialIndices, materialTable);
         } else if constexpr (std::is_same_v<T, Behaviour::Grating>) {
             behaveGrating(ray, behaviour, col);
         } else if constexpr (std::is_same_v<T, Behaviour::Slit>) {
@@ -246,15 +289,36 @@ void behave(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, c
         } else if constexpr (std::is_same_v<T, Behaviour::RZP>) {
             behaveRZP(ray, behaviour, col);
         } else if constexpr (std::is_same_v<T, Behaviour::Crystal>) {
-            behaveCrystal(ray, behaviour, col);
+            behaveCrystal<UpdateElectricField>(ray, behaviour, col);
         } else if constexpr (std::is_same_v<T, Behaviour::ImagePlane>) {
             behaveImagePlane(ray);
         } else if constexpr (std::is_same_v<T, Behaviour::Foil>) {
-            behaveFoil(ray, behaviour, col, element.m_material, materialIndices, materialTable);
+            behaveFoil<UpdateElectricField>(ray, behaviour, col, element.m_material, materialIndices, materialTable);
         } else {
-            _throw("invalid behaviour type in dynamicElements!");
+            static_assert(!std::is_same_v<T, T>, "behave: unhandled behaviour type");
         }
     });
 }
 
+static_assert(std::size(TRACE_ELEMENT_TYPE_MASKS) == 2, "instantiate behave for each element type mask");
+
+#define RAYX_INSTANTIATE_BEHAVE(UpdateElectricField)                                                                                                   \
+    template RAYX_FN_ACC void behaveCrystal<UpdateElectricField>(detail::Ray& __restrict, const Behaviour::Crystal& __restrict,                        \
+                                                                 const CollisionPoint& __restrict);                                                    \
+    template RAYX_FN_ACC void behaveMirror<UpdateElectricField>(detail::Ray& __restrict, const CollisionPoint& __restrict,                             \
+                                                                const Coating& __restrict, const int, const int* __restrict,                           \
+                                                                const double* __restrict);                                                             \
+    template RAYX_FN_ACC void behaveFoil<UpdateElectricField>(detail::Ray& __restrict, const Behaviour::Foil& __restrict,                              \
+                                                              const CollisionPoint& __restrict, const int, const int* __restrict,                      \
+                                                              const double* __restrict);                                                               \
+    template RAYX_FN_ACC void behave<UpdateElectricField, TRACE_ELEMENT_TYPE_MASKS[0]>(                                                                \
+        detail::Ray& __restrict, const CollisionPoint& __restrict, const OpticalElement& __restrict, const int* __restrict, const double* __restrict); \
+    template RAYX_FN_ACC void behave<UpdateElectricField, TRACE_ELEMENT_TYPE_MASKS[1]>(                                                                \
+        detail::Ray& __restrict, const CollisionPoint& __restrict, const OpticalElement& __restrict, const int* __restrict, const double* __restrict);
+
+RAYX_INSTANTIATE_BEHAVE(true)
+RAYX_INSTANTIATE_BEHAVE(false)
+
+#undef RAYX_INSTANTIATE_BEHAVE
+
 }  // namespace rayx
@@ -17,15 +17,25 @@ namespace rayx {
 /// - change the rays stokes vector
 /// - potentially absorb the ray (by calling `recordFinalEvent(_, EventType::Absorbed)`)
 
-RAYX_FN_ACC void behaveCrystal(detail::Ray& __restrict ray, const Behaviour::Crystal& __restrict crystal, const CollisionPoint& __restrict col);
-RAYX_FN_ACC void behaveSlit(detail::Ray& __restrict ray, const Behaviour::Slit& __restrict slit);
-RAYX_FN_ACC void behaveRZP(detail::Ray& __restrict ray, const Behaviour::RZP& __restrict rzp, const CollisionPoint& __restrict col);
-RAYX_FN_ACC void behaveGrating(detail::Ray& __restrict ray, const Behaviour::Grating& __restrict grating, const CollisionPoint& __restrict col);
-RAYX_FN_ACC void behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const Coating& __restrict coating, int material,
-                              const int* __restrict materialIndices, const double* __restrict materialTable);
-RAYX_FN_ACC void behaveFoil(detail::Ray& __restrict ray, const Behaviour::Foil& __restrict foil, const CollisionPoint& __restrict col, int material,
-                            const int* __restrict materialIndices, const double* __restrict materialTable);
-RAYX_FN_ACC void behaveImagePlane(detail::Ray& __restrict ray);
+/// The `UpdateElectricField` template parameter allows to skip all computations that only affect the electric field of the ray. This is used if
+/// the electric field is not recorded.
+/// The `ElementTypes` template parameter restricts the behaviour types that `behave` dispatches to. See ElementTypeMask.
+
+template <bool UpdateElectricField = true>
+RAYX_FN_ACC void RAYX_BENCH_API behaveCrystal(detail::Ray& __restrict ray, const Behaviour::Crystal& __restrict crystal,
+                                              const CollisionPoint& __restrict col);
+RAYX_FN_ACC void RAYX_BENCH_API behaveSlit(detail::Ray& __restrict ray, const Behaviour::Slit& __restrict slit);
+RAYX_FN_ACC void RAYX_BENCH_API behaveRZP(detail::Ray& __restrict ray, const Behaviour::RZP& __restrict rzp, const CollisionPoint& __restrict col);
+RAYX_FN_ACC void RAYX_BENCH_API behaveGrating(detail::Ray& __restrict ray, const Behaviour::Grating& __restrict grating,
+                                              const CollisionPoint& __restrict col);
+template <bool UpdateElectricField = true>
+RAYX_FN_ACC void RAYX_BENCH_API behaveMirror(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const Coating& __restrict coating,
+                                             int material, const int* __restrict materialIndices, const double* __restrict materialTable);
+template <bool UpdateElectricField = true>
+RAYX_FN_ACC void RAYX_BENCH_API behaveFoil(detail::Ray& __restrict ray, const Behaviour::Foil& __restrict foil, const CollisionPoint& __restrict col,
+                                           int material, const int* __restrict materialIndices, const double* __restrict materialTable);
+RAYX_FN_ACC void RAYX_BENCH_API behaveImagePlane(detail::Ray& __restrict ray);
+template <bool UpdateElectricField = true, ElementTypeMask ElementTypes = ElementTypeMask::All>
 RAYX_FN_ACC void behave(detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const OpticalElement& __restrict element,
                         const int* __restrict materialIndices, const double* __restrict materialTable);
 
@@ -4,12 +4,27 @@
 #include "Cubic.h"
 #include "CutoutFns.h"
 #include "InvocationState.h"
-#include "Throw.h"
+#include "TraceCounters.h"
 #include "Utils.h"
 #include "Variant.h"
 
 namespace {
 constexpr double COLLISION_EPSILON = 1e-6;
+
+// iterations of the cubic newton method, before falling back to an approximation
+constexpr int CUBIC_MAX_ITERATIONS = 1000;
+
+#ifdef RAYX_FAST_CUBIC_COLLISION
+RAYX_FN_ACC inline double cubicSquare(const double x) { return x * x; }
+RAYX_FN_ACC inline double cubicCube(const double x) { return x * x * x; }
+// the approximation is returned if the method does not converge
+RAYX_FN_ACC inline bool isCubicIterationBounded(const double counter) { return counter <= CUBIC_MAX_ITERATIONS + 1; }
+#else
+// the cubic collision of RAY-UI truncates to float in the powers and iterates until it converges
+RAYX_FN_ACC inline double cubicSquare(const double x) { return pow(float(x), 2); }
+RAYX_FN_ACC inline double cubicCube(const double x) { return pow(float(x), 3); }
+RAYX_FN_ACC inline bool isCubicIterationBounded(const double) { return true; }
+#endif
 }  // unnamed namespace
 
 namespace rayx {
@@ -141,12 +156,14 @@ OptCollisionPoint getQuadricCollision(const glm::dvec3& __restrict rayPosition,
  *  with a surface of 3. order
  *
  *  method: the iterative Newtonmethod is used for zero point search
+ *  if the method does not converge within CUBIC_MAX_ITERATIONS, an approximation is used. if RAYX_FAST_CUBIC_COLLISION is defined, the
+ *  approximation is returned and the computation is in double precision, otherwise the results are identical to RAY-UI
  *  result is X,Y,Z of intersection
  * Ray in in element koordinates.
  */
 RAYX_FN_ACC
 OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                    const Surface::Cubic& __restrict cu) {
+                                    const Surface::Cubic& __restrict cu, TraceCounter* __restrict counters) {
     // TODO: what is this and do we need it?
     // Ray r = rotateForCubic(rin, cu.m_psi, 1000);
 
@@ -184,20 +201,20 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
             y1 = y - aml * (x - xx);
             z1 = z - anl * (x - xx);
 
-            double func = (2 * ((x1 - xx) * an - al * z1) * cu.m_a23 - (2 * cu.m_a24 + cu.m_b12 * pow(float(xx), 2.0)) * al +
+            double func = (2 * ((x1 - xx) * an - al * z1) * cu.m_a23 - (2 * cu.m_a24 + cu.m_b12 * cubicSquare(xx)) * al +
                            ((x1 - xx) * am - al * y1) * (cu.m_a22 + cu.m_b21 * xx)) *
                           ((x1 - xx) * am - al * y1);
-            func = func + pow(float(((x1 - xx) * an - al * z1)), 2.0) * cu.m_a33;
-            func = func - ((x1 - xx) * an - al * z1) * (2 * cu.m_a34 + cu.m_b13 * pow(float(xx), 2.0) * al + cu.m_a44 * pow(float(al), 2.0));
+            func = func + cubicSquare((x1 - xx) * an - al * z1) * cu.m_a33;
+            func = func - ((x1 - xx) * an - al * z1) * (2 * cu.m_a34 + cu.m_b13 * cubicSquare(xx) * al + cu.m_a44 * cubicSquare(al));
             func = (func -
                     (2 * ((x1 - xx) * an - al * z1) * cu.m_a13 - (cu.m_a11 * xx + 2 * cu.m_a14) * al + 2 * ((x1 - xx) * am - al * y1) * cu.m_a12) *
                         al * xx) *
                    al;
-            func = (func - (pow(float(((x1 - xx) * am - al * y1)), 2.0) * cu.m_b23 +
+            func = (func - (cubicSquare((x1 - xx) * am - al * y1) * cu.m_b23 +
                             ((x1 - xx) * am - al * y1) * ((x1 - xx) * an - al * z1) * cu.m_b32 - ((x1 - xx) * an - al * z1) * al * cu.m_b31 * xx) *
-                               ((x1 - xx) * an - al * z1) / pow(float(al), 3));
+                               ((x1 - xx) * an - al * z1) / cubicCube(al));
 
-            double dfunc = (2 * ((x1 - xx) * an - al * z1) * cu.m_a23 - (2 * cu.m_a24 + cu.m_b12 * pow(float(xx), 2)) * al +
+            double dfunc = (2 * ((x1 - xx) * an - al * z1) * cu.m_a23 - (2 * cu.m_a24 + cu.m_b12 * cubicSquare(xx)) * al +
                             ((x1 - xx) * am - al * y1) * (cu.m_a22 + cu.m_b21 * xx)) *
                            am;
             dfunc = dfunc - (2 * (cu.m_a12 * am + cu.m_a13 * an) + cu.m_a11 * al) * al * xx;
@@ -207,15 +224,15 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
                 dfunc * al + ((cu.m_a22 + cu.m_b21 * xx) * am + 2 * (cu.m_a23 * an + al * cu.m_b12 * xx) - ((x1 - xx) * am - al * y1) * cu.m_b21) *
                                  ((x1 - xx) * am - al * y1);
             dfunc = (dfunc + 2 * ((x1 - xx) * an - al * z1) * (cu.m_a33 * an + al * cu.m_b13 * xx) -
-                     (2 * cu.m_a34 + cu.m_b13 * pow(float(xx), 2)) * al * an) *
+                     (2 * cu.m_a34 + cu.m_b13 * cubicSquare(xx)) * al * an) *
                     al;
             dfunc = (dfunc - ((((x1 - xx) * an - al * z1) * (al * cu.m_b31 + am * cu.m_b32) - al * an * cu.m_b31 * xx +
                                ((x1 - xx) * am - al * y1) * (2 * am * cu.m_b23 + an * cu.m_b32)) *
                                   ((x1 - xx) * an - al * z1) +
-                              (pow(float(((x1 - xx) * am - al * y1)), 2) * cu.m_b23 +
+                              (cubicSquare((x1 - xx) * am - al * y1) * cu.m_b23 +
                                ((x1 - xx) * am - al * y1) * ((x1 - xx) * an - al * z1) * cu.m_b32 - ((x1 - xx) * an - al * z1) * al * cu.m_b31 * xx) *
                                   an));
-            dfunc = dfunc / pow(float(al), 3);
+            dfunc = dfunc / cubicCube(al);
 
             if (glm::abs(dfunc) < 0.001) { dfunc = 0.001; }
 
@@ -226,13 +243,13 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
             y = y1;
             z = z1;
 
-            if (counter > 1000) {
+            if (counter > CUBIC_MAX_ITERATIONS) {
                 x = -2 * y1 / 2 / aml;
                 y = y1 + aml * x;
                 z = z1 + anl * x;
             }
             counter++;
-        } while (glm::abs(dx) > 0.001);
+        } while (glm::abs(dx) > 0.001 && isCubicIterationBounded(counter));
     } else if (cs == 2) {
         double alm = al / am;
         double anm = an / am;
@@ -246,33 +263,33 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
                            ((y1 - yy) * al - am * x1) * (cu.m_a11 + cu.m_b12 * yy)) *
                           ((y1 - yy) * al - am * x1);
             func = func + (((y1 - yy) * an - am * z1) * cu.m_a33 - 2 * (cu.m_a23 * yy + cu.m_a34) * am) * ((y1 - yy) * an - am * z1) +
-                   (2 * cu.m_a24 * yy + cu.m_a44 + cu.m_a22 * pow(float(yy), 2) * pow(float(am), 2));
+                   (2 * cu.m_a24 * yy + cu.m_a44 + cu.m_a22 * cubicSquare(yy) * cubicSquare(am));
             func = func * am +
-                   ((((y1 - yy) * an - am * z1) * cu.m_b32 - am * cu.m_b23 * yy) * am * yy - pow(float((y1 - yy) * al - am * x1), 2) * cu.m_b13) *
+                   ((((y1 - yy) * an - am * z1) * cu.m_b32 - am * cu.m_b23 * yy) * am * yy - cubicSquare((y1 - yy) * al - am * x1) * cu.m_b13) *
                        ((y1 - yy) * an - am * z1);
-            func = func - (pow(float(((y1 - yy) * an - am * z1)), 2) * cu.m_b31 + pow(float(am), 2) * cu.m_b21 * pow(float(yy), 2)) *
+            func = func - (cubicSquare((y1 - yy) * an - am * z1) * cu.m_b31 + cubicSquare(am) * cu.m_b21 * cubicSquare(yy)) *
                               ((y1 - yy) * al - am * x1);
-            func = func / pow(float(am), 3);
+            func = func / cubicCube(am);
 
-            double dfunc = (pow(float((y1 - yy) * an - am * z1), 2) * cu.m_b31 + pow(float(am), 2) * cu.m_b21 * pow(float(yy), 2) * al +
-                            2 * (((y1 - yy) * an - am * z1) * an * cu.m_b31 - pow(float(am), 2)) * cu.m_b21 * yy) *
+            double dfunc = (cubicSquare((y1 - yy) * an - am * z1) * cu.m_b31 + cubicSquare(am) * cu.m_b21 * cubicSquare(yy) * al +
+                            2 * (((y1 - yy) * an - am * z1) * an * cu.m_b31 - cubicSquare(am)) * cu.m_b21 * yy) *
                            ((y1 - yy) * al - am * x1);
             dfunc =
                 dfunc -
-                ((((y1 - yy) * an - am * z1) * cu.m_b32 - am * cu.m_b23 * yy) * am * yy - pow(float((y1 - yy) * al - am * x1), 2) * cu.m_b13) * an;
+                ((((y1 - yy) * an - am * z1) * cu.m_b32 - am * cu.m_b23 * yy) * am * yy - cubicSquare((y1 - yy) * al - am * x1) * cu.m_b13) * an;
             dfunc = dfunc + (2 * ((y1 - yy) * al - am * x1) * al * cu.m_b13 - (am * cu.m_b23 + an * cu.m_b32) * am * yy +
                              (((y1 - yy) * an - am * z1) * cu.m_b32 - am * cu.m_b23 * yy) * am) *
                                 ((y1 - yy) * an - am * z1);
             dfunc = dfunc - (((cu.m_a11 + cu.m_b12 * yy) * al + 2 * (cu.m_a12 * am + cu.m_a13 * an) - ((y1 - yy) * al - am * x1) * cu.m_b12) *
                                  ((y1 - yy) * al - am * x1) -
-                             2 * (cu.m_a22 * pow(float(am), 2) * yy + cu.m_a23 * pow(float(am), 2) * z1 - cu.m_a23 * am * an * y1 +
-                                  2 * cu.m_a23 * am * an * yy + cu.m_a24 * pow(float(am), 2) + cu.m_a33 * am * an * z1 -
-                                  cu.m_a33 * pow(float(an), 2) * y1 + cu.m_a33 * pow(float(an), 2) * yy + cu.m_a34 * am * an) +
+                             2 * (cu.m_a22 * cubicSquare(am) * yy + cu.m_a23 * cubicSquare(am) * z1 - cu.m_a23 * am * an * y1 +
+                                  2 * cu.m_a23 * am * an * yy + cu.m_a24 * cubicSquare(am) + cu.m_a33 * am * an * z1 -
+                                  cu.m_a33 * cubicSquare(an) * y1 + cu.m_a33 * cubicSquare(an) * yy + cu.m_a34 * am * an) +
                              (2 * (((y1 - yy) * an - am * z1) * cu.m_a13 - (cu.m_a12 * yy + cu.m_a14) * am) +
                               ((y1 - yy) * al - am * x1) * (cu.m_a11 + cu.m_b12 * yy)) *
                                  al) *
                                 am;
-            dfunc = dfunc / pow(float(am), 3);
+            dfunc = dfunc / cubicCube(am);
 
             if (glm::abs(dfunc) < 0.001) { dfunc = 0.001; }
 
@@ -283,13 +300,13 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
             y = y1;
             z = z1;
 
-            if (counter > 1000) {
+            if (counter > CUBIC_MAX_ITERATIONS) {
                 x = x1;
                 y = 0;
                 z = z1;
             }
             counter++;
-        } while (glm::abs(dx) > 0.001);
+        } while (glm::abs(dx) > 0.001 && isCubicIterationBounded(counter));
     } else {
         double aln = al / an;
         double amn = am / an;
@@ -302,29 +319,29 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
             double func = ((2 * (((z1 - zz) * am - an * y1) * cu.m_a12 - (cu.m_a13 * zz + cu.m_a14) * an) + ((z1 - zz) * al - an * x1) * cu.m_a11) *
                                ((z1 - zz) * al - an * x1) +
                            (((z1 - zz) * am - an * y1) * cu.m_a22 - 2 * (cu.m_a23 * zz + cu.m_a24) * an) * ((z1 - zz) * am - an * y1) +
-                           (2 * cu.m_a34 * zz + cu.m_a44 + cu.m_a33 * pow(float(zz), 2)) * pow(float(an), 2)) *
+                           (2 * cu.m_a34 * zz + cu.m_a44 + cu.m_a33 * cubicSquare(zz)) * cubicSquare(an)) *
                           an;
-            func = func - ((((z1 - zz) * am - an * y1) * cu.m_b12 - an * cu.m_b13 * zz) * pow(float(((z1 - zz) * al - an * x1)), 2) -
+            func = func - ((((z1 - zz) * am - an * y1) * cu.m_b12 - an * cu.m_b13 * zz) * cubicSquare((z1 - zz) * al - an * x1) -
                            (((z1 - zz) * am - an * y1) * cu.m_b23 - an * cu.m_b32 * zz) * ((z1 - zz) * am - an * y1) * an * zz +
-                           (pow(float(((z1 - zz) * am - an * y1)), 2) * cu.m_b21 + pow(float(an), 2) * cu.m_b31 * pow(float(zz), 2)) *
+                           (cubicSquare((z1 - zz) * am - an * y1) * cu.m_b21 + cubicSquare(an) * cu.m_b31 * cubicSquare(zz)) *
                                ((z1 - zz) * al - an * x1));
-            func = func / pow(float(an), 3);
+            func = func / cubicCube(an);
 
             double dfunc = (((z1 - zz) * am - an * y1) * cu.m_a22 - 2 * (cu.m_a23 * zz + cu.m_a24) * an) * am +
                            (2 * (cu.m_a12 * am + cu.m_a13 * an) + cu.m_a11 * al) * ((z1 - zz) * al - an * x1);
-            dfunc = dfunc + ((z1 - zz) * am - an * y1) * (cu.m_a22 * am + 2 * cu.m_a23 * an) - 2 * (cu.m_a33 * zz + cu.m_a34) * pow(float(an), 2);
+            dfunc = dfunc + ((z1 - zz) * am - an * y1) * (cu.m_a22 * am + 2 * cu.m_a23 * an) - 2 * (cu.m_a33 * zz + cu.m_a34) * cubicSquare(an);
             dfunc = (dfunc +
                      (2 * (((z1 - zz) * am - an * y1) * cu.m_a12 - (cu.m_a13 * zz + cu.m_a14) * an) + ((z1 - zz) * al - an * x1) * cu.m_a11) * al) *
                     an;
             dfunc = dfunc - (2 *
-                                 (((z1 - zz) * am - an * y1) * am * cu.m_b21 - pow(float(an), 2) * cu.m_b31 * zz +
+                                 (((z1 - zz) * am - an * y1) * am * cu.m_b21 - cubicSquare(an) * cu.m_b31 * zz +
                                   (((z1 - zz) * am - an * y1) * cu.m_b12 - an * cu.m_b13 * zz) * al) *
                                  ((z1 - zz) * al - an * x1) +
-                             (pow(float(((z1 - zz) * am - an * y1)), 2) * cu.m_b21 + pow(float(an), 2) * cu.m_b31 * pow(float(zz), 2)) * al +
-                             pow(float(((z1 - zz) * al - an * x1)), 2) * (am * cu.m_b12 + an * cu.m_b13) -
+                             (cubicSquare((z1 - zz) * am - an * y1) * cu.m_b21 + cubicSquare(an) * cu.m_b31 * cubicSquare(zz)) * al +
+                             cubicSquare((z1 - zz) * al - an * x1) * (am * cu.m_b12 + an * cu.m_b13) -
                              ((z1 - zz) * am - an * y1) * (am * cu.m_b23 + an * cu.m_b32) * an * zz +
                              (((z1 - zz) * am - an * y1) * cu.m_b23 - an * cu.m_b32 * zz) * (am * z1 - 2 * am * zz - an * y1) * an);
-            dfunc = (-dfunc) / pow(float(an), 3);
+            dfunc = (-dfunc) / cubicCube(an);
 
             if (glm::abs(dfunc) < 0.001) { dfunc = 0.001; }
 
@@ -335,13 +352,13 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
             y = y1;
             z = z1;
 
-            if (counter > 1000) {
+            if (counter > CUBIC_MAX_ITERATIONS) {
                 x = x1 + aln * z;
                 y = y1 + amn * z;
                 z = -2 * y1 / 2 / amn;
             }
             counter++;
-        } while (glm::abs(dx) > 0.001);
+        } while (glm::abs(dx) > 0.001 && isCubicIterationBounded(counter));
         // rayPosition = glm::dvec3(a, b, c);
     }
 
@@ -358,6 +375,8 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
     const auto normal =
         normalize(glm::dvec3(fx, fy * glm::cos(-cu.m_psi) - fz * glm::sin(-cu.m_psi), fz * glm::cos(-cu.m_psi) + fy * glm::sin(-cu.m_psi)));
 
+    RAYX_TRACE_COUNT(counters, TraceCounterColumn::CubicIterations, static_cast<int>(counter));
+
     return CollisionPoint{
         .hitpoint = hitpoint,
         .normal   = normal,
@@ -367,31 +386,75 @@ OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, co
 /**************************************************************
  *                    Toroid Collision
  **************************************************************/
+namespace {
+// the toroid is given implicitly by f(x, y, z) = -rx(x)^2 + (y - longRad)^2 + z^2 = 0, with rx(x) = longRad - shortRad + sign(shortRad) *
+// sqrt(shortRad^2 - x^2). along the ray, x and y are linear in z, so the collision is a root of f(z). the derivatives of f(z) are taken along
+// the ray direction normalized to dz = 1
+struct ToroidCollisionParams {
+    double longRad;
+    double shortRad;
+    double isigro;  // sign radius: +1 = concave, -1 = convex
+    glm::dvec3 normalized_dir;
+};
+
+RAYX_FN_ACC inline ToroidCollisionParams makeToroidCollisionParams(const glm::dvec3& __restrict rayDirection,
+                                                                   const Surface::Toroid& __restrict toroid) {
+    const double shortRad = (toroid.m_toroidType == ToroidType::Convex) ? -toroid.m_shortRadius : toroid.m_shortRadius;
+    return ToroidCollisionParams{
+        .longRad        = toroid.m_longRadius,
+        .shortRad       = shortRad,
+        .isigro         = glm::sign(shortRad),
+        .normalized_dir = rayDirection / rayDirection.z,
+    };
+}
+
+// the toroid normal, as used by the newton iteration. the normal is not normalized
+RAYX_FN_ACC inline glm::dvec3 toroidNormal(const ToroidCollisionParams& __restrict t, const double xx, const double yy, const double zz,
+                                           const double sq) {
+    const double rx = t.longRad - t.shortRad + t.isigro * sq;
+    return glm::dvec3((-2 * xx * t.isigro / sq) * rx, -2 * (yy - t.longRad), -2 * zz);
+}
+
+RAYX_FN_ACC inline OptCollisionPoint makeToroidCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                         const glm::dvec3& __restrict hitpoint, const glm::dvec3& __restrict normal,
+                                                         bool isTriangul) {
+    CollisionPoint col;
+    col.normal   = normalize(normal);
+    col.hitpoint = hitpoint;
+
+    if (isTriangul)  // TODO: Hack, Triangulation sensetive to direction apparently. Actual fix or func rework is needed!
+        return col;
+
+    glm::dvec3 rayToHitpoint = col.hitpoint - rayPosition;
+    // edit: if ray points away from the hitpoint, no collision can be found.
+    // Note that multiplying the rays direction with -1 SHOULD totally have an effect on the collision detection - in most cases this 180° rotation
+    // will make the ray point away from the toroid, and hence preventing a Collision completely. The above code however, is unaffected when
+    // multiplying the ray direction with -1. Due to it having no effect on `glm::dvec3 normalized_dir = glm::dvec3(rayDirection) / rayDirection.z;`
+    if (dot(rayToHitpoint, rayDirection) <= 0.0) return std::nullopt;
+
+    return col;
+}
+}  // unnamed namespace
+
 // this uses newton to approximate a solution.
 RAYX_FN_ACC
-OptCollisionPoint getToroidCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                     const Surface::Toroid& __restrict toroid, bool isTriangul) {
+OptCollisionPoint getToroidCollisionNewton(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                           const Surface::Toroid& __restrict toroid, bool isTriangul, int& __restrict numIterations) {
     // Constants
     const double NEW_TOLERANCE   = 0.0001;
     const int NEW_MAX_ITERATIONS = 50;
 
-    double longRad  = toroid.m_longRadius;
-    double shortRad = (toroid.m_toroidType == ToroidType::Convex) ? -toroid.m_shortRadius : toroid.m_shortRadius;
+    const auto t                    = makeToroidCollisionParams(rayDirection, toroid);
+    const double shortRad           = t.shortRad;
+    const glm::dvec3 normalized_dir = t.normalized_dir;
 
-    // sign radius: +1 = concave, -1 = convex
-    double isigro = glm::sign(shortRad);
+    glm::dvec3 normal = glm::dvec3(0, 0, 0);
+    double xx         = 0.0;
+    double zz         = 0.0;
+    double yy         = 0.0;
+    double dz         = 0.0;
 
-    // double aln = rayDirection.x / rayDirection.z;
-    // double amn = rayDirection.y / rayDirection.z;
-
-    glm::dvec4 normal         = glm::dvec4(0, 0, 0, 0);
-    double xx                 = 0.0;
-    double zz                 = 0.0;
-    double yy                 = 0.0;
-    double dz                 = 0.0;
-    glm::dvec3 normalized_dir = glm::dvec3(rayDirection) / rayDirection.z;
-
-    int n = 0;
+    numIterations = 0;
     // Newton's method iteration
     // While not converged...
     do {
@@ -400,34 +463,123 @@ OptCollisionPoint getToroidCollision(const glm::dvec3& __restrict rayPosition, c
         if (xx * xx > shortRad * shortRad) { xx = xx / glm::abs(xx) * 0.95 * shortRad; }
         yy        = rayPosition.y + normalized_dir.y * (zz - rayPosition.z);
         double sq = sqrt(shortRad * shortRad - xx * xx);
-        double rx = (longRad - shortRad + isigro * sq);
+        double rx = (t.longRad - shortRad + t.isigro * sq);
 
         // Calculate toroid normal
-        normal.x = (-2 * xx * isigro / sq) * rx;
-        normal.y = -2 * (yy - longRad);
-        normal.z = -2 * zz;
+        normal = toroidNormal(t, xx, yy, zz, sq);
 
-        double func = -rx * rx + (yy - longRad) * (yy - longRad) + zz * zz;
+        double func = -rx * rx + (yy - t.longRad) * (yy - t.longRad) + zz * zz;
         double df   = normalized_dir.x * normal.x + normalized_dir.y * normal.y + normal.z;  // dot(normalized_dir, glm::dvec3(normal));
         dz          = func / df;
-        n += 1;
-        if (n >= NEW_MAX_ITERATIONS) { return std::nullopt; }
+        numIterations += 1;
+        if (numIterations >= NEW_MAX_ITERATIONS) { return std::nullopt; }
     } while (glm::abs(dz) > NEW_TOLERANCE);
 
-    CollisionPoint col;
-    col.normal   = normalize(glm::dvec3(normal));
-    col.hitpoint = glm::dvec3(xx, yy, zz);
+    return makeToroidCollision(rayPosition, rayDirection, glm::dvec3(xx, yy, zz), normal, isTriangul);
+}
 
-    if (isTriangul)  // TODO: Hack, Triangulation sensetive to direction apparently. Actual fix or func rework is needed!
+// this uses halley's method, starting at the intersection with the osculating paraboloid at the vertex of the toroid. converges in a few
+// iterations to a much tighter tolerance than the newton method. falls back to the newton method if the iteration leaves the toroid or does not
+// converge
+RAYX_FN_ACC
+OptCollisionPoint getToroidCollisionHalley(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                           const Surface::Toroid& __restrict toroid, bool isTriangul, int& __restrict numIterations) {
+    constexpr double HALLEY_TOLERANCE   = 1e-9;
+    constexpr int HALLEY_MAX_ITERATIONS = 8;
+
+#if !defined(RAYX_CUDA_ENABLED)
+    // std::isfinite is not tagged as device function, when compiling with nvcc
+    using std::isfinite;
+#endif
+
+    const auto t                    = makeToroidCollisionParams(rayDirection, toroid);
+    const double shortRad           = t.shortRad;
+    const glm::dvec3 normalized_dir = t.normalized_dir;
+
+    // the ray as a function of z: x = x0 + dx * z, y = y0 + dy * z
+    const double x0 = rayPosition.x - normalized_dir.x * rayPosition.z;
+    const double y0 = rayPosition.y - normalized_dir.y * rayPosition.z;
+
+    // start at the intersection with the osculating paraboloid y = x^2 / (2 * shortRad) + z^2 / (2 * longRad), which is the closest root in ray
+    // direction of a * z^2 + b * z + c = 0. if there is none, start at z = 0 like the newton method
+    double zz = 0.0;
+    {
+        const double a    = normalized_dir.x * normalized_dir.x / (2 * shortRad) + 1 / (2 * t.longRad);
+        const double b    = x0 * normalized_dir.x / shortRad - normalized_dir.y;
+        const double c    = x0 * x0 / (2 * shortRad) - y0;
+        const double disc = b * b - 4 * a * c;
+
+        if (disc >= 0) {
+            // numerically stable roots of the quadratic
+            const double q     = -0.5 * (b + (b >= 0 ? 1.0 : -1.0) * sqrt(disc));
+            const double root1 = q / a;
+            const double root2 = c / q;
+
+            // ray parameters of the roots. the ray moves forward in z, if rayDirection.z is positive
+            const double dirSign = glm::sign(rayDirection.z);
+            const double t1      = (root1 - rayPosition.z) * dirSign;
+            const double t2      = (root2 - rayPosition.z) * dirSign;
+            const bool valid1    = isfinite(root1) && t1 >= 0;
+            const bool valid2    = isfinite(root2) && t2 >= 0;
+
+            if (valid1 && (!valid2 || t1 <= t2))
+                zz = root1;
+            else if (valid2)
+                zz = root2;
+        }
+    }
+
+    numIterations = 0;
+    bool converged = false;
+    while (!converged && numIterations < HALLEY_MAX_ITERATIONS) {
+        const double xx   = x0 + normalized_dir.x * zz;
+        const double yy   = y0 + normalized_dir.y * zz;
+        const double sqSq = shortRad * shortRad - xx * xx;
+
+        // the iteration left the toroid
+        if (!(sqSq > 0)) break;
+
+        const double sq   = sqrt(sqSq);
+        const double rx   = t.longRad - shortRad + t.isigro * sq;
+        const double drx  = -t.isigro * xx * normalized_dir.x / sq;
+        const double ddrx = -t.isigro * normalized_dir.x * normalized_dir.x * shortRad * shortRad / (sq * sq * sq);
+
+        const double func = -rx * rx + (yy - t.longRad) * (yy - t.longRad) + zz * zz;
+        const double df   = -2 * rx * drx + 2 * (yy - t.longRad) * normalized_dir.y + 2 * zz;
+        const double ddf  = -2 * drx * drx - 2 * rx * ddrx + 2 * normalized_dir.y * normalized_dir.y + 2;
+
+        const double dz = 2 * func * df / (2 * df * df - func * ddf);
+        if (!isfinite(dz)) break;
+
+        zz -= dz;
+        numIterations += 1;
+        converged = glm::abs(dz) <= HALLEY_TOLERANCE;
+    }
+
+    const double xx   = x0 + normalized_dir.x * zz;
+    const double sqSq = shortRad * shortRad - xx * xx;
+
+    if (!converged || !(sqSq > 0)) {
+        int numIterationsNewton = 0;
+        const auto col          = getToroidCollisionNewton(rayPosition, rayDirection, toroid, isTriangul, numIterationsNewton);
+        numIterations += numIterationsNewton;
         return col;
+    }
 
-    glm::dvec3 rayToHitpoint = col.hitpoint - rayPosition;
-    // edit: if ray points away from the hitpoint, no collision can be found.
-    // Note that multiplying the rays direction with -1 SHOULD totally have an effect on the collision detection - in most cases this 180° rotation
-    // will make the ray point away from the toroid, and hence preventing a Collision completely. The above code however, is unaffected when
-    // multiplying the ray direction with -1. Due to it having no effect on `glm::dvec3 normalized_dir = glm::dvec3(rayDirection) / rayDirection.z;`
-    if (dot(rayToHitpoint, rayDirection) <= 0.0) return std::nullopt;
+    const double yy = y0 + normalized_dir.y * zz;
+    return makeToroidCollision(rayPosition, rayDirection, glm::dvec3(xx, yy, zz), toroidNormal(t, xx, yy, zz, sqrt(sqSq)), isTriangul);
+}
 
+RAYX_FN_ACC
+OptCollisionPoint getToroidCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                     const Surface::Toroid& __restrict toroid, bool isTriangul, TraceCounter* __restrict counters) {
+    int numIterations = 0;
+#ifdef RAYX_FAST_TOROID_COLLISION
+    const auto col = getToroidCollisionHalley(rayPosition, rayDirection, toroid, isTriangul, numIterations);
+#else
+    const auto col = getToroidCollisionNewton(rayPosition, rayDirection, toroid, isTriangul, numIterations);
+#endif
+    RAYX_TRACE_COUNT(counters, TraceCounterColumn::ToroidIterations, numIterations);
     return col;
 }
 
@@ -455,21 +607,26 @@ OptCollisionPoint getPlaneCollision(const glm::dvec3& __restrict rayPosition, co
  **************************************************************/
 
 // TODO: remove parameter isTriangul, which is required by RAUX-UI
-RAYX_FN_ACC
-OptCollisionPoint findCollisionInElementCoordsWithoutSlopeError(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                                                const Surface& __restrict surface, const Cutout& __restrict cutout, bool isTriangul) {
-    OptCollisionPoint col = surface.visit([&]<typename T>([[maybe_unused]] const T& surface) {
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC OptCollisionPoint findCollisionInElementCoordsWithoutSlopeError(const glm::dvec3& __restrict rayPosition,
+                                                                            const glm::dvec3& __restrict rayDirection,
+                                                                            const Surface& __restrict surface, const Cutout& __restrict cutout,
+                                                                            bool isTriangul, TraceCounter* __restrict counters = nullptr) {
+    using Filter = ElementTypeFilter<ElementTypes>;
+
+    RAYX_TRACE_COUNT(counters, TraceCounterColumn::ElementsTested, 1);
+
+    OptCollisionPoint col = surface.visitFiltered<Filter::template Filter>([&]<typename T>([[maybe_unused]] const T& surface) {
         if constexpr (std::is_same_v<T, Surface::Plane>) {
             return getPlaneCollision(rayPosition, rayDirection);
         } else if constexpr (std::is_same_v<T, Surface::Quadric>) {
             return getQuadricCollision(rayPosition, rayDirection, surface);
         } else if constexpr (std::is_same_v<T, Surface::Cubic>) {
-            return getCubicCollision(rayPosition, rayDirection, surface);
+            return getCubicCollision(rayPosition, rayDirection, surface, counters);
         } else if constexpr (std::is_same_v<T, Surface::Toroid>) {
-            return getToroidCollision(rayPosition, rayDirection, surface, isTriangul);
+            return getToroidCollision(rayPosition, rayDirection, surface, isTriangul, counters);
         } else {
-            _throw("invalid surface type!");
-            return std::nullopt;
+            static_assert(!std::is_same_v<T, T>, "findCollisionInElementCoords: unhandled surface type");
         }
     });
 
@@ -488,12 +645,20 @@ OptCollisionPoint findCollisionInElementCoordsWithoutSlopeError(const glm::dvec3
     return col;
 }
 
+RAYX_FN_ACC
+OptCollisionPoint findCollisionInElementCoordsWithoutSlopeError(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                                const Surface& __restrict surface, const Cutout& __restrict cutout, bool isTriangul) {
+    return findCollisionInElementCoordsWithoutSlopeError<ElementTypeMask::All>(rayPosition, rayDirection, surface, cutout, isTriangul);
+}
+
 // checks whether `r` collides with the element of the given `id`,
 // and returns a Collision accordingly.
-RAYX_FN_ACC
-OptCollisionPoint findCollisionInElementCoords(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                               const OpticalElement& __restrict element, Rand& __restrict rand) {
-    auto col = findCollisionInElementCoordsWithoutSlopeError(rayPosition, rayDirection, element.m_surface, element.m_cutout, false);
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC OptCollisionPoint findCollisionInElementCoords(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                           const OpticalElement& __restrict element, Rand& __restrict rand,
+                                                           TraceCounter* __restrict counters) {
+    auto col =
+        findCollisionInElementCoordsWithoutSlopeError<ElementTypes>(rayPosition, rayDirection, element.m_surface, element.m_cutout, false, counters);
 
     if (!col) return std::nullopt;
 
@@ -503,10 +668,11 @@ OptCollisionPoint findCollisionInElementCoords(const glm::dvec3& __restrict rayP
     return col;
 }
 
-RAYX_FN_ACC
-OptCollisionWithElement findCollisionWithElements(glm::dvec3 rayPosition, glm::dvec3 rayDirection, const OpticalElement* __restrict elements,
-                                                  const ObjectTransform* __restrict objectTransforms, const int numSources, const int numElements,
-                                                  Rand& __restrict rand) {
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC OptCollisionWithElement findCollisionWithElements(glm::dvec3 rayPosition, glm::dvec3 rayDirection,
+                                                              const OpticalElement* __restrict elements,
+                                                              const ObjectTransform* __restrict objectTransforms, const int numSources,
+                                                              const int numElements, Rand& __restrict rand, TraceCounter* __restrict counters) {
     // global coordinates of first intersection point of ray among all elements in beamline
     OptCollisionPoint best_col = std::nullopt;
 
@@ -527,7 +693,7 @@ OptCollisionWithElement findCollisionWithElements(glm::dvec3 rayPosition, glm::d
 
         rayMatrixMult(objectTransforms[elementIndex + numSources].m_inTrans, rayPosition, rayDirection);
 
-        const auto current_col = findCollisionInElementCoords(rayPosition, rayDirection, element, rand);
+        const auto current_col = findCollisionInElementCoords<ElementTypes>(rayPosition, rayDirection, element, rand, counters);
         if (current_col) {
             // calculate distance from ray start to intersection point. doing this in element coordinates is totally fine.
             const auto current_dist = glm::length(current_col->hitpoint - rayPosition);
@@ -546,4 +712,183 @@ OptCollisionWithElement findCollisionWithElements(glm::dvec3 rayPosition, glm::d
     return CollisionWithElement{.point = *best_col, .elementIndex = best_element};
 }
 
+/**************************************************************
+ *                    Mixed precision collision finder
+ **************************************************************/
+namespace {
+
+/// relative tolerance of the single precision screening. decisions that are not clear within this tolerance are left to double precision
+constexpr float SCREENING_TOLERANCE = 1e-4f;
+
+enum class Screening { Miss, Candidate, NotScreened };
+
+// single precision version of getQuadricCollision, without the check for hitpoints behind the ray. the axes are permuted instead of
+// branching on the dominant direction component, see getQuadricCollisionPacket
+RAYX_FN_ACC inline Screening screenQuadricCollision(const glm::vec3& __restrict pos, const glm::vec3& __restrict dir,
+                                                    const Surface::Quadric& __restrict q, glm::vec3& __restrict hitpoint) {
+    const bool csY = glm::abs(dir.y) >= glm::abs(dir.x) && glm::abs(dir.y) >= glm::abs(dir.z);
+    const bool csZ = !csY && glm::abs(dir.z) >= glm::abs(dir.x) && glm::abs(dir.z) >= glm::abs(dir.y);
+
+    const float du = csY ? dir.y : csZ ? dir.z : dir.x;
+    const float dv = csY ? dir.x : csZ ? dir.x : dir.y;
+    const float dw = csY ? dir.z : csZ ? dir.y : dir.z;
+    const float pu = csY ? pos.y : csZ ? pos.z : pos.x;
+    const float pv = csY ? pos.x : csZ ? pos.x : pos.y;
+    const float pw = csY ? pos.z : csZ ? pos.y : pos.z;
+
+    const float a_uu = static_cast<float>(csY ? q.m_a22 : csZ ? q.m_a33 : q.m_a11);
+    const float a_vv = static_cast<float>(csY ? q.m_a11 : csZ ? q.m_a11 : q.m_a22);
+    const float a_ww = static_cast<float>(csY ? q.m_a33 : csZ ? q.m_a22 : q.m_a33);
+    const float a_uv = static_cast<float>(csY ? q.m_a12 : csZ ? q.m_a13 : q.m_a12);
+    const float a_uw = static_cast<float>(csY ? q.m_a23 : csZ ? q.m_a23 : q.m_a13);
+    const float a_vw = static_cast<float>(csY ? q.m_a13 : csZ ? q.m_a12 : q.m_a23);
+    const float a_u4 = static_cast<float>(csY ? q.m_a24 : csZ ? q.m_a34 : q.m_a14);
+    const float a_v4 = static_cast<float>(csY ? q.m_a14 : csZ ? q.m_a14 : q.m_a24);
+    const float a_w4 = static_cast<float>(csY ? q.m_a34 : csZ ? q.m_a24 : q.m_a34);
+    const float a_44 = static_cast<float>(q.m_a44);
+
+    const float r1     = dv / du;
+    const float r2     = dw / du;
+    const float v0     = pv - r1 * pu;
+    const float w0     = pw - r2 * pu;
+    const float d_sign = glm::sign(du) * static_cast<float>(q.m_icurv);
+    const float a      = a_uu + 2 * a_uv * r1 + a_vv * r1 * r1 + 2 * a_uw * r2 + 2 * a_vw * r1 * r2 + a_ww * r2 * r2;
+    const float b      = a_u4 + a_v4 * r1 + a_w4 * r2 + (a_uv + a_vv * r1 + a_vw * r2) * v0 + (a_uw + a_vw * r1 + a_ww * r2) * w0;
+    const float c      = a_44 + a_vv * v0 * v0 + 2 * a_w4 * w0 + a_ww * w0 * w0 + 2 * v0 * (a_v4 + a_vw * w0);
+    const float bbac   = b * b - a * c;
+
+    // the surface is only missed, if the discriminant is clearly negative
+    if (bbac < -SCREENING_TOLERANCE * (b * b + glm::abs(a * c))) return Screening::Miss;
+
+    // select the same root as getQuadricCollision, using the form that avoids cancellation. (-b + d * s) / a == c / (-b - d * s)
+    const float sq = glm::sqrt(glm::max(bbac, 0.0f));
+    const float u  = (-b) * (d_sign * sq) >= 0 ? (-b + d_sign * sq) / a : c / (-b - d_sign * sq);
+    const float v  = v0 + r1 * u;
+    const float w  = w0 + r2 * u;
+
+    hitpoint = glm::vec3(csY ? v : csZ ? v : u, csY ? u : csZ ? w : v, csY ? w : csZ ? u : w);
+    return Screening::Candidate;
+}
+
+/// screens the collision of a ray with an element in single precision. planes and quadrics are screened, other surfaces are not.
+/// returns Screening::Miss only if the element is clearly missed. hits near the edge of the cutout or near the origin of the ray are
+/// candidates, because single precision can not decide them. for candidates, `distance` is the approximate distance to the hitpoint
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC inline Screening screenCollisionInElementCoords(const glm::vec3& __restrict pos, const glm::vec3& __restrict dir,
+                                                            const Surface& __restrict surface, const Cutout& __restrict cutout,
+                                                            float& __restrict distance, float& __restrict tolerance) {
+#if !defined(RAYX_CUDA_ENABLED)
+    // std::isfinite is not tagged as device function, when compiling with nvcc
+    using std::isfinite;
+#endif
+    using Filter = ElementTypeFilter<ElementTypes>;
+
+    glm::vec3 hitpoint;
+    const auto screening = surface.visitFiltered<Filter::template Filter>([&]<typename T>([[maybe_unused]] const T& surface) {
+        if constexpr (std::is_same_v<T, Surface::Plane>) {
+            hitpoint   = pos - dir * (pos.y / dir.y);
+            hitpoint.y = 0;
+            return Screening::Candidate;
+        } else if constexpr (std::is_same_v<T, Surface::Quadric>) {
+            return screenQuadricCollision(pos, dir, surface, hitpoint);
+        } else {
+            return Screening::NotScreened;
+        }
+    });
+
+    if (screening != Screening::Candidate) return screening;
+    if (!isfinite(hitpoint.x) || !isfinite(hitpoint.y) || !isfinite(hitpoint.z)) return Screening::NotScreened;
+
+    // absolute error bound of the single precision computation
+    tolerance = SCREENING_TOLERANCE * (1 + glm::max(glm::length(pos), glm::length(hitpoint)));
+
+    // the hitpoint is clearly behind the ray
+    if (glm::dot(hitpoint - pos, dir) < -tolerance) return Screening::Miss;
+
+    // the hitpoint is clearly outside of the cutout. the cutout is applied in the XZ plane
+    const bool maybeInCutout = inCutout(cutout, hitpoint.x, hitpoint.z) || inCutout(cutout, hitpoint.x - tolerance, hitpoint.z) ||
+                               inCutout(cutout, hitpoint.x + tolerance, hitpoint.z) || inCutout(cutout, hitpoint.x, hitpoint.z - tolerance) ||
+                               inCutout(cutout, hitpoint.x, hitpoint.z + tolerance);
+    if (!maybeInCutout) return Screening::Miss;
+
+    distance = glm::length(hitpoint - pos);
+    return Screening::Candidate;
+}
+
+}  // unnamed namespace
+
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC OptCollisionWithElement findCollisionWithElementsMixedPrecision(glm::dvec3 rayPosition, glm::dvec3 rayDirection,
+                                                                            const OpticalElement* __restrict elements,
+                                                                            const ObjectTransform* __restrict objectTransforms,
+                                                                            const int numSources, const int numElements, Rand& __restrict rand,
+                                                                            TraceCounter* __restrict counters) {
+    // element coordinates of the closest intersection point found so far, computed in double precision
+    OptCollisionPoint best_col = std::nullopt;
+    auto best_dist             = std::numeric_limits<double>::max();
+    auto best_element          = 0;
+
+    // move ray slightly forward. see findCollisionWithElements
+    rayPosition += rayDirection * COLLISION_EPSILON;
+
+    const auto rayPositionSingle  = glm::vec3(rayPosition);
+    const auto rayDirectionSingle = glm::vec3(rayDirection);
+
+    for (int elementIndex = 0; elementIndex < numElements; ++elementIndex) {
+        const auto& element = elements[elementIndex];
+        const auto& inTrans = objectTransforms[elementIndex + numSources].m_inTrans;
+
+        // screen the element in single precision, and skip it if it is clearly missed or clearly farther away than the best hit so far
+        const auto inTransSingle = glm::mat4(inTrans);
+        const auto pos           = glm::vec3(inTransSingle * glm::vec4(rayPositionSingle, 1));
+        const auto dir           = glm::vec3(inTransSingle * glm::vec4(rayDirectionSingle, 0));
+        float distance           = 0;
+        float tolerance          = 0;
+        const auto screening = screenCollisionInElementCoords<ElementTypes>(pos, dir, element.m_surface, element.m_cutout, distance, tolerance);
+
+        if (screening == Screening::Miss) continue;
+        if (screening == Screening::Candidate && distance - tolerance > best_dist) continue;
+
+        // recompute the hit in double precision
+        const auto position    = glm::dvec3(inTrans * glm::dvec4(rayPosition, 1));
+        const auto direction   = glm::dvec3(inTrans * glm::dvec4(rayDirection, 0));
+        const auto current_col = findCollisionInElementCoordsWithoutSlopeError<ElementTypes>(position, direction, element.m_surface, element.m_cutout,
+                                                                                             false, counters);
+        if (current_col) {
+            const auto current_dist = glm::length(current_col->hitpoint - position);
+
+            if (current_dist < best_dist) {
+                best_col     = current_col;
+                best_dist    = current_dist;
+                best_element = elementIndex;
+            }
+        }
+    }
+
+    if (!best_col) return std::nullopt;
+
+    // the slope error is only applied to the closest hit
+    best_col->normal = applySlopeError(best_col->normal, elements[best_element].m_slopeError, 0, rand);
+
+    return CollisionWithElement{.point = *best_col, .elementIndex = best_element};
+}
+
+static_assert(std::size(TRACE_ELEMENT_TYPE_MASKS) == 2, "instantiate the collision functions for each element type mask");
+
+#define RAYX_INSTANTIATE_COLLISION(ElementTypes)                                                                                                  \
+    template RAYX_FN_ACC OptCollisionPoint findCollisionInElementCoords<ElementTypes>(const glm::dvec3& __restrict, const glm::dvec3& __restrict, \
+                                                                                      const OpticalElement& __restrict, Rand& __restrict,         \
+                                                                                      int* __restrict);                                           \
+    template RAYX_FN_ACC OptCollisionWithElement findCollisionWithElements<ElementTypes>(                                                         \
+        glm::dvec3, glm::dvec3, const OpticalElement* __restrict, const ObjectTransform* __restrict, const int, const int, Rand& __restrict,     \
+        int* __restrict);                                                                                                                         \
+    template RAYX_FN_ACC OptCollisionWithElement findCollisionWithElementsMixedPrecision<ElementTypes>(                                           \
+        glm::dvec3, glm::dvec3, const OpticalElement* __restrict, const ObjectTransform* __restrict, const int, const int, Rand& __restrict,     \
+        int* __restrict);
+
+RAYX_INSTANTIATE_COLLISION(TRACE_ELEMENT_TYPE_MASKS[0])
+RAYX_INSTANTIATE_COLLISION(TRACE_ELEMENT_TYPE_MASKS[1])
+
+#undef RAYX_INSTANTIATE_COLLISION
+
 }  // namespace rayx
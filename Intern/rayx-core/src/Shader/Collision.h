@@ -4,6 +4,7 @@
 
 #include "Core.h"
 #include "Element/Cutout.h"
+#include "Element/ElementTypeMask.h"
 #include "InvocationState.h"
 #include "Rand.h"
 #include "Ray.h"
@@ -24,25 +25,60 @@ struct CollisionWithElement {
 static_assert(std::is_trivially_copyable_v<CollisionWithElement>);
 using OptCollisionWithElement = std::optional<CollisionWithElement>;
 
-RAYX_FN_ACC OptCollisionPoint getQuadricCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                                  const Surface::Quadric& __restrict quadric);
+RAYX_FN_ACC OptCollisionPoint RAYX_BENCH_API getQuadricCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                                 const Surface::Quadric& __restrict quadric);
 
-RAYX_FN_ACC OptCollisionPoint getCubicCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                                const Surface::Cubic& __restrict cu);
+// `counters` is the performance counter row of the block (see TraceCounters.h). the iterations of the collision are added to it, unless it is nullptr
 
-RAYX_FN_ACC OptCollisionPoint getToroidCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                                 const Surface::Toroid& __restrict toroid, bool isTriangul);
+RAYX_FN_ACC OptCollisionPoint RAYX_BENCH_API getCubicCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                               const Surface::Cubic& __restrict cu, TraceCounter* __restrict counters = nullptr);
+
+RAYX_FN_ACC OptCollisionPoint RAYX_BENCH_API getToroidCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                                const Surface::Toroid& __restrict toroid, bool isTriangul,
+                                                                TraceCounter* __restrict counters = nullptr);
+
+// toroid collision using the newton method of RAY-UI. this is used by getToroidCollision, unless RAYX_FAST_TOROID_COLLISION is defined.
+// `numIterations` returns the number of iterations
+RAYX_FN_ACC OptCollisionPoint RAYX_API getToroidCollisionNewton(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                                const Surface::Toroid& __restrict toroid, bool isTriangul,
+                                                                int& __restrict numIterations);
+
+// toroid collision using halley's method, starting at the osculating paraboloid. more accurate and requires fewer iterations than the newton
+// method, but results are not identical to RAY-UI. this is used by getToroidCollision, if RAYX_FAST_TOROID_COLLISION is defined.
+// `numIterations` returns the number of iterations, including the iterations of a fallback to the newton method
+RAYX_FN_ACC OptCollisionPoint RAYX_API getToroidCollisionHalley(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                                const Surface::Toroid& __restrict toroid, bool isTriangul,
+                                                                int& __restrict numIterations);
 
 RAYX_FN_ACC OptCollisionPoint RAYX_API findCollisionInElementCoordsWithoutSlopeError(const glm::dvec3& __restrict rayPosition,
                                                                                      const glm::dvec3& __restrict rayDirection,
                                                                                      const Surface& __restrict surface,
                                                                                      const Cutout& __restrict cutout, bool isTriangul);
 
+// the following functions are specialized on the element types that may occur. see ElementTypeMask
+// `counters` is the performance counter row of the block (see TraceCounters.h), or nullptr
+
+template <ElementTypeMask ElementTypes>
 RAYX_FN_ACC OptCollisionPoint findCollisionInElementCoords(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
-                                                           const OpticalElement& __restrict element, Rand& __restrict rand);
+                                                           const OpticalElement& __restrict element, Rand& __restrict rand,
+                                                           TraceCounter* __restrict counters = nullptr);
+
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC OptCollisionWithElement RAYX_API findCollisionWithElements(glm::dvec3 rayPosition, glm::dvec3 rayDirection,
+                                                                       const OpticalElement* __restrict elements,
+                                                                       const ObjectTransform* __restrict objectTransforms, const int numSources,
+                                                                       const int numElements, Rand& __restrict rand,
+                                                                       TraceCounter* __restrict counters = nullptr);
 
-RAYX_FN_ACC OptCollisionWithElement findCollisionWithElements(glm::dvec3 rayPosition, glm::dvec3 rayDirection,
-                                                              const OpticalElement* __restrict elements, const ObjectTransform* __restrict,
-                                                              const int numSources, const int numElements, Rand& __restrict rand);
+// same as findCollisionWithElements, but the elements are screened in single precision first. only elements that may be hit before the closest
+// hit found so far are intersected in double precision. the slope error is only applied to the closest hit, so the random numbers drawn differ
+// from findCollisionWithElements if several elements with slope errors are hit. used if RAYX_MIXED_PRECISION_COLLISION is defined
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC OptCollisionWithElement RAYX_API findCollisionWithElementsMixedPrecision(glm::dvec3 rayPosition, glm::dvec3 rayDirection,
+                                                                                     const OpticalElement* __restrict elements,
+                                                                                     const ObjectTransform* __restrict objectTransforms,
+                                                                                     const int numSources, const int numElements,
+                                                                                     Rand& __restrict rand,
+                                                                                     TraceCounter* __restrict counters = nullptr);
 
 }  // namespace rayx
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Core.h"
+#include "Element/Cutout.h"
+#include "Element/Surface.h"
+#include "Variant.h"
+
+namespace rayx {
+
+// Packet versions of the plane and quadric collision functions (see Collision.h).
+// A packet holds a fixed number of rays in structure-of-arrays layout and all rays of a packet are intersected with the same surface.
+// The surface and cutout variants are visited once per packet, and the per-lane loops are written without data dependent branches, so that the
+// compiler can map them onto SIMD registers (4 lanes for AVX2, 8 lanes for AVX-512).
+// The arithmetic per lane is the same as in the scalar functions, so results are bitwise identical to the scalar path.
+
+/// number of rays in a packet used by the cpu tracer
+constexpr int RAY_PACKET_SIZE = 4;
+
+template <int N>
+struct RayPacket {
+    double positionX[N];
+    double positionY[N];
+    double positionZ[N];
+    double directionX[N];
+    double directionY[N];
+    double directionZ[N];
+
+    RAYX_FN_ACC inline void set(const int lane, const glm::dvec3& position, const glm::dvec3& direction) {
+        positionX[lane]  = position.x;
+        positionY[lane]  = position.y;
+        positionZ[lane]  = position.z;
+        directionX[lane] = direction.x;
+        directionY[lane] = direction.y;
+        directionZ[lane] = direction.z;
+    }
+
+    RAYX_FN_ACC inline glm::dvec3 position(const int lane) const { return glm::dvec3(positionX[lane], positionY[lane], positionZ[lane]); }
+    RAYX_FN_ACC inline glm::dvec3 direction(const int lane) const { return glm::dvec3(directionX[lane], directionY[lane], directionZ[lane]); }
+};
+
+template <int N>
+struct CollisionPacket {
+    double hitpointX[N];
+    double hitpointY[N];
+    double hitpointZ[N];
+    double normalX[N];
+    double normalY[N];
+    double normalZ[N];
+    bool found[N];
+
+    RAYX_FN_ACC inline glm::dvec3 hitpoint(const int lane) const { return glm::dvec3(hitpointX[lane], hitpointY[lane], hitpointZ[lane]); }
+    RAYX_FN_ACC inline glm::dvec3 normal(const int lane) const { return glm::dvec3(normalX[lane], normalY[lane], normalZ[lane]); }
+};
+
+/// returns true if the packet path supports this surface. other surfaces need to go through the scalar collision functions
+RAYX_FN_ACC inline bool isPacketSurface(const Surface& surface) { return surface.is<Surface::Plane>() || surface.is<Surface::Quadric>(); }
+
+template <int N>
+RAYX_FN_ACC inline void getPlaneCollisionPacket(const RayPacket<N>& __restrict rays, CollisionPacket<N>& __restrict col) {
+    for (int lane = 0; lane < N; ++lane) {
+        const double time = -rays.positionY[lane] / rays.directionY[lane];
+
+        col.found[lane]     = !(time < 0);
+        col.normalX[lane]   = 0;
+        col.normalY[lane]   = -glm::sign(rays.directionY[lane]);
+        col.normalZ[lane]   = 0;
+        col.hitpointX[lane] = rays.positionX[lane] + rays.directionX[lane] * time;
+        col.hitpointY[lane] = 0;
+        col.hitpointZ[lane] = rays.positionZ[lane] + rays.directionZ[lane] * time;
+    }
+}
+
+template <int N>
+RAYX_FN_ACC inline void getQuadricCollisionPacket(const RayPacket<N>& __restrict rays, const Surface::Quadric& __restrict q,
+                                                  CollisionPacket<N>& __restrict col) {
+    for (int lane = 0; lane < N; ++lane) {
+        const double px = rays.positionX[lane];
+        const double py = rays.positionY[lane];
+        const double pz = rays.positionZ[lane];
+        const double dx = rays.directionX[lane];
+        const double dy = rays.directionY[lane];
+        const double dz = rays.directionZ[lane];
+
+        // the scalar version branches on the dominant direction component `cs`. the three branches only differ in a permutation of the axes,
+        // so we select the permuted coefficients instead: u is the dominant axis, v and w are the remaining axes in ascending order.
+        const bool csY = glm::abs(dy) >= glm::abs(dx) && glm::abs(dy) >= glm::abs(dz);
+        const bool csZ = !csY && glm::abs(dz) >= glm::abs(dx) && glm::abs(dz) >= glm::abs(dy);
+
+        const double du = csY ? dy : csZ ? dz : dx;
+        const double dv = csY ? dx : csZ ? dx : dy;
+        const double dw = csY ? dz : csZ ? dy : dz;
+        const double pu = csY ? py : csZ ? pz : px;
+        const double pv = csY ? px : csZ ? px : py;
+        const double pw = csY ? pz : csZ ? py : pz;
+
+        const double a_uu = csY ? q.m_a22 : csZ ? q.m_a33 : q.m_a11;
+        const double a_vv = csY ? q.m_a11 : csZ ? q.m_a11 : q.m_a22;
+        const double a_ww = csY ? q.m_a33 : csZ ? q.m_a22 : q.m_a33;
+        const double a_uv = csY ? q.m_a12 : csZ ? q.m_a13 : q.m_a12;
+        const double a_uw = csY ? q.m_a23 : csZ ? q.m_a23 : q.m_a13;
+        const double a_vw = csY ? q.m_a13 : csZ ? q.m_a12 : q.m_a23;
+        const double a_u4 = csY ? q.m_a24 : csZ ? q.m_a34 : q.m_a14;
+        const double a_v4 = csY ? q.m_a14 : csZ ? q.m_a14 : q.m_a24;
+        const double a_w4 = csY ? q.m_a34 : csZ ? q.m_a24 : q.m_a34;
+
+        const double r1     = dv / du;
+        const double r2     = dw / du;
+        const double v0     = pv - r1 * pu;
+        const double w0     = pw - r2 * pu;
+        const int d_sign    = int(glm::sign(du) * q.m_icurv);
+        const double a      = a_uu + 2 * a_uv * r1 + a_vv * r1 * r1 + 2 * a_uw * r2 + 2 * a_vw * r1 * r2 + a_ww * r2 * r2;
+        const double b      = a_u4 + a_v4 * r1 + a_w4 * r2 + (a_uv + a_vv * r1 + a_vw * r2) * v0 + (a_uw + a_vw * r1 + a_ww * r2) * w0;
+        const double c      = q.m_a44 + a_vv * v0 * v0 + 2 * a_w4 * w0 + a_ww * w0 * w0 + 2 * v0 * (a_v4 + a_vw * w0);
+        const double bbac   = b * b - a * c;
+        const bool isSolved = !(bbac < 0);
+
+        // both roots are evaluated and one is selected. the discarded one may be nan, which is harmless
+        const double rootQuadratic = (-b + d_sign * sqrt(isSolved ? bbac : 0.0)) / a;
+        const double rootLinear    = (-c / 2) / b;
+        const double u             = glm::abs(a) > glm::abs(c) * 1e-10 ? rootQuadratic : rootLinear;
+        const double v             = v0 + r1 * u;
+        const double w             = w0 + r2 * u;
+
+        const double x = csY ? v : csZ ? v : u;
+        const double y = csY ? u : csZ ? w : v;
+        const double z = csY ? w : csZ ? u : w;
+
+        // intersection point is in the negative direction (behind the position when the direction is followed forwards)
+        const bool isBehind = (x - px) / dx < 0 || (y - py) / dy < 0 || (z - pz) / dz < 0;
+
+        const double fx     = 2 * q.m_a14 + 2 * q.m_a11 * x + 2 * q.m_a12 * y + 2 * q.m_a13 * z;
+        const double fy     = 2 * q.m_a24 + 2 * q.m_a12 * x + 2 * q.m_a22 * y + 2 * q.m_a23 * z;
+        const double fz     = 2 * q.m_a34 + 2 * q.m_a13 * x + 2 * q.m_a23 * y + 2 * q.m_a33 * z;
+        const auto normal   = glm::normalize(glm::dvec3(fx, fy, fz));
+        col.found[lane]     = isSolved && !isBehind;
+        col.hitpointX[lane] = x;
+        col.hitpointY[lane] = y;
+        col.hitpointZ[lane] = z;
+        col.normalX[lane]   = normal.x;
+        col.normalY[lane]   = normal.y;
+        col.normalZ[lane]   = normal.z;
+    }
+}
+
+/// clears `col.found` for all lanes whose hitpoint lies outside the cutout. the cutout is applied in the XZ plane.
+template <int N>
+RAYX_FN_ACC inline void applyCutoutPacket(const Cutout& __restrict cutout, CollisionPacket<N>& __restrict col) {
+    cutout.visit([&]<typename T>(const T& cutout_type) {
+        if constexpr (std::is_same_v<T, Cutout::Unlimited>) {
+            return;
+        } else if constexpr (std::is_same_v<T, Cutout::Rect>) {
+            const double x_min = -cutout_type.m_width / 2.0;
+            const double x_max = cutout_type.m_width / 2.0;
+            const double z_min = -cutout_type.m_length / 2.0;
+            const double z_max = cutout_type.m_length / 2.0;
+
+            for (int lane = 0; lane < N; ++lane) {
+                const double x = col.hitpointX[lane];
+                const double z = col.hitpointZ[lane];
+                col.found[lane] &= !(x <= x_min || x >= x_max || z <= z_min || z >= z_max);
+            }
+        } else if constexpr (std::is_same_v<T, Cutout::Trapezoid>) {
+            // see inCutout for the naming of the corners
+            const auto A   = glm::dvec2(-cutout_type.m_widthA / 2.0, -cutout_type.m_length / 2.0);
+            const auto B   = glm::dvec2(cutout_type.m_widthA / 2.0, -cutout_type.m_length / 2.0);
+            const auto C   = glm::dvec2(cutout_type.m_widthB / 2.0, cutout_type.m_length / 2.0);
+            const auto D   = glm::dvec2(-cutout_type.m_widthB / 2.0, cutout_type.m_length / 2.0);
+            const auto BmA = B - A;
+            const auto CmD = C - D;
+            const auto DmA = D - A;
+            const auto CmB = C - B;
+
+            for (int lane = 0; lane < N; ++lane) {
+                const auto P   = glm::dvec2(col.hitpointX[lane], col.hitpointZ[lane]);
+                const auto PmA = P - A;
+                const auto PmD = P - D;
+                const auto PmB = P - B;
+
+                const double l1 = (PmA.x * BmA.y - PmA.y * BmA.x) * (PmD.x * CmD.y - PmD.y * CmD.x);
+                const double l2 = (PmA.x * DmA.y - PmA.y * DmA.x) * (PmB.x * CmB.y - PmB.y * CmB.x);
+                col.found[lane] &= l1 < 0 && l2 < 0;
+            }
+        } else if constexpr (std::is_same_v<T, Cutout::Elliptical>) {
+            const double radius_x = cutout_type.m_diameter_x / 2.0;
+            const double radius_z = cutout_type.m_diameter_z / 2.0;
+
+            for (int lane = 0; lane < N; ++lane) {
+                const double val1 = col.hitpointX[lane] / radius_x;
+                const double val2 = col.hitpointZ[lane] / radius_z;
+                const double rd2  = val1 * val1 + val2 * val2;
+                col.found[lane] &= rd2 <= 1.0;
+            }
+        }
+    });
+}
+
+/// packet version of findCollisionInElementCoordsWithoutSlopeError. requires isPacketSurface(surface)
+template <int N>
+RAYX_FN_ACC inline void findCollisionInElementCoordsWithoutSlopeErrorPacket(const RayPacket<N>& __restrict rays, const Surface& __restrict surface,
+                                                                            const Cutout& __restrict cutout, CollisionPacket<N>& __restrict col) {
+    surface.visit([&]<typename T>([[maybe_unused]] const T& surface) {
+        if constexpr (std::is_same_v<T, Surface::Plane>) {
+            getPlaneCollisionPacket(rays, col);
+        } else if constexpr (std::is_same_v<T, Surface::Quadric>) {
+            getQuadricCollisionPacket(rays, surface, col);
+        } else {
+            for (int lane = 0; lane < N; ++lane) col.found[lane] = false;
+        }
+    });
+
+    applyCutoutPacket(cutout, col);
+
+    // flip the normal to oppose the ray direction, see findCollisionInElementCoordsWithoutSlopeError
+    for (int lane = 0; lane < N; ++lane) {
+        const double d    = rays.directionX[lane] * col.normalX[lane] + rays.directionY[lane] * col.normalY[lane] + rays.directionZ[lane] * col.normalZ[lane];
+        const double flip = d > 0.0 ? -1.0 : 1.0;
+        col.normalX[lane] *= flip;
+        col.normalY[lane] *= flip;
+        col.normalZ[lane] *= flip;
+    }
+}
+
+}  // namespace rayx
@@ -1,6 +1,5 @@
 #include "CutoutFns.h"
 
-#include "Throw.h"
 #include "Variant.h"
 
 namespace rayx {
@@ -51,8 +50,7 @@ bool RAYX_API inCutout(Cutout cutout, double x, double z) {
             double rd2      = val1 * val1 + val2 * val2;
             return rd2 <= 1.0;
         } else {
-            _throw("invalid cutout type in inCutout!");
-            return false;
+            static_assert(!std::is_same_v<T, T>, "inCutout: unhandled cutout type");
         }
     });  // to ensure cutout is valid
 }
@@ -97,8 +95,7 @@ glm::dmat4 RAYX_API keyCutoutPoints(Cutout cutout) {
                               glm::dvec4(0.0, 0.0, -rz, 0.0)   // Bottom
             );
         } else {
-            _throw("invalid cutout type in keyCutoutPoints!");
-            return glm::dmat4(0.0);
+            static_assert(!std::is_same_v<T, T>, "keyCutoutPoints: unhandled cutout type");
         }
     });  // to ensure cutout is valid
 }
@@ -117,17 +114,4 @@ glm::dvec2 RAYX_API cutoutBoundingBox(Cutout cutout) {
     return ret;
 }
 
-// checks whether c1 is a subset of c2, and prints an error otherwise.
-// might not find all subset-violations, but should find most of them.
-// (might not find all Ellipsoid vs Trapezoid violations)
-RAYX_FN_ACC
-void RAYX_API assertCutoutSubset(Cutout c1, Cutout c2) {
-    glm::dmat4 keypoints = keyCutoutPoints(c1);
-    for (int i = 0; i < 4; i++) {
-        double x = keypoints[i][0];
-        double z = keypoints[i][2];
-        _assert(inCutout(c2, x, z), "assertCutoutSubset failed!");
-    }
-}
-
 }  // namespace rayx
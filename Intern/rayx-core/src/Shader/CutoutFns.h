@@ -16,9 +16,4 @@ RAYX_FN_ACC glm::dmat4 RAYX_API keyCutoutPoints(Cutout cutout);
 // returns width and length of the bounding box.
 RAYX_FN_ACC glm::dvec2 RAYX_API cutoutBoundingBox(Cutout cutout);
 
-// checks whether c1 is a subset of c2, and prints an error otherwise.
-// might not find all subset-violations, but should find most of them.
-// (might not find all Ellipsoid vs Trapezoid violations)
-RAYX_FN_ACC void RAYX_API assertCutoutSubset(Cutout c1, Cutout c2);
-
 }  // namespace rayx
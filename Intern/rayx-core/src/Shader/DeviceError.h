@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Core.h"
+#include "Ray.h"
+
+// Errors of the trace kernels. Instead of printing from the kernels, the trace functions return an error per ray, which the trace kernels append
+// to a small error buffer with atomics. The buffer holds a count and the first few errors per error code. It is transferred to the host per batch
+// (see reduceDeviceErrors), so the event types of the output do not need to be scanned for errors.
+
+namespace rayx {
+
+enum class DeviceErrorCode : int32_t {
+    None = 0,
+    /// the ray hit an element the kernels can not handle, e.g. a slit with an unsupported opening, or a material without refractive index for the
+    /// energy of the ray. the ray is terminated with EventType::FatalError
+    FatalError,
+    /// the ray went beyond the horizon while refracting (EventType::BeyondHorizon)
+    BeyondHorizon,
+    /// the ray would hit more elements than the maximum number of events (EventType::TooManyEvents)
+    TooManyEvents,
+    /// the object_id of an input ray is out of bounds of the beamline, e.g. in a ray list of another beamline. the ray is not traced
+    InvalidObjectId,
+    /// the ray terminated without an event type (EventType::Uninitialized), e.g. a ray of a ray list that was never emitted. its events in the
+    /// output are uninitialized
+    Uninitialized,
+};
+
+constexpr int NUM_DEVICE_ERROR_CODES = static_cast<int>(DeviceErrorCode::Uninitialized) + 1;
+
+/// number of errors kept per error code and batch. further errors are only counted
+constexpr int DEVICE_ERROR_RECORDS_PER_CODE = 16;
+
+inline std::string to_string(const DeviceErrorCode code) {
+    switch (code) {
+        case DeviceErrorCode::None:
+            return "none";
+        case DeviceErrorCode::FatalError:
+            return "fatal error";
+        case DeviceErrorCode::BeyondHorizon:
+            return "beyond horizon";
+        case DeviceErrorCode::TooManyEvents:
+            return "too many events";
+        case DeviceErrorCode::InvalidObjectId:
+            return "invalid object id";
+        case DeviceErrorCode::Uninitialized:
+            return "uninitialized";
+    }
+    return "unknown";
+}
+
+struct DeviceError {
+    DeviceErrorCode code = DeviceErrorCode::None;
+    /// the element the ray was on, or -1 if it was not on an element
+    int32_t elementIndex = -1;
+    /// the path_id of the ray
+    int64_t rayIndex = -1;
+};
+
+/// the error buffer of a batch in device memory
+struct DeviceErrorsPtr {
+    /// number of errors per error code
+    int* __restrict counts;
+    /// the first DEVICE_ERROR_RECORDS_PER_CODE errors per error code, in order of the error codes
+    DeviceError* __restrict records;
+};
+
+/// the error of a ray, derived from the event type it terminated with. DeviceErrorCode::None if the ray terminated regularly
+RAYX_FN_ACC inline DeviceError getDeviceError(const detail::Ray& __restrict ray, const int numSources) {
+    auto code = DeviceErrorCode::None;
+    if (ray.event_type == EventType::FatalError)
+        code = DeviceErrorCode::FatalError;
+    else if (ray.event_type == EventType::BeyondHorizon)
+        code = DeviceErrorCode::BeyondHorizon;
+    else if (ray.event_type == EventType::TooManyEvents)
+        code = DeviceErrorCode::TooManyEvents;
+    else if (ray.event_type == EventType::Uninitialized)
+        code = DeviceErrorCode::Uninitialized;
+
+    const auto elementIndex = ray.object_id - numSources;
+    return DeviceError{.code = code, .elementIndex = 0 <= elementIndex ? elementIndex : -1, .rayIndex = ray.path_id};
+}
+
+/// errors reported by the trace kernels, summed over all rays
+struct RAYX_API DeviceErrors {
+    /// number of rays per error code, indexed by DeviceErrorCode
+    std::array<int64_t, NUM_DEVICE_ERROR_CODES> numRaysPerCode = {};
+    /// the first errors per error code, at most DEVICE_ERROR_RECORDS_PER_CODE per error code
+    std::vector<DeviceError> records;
+
+    int64_t numRays(const DeviceErrorCode code) const { return numRaysPerCode[static_cast<int>(code)]; }
+
+    bool empty() const {
+        for (int i = 1; i < NUM_DEVICE_ERROR_CODES; ++i)
+            if (numRaysPerCode[i] != 0) return false;
+        return true;
+    }
+
+    DeviceErrors& operator+=(const DeviceErrors& other) {
+        for (int i = 0; i < NUM_DEVICE_ERROR_CODES; ++i) numRaysPerCode[i] += other.numRaysPerCode[i];
+
+        // keep the records of earlier batches, so the records do not grow with the number of batches
+        auto numRecordsPerCode = std::array<int, NUM_DEVICE_ERROR_CODES>{};
+        for (const auto& record : records) ++numRecordsPerCode[static_cast<int>(record.code)];
+        for (const auto& record : other.records) {
+            auto& numRecords = numRecordsPerCode[static_cast<int>(record.code)];
+            if (numRecords == DEVICE_ERROR_RECORDS_PER_CODE) continue;
+            records.push_back(record);
+            ++numRecords;
+        }
+        return *this;
+    }
+};
+
+/// collects the error counts and the kept errors of a batch
+inline DeviceErrors reduceDeviceErrors(const int* counts, const DeviceError* records) {
+    auto result = DeviceErrors{};
+    for (int i = 1; i < NUM_DEVICE_ERROR_CODES; ++i) {
+        result.numRaysPerCode[i] = counts[i];
+        const auto numRecords    = std::min(counts[i], DEVICE_ERROR_RECORDS_PER_CODE);
+        result.records.insert(result.records.end(), records + i * DEVICE_ERROR_RECORDS_PER_CODE,
+                              records + i * DEVICE_ERROR_RECORDS_PER_CODE + numRecords);
+    }
+    return result;
+}
+
+}  // namespace rayx
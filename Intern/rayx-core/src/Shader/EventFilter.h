@@ -0,0 +1,50 @@
+#pragma once
+
+#include <limits>
+
+#include "Core.h"
+#include "EventType.h"
+#include "Ray.h"
+
+namespace rayx {
+
+/**
+ * @brief Predicates on events, evaluated on the device when an event is recorded
+ * Events that fail any predicate are not stored, so they are neither compacted, transferred nor returned by the tracer. path_event_id still
+ * counts filtered events, so the result is the same as filtering the unfiltered result on the host. The default filter passes all events.
+ */
+struct RAYX_API EventFilter {
+    /// only events of these types pass
+    EventTypeMask eventTypes = EventTypeMask::All;
+    /// only events with an energy within [minEnergy, maxEnergy] pass
+    double minEnergy = std::numeric_limits<double>::lowest();
+    double maxEnergy = std::numeric_limits<double>::max();
+    /// only events with an order of diffraction within [minOrder, maxOrder] pass
+    int minOrder = std::numeric_limits<int>::lowest();
+    int maxOrder = std::numeric_limits<int>::max();
+    /// only events of rays emitted by a source with source_id within [minSourceId, maxSourceId] pass
+    int minSourceId = 0;
+    int maxSourceId = std::numeric_limits<int>::max();
+    /// events on the object with this object_id pass only if their position lies within [positionMin, positionMax]. positions of events on
+    /// elements are in element coordinates. events on other objects are not affected. -1 disables the position box
+    int positionBoxObjectId = -1;
+    glm::dvec3 positionMin  = glm::dvec3(std::numeric_limits<double>::lowest());
+    glm::dvec3 positionMax  = glm::dvec3(std::numeric_limits<double>::max());
+};
+
+RAYX_FN_ACC inline bool passesEventFilter(const detail::Ray& __restrict ray, const EventFilter& __restrict filter) {
+    if (!(eventTypeToMask(ray.event_type) & filter.eventTypes)) return false;
+    if (ray.energy < filter.minEnergy || filter.maxEnergy < ray.energy) return false;
+    if (ray.order < filter.minOrder || filter.maxOrder < ray.order) return false;
+    if (ray.source_id < filter.minSourceId || filter.maxSourceId < ray.source_id) return false;
+
+    if (ray.object_id == filter.positionBoxObjectId) {
+        const auto inside =
+            glm::all(glm::greaterThanEqual(ray.position, filter.positionMin)) && glm::all(glm::lessThanEqual(ray.position, filter.positionMax));
+        if (!inside) return false;
+    }
+
+    return true;
+}
+
+}  // namespace rayx
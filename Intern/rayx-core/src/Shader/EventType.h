@@ -37,10 +37,11 @@ enum class EventTypeMask : std::underlying_type_t<EventType> {
     Absorbed      = 1 << static_cast<int>(EventType::Absorbed),
     BeyondHorizon = 1 << static_cast<int>(EventType::BeyondHorizon),
     TooManyEvents = 1 << static_cast<int>(EventType::TooManyEvents),
+    All           = (1 << (static_cast<int>(EventType::TooManyEvents) + 1)) - 1,
 };
 
 RAYX_FN_ACC constexpr inline EventTypeMask operator|(const EventTypeMask lhs, const EventTypeMask rhs) {
-    return static_cast<EventTypeMask>(static_cast<std::underlying_type_t<EventTypeMask>>(lhs) &
+    return static_cast<EventTypeMask>(static_cast<std::underlying_type_t<EventTypeMask>>(lhs) |
                                       static_cast<std::underlying_type_t<EventTypeMask>>(rhs));
 }
 RAYX_FN_ACC constexpr inline EventTypeMask operator&(const EventTypeMask lhs, const EventTypeMask rhs) {
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "DeviceError.h"
 #include "Element/Element.h"
+#include "EventFilter.h"
 #include "RaysPtr.h"
+#include "TraceCounters.h"
 
 namespace rayx {
 
@@ -10,10 +13,23 @@ namespace rayx {
 /// On the other hand calling it with `Sequential::Yes` makes the meaning more clear.
 enum class Sequential { No, Yes };
 
+/// Selects which events of a ray path are recorded. In the LastEvent modes, the trace kernels overwrite the slot of a ray whenever an event is
+/// recorded, so the slot holds the last recorded event when the ray terminates. Event buffers are sized by the number of rays alone (times the
+/// number of recorded objects for LastEventPerObject), instead of rays times maxEvents.
+enum class RecordMode {
+    /// every recorded event
+    AllEvents,
+    /// only the last recorded event of each ray path. yields the same events as Rays::filterByLastEventInPath
+    LastEvent,
+    /// only the last recorded event of each ray path on each object
+    LastEventPerObject,
+};
+
 /// stores all constant buffers
 struct RAYX_API ConstState {
     int maxEvents;
     Sequential sequential = Sequential::No;
+    RecordMode recordMode = RecordMode::AllEvents;
     int numSources;
     int numElements;
     int outputEventsGridStride;
@@ -23,14 +39,26 @@ struct RAYX_API ConstState {
     int* __restrict materialIndices;
     double* __restrict materialTable;
     bool* __restrict objectRecordMask;  // Mask that decides which elements to record events for (array length is numElements)
+    int* __restrict objectRecordSlots;  // Dense slot of each recorded object among the event slots of a ray, -1 if not recorded (see ObjectIndexMask)
     RayAttrMask attrRecordMask;
+    EventFilter eventFilter;
     RaysPtr rays;
+    /// sequential tracing only. if not -1, `rays` are the states of the rays leaving this element, captured by a previous trace (see
+    /// captureElementIndex), and tracing resumes at the next element. events up to this element are not recorded again
+    int resumeElementIndex = -1;
+    /// sequential tracing only. if not -1, the state of each ray leaving this element is written to MutableState::capturedRays. rays that finish
+    /// before this element are written with their final state, so that a resumed trace reports their final event type and error without tracing
+    /// them
+    int captureElementIndex = -1;
 };
 
 /// stores all mutable buffers
 struct RAYX_API MutableState {
     RaysPtr events;
     bool* __restrict storedFlags;
+    TraceCounter* __restrict counters;  // the row of performance counters of the block, or nullptr if disabled (see TraceCounters.h)
+    RaysPtr capturedRays;               // one ray state per ray, only used if ConstState::captureElementIndex is set
+    DeviceErrorsPtr errors;             // errors of the rays, appended by the trace kernels (see DeviceError.h)
 };
 
 }  // namespace rayx
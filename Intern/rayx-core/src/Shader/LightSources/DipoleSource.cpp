@@ -395,7 +395,7 @@ DipoleSource::DipoleSource(const DesignSource& dSource)
  * @returns Ray
  */
 RAYX_FN_ACC
-detail::Ray DipoleSource::genRay(const int rayPathIndex, const int sourceId, Rand& __restrict rand) const {
+detail::Ray DipoleSource::genRay(const int64_t rayPathIndex, const int sourceId, Rand& __restrict rand) const {
     double phi, en;  // phi=horizontal Angle, en=energy
 
     // create ray with random position and divergence within the given span
@@ -33,7 +33,7 @@ class RAYX_API DipoleSource : public LightSourceBase {
   public:
     DipoleSource(const DesignSource&);
 
-    RAYX_FN_ACC detail::Ray genRay(const int rayPathIndex, const int sourceId, Rand& __restrict rand) const;
+    RAYX_FN_ACC detail::Ray genRay(const int64_t rayPathIndex, const int sourceId, Rand& __restrict rand) const;
 
   private:
     // calculate Ray-Information
@@ -25,13 +25,13 @@ MatrixSource::MatrixSource(const DesignSource& dSource)
  * returns vector of rays
  */
 RAYX_FN_ACC
-detail::Ray MatrixSource::genRay(const int rayPathIndex, const int sourceId, const EnergyDistributionDataVariant& __restrict energyDistribution,
+detail::Ray MatrixSource::genRay(const int64_t rayPathIndex, const int sourceId, const EnergyDistributionDataVariant& __restrict energyDistribution,
                                  Rand& __restrict rand) const {
     // Calculate grid size
     const int rmat  = static_cast<int>(std::sqrt(m_numberOfRays));
     const int nGrid = rmat * rmat;
-    const int row   = rayPathIndex % rmat;
-    const int col   = (rayPathIndex / rmat) % rmat;
+    const int row   = static_cast<int>(rayPathIndex % rmat);
+    const int col   = static_cast<int>((rayPathIndex / rmat) % rmat);
 
     // Count how many rays share this origin
     int originIndex   = row + rmat * col;
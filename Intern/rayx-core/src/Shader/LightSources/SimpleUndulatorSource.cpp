@@ -86,7 +86,7 @@ double SimpleUndulatorSource::getCoord(const double extent, Rand& __restrict ran
  * @returns list of rays
  */
 RAYX_FN_ACC
-detail::Ray SimpleUndulatorSource::genRay(const int rayPathIndex, const int sourceId,
+detail::Ray SimpleUndulatorSource::genRay(const int64_t rayPathIndex, const int sourceId,
                                           const EnergyDistributionDataVariant& __restrict energyDistribution, Rand& __restrict rand) const {
     // create ray with random position and divergence within the given span
     // for width, height, depth, horizontal and vertical divergence
@@ -2,7 +2,6 @@
 
 #include "Element/Behaviour.h"
 #include "ImageType.h"
-#include "Throw.h"
 
 namespace rayx {
 
@@ -41,10 +40,10 @@ double RAYX_API vlsGrating(double lineDensity, glm::dvec3 normal, double z, cons
 /**
 calculates DX and DZ (line spacing in x and z direction) at a given point for a
 given direction on the grating
-@returns: (inplace) DX, DZ
+@returns: (inplace) DX, DZ. false if the image type is not supported
 */
 RAYX_FN_ACC
-void RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::dvec3& __restrict normal, const Behaviour::RZP& __restrict b,
+bool RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::dvec3& __restrict normal, const Behaviour::RZP& __restrict b,
                              double& __restrict DX, double& __restrict DZ) {
     int IMAGE_TYPE = b.m_imageType;
     int RZP_TYPE   = b.m_rzpType;
@@ -146,7 +145,7 @@ void RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::d
         DZ = (ai + am) / (WL * Ord);
         DX = (-bi - bm) / (WL * Ord);
 
-        return;
+        return true;
     } else if (IMAGE_TYPE == IT_POINT2HORIZONTAL_LINE) {
         // TODO don't use magic constants
 
@@ -183,7 +182,7 @@ void RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::d
             ym = -((FX * X * (Z - rosag * c_beta)) / (Z + risag * c_alpha)) + FZ * (-Z + rosag * c_beta) + FY * (-Y + rosag * s_beta);
         }
     } else {
-        _throw("unsupported ImageType!");
+        return false;
     }
 
     double ris = glm::sqrt(zi * zi + xi * xi + yi * yi);
@@ -196,6 +195,7 @@ void RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::d
 
     DX = (ai + am) / (WL * Ord);
     DZ = (-bi - bm) / (WL * Ord);
+    return true;
 }
 
 }  // namespace rayx
@@ -19,9 +19,9 @@ RAYX_FN_ACC double RAYX_API vlsGrating(double lineDensity, glm::dvec3 normal, do
 calculates DX and DZ (line spacing in x and z direction) at a given point for a
 given direction on the grating
 @params: lots
-@returns: (inplace) DX, DZ
+@returns: (inplace) DX, DZ. false if the image type is not supported
 */
-RAYX_FN_ACC void RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::dvec3& __restrict normal,
+RAYX_FN_ACC bool RAYX_API RZPLineDensity(const glm::dvec3& __restrict position, const glm::dvec3& __restrict normal,
                                          const Behaviour::RZP& __restrict b, double& __restrict DX, double& __restrict DZ);
 
 }  // namespace rayx
@@ -27,6 +27,7 @@ RAYX_FN_ACC double RAYX_API squaresDoubleRNG(RandCounter& ctr);
 RAYX_FN_ACC double RAYX_API squaresNormalRNG(RandCounter& ctr, double mu, double sigma);
 
 struct Rand {
+    RAYX_FN_ACC
     Rand() noexcept {}
 
     Rand(const Rand&)            = delete;
@@ -38,7 +39,7 @@ struct Rand {
     explicit Rand(const RandCounter ctr) noexcept : counter(ctr) {}
 
     RAYX_FN_ACC
-    explicit Rand(const int rayPathIndex, const int numRaysTotal, const double randomSeed) noexcept {
+    explicit Rand(const int64_t rayPathIndex, const int64_t numRaysTotal, const double randomSeed) noexcept {
         // ray specific "seed" for random numbers -> every ray has a different starting value for the counter that creates the random number
         const RandCounter MAX_UINT64   = ~(static_cast<RandCounter>(0));
         const double MAX_UINT64_DOUBLE = 18446744073709551616.0;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "EventFilter.h"
+#include "InvocationState.h"
 #include "Ray.h"
 #include "RaysPtr.h"
 
@@ -8,6 +10,34 @@ namespace rayx {
 RAYX_FN_ACC
 inline int getRecordIndex(const int gid, const int numRecorded, const int gridStride) { return gid + numRecorded * gridStride; }
 
+/// slot of an event among the event slots of its ray. `eventSlot` is the slot of the event if all events are recorded (RecordMode::AllEvents).
+/// `objectSlot` is the dense slot of the object of the event (see ConstState::objectRecordSlots)
+RAYX_FN_ACC
+inline int getRecordSlot(const RecordMode recordMode, const int eventSlot, const int objectSlot) {
+    switch (recordMode) {
+        case RecordMode::LastEvent:
+            return 0;
+        case RecordMode::LastEventPerObject:
+            return objectSlot;
+        default:
+            return eventSlot;
+    }
+}
+
+/// number of event slots per ray. in non-sequential tracing, all events are recorded in order of occurrence, which requires `maxEvents` slots.
+/// otherwise events are recorded in the slot of their object, which requires `numObjectRecordSlots` slots
+RAYX_FN_ACC
+inline int getNumRecordSlots(const RecordMode recordMode, const Sequential sequential, const int maxEvents, const int numObjectRecordSlots) {
+    switch (recordMode) {
+        case RecordMode::LastEvent:
+            return 1;
+        case RecordMode::LastEventPerObject:
+            return numObjectRecordSlots;
+        default:
+            return sequential == Sequential::Yes ? numObjectRecordSlots : maxEvents;
+    }
+}
+
 RAYX_FN_ACC
 inline detail::Ray loadRay(const int i, const RaysPtr& __restrict rays) {
     return {
@@ -48,15 +78,23 @@ inline void storeRay(const int i, RaysPtr& __restrict rays, const detail::Ray& _
     rays.rand_counter[i]        = ray.rand.counter;
 }
 
-RAYX_FN_ACC
-inline bool storeRay(const int i, bool* __restrict storedFlags, RaysPtr& __restrict rays, detail::Ray& __restrict ray,
-                     const bool* __restrict objectRecordMask, const int objectIndex, const RayAttrMask attrRecordMask) {
+/// stores the ray, if the object is recorded and the event passes `eventFilter`. only attributes contained in both `RecordMask` and
+/// `attrRecordMask` are stored. since `RecordMask` is known at compile time, stores of attributes outside of it are removed by the compiler.
+/// returns true if the object is recorded, even if the event was rejected by `eventFilter`, so that path_event_id does not depend on the filter
+template <RayAttrMask RecordMask = RayAttrMask::All>
+RAYX_FN_ACC inline bool storeRay(const int i, bool* __restrict storedFlags, RaysPtr& __restrict rays, detail::Ray& __restrict ray,
+                                 const bool* __restrict objectRecordMask, const int objectIndex, RayAttrMask attrRecordMask,
+                                 const EventFilter& __restrict eventFilter) {
     // TODO: should we do a syncwarp here, to make the whole warp access gmem?
 
     // object record mask
     if (!objectRecordMask[objectIndex]) return false;
 
+    // the store flag stays cleared, so the event is removed by the compaction
+    if (!passesEventFilter(ray, eventFilter)) return true;
+
     // attribute record mask
+    attrRecordMask &= RecordMask;
     if (!!(attrRecordMask & RayAttrMask::PathId)) rays.path_id[i] = ray.path_id;
     if (!!(attrRecordMask & RayAttrMask::PathEventId)) rays.path_event_id[i] = ray.path_event_id;
     if (!!(attrRecordMask & RayAttrMask::PositionX)) rays.position_x[i] = ray.position.x;
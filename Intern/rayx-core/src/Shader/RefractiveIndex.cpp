@@ -1,7 +1,5 @@
 #include "RefractiveIndex.h"
 
-#include "Throw.h"
-
 namespace rayx {
 
 // The materialTable table consists of all the entries from the Palik & Nff tables for all materials that were loaded into the shader.
@@ -135,10 +133,7 @@ complex::Complex RAYX_API getRefractiveIndex(double energy, int material, const
     }
 
     // out of range check
-    if (material < 1 || material > 140) {
-        _throw("getRefractiveIndex material out of range!");
-        return complex::Complex(-1.0, -1.0);
-    }
+    if (material < 1 || material > 140) return REFRACTIVE_INDEX_NOT_FOUND;
 
     //check if material is an atom < 92 
     if (material <= 92) {
@@ -237,8 +232,7 @@ complex::Complex RAYX_API getRefractiveIndex(double energy, int material, const
         }
     }
 
-    _throw("getRefractiveIndex: no matching entry found!");
-    return complex::Complex(-1.0, -1.0);
+    return REFRACTIVE_INDEX_NOT_FOUND;
 }
 
 RAYX_FN_ACC
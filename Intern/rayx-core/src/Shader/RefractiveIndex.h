@@ -47,7 +47,12 @@ RAYX_FN_ACC NKEntry RAYX_API getCromerEntry(int index, int material, const int*
 
 RAYX_FN_ACC NKEntry RAYX_API getMolecEntry(int index, int material, const int* materialIndices, const double* materialTable);
 
-// returns dvec2 to represent a complex number
+/// returned by getRefractiveIndex if the material is out of range, or the material tables have no entry for the energy
+constexpr complex::Complex REFRACTIVE_INDEX_NOT_FOUND = complex::Complex(-1.0, -1.0);
+
+RAYX_FN_ACC inline bool isRefractiveIndexFound(const complex::Complex& n) { return n != REFRACTIVE_INDEX_NOT_FOUND; }
+
+// returns dvec2 to represent a complex number. REFRACTIVE_INDEX_NOT_FOUND if there is no refractive index for the material and energy
 RAYX_FN_ACC complex::Complex RAYX_API getRefractiveIndex(double energy, int material, const int* materialIndices, const double* materialTable);
 
 // linear interpolation
@@ -1,112 +1,330 @@
 #include "Trace.h"
 
+#include "ApplySlopeError.h"
 #include "Behave.h"
 #include "Collision.h"
+#include "CollisionPacket.h"
 #include "RecordEvent.h"
+#include "TraceCounters.h"
 #include "Utils.h"
 
 namespace rayx {
 
-#define assertObjectIdInBounds(object_id, numObjects) \
-    _debug_assert(0 <= object_id && object_id < numObjects, "error: ray object id '%d' is out of bounds [0, %d)", object_id, numObjects);
+namespace {
+
+/// rays loaded from ConstState::rays may refer to objects of another beamline, e.g. rays of a ray list
+RAYX_FN_ACC inline bool isObjectIdInBounds(const int objectId, const ConstState& __restrict constState) {
+    return 0 <= objectId && objectId < constState.numSources + constState.numElements;
+}
+
+/// the error of a ray that is not traced, because its object id is out of bounds
+RAYX_FN_ACC inline DeviceError invalidObjectIdError(const detail::Ray& __restrict ray) {
+    return DeviceError{.code = DeviceErrorCode::InvalidObjectId, .elementIndex = -1, .rayIndex = ray.path_id};
+}
+
+/// applies the transformation matrix to the ray. the electric field is only transformed if it may be recorded
+template <RayAttrMask RecordMask>
+RAYX_FN_ACC inline void transformRay(const glm::dmat4& __restrict m, detail::Ray& __restrict ray) {
+    if constexpr (!!(RecordMask & RayAttrMask::ElectricField)) {
+        rayMatrixMult(m, ray.position, ray.direction, ray.electric_field);
+    } else {
+        rayMatrixMult(m, ray.position, ray.direction);
+    }
+}
+
+/// moves the ray to the hitpoint. the optical path length and the electric field are only advanced if they may be recorded
+template <RayAttrMask RecordMask>
+RAYX_FN_ACC inline void advanceRay(detail::Ray& __restrict ray, const glm::dvec3& __restrict hitpoint) {
+    constexpr bool recordOpticalPathLength = contains(RecordMask, RayAttrMask::OpticalPathLength);
+    constexpr bool recordElectricField     = !!(RecordMask & RayAttrMask::ElectricField);
+
+    if constexpr (recordOpticalPathLength || recordElectricField) {
+        const auto col_optical_distance = glm::length(ray.position - hitpoint);
+        if constexpr (recordOpticalPathLength) ray.optical_path_length += col_optical_distance;
+        if constexpr (recordElectricField)
+            ray.electric_field = advanceElectricField(ray.electric_field, energyToWaveLength(ray.energy), col_optical_distance);
+    }
+
+    ray.position = hitpoint;
+}
+
+/// handles the interaction of a ray with the element it hit in sequential tracing, and stores the resulting event
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC inline void hitElementSequential(const int gid, detail::Ray& __restrict ray, const CollisionPoint& __restrict col, const int elementIndex,
+                                             const OpticalElement& __restrict element, const ConstState& __restrict constState,
+                                             MutableState& __restrict mutableState) {
+    advanceRay<RecordMask>(ray, col.hitpoint);
+    ray.object_id  = constState.numSources + elementIndex;
+    ray.event_type = EventType::HitElement;
+    RAYX_TRACE_COUNT(mutableState.counters, TraceCounterColumn::HitsPerElement + elementIndex, 1);
+
+    behave<!!(RecordMask & RayAttrMask::ElectricField), ElementTypes>(ray, col, element, constState.materialIndices, constState.materialTable);
+
+    const auto objectSlot = constState.objectRecordSlots[ray.object_id];
+    const auto eventSlot  = getRecordSlot(constState.recordMode, objectSlot, objectSlot);
+    const auto eventIndex = getRecordIndex(gid, eventSlot, constState.outputEventsGridStride);
+    const auto stored     = storeRay<RecordMask>(eventIndex, mutableState.storedFlags, mutableState.events, ray, constState.objectRecordMask,
+                                                 ray.object_id, constState.attrRecordMask, constState.eventFilter);
+    ray.path_event_id += stored ? 1 : 0;
+
+    // the captured state is in element coordinates. a resumed trace transforms it to world coordinates, as done below
+    if (elementIndex == constState.captureElementIndex) storeRay(gid, mutableState.capturedRays, ray);
+
+    transformRay<RecordMask>(constState.objectTransforms[elementIndex + constState.numSources].m_outTrans, ray);
+}
+
+/// prepares a ray loaded from ConstState::rays for the first element to trace in sequential tracing, and returns the index of that element. a
+/// generated ray records its event on the source. a resumed ray continues after the element it was captured at, without recording an event.
+/// returns numElements if the resumed ray finished before that element, and -1 if the object id of the ray is out of bounds
+template <RayAttrMask RecordMask>
+RAYX_FN_ACC inline int beginSequential(const int gid, detail::Ray& __restrict ray, const ConstState& __restrict constState,
+                                       MutableState& __restrict mutableState) {
+    if (constState.captureElementIndex != -1) {
+        auto uncaptured       = ray;
+        uncaptured.event_type = EventType::Uninitialized;
+        storeRay(gid, mutableState.capturedRays, uncaptured);
+    }
+
+    if (!isObjectIdInBounds(ray.object_id, constState)) return -1;
+
+    if (constState.resumeElementIndex != -1) {
+        // the final state of the ray was captured (see captureFinishedRay). it is not traced again, only its final event type and error are reported
+        if (ray.object_id < constState.numSources + constState.resumeElementIndex) return constState.numElements;
+        transformRay<RecordMask>(constState.objectTransforms[ray.object_id].m_outTrans, ray);
+        return constState.resumeElementIndex + 1;
+    }
 
-RAYX_FN_ACC
-void traceSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState) {
-    auto ray = loadRay(gid, constState.rays);
-    assertObjectIdInBounds(ray.object_id, constState.numSources + constState.numElements);
     // TODO: do we want to increment here? its a design question. in case one traces one beamline and uses events to trace another beamline, the
     // ray_path_id does not overlap, because it was incremented
     ++ray.path_event_id;
 
-    const auto stored = storeRay(getRecordIndex(gid, 0, constState.outputEventsGridStride), mutableState.storedFlags, mutableState.events, ray,
-                                 constState.objectRecordMask, ray.object_id, constState.attrRecordMask);
+    const auto eventSlot  = getRecordSlot(constState.recordMode, 0, constState.objectRecordSlots[ray.object_id]);
+    const auto eventIndex = getRecordIndex(gid, eventSlot, constState.outputEventsGridStride);
+    const auto stored     = storeRay<RecordMask>(eventIndex, mutableState.storedFlags, mutableState.events, ray, constState.objectRecordMask,
+                                                 ray.object_id, constState.attrRecordMask, constState.eventFilter);
     ray.path_event_id += stored ? 1 : 0;
 
-    rayMatrixMult(constState.objectTransforms[ray.object_id].m_inTrans, ray.position, ray.direction, ray.electric_field);
+    transformRay<RecordMask>(constState.objectTransforms[ray.object_id].m_inTrans, ray);
+    return 0;
+}
+
+/// in a capturing trace, replaces the captured state of a ray that finished before it left the capture element by its final state, so that a
+/// resumed trace reports the final event type and the error of the ray, e.g. absorbed or beyond horizon before the element
+RAYX_FN_ACC inline void captureFinishedRay(const int gid, const detail::Ray& __restrict ray, const ConstState& __restrict constState,
+                                           MutableState& __restrict mutableState) {
+    if (constState.captureElementIndex != -1 && ray.object_id < constState.numSources + constState.captureElementIndex)
+        storeRay(gid, mutableState.capturedRays, ray);
+}
+
+/// finds the next element hit by the ray in non-sequential tracing
+template <ElementTypeMask ElementTypes>
+RAYX_FN_ACC inline OptCollisionWithElement findNextCollision(const glm::dvec3& __restrict rayPosition, const glm::dvec3& __restrict rayDirection,
+                                                             Rand& __restrict rand, const ConstState& __restrict constState,
+                                                             TraceCounter* __restrict counters) {
+#ifdef RAYX_MIXED_PRECISION_COLLISION
+    return findCollisionWithElementsMixedPrecision<ElementTypes>(rayPosition, rayDirection, constState.elements, constState.objectTransforms,
+                                                                 constState.numSources, constState.numElements, rand, counters);
+#else
+    return findCollisionWithElements<ElementTypes>(rayPosition, rayDirection, constState.elements, constState.objectTransforms, constState.numSources,
+                                                   constState.numElements, rand, counters);
+#endif
+}
+
+}  // unnamed namespace
 
-    for (int elementIndex = 0; elementIndex < constState.numElements; ++elementIndex) {
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC DeviceError traceSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState) {
+    auto* counters               = mutableState.counters;
+    auto ray                     = loadRay(gid, constState.rays);
+    const auto firstElementIndex = beginSequential<RecordMask>(gid, ray, constState, mutableState);
+    if (firstElementIndex < 0) return invalidObjectIdError(ray);
+
+    for (int elementIndex = firstElementIndex; elementIndex < constState.numElements; ++elementIndex) {
         if (isRayTerminated(ray.event_type)) break;
 
         const auto element = constState.elements[elementIndex];
 
-        rayMatrixMult(constState.objectTransforms[elementIndex + constState.numSources].m_inTrans, ray.position, ray.direction, ray.electric_field);
+        transformRay<RecordMask>(constState.objectTransforms[elementIndex + constState.numSources].m_inTrans, ray);
 
-        const auto col = findCollisionInElementCoords(ray.position, ray.direction, element, ray.rand);
+        const auto col = findCollisionInElementCoords<ElementTypes>(ray.position, ray.direction, element, ray.rand, counters);
 
         // no element was hit. tracing is done!
         if (!col) break;
 
-        const auto col_optical_distance = glm::length(ray.position - col->hitpoint);
-        ray.optical_path_length += col_optical_distance;
-        ray.electric_field = advanceElectricField(ray.electric_field, energyToWaveLength(ray.energy), col_optical_distance);
-        ray.position       = col->hitpoint;
-        ray.object_id      = constState.numSources + elementIndex;
-        ray.event_type     = EventType::HitElement;
+        hitElementSequential<RecordMask, ElementTypes>(gid, ray, *col, elementIndex, element, constState, mutableState);
+    }
 
-        behave(ray, *col, element, constState.materialIndices, constState.materialTable);
+    captureFinishedRay(gid, ray, constState, mutableState);
+    RAYX_TRACE_COUNT(counters, TraceCounterColumn::FinalEventType + static_cast<int>(ray.event_type), 1);
+    return getDeviceError(ray, constState.numSources);
+}
 
-        assertObjectIdInBounds(ray.object_id, constState.numSources + constState.numElements);
-        const auto stored = storeRay(getRecordIndex(gid, ray.object_id, constState.outputEventsGridStride), mutableState.storedFlags,
-                                     mutableState.events, ray, constState.objectRecordMask, ray.object_id, constState.attrRecordMask);
-        ray.path_event_id += stored ? 1 : 0;
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC void traceSequentialPacket(const int firstGid, const int numRays, const ConstState& __restrict constState,
+                                       MutableState& __restrict mutableState, DeviceError* __restrict errors) {
+    auto* counters = mutableState.counters;
+    detail::Ray rays[RAY_PACKET_SIZE];
+    bool isActive[RAY_PACKET_SIZE];
 
-        rayMatrixMult(constState.objectTransforms[elementIndex + constState.numSources].m_outTrans, ray.position, ray.direction, ray.electric_field);
+    for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+        isActive[lane] = lane < numRays;
+        if (!isActive[lane]) continue;
+
+        const auto gid = firstGid + lane;
+        auto& ray      = rays[lane];
+        ray            = loadRay(gid, constState.rays);
+        errors[lane]   = DeviceError{};
+        const auto beginElementIndex = beginSequential<RecordMask>(gid, ray, constState, mutableState);
+        if (beginElementIndex < 0) errors[lane] = invalidObjectIdError(ray);
+        if (beginElementIndex < 0 || beginElementIndex == constState.numElements) isActive[lane] = false;
+    }
+
+    // inactive lanes still take part in the packet arithmetic, so they need well defined inputs
+    RayPacket<RAY_PACKET_SIZE> packet;
+    for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) packet.set(lane, glm::dvec3(0, 1, 0), glm::dvec3(0, -1, 0));
+
+    // all rays of a packet begin at the same element
+    const auto firstElementIndex = constState.resumeElementIndex + 1;
+    for (int elementIndex = firstElementIndex; elementIndex < constState.numElements; ++elementIndex) {
+        const auto element  = constState.elements[elementIndex];
+        const auto& inTrans = constState.objectTransforms[elementIndex + constState.numSources].m_inTrans;
+        auto numActiveLanes = 0;
+
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            if (isActive[lane] && isRayTerminated(rays[lane].event_type)) isActive[lane] = false;
+            if (!isActive[lane]) continue;
+
+            auto& ray = rays[lane];
+            transformRay<RecordMask>(inTrans, ray);
+            packet.set(lane, ray.position, ray.direction);
+            ++numActiveLanes;
+        }
+
+        if (numActiveLanes == 0) break;
+
+        if (isPacketSurface(element.m_surface)) {
+            CollisionPacket<RAY_PACKET_SIZE> colPacket;
+            findCollisionInElementCoordsWithoutSlopeErrorPacket(packet, element.m_surface, element.m_cutout, colPacket);
+
+            for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+                if (!isActive[lane]) continue;
+                RAYX_TRACE_COUNT(counters, TraceCounterColumn::ElementsTested, 1);
+
+                // no element was hit. tracing is done for this ray!
+                if (!colPacket.found[lane]) {
+                    isActive[lane] = false;
+                    continue;
+                }
+
+                auto& ray         = rays[lane];
+                const auto normal = applySlopeError(colPacket.normal(lane), element.m_slopeError, 0, ray.rand);
+                const auto col    = CollisionPoint{.hitpoint = colPacket.hitpoint(lane), .normal = normal};
+
+                hitElementSequential<RecordMask, ElementTypes>(firstGid + lane, ray, col, elementIndex, element, constState, mutableState);
+            }
+        } else {
+            for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+                if (!isActive[lane]) continue;
+
+                auto& ray      = rays[lane];
+                const auto col = findCollisionInElementCoords<ElementTypes>(ray.position, ray.direction, element, ray.rand, counters);
+
+                // no element was hit. tracing is done for this ray!
+                if (!col) {
+                    isActive[lane] = false;
+                    continue;
+                }
+
+                hitElementSequential<RecordMask, ElementTypes>(firstGid + lane, ray, *col, elementIndex, element, constState, mutableState);
+            }
+        }
+    }
+
+    for (int lane = 0; lane < numRays; ++lane) {
+        if (errors[lane].code == DeviceErrorCode::InvalidObjectId) continue;
+        captureFinishedRay(firstGid + lane, rays[lane], constState, mutableState);
+        RAYX_TRACE_COUNT(counters, TraceCounterColumn::FinalEventType + static_cast<int>(rays[lane].event_type), 1);
+        errors[lane] = getDeviceError(rays[lane], constState.numSources);
     }
 }
 
-RAYX_FN_ACC
-void traceNonSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState) {
-    auto ray = loadRay(gid, constState.rays);
-    assertObjectIdInBounds(ray.object_id, constState.numSources + constState.numElements);
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC DeviceError traceNonSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState) {
+    auto* counters = mutableState.counters;
+    auto ray       = loadRay(gid, constState.rays);
+    if (!isObjectIdInBounds(ray.object_id, constState)) return invalidObjectIdError(ray);
     // TODO: see above (traceSequential)
     ++ray.path_event_id;
 
-    const auto stored = storeRay(getRecordIndex(gid, 0, constState.outputEventsGridStride), mutableState.storedFlags, mutableState.events, ray,
-                                 constState.objectRecordMask, ray.object_id, constState.attrRecordMask);
+    const auto eventSlot  = getRecordSlot(constState.recordMode, 0, constState.objectRecordSlots[ray.object_id]);
+    const auto eventIndex = getRecordIndex(gid, eventSlot, constState.outputEventsGridStride);
+    const auto stored     = storeRay<RecordMask>(eventIndex, mutableState.storedFlags, mutableState.events, ray, constState.objectRecordMask,
+                                                 ray.object_id, constState.attrRecordMask, constState.eventFilter);
     ray.path_event_id += stored ? 1 : 0;
 
     // TODO: object_id from previous beamline is not correct for this beamline
-    rayMatrixMult(constState.objectTransforms[ray.object_id].m_inTrans, ray.position, ray.direction, ray.electric_field);
+    transformRay<RecordMask>(constState.objectTransforms[ray.object_id].m_inTrans, ray);
 
     for (int hitIndex = 0; hitIndex < constState.maxEvents; ++hitIndex) {
         if (isRayTerminated(ray.event_type)) break;
 
-        const auto col = findCollisionWithElements(ray.position, ray.direction, constState.elements, constState.objectTransforms,
-                                                   constState.numSources, constState.numElements, ray.rand);
+        const auto col = findNextCollision<ElementTypes>(ray.position, ray.direction, ray.rand, constState, counters);
 
         // no element was hit. tracing is done!
         if (!col) break;
 
         const auto element = constState.elements[col->elementIndex];
-        rayMatrixMult(constState.objectTransforms[col->elementIndex + constState.numSources].m_inTrans, ray.position, ray.direction,
-                      ray.electric_field);
+        transformRay<RecordMask>(constState.objectTransforms[col->elementIndex + constState.numSources].m_inTrans, ray);
 
-        const auto col_optical_distance = glm::length(ray.position - col->point.hitpoint);
-        ray.optical_path_length += col_optical_distance;
-        ray.electric_field = advanceElectricField(ray.electric_field, energyToWaveLength(ray.energy), col_optical_distance);
-        ray.position       = col->point.hitpoint;
-        ray.object_id      = constState.numSources + col->elementIndex;
-        ray.event_type     = EventType::HitElement;
+        advanceRay<RecordMask>(ray, col->point.hitpoint);
+        ray.object_id  = constState.numSources + col->elementIndex;
+        ray.event_type = EventType::HitElement;
+        RAYX_TRACE_COUNT(counters, TraceCounterColumn::HitsPerElement + col->elementIndex, 1);
 
-        behave(ray, col->point, element, constState.materialIndices, constState.materialTable);
+        behave<!!(RecordMask & RayAttrMask::ElectricField), ElementTypes>(ray, col->point, element, constState.materialIndices,
+                                                                          constState.materialTable);
 
         // check if the number of events exceed capacity. if so, set event type to TooManyEvents
         if (hitIndex == constState.maxEvents - 1 && !isRayTerminated(ray.event_type)) {
             // still something to hit?
-            if (findCollisionWithElements(ray.position, ray.direction, constState.elements, constState.objectTransforms, constState.numSources,
-                                          constState.numElements, ray.rand))
+            if (findNextCollision<ElementTypes>(ray.position, ray.direction, ray.rand, constState, counters))
                 ray.event_type = EventType::TooManyEvents;
         }
 
-        const auto recordIndex = hitIndex + 1;  // add 1 because one source event has potentially been stored already
-        assertObjectIdInBounds(ray.object_id, constState.numSources + constState.numElements);
-        const auto stored = storeRay(getRecordIndex(gid, recordIndex, constState.outputEventsGridStride), mutableState.storedFlags,
-                                     mutableState.events, ray, constState.objectRecordMask, ray.object_id, constState.attrRecordMask);
+        // add 1 because one source event has potentially been stored already
+        const auto eventSlot  = getRecordSlot(constState.recordMode, hitIndex + 1, constState.objectRecordSlots[ray.object_id]);
+        const auto eventIndex = getRecordIndex(gid, eventSlot, constState.outputEventsGridStride);
+        const auto stored     = storeRay<RecordMask>(eventIndex, mutableState.storedFlags, mutableState.events, ray, constState.objectRecordMask,
+                                                     ray.object_id, constState.attrRecordMask, constState.eventFilter);
         ray.path_event_id += stored ? 1 : 0;
 
-        rayMatrixMult(constState.objectTransforms[col->elementIndex + constState.numSources].m_outTrans, ray.position, ray.direction,
-                      ray.electric_field);
+        transformRay<RecordMask>(constState.objectTransforms[col->elementIndex + constState.numSources].m_outTrans, ray);
     }
+
+    RAYX_TRACE_COUNT(counters, TraceCounterColumn::FinalEventType + static_cast<int>(ray.event_type), 1);
+    return getDeviceError(ray, constState.numSources);
 }
 
+static_assert(std::size(TRACE_RECORD_MASKS) == 3, "instantiate the trace functions for each record mask");
+static_assert(std::size(TRACE_ELEMENT_TYPE_MASKS) == 2, "instantiate the trace functions for each element type mask");
+
+#define RAYX_INSTANTIATE_TRACE(RecordMask, ElementTypes)                                                                                       \
+    template RAYX_FN_ACC DeviceError traceSequential<RecordMask, ElementTypes>(const int, const ConstState& __restrict,                        \
+                                                                                MutableState& __restrict);                                     \
+    template RAYX_FN_ACC void traceSequentialPacket<RecordMask, ElementTypes>(const int, const int, const ConstState& __restrict,              \
+                                                                             MutableState& __restrict, DeviceError* __restrict);               \
+    template RAYX_FN_ACC DeviceError traceNonSequential<RecordMask, ElementTypes>(const int, const ConstState& __restrict,                     \
+                                                                                   MutableState& __restrict);
+
+#define RAYX_INSTANTIATE_TRACE_ELEMENT_TYPES(RecordMask)            \
+    RAYX_INSTANTIATE_TRACE(RecordMask, TRACE_ELEMENT_TYPE_MASKS[0]) \
+    RAYX_INSTANTIATE_TRACE(RecordMask, TRACE_ELEMENT_TYPE_MASKS[1])
+
+RAYX_INSTANTIATE_TRACE_ELEMENT_TYPES(TRACE_RECORD_MASKS[0])
+RAYX_INSTANTIATE_TRACE_ELEMENT_TYPES(TRACE_RECORD_MASKS[1])
+RAYX_INSTANTIATE_TRACE_ELEMENT_TYPES(TRACE_RECORD_MASKS[2])
+
+#undef RAYX_INSTANTIATE_TRACE_ELEMENT_TYPES
+#undef RAYX_INSTANTIATE_TRACE
+
 }  // namespace rayx
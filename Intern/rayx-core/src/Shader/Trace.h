@@ -1,11 +1,37 @@
 #pragma once
 
 #include "Core.h"
+#include "Element/ElementTypeMask.h"
 #include "InvocationState.h"
 
 namespace rayx {
 
-RAYX_FN_ACC void traceSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState);
-RAYX_FN_ACC void traceNonSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState);
+/// ray attributes that are cheap to record, because they do not require any additional computations during tracing
+constexpr RayAttrMask TRACE_RECORD_MASK_IDS = RayAttrMask::PathId | RayAttrMask::PathEventId | RayAttrMask::Order | RayAttrMask::ObjectId |
+                                              RayAttrMask::SourceId | RayAttrMask::EventType | RayAttrMask::RandCounter;
+
+/// The trace functions are specialized at compile time on a record mask. Attributes outside of the record mask are never recorded, and
+/// computations that are only required for these attributes are removed (e.g. the electric field). Attributes within the record mask are still
+/// subject to the `attrRecordMask` passed at runtime.
+/// The masks are ordered from smallest to largest. A trace should use the first mask that contains its `attrRecordMask`.
+/// Likewise, the trace functions are specialized on the element types of the beamline (see TRACE_ELEMENT_TYPE_MASKS).
+constexpr RayAttrMask TRACE_RECORD_MASKS[] = {
+    RayAttrMask::Position | TRACE_RECORD_MASK_IDS,
+    RayAttrMask::Position | RayAttrMask::Direction | RayAttrMask::Energy | TRACE_RECORD_MASK_IDS,
+    RayAttrMask::All,
+};
+
+/// the trace functions return the error of each traced ray, which the trace kernels append to MutableState::errors (see DeviceError.h)
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC DeviceError traceSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState);
+
+// traces up to RAY_PACKET_SIZE consecutive rays starting at firstGid. the plane and quadric collisions of a packet are computed in one go, which
+// maps well to SIMD on the cpu. produces the same events as calling traceSequential for each ray. the errors of the rays are written to `errors`
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC void traceSequentialPacket(const int firstGid, const int numRays, const ConstState& __restrict constState,
+                                       MutableState& __restrict mutableState, DeviceError* __restrict errors);
+
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+RAYX_FN_ACC DeviceError traceNonSequential(const int gid, const ConstState& __restrict constState, MutableState& __restrict mutableState);
 
 }  // namespace rayx
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Core.h"
+#include "EventType.h"
+
+// Performance counters of the trace kernels. They are compiled in only if RAYX_TRACE_COUNTERS is defined (cmake option RAYX_TRACE_COUNTERS).
+// Otherwise RAYX_TRACE_COUNT does nothing and no counter buffer is allocated.
+// The counter buffer holds NUM_TRACE_COUNTER_SLOTS rows of counters, independent of the number of rays. Every block of the trace kernels adds
+// to one row with atomics (see traceCounterSlot), which spreads the contention over the rows. The rows of a batch are summed up on the host (see
+// reduceTraceCounters).
+
+#ifdef RAYX_TRACE_COUNTERS
+#define RAYX_TRACE_COUNT(counters, column, n)                                  \
+    do {                                                                       \
+        if (counters) rayx::atomicAddTraceCounter((counters) + (column), (n)); \
+    } while (0)
+#else
+#define RAYX_TRACE_COUNT(counters, column, n) ((void)(counters))
+#endif
+
+namespace rayx {
+
+/// a counter of the counter buffer. 64 bit, as counts summed over the rays of a batch can exceed 2^31. unsigned long long, because that is the
+/// 64 bit type of the native atomicAdd of CUDA and HIP
+using TraceCounter = unsigned long long;
+
+constexpr int NUM_EVENT_TYPES = static_cast<int>(EventType::TooManyEvents) + 1;
+
+/// columns of a row in the counter buffer
+namespace TraceCounterColumn {
+/// number of ray-element intersections computed in double precision
+constexpr int ElementsTested = 0;
+/// number of iterations of the toroid collision (newton or halley)
+constexpr int ToroidIterations = 1;
+/// number of iterations of the cubic collision
+constexpr int CubicIterations = 2;
+/// one column per EventType, counting the rays by the event type of their last event
+constexpr int FinalEventType = 3;
+/// one column per element, counting the hits on the element
+constexpr int HitsPerElement = FinalEventType + NUM_EVENT_TYPES;
+}  // namespace TraceCounterColumn
+
+RAYX_FN_ACC constexpr inline int numTraceCounterColumns(const int numElements) { return TraceCounterColumn::HitsPerElement + numElements; }
+
+/// number of rows of the counter buffer. blocks share a row, if there are more blocks than rows
+constexpr int NUM_TRACE_COUNTER_SLOTS = 64;
+
+/// the row of the block `blockIndex`, or nullptr if counters are disabled
+RAYX_FN_ACC inline TraceCounter* traceCounterSlot(TraceCounter* __restrict counters, const int blockIndex, const int numElements) {
+    return counters ? counters + (blockIndex % NUM_TRACE_COUNTER_SLOTS) * numTraceCounterColumns(numElements) : nullptr;
+}
+
+/// the trace functions have no accelerator to call alpaka atomics with, so the native atomics of the device are used
+RAYX_FN_ACC inline void atomicAddTraceCounter(TraceCounter* __restrict counter, const int n) {
+#if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+    atomicAdd(counter, static_cast<TraceCounter>(n));
+#else
+    std::atomic_ref<TraceCounter>(*counter).fetch_add(static_cast<TraceCounter>(n), std::memory_order_relaxed);
+#endif
+}
+
+/// performance counters of a trace, summed over all rays
+struct RAYX_API TraceCounters {
+    int64_t numRays = 0;
+    /// number of ray-element intersections computed in double precision. in mixed precision collision (RAYX_MIXED_PRECISION_COLLISION), elements
+    /// rejected by the single precision screening are not counted
+    int64_t elementsTested   = 0;
+    int64_t toroidIterations = 0;
+    int64_t cubicIterations  = 0;
+    /// number of rays by the event type of their last event. rays with EventType::TooManyEvents exceeded the maximum number of events
+    std::array<int64_t, NUM_EVENT_TYPES> raysPerFinalEventType = {};
+    /// number of hits per element, indexed by element index
+    std::vector<int64_t> hitsPerElement;
+
+    TraceCounters& operator+=(const TraceCounters& other) {
+        numRays += other.numRays;
+        elementsTested += other.elementsTested;
+        toroidIterations += other.toroidIterations;
+        cubicIterations += other.cubicIterations;
+        for (int i = 0; i < NUM_EVENT_TYPES; ++i) raysPerFinalEventType[i] += other.raysPerFinalEventType[i];
+        if (hitsPerElement.size() < other.hitsPerElement.size()) hitsPerElement.resize(other.hitsPerElement.size(), 0);
+        for (int i = 0; i < static_cast<int>(other.hitsPerElement.size()); ++i) hitsPerElement[i] += other.hitsPerElement[i];
+        return *this;
+    }
+};
+
+/// sums up the NUM_TRACE_COUNTER_SLOTS counter rows of a batch of `numRays` rays
+inline TraceCounters reduceTraceCounters(const TraceCounter* counters, const int numRays, const int numElements) {
+    const auto numColumns = numTraceCounterColumns(numElements);
+
+    auto result           = TraceCounters{};
+    result.numRays        = numRays;
+    result.hitsPerElement = std::vector<int64_t>(numElements, 0);
+
+    for (int i = 0; i < NUM_TRACE_COUNTER_SLOTS; ++i) {
+        const auto* row = counters + i * numColumns;
+        result.elementsTested += static_cast<int64_t>(row[TraceCounterColumn::ElementsTested]);
+        result.toroidIterations += static_cast<int64_t>(row[TraceCounterColumn::ToroidIterations]);
+        result.cubicIterations += static_cast<int64_t>(row[TraceCounterColumn::CubicIterations]);
+        for (int j = 0; j < NUM_EVENT_TYPES; ++j)
+            result.raysPerFinalEventType[j] += static_cast<int64_t>(row[TraceCounterColumn::FinalEventType + j]);
+        for (int j = 0; j < numElements; ++j) result.hitsPerElement[j] += static_cast<int64_t>(row[TraceCounterColumn::HitsPerElement + j]);
+    }
+
+    return result;
+}
+
+}  // namespace rayx
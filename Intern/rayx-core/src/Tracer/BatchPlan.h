@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "Beamline/Beamline.h"
+#include "Debug/Debug.h"
+
+namespace rayx {
+
+/// how the rays of a trace are split into batches. the total number of rays is 64 bit, the rays of a batch and the batch indices are int
+struct BatchPlan {
+    int64_t numRaysTotal;
+    int numRaysBatchAtMost;
+    int numBatches;
+};
+
+/// total number of rays of all sources of `group`, in 64 bit
+inline int64_t numRaysTotal(const Group& group) { return static_cast<int64_t>(group.numRayPaths()); }
+
+/// splits `numRaysTotal` rays into batches of at most `maxBatchSize` rays. exits if the number of batches can not be indexed with int
+inline BatchPlan planBatches(const int64_t numRaysTotal, const int maxBatchSize) {
+    const auto numRaysBatchAtMost = static_cast<int>(std::min(numRaysTotal, static_cast<int64_t>(maxBatchSize)));
+    const auto numBatches         = numRaysBatchAtMost ? (numRaysTotal + numRaysBatchAtMost - 1) / numRaysBatchAtMost : int64_t{0};
+    if (std::numeric_limits<int>::max() < numBatches)
+        RAYX_EXIT << "error: tracing " << numRaysTotal << " rays in batches of " << numRaysBatchAtMost << " rays requires " << numBatches
+                  << " batches, which exceeds the maximum number of batches. Increase the batch size";
+
+    return BatchPlan{
+        .numRaysTotal       = numRaysTotal,
+        .numRaysBatchAtMost = numRaysBatchAtMost,
+        .numBatches         = static_cast<int>(numBatches),
+    };
+}
+
+}  // namespace rayx
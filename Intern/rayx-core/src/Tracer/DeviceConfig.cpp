@@ -2,8 +2,18 @@
 
 #include <algorithm>
 #include <alpaka/alpaka.hpp>
+#include <cctype>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <numeric>
 #include <ranges>
 #include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 #include "Debug/Debug.h"
 #include "Debug/Instrumentor.h"
@@ -109,6 +119,70 @@ std::string deviceTypeToString(DeviceType deviceType) {
     return ss.str();
 }
 
+/// parses a cpu list in the format of the linux sysfs, e.g. "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& cpuList) {
+    std::vector<int> cpus;
+    std::stringstream ss(cpuList);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || !std::isdigit(range[0])) continue;
+        const auto dash  = range.find('-');
+        const auto first = std::stoi(range.substr(0, dash));
+        const auto last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+/// returns the cpus this process is allowed to run on
+std::vector<int> getAvailableCpus() {
+#if defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &cpuSet)) cpus.push_back(cpu);
+        return cpus;
+    }
+#endif
+
+    std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+    std::iota(cpus.begin(), cpus.end(), 0);
+    return cpus;
+}
+
+/// returns the available cpus of each NUMA node, ordered by node id. empty if the NUMA topology is unknown
+std::vector<std::vector<int>> getNumaNodeCpus(const std::vector<int>& availableCpus) {
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+
+#if defined(__linux__)
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+        const auto name = entry.path().filename().string();
+        if (!name.starts_with("node") || name.size() == 4 || !std::isdigit(name[4])) continue;
+
+        std::ifstream file(entry.path() / "cpulist");
+        std::string cpuList;
+        if (!std::getline(file, cpuList)) continue;
+
+        auto cpus = parseCpuList(cpuList);
+        std::erase_if(cpus, [&](const int cpu) { return std::ranges::find(availableCpus, cpu) == availableCpus.end(); });
+        if (!cpus.empty()) nodes.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+    }
+#else
+    static_cast<void>(availableCpus);
+#endif
+
+    std::ranges::sort(nodes, {}, &std::pair<int, std::vector<int>>::first);
+
+    std::vector<std::vector<int>> nodeCpus;
+    for (auto& node : nodes) nodeCpus.push_back(std::move(node.second));
+    return nodeCpus;
+}
+
 }  // unnamed namespace
 
 namespace rayx {
@@ -188,6 +262,50 @@ DeviceConfig& DeviceConfig::enableBestDevice(DeviceType deviceType) {
     return *this;
 }
 
+DeviceConfig& DeviceConfig::partitionCpu(std::optional<int> numPartitions) {
+    const auto availableCpus = getAvailableCpus();
+    const auto numCpus       = static_cast<int>(availableCpus.size());
+
+    auto partitions = std::vector<std::vector<int>>();
+    if (numPartitions) {
+        if (*numPartitions < 1) RAYX_EXIT << "Number of cpu partitions must be at least 1: " << *numPartitions;
+
+        for (int i = 0; i < *numPartitions; ++i) {
+            const auto begin = availableCpus.begin() + i * numCpus / *numPartitions;
+            const auto end   = availableCpus.begin() + (i + 1) * numCpus / *numPartitions;
+            // if there are more partitions than cpus, partitions share cpus
+            partitions.push_back(begin != end ? std::vector<int>(begin, end) : std::vector<int>{availableCpus[i % numCpus]});
+        }
+    } else {
+        partitions = getNumaNodeCpus(availableCpus);
+    }
+
+    if (partitions.size() <= 1) {
+        RAYX_VERB << "Cpu device is not partitioned, because there is only one partition";
+        return *this;
+    }
+
+    auto partitionedDevices = std::vector<Device>();
+    for (const auto& device : devices) {
+        // devices that are already partitioned are kept as they are
+        if (!(device.type & DeviceType::Cpu) || !device.cpus.empty()) {
+            partitionedDevices.push_back(device);
+            continue;
+        }
+
+        for (size_t i = 0; i < partitions.size(); ++i) {
+            auto partition  = device;
+            partition.name  = std::format("{} (partition {}/{}, {} cpus)", device.name, i + 1, partitions.size(), partitions[i].size());
+            partition.score = device.score * partitions[i].size() / numCpus;
+            partition.cpus  = partitions[i];
+            partitionedDevices.push_back(partition);
+        }
+    }
+
+    devices = std::move(partitionedDevices);
+    return *this;
+}
+
 DeviceConfig::DeviceType DeviceConfig::availableDeviceTypes() {
     DeviceType deviceType = DeviceType::None;
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,8 @@ struct RAYX_API DeviceConfig {
         Index index;
         Score score;
         bool enable;
+        /// cpus the tracing threads of this device are pinned to. empty means no pinning. only used for partitions of the cpu device
+        std::vector<int> cpus = {};
     };
 
     DeviceConfig(DeviceType fetchedDeviceType = DeviceType::All);
@@ -47,6 +50,14 @@ struct RAYX_API DeviceConfig {
 
     DeviceConfig& enableBestDevice(DeviceType deviceType = DeviceType::All);
 
+    /**
+     * @brief Split the cpu device into several devices, each pinned to a disjoint set of cpus
+     * Enabling several partitions traces batches on all of them concurrently. Each partition allocates its buffers from its own threads, which
+     * keeps memory local to the NUMA node of the partition.
+     * @param numPartitions Number of partitions. Default: one partition per NUMA node
+     */
+    DeviceConfig& partitionCpu(std::optional<int> numPartitions = std::nullopt);
+
     static DeviceType availableDeviceTypes();
 
     std::vector<Device> devices;
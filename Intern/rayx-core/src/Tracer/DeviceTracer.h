@@ -1,15 +1,97 @@
 #pragma once
 
+#include <atomic>
 #include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <vector>
 
 #include "Core.h"
+#include "DeviceRays.h"
 #include "ObjectMask.h"
 #include "Rays.h"
+#include "RaysByPath.h"
+#include "Shader/DeviceError.h"
 #include "Shader/InvocationState.h"
+#include "Shader/TraceCounters.h"
 
 namespace rayx {
 
+/// rays recorded for one batch of generated rays. `batchIndex` identifies the batch within the trace
+struct TracedBatch {
+    int batchIndex;
+    /// number of generated rays in this batch
+    int numRays;
+    Rays rays;
+    /// path id of the first generated ray of this batch
+    int64_t firstPathId;
+    /// per generated ray, the offset of its events in `rays` (numRays + 1 elements). only set for OutputLayout::ByPath, where the events are
+    /// grouped by path and `rays` contains neither path_id nor path_event_id
+    std::vector<int64_t> pathOffsets;
+    /// number of events kept on the device by DeviceTracer::traceToDevice. `rays` is empty then
+    int numEventsOnDevice = 0;
+    /// only set when capturing a RetracePlane: the state of each generated ray leaving the element, and the number of events at the beginning of
+    /// `rays` that were recorded up to and including the element
+    Rays rayStates;
+    int numEventsUpToPlane = 0;
+    /// performance counters of the rays of this batch. std::nullopt if rayx-core was built without RAYX_TRACE_COUNTERS
+    std::optional<TraceCounters> counters;
+    /// errors of the rays of this batch, reported by the trace kernels
+    DeviceErrors errors;
+};
+
+/// the rays leaving an element in sequential tracing, at which a trace is captured or resumed (see RetraceCache)
+struct RetracePlane {
+    /// index of the element among the elements of the beamline
+    int elementIndex;
+    /// states of the rays leaving the element per batch index, captured by a previous trace. if set, the rays of a batch are loaded from here
+    /// instead of being generated, and only the elements after the element are traced. otherwise the states are captured into the traced batches
+    const std::map<int, Rays>* rayStates = nullptr;
+};
+
+/**
+ * @brief CancellationToken requests a running trace to stop
+ * cancel() may be called from any thread. devices finish the batch they are currently tracing and do not start another one. a token stays
+ * cancelled until reset() is called
+ */
+class RAYX_API CancellationToken {
+  public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    void reset() { m_cancelled.store(false, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<bool> m_cancelled = false;
+};
+
+/**
+ * @brief BatchQueue hands out the batches of a trace to the device tracers
+ * all devices of a trace share one queue and take the next batch as soon as they finished the previous one. this way faster devices trace more
+ * batches
+ */
+class BatchQueue {
+  public:
+    explicit BatchQueue(std::vector<int> batchIndices, const CancellationToken* cancellationToken = nullptr)
+        : m_batchIndices(std::move(batchIndices)), m_cancellationToken(cancellationToken) {}
+
+    /// returns the index of the next batch to trace, or std::nullopt if all batches have been handed out or the trace was cancelled. thread-safe
+    std::optional<int> pop() {
+        if (isCancelled()) return std::nullopt;
+        const auto i = m_next.fetch_add(1, std::memory_order_relaxed);
+        if (static_cast<int>(m_batchIndices.size()) <= i) return std::nullopt;
+        return m_batchIndices[i];
+    }
+
+    bool isCancelled() const { return m_cancellationToken && m_cancellationToken->isCancelled(); }
+
+  private:
+    const std::vector<int> m_batchIndices;
+    const CancellationToken* m_cancellationToken;
+    std::atomic<int> m_next = 0;
+};
+
 /**
  * @brief DeviceTracer is an interface to a tracer implementation
  * we need this interface to remove the actual implementation from the rayx api
@@ -18,8 +100,25 @@ class RAYX_API DeviceTracer {
   public:
     virtual ~DeviceTracer() = default;
 
-    virtual Rays trace(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
-                       const int maxEvents, const int maxBatchSize) = 0;
+    /// traces batches taken from `batchQueue` until it is empty or the trace is cancelled, and passes each traced batch to `onBatchTraced` as
+    /// soon as it is done. events rejected by `eventFilter` are not recorded. `recordMode` selects which of the recorded events are kept. `layout`
+    /// selects the order of the events of a batch. `seed` must be the same for all devices of a trace. `retracePlane` is only supported in
+    /// sequential tracing with OutputLayout::Events, and not with RecordMode::LastEvent
+    virtual void trace(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                       const EventFilter& eventFilter, const RecordMode recordMode, const OutputLayout layout,
+                       const std::optional<RetracePlane>& retracePlane, const int maxEvents, const int maxBatchSize, const double seed,
+                       BatchQueue& batchQueue, const std::function<void(TracedBatch&&)>& onBatchTraced) = 0;
+
+    /// same as trace, but appends the compacted events of all batches to a buffer on the device instead of transferring them to the host. all
+    /// ray attributes are recorded. the batches passed to `onBatchTraced` contain no events. requires the batches of `batchQueue` to be traced
+    /// in order, i.e. by this device only
+    virtual std::shared_ptr<DeviceRaysStorage> traceToDevice(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask,
+                                                             const EventFilter& eventFilter, const RecordMode recordMode, const int maxEvents,
+                                                             const int maxBatchSize, const double seed, BatchQueue& batchQueue,
+                                                             const std::function<void(TracedBatch&&)>& onBatchTraced) = 0;
+
+    /// releases device buffers larger than `maxRetainedBufferBytes`. must not be called during a trace
+    virtual void trimBuffers(const int64_t maxRetainedBufferBytes) = 0;
 };
 
 }  // namespace rayx
@@ -2,6 +2,7 @@
 
 #include <alpaka/alpaka.hpp>
 
+#include "BatchPlan.h"
 #include "Beamline/Beamline.h"
 #include "Beamline/StringConversion.h"
 #include "Debug/Instrumentor.h"
@@ -26,48 +27,42 @@ struct GenRaysKernel {
     // DipoleSource
     template <typename Acc>
     RAYX_FN_ACC void operator()(const Acc& __restrict acc, RaysPtr dstRays, const int startRayIndexBatch, const DipoleSource source,
-                                const int sourceId, const int startRayIndex, const int numRaysTotal, const double seed, const int n) const {
-        const auto gid = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
-
-        if (gid < n) {
+                                const int sourceId, const int64_t startRayIndex, const int64_t numRaysTotal, const double seed, const int n) const {
+        forEachThreadElem(acc, n, [&](const int gid) {
             const auto rayPathIndex = startRayIndex + gid;
             auto rand               = Rand(rayPathIndex, numRaysTotal, seed);
             const auto ray          = source.genRay(rayPathIndex, sourceId, rand);
             const auto dstIndex     = startRayIndexBatch + gid;
             storeRay(dstIndex, dstRays, ray);
-        }
+        });
     }
 
     // RayListSource
     template <typename Acc>
     RAYX_FN_ACC void operator()(const Acc& __restrict acc, RaysPtr dstRays, const int startRayIndexBatch, const RayListSource source,
                                 const int sourceId, const int srcStartIndex, const int n) const {
-        const auto gid = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
-
-        if (gid < n) {
+        forEachThreadElem(acc, n, [&](const int gid) {
             const auto srcIndex = srcStartIndex + gid;
             auto ray            = loadRay(srcIndex, source.rays);
             ray.source_id       = sourceId;
             ray.object_id       = sourceId;
             const auto dstIndex = startRayIndexBatch + gid;
             storeRay(dstIndex, dstRays, ray);
-        }
+        });
     }
 
     // other sources
     template <typename Acc, typename Source>
     RAYX_FN_ACC void operator()(const Acc& __restrict acc, RaysPtr dstRays, const int startRayIndexBatch, const Source source, const int sourceId,
-                                const EnergyDistributionDataVariant energyDistribution, const int startRayIndex, const int numRaysTotal,
+                                const EnergyDistributionDataVariant energyDistribution, const int64_t startRayIndex, const int64_t numRaysTotal,
                                 const double seed, const int n) const {
-        const auto gid = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
-
-        if (gid < n) {
+        forEachThreadElem(acc, n, [&](const int gid) {
             const auto rayPathIndex = startRayIndex + gid;
             auto rand               = Rand(rayPathIndex, numRaysTotal, seed);
             const auto ray          = source.genRay(rayPathIndex, sourceId, energyDistribution, rand);
             const auto dstIndex     = startRayIndexBatch + gid;
             storeRay(dstIndex, dstRays, ray);
-        }
+        });
     }
 };
 
@@ -76,11 +71,7 @@ struct GenRaysKernel {
 template <typename Acc>
 struct GenRays {
     /// holds configuration state of sources
-    struct SourceConfig {
-        int numRaysTotal;
-        int numRaysBatchAtMost;
-        int numBatches;
-    };
+    using SourceConfig = BatchPlan;
 
     /// holds configuration state of one batch
     struct BatchConfig {
@@ -88,15 +79,15 @@ struct GenRays {
         RaysBuf<Acc> d_rays;
     };
 
+    /// `seed` is shared by all devices of a trace, so that any device generates the same rays for a batch. allocations are accounted in
+    /// `memoryTracker`
     template <typename Queue>
-    SourceConfig update(Queue q, const Group& beamline, const int maxBatchSize) {
+    SourceConfig update(Queue q, const Group& beamline, const int maxBatchSize, const double seed, MemoryTracker& memoryTracker) {
         RAYX_PROFILE_FUNCTION_STDOUT();
 
         const auto platformHost = alpaka::PlatformCpu{};
         const auto devHost      = alpaka::getDevByIdx(platformHost, 0);
 
-        m_startRayIndex = 0;
-
         auto rayListSourcesIndex = 0;
         const auto compileSource = [&, this](const DesignSource& designSource) -> std::optional<SourceVariant> {
             switch (designSource.getType()) {
@@ -113,11 +104,28 @@ struct GenRays {
                 case ElementType::SimpleUndulatorSource:
                     return SimpleUndulatorSource(designSource);
                 case ElementType::RayListSource: {
+                    const auto numRaysSource = static_cast<int>(designSource.getNumberOfRays());
+
+                    // rays kept on this device by a previous trace are read in place. rays on another device are copied via the host
+                    auto copiedRays = std::optional<Rays>();
+                    if (const auto deviceRays = designSource.getDeviceRayList()) {
+                        if (deviceRays->size() < numRaysSource)
+                            throw std::runtime_error(std::format("RayListSource \"{}\" has {} rays on the device, but traces {} rays",
+                                                                 designSource.getName(), deviceRays->size(), numRaysSource));
+
+                        auto* deviceRaysBuf = dynamic_cast<DeviceRaysBuf<Acc>*>(deviceRays->storage());
+                        if (deviceRaysBuf && deviceRaysBuf->devAcc() == alpaka::getDev(q))
+                            return RayListSource{.rays = raysBufToRaysPtr(deviceRaysBuf->rays)};
+
+                        RAYX_WARN << "warning: rays of RayListSource \"" << designSource.getName()
+                                  << "\" are on another device. they are copied via the host";
+                        copiedRays = deviceRays->toHost();
+                    }
+
                     const auto index = rayListSourcesIndex++;
                     if (static_cast<int>(d_rayListSources.size()) <= index) d_rayListSources.emplace_back();
-                    const auto numRaysSource = static_cast<int>(designSource.getNumberOfRays());
-                    allocRaysBuf(q, RayAttrMask::All, d_rayListSources[index], numRaysSource);
-                    const auto& rays = *designSource.getRayList();
+                    allocRaysBuf(q, RayAttrMask::All, d_rayListSources[index], numRaysSource, memoryTracker, MemoryCategory::Sources);
+                    const auto& rays = copiedRays ? *copiedRays : *designSource.getRayList();
                     assert(rays.attrMask() == RayAttrMask::All && "rays in RayListSource must contain all attributes");
 #define X(type, name, flag) alpaka::memcpy(q, *d_rayListSources[index].name, alpaka::createView(devHost, rays.name, numRaysSource), numRaysSource);
                     RAYX_X_MACRO_RAY_ATTR
@@ -166,8 +174,8 @@ struct GenRays {
                             d_energyDistributionListWeights.emplace_back();
                             d_energyDistributionListEnergies.emplace_back();
                         }
-                        allocBuf(q, d_energyDistributionListWeights[index], size);
-                        allocBuf(q, d_energyDistributionListEnergies[index], size);
+                        allocBuf(q, d_energyDistributionListWeights[index], size, memoryTracker, MemoryCategory::Sources);
+                        allocBuf(q, d_energyDistributionListEnergies[index], size, memoryTracker, MemoryCategory::Sources);
                         alpaka::memcpy(q, *d_energyDistributionListWeights[index], alpaka::createView(devHost, prefixWeights, size));
                         alpaka::memcpy(q, *d_energyDistributionListEnergies[index], alpaka::createView(devHost, energies, size));
 
@@ -186,96 +194,123 @@ struct GenRays {
                 designSource.getEnergyDistribution());
         };
 
-        m_numRaysTotal      = 0;
-        auto numRaysSources = std::vector<int>();
-        auto sourceId       = static_cast<int>(0);
+        m_numRaysTotal = 0;
+        m_sourceStates.clear();
+        auto sourceId = static_cast<int>(0);
 
         for (const auto* designSource : beamline.getSources()) {
             const auto source             = *compileSource(*designSource);
             const auto energyDistribution = compileEnergyDistribution(*designSource);
             const auto numRaysSource      = static_cast<int>(designSource->getNumberOfRays());
-            m_numRaysTotal += numRaysSource;
 
             m_sourceStates.push_back(SourceState{
-                .source                 = source,
-                .sourceId               = sourceId,
-                .energyDistribution     = energyDistribution,
-                .numRaysSource          = numRaysSource,
-                .numRaysSourceRemaining = numRaysSource,
-                .name                   = designSource->getName(),
+                .source             = source,
+                .sourceId           = sourceId,
+                .energyDistribution = energyDistribution,
+                .startRayIndex      = m_numRaysTotal,
+                .numRaysSource      = numRaysSource,
+                .name               = designSource->getName(),
             });
 
+            m_numRaysTotal += numRaysSource;
+
             ++sourceId;
         }
 
-        m_numRaysBatchAtMost = std::min(m_numRaysTotal, maxBatchSize);
+        const auto batchPlan = planBatches(m_numRaysTotal, maxBatchSize);
+        m_numRaysBatchAtMost = batchPlan.numRaysBatchAtMost;
 
-#define X(type, name, flag) allocBuf(q, d_rays.name, m_numRaysBatchAtMost);
+#define X(type, name, flag) allocBuf(q, d_rays.name, m_numRaysBatchAtMost, memoryTracker, MemoryCategory::Sources);
 
         RAYX_X_MACRO_RAY_ATTR
 #undef X
 
-        const auto numBatches = m_numRaysBatchAtMost ? ceilIntDivision(m_numRaysTotal, m_numRaysBatchAtMost) : 0;
+        m_seed = seed;
 
-        m_seed = randomDouble();
+        return batchPlan;
+    }
 
-        return {
-            .numRaysTotal       = m_numRaysTotal,
-            .numRaysBatchAtMost = m_numRaysBatchAtMost,
-            .numBatches         = numBatches,
-        };
+    /// releases buffers larger than `maxRetainedBytes`. they are allocated again by the next update
+    void trim(const int64_t maxRetainedBytes, MemoryTracker& memoryTracker) {
+        trimRaysBuf(d_rays, maxRetainedBytes, memoryTracker, MemoryCategory::Sources);
+        for (auto& buf : d_rayListSources) trimRaysBuf(buf, maxRetainedBytes, memoryTracker, MemoryCategory::Sources);
+        for (auto& buf : d_energyDistributionListWeights) trimBuf(buf, maxRetainedBytes, memoryTracker, MemoryCategory::Sources);
+        for (auto& buf : d_energyDistributionListEnergies) trimBuf(buf, maxRetainedBytes, memoryTracker, MemoryCategory::Sources);
     }
 
+    /// generates the rays of one batch. the rays of a batch only depend on the batch index, so batches can be generated in any order. the work
+    /// division of GenRaysKernel is tuned by `workDivTuner`, per source type
     template <typename DevAcc, typename Queue>
-    BatchConfig genRaysBatch(DevAcc devAcc, Queue q, const int batchIndex) {
+    BatchConfig genRaysBatch(DevAcc devAcc, Queue q, const int batchIndex, WorkDivTuner& workDivTuner) {
         RAYX_PROFILE_FUNCTION_STDOUT();
 
-        const auto batchStartRayIndex    = batchIndex * m_numRaysBatchAtMost;
+        const auto batchStartRayIndex    = static_cast<int64_t>(batchIndex) * m_numRaysBatchAtMost;
         const auto numRaysTotalRemaining = m_numRaysTotal - batchStartRayIndex;
-        const auto numRaysBatch          = std::min(numRaysTotalRemaining, m_numRaysBatchAtMost);
-        auto numRaysBatchRemaining       = numRaysBatch;
-
-        for (auto& sourceState : m_sourceStates) {
-            const auto numRaysBatchSource  = std::min(numRaysBatchRemaining, sourceState.numRaysSourceRemaining);
-            const auto startRayIndexSource = sourceState.numRaysSource - sourceState.numRaysSourceRemaining;
-
-            if (numRaysBatchSource) {
-                const auto startRayIndexBatch = numRaysBatch - numRaysBatchRemaining;
-                numRaysBatchRemaining -= numRaysBatchSource;
-                sourceState.numRaysSourceRemaining -= numRaysBatchSource;
+        const auto numRaysBatch          = static_cast<int>(std::min(numRaysTotalRemaining, static_cast<int64_t>(m_numRaysBatchAtMost)));
+        const auto batchEndRayIndex      = batchStartRayIndex + numRaysBatch;
+
+        for (const auto& sourceState : m_sourceStates) {
+            // intersection of the ray indices of the batch and the source
+            const auto startRayIndex      = std::max(batchStartRayIndex, sourceState.startRayIndex);
+            const auto endRayIndex        = std::min(batchEndRayIndex, sourceState.startRayIndex + sourceState.numRaysSource);
+            const auto numRaysBatchSource = static_cast<int>(endRayIndex - startRayIndex);
+
+            if (0 < numRaysBatchSource) {
+                // offsets within the batch and within the source fit into int
+                const auto startRayIndexBatch  = static_cast<int>(startRayIndex - batchStartRayIndex);
+                const auto startRayIndexSource = static_cast<int>(startRayIndex - sourceState.startRayIndex);
+
+                const auto* kernelName = GEN_RAYS_KERNEL_NAMES[sourceState.source.index()];
+                const auto exec        = [&](const auto&... args) {
+                    const auto launchConfig =
+                        tuneLaunchConfig<Acc>(workDivTuner, kernelName, devAcc, q, numRaysBatchSource, GenRaysKernel{}, args...);
+                    execWithValidWorkDiv<Acc>(devAcc, q, numRaysBatchSource, launchConfig, GenRaysKernel{}, args...);
+                };
 
                 std::visit(
                     [&]<typename Source>(const Source& source) {
-                        RAYX_VERB << "execute GenRaysKernel<Source> with Source = '" << sourceState.name << "'";
+                        RAYX_VERB << "execute " << kernelName << " for source '" << sourceState.name << "'";
 
                         // DipoleSource
                         if constexpr (std::is_same_v<Source, DipoleSource>) {
-                            execWithValidWorkDiv<Acc>(devAcc, q, numRaysBatchSource, BlockSizeConstraint::None{}, GenRaysKernel{},
-                                                      raysBufToRaysPtr(d_rays), startRayIndexBatch, source, sourceState.sourceId, m_startRayIndex,
-                                                      m_numRaysTotal, m_seed, numRaysBatchSource);
+                            exec(raysBufToRaysPtr(d_rays), startRayIndexBatch, source, sourceState.sourceId, startRayIndex, m_numRaysTotal, m_seed,
+                                 numRaysBatchSource);
                         }
 
                         // RayListSource
                         else if constexpr (std::is_same_v<Source, RayListSource>) {
-                            execWithValidWorkDiv<Acc>(devAcc, q, numRaysBatchSource, BlockSizeConstraint::None{}, GenRaysKernel{},
-                                                      raysBufToRaysPtr(d_rays), startRayIndexBatch, source, sourceState.sourceId, startRayIndexSource,
-                                                      numRaysBatchSource);
+                            exec(raysBufToRaysPtr(d_rays), startRayIndexBatch, source, sourceState.sourceId, startRayIndexSource, numRaysBatchSource);
                         }
 
                         // other sources
                         else {
-                            execWithValidWorkDiv<Acc>(devAcc, q, numRaysBatchSource, BlockSizeConstraint::None{}, GenRaysKernel{},
-                                                      raysBufToRaysPtr(d_rays), startRayIndexBatch, source, sourceState.sourceId,
-                                                      *sourceState.energyDistribution, m_startRayIndex, m_numRaysTotal, m_seed, numRaysBatchSource);
+                            exec(raysBufToRaysPtr(d_rays), startRayIndexBatch, source, sourceState.sourceId, *sourceState.energyDistribution,
+                                 startRayIndex, m_numRaysTotal, m_seed, numRaysBatchSource);
                         }
                     },
                     sourceState.source);
+            }
+        }
+
+        return BatchConfig{
+            .numRaysBatch = numRaysBatch,
+            .d_rays       = d_rays,
+        };
+    }
 
-                m_startRayIndex += numRaysBatchSource;
+    /// loads the rays of one batch from `rays` instead of generating them, e.g. the ray states captured by a RetraceCache
+    template <typename Queue>
+    BatchConfig loadRaysBatch(Queue q, const Rays& rays) {
+        RAYX_PROFILE_FUNCTION_STDOUT();
 
-                assert(0 <= numRaysBatchRemaining);
-                if (numRaysBatchRemaining == 0) break;
-            }
+        const auto devHost      = alpaka::getDevByIdx(alpaka::PlatformCpu{}, 0);
+        const auto numRaysBatch = static_cast<int>(rays.size());
+        assert(numRaysBatch <= m_numRaysBatchAtMost && rays.attrMask() == RayAttrMask::All);
+
+        if (0 < numRaysBatch) {
+#define X(type, name, flag) alpaka::memcpy(q, *d_rays.name, alpaka::createView(devHost, rays.name, numRaysBatch), numRaysBatch);
+            RAYX_X_MACRO_RAY_ATTR
+#undef X
         }
 
         return BatchConfig{
@@ -297,18 +332,25 @@ struct GenRays {
 
     using SourceVariant = std::variant<CircleSource, DipoleSource, MatrixSource, PixelSource, PointSource, SimpleUndulatorSource, RayListSource>;
 
+    /// names of the instantiations of GenRaysKernel per alternative of SourceVariant. their work divisions are tuned separately
+    static constexpr const char* GEN_RAYS_KERNEL_NAMES[] = {
+        "GenRaysKernel<CircleSource>", "GenRaysKernel<DipoleSource>",           "GenRaysKernel<MatrixSource>",  "GenRaysKernel<PixelSource>",
+        "GenRaysKernel<PointSource>",  "GenRaysKernel<SimpleUndulatorSource>", "GenRaysKernel<RayListSource>",
+    };
+    static_assert(std::size(GEN_RAYS_KERNEL_NAMES) == std::variant_size_v<SourceVariant>);
+
     struct SourceState {
         const SourceVariant source;
         const int sourceId;
         const std::optional<EnergyDistributionDataVariant> energyDistribution;
+        /// index of the first ray of this source, counted over all sources
+        int64_t startRayIndex;
         int numRaysSource;
-        int numRaysSourceRemaining;
         std::string name;
     };
 
     std::vector<SourceState> m_sourceStates;
-    int m_startRayIndex;
-    int m_numRaysTotal;
+    int64_t m_numRaysTotal;
     int m_numRaysBatchAtMost;
     double m_seed;
 };
@@ -9,7 +9,10 @@
 #include "GenRays.h"
 #include "Material/Material.h"
 #include "Random.h"
+#include "Shader/CollisionPacket.h"
+#include "Shader/DeviceError.h"
 #include "Shader/Trace.h"
+#include "Shader/TraceCounters.h"
 #include "Util.h"
 
 namespace rayx {
@@ -18,36 +21,109 @@ namespace {
 constexpr int WARP_SIZE            = 32;
 constexpr int GRID_STRIDE_MULTIPLE = WARP_SIZE;
 
+/// counts the error and keeps it, if fewer than DEVICE_ERROR_RECORDS_PER_CODE errors with its code were kept
+template <typename Acc>
+RAYX_FN_ACC inline void recordDeviceError(const Acc& __restrict acc, const DeviceErrorsPtr& errors, const DeviceError& error) {
+    if (error.code == DeviceErrorCode::None) return;
+
+    const auto code  = static_cast<int>(error.code);
+    const auto index = alpaka::atomicAdd(acc, errors.counts + code, 1, alpaka::hierarchy::Grids{});
+    if (index < DEVICE_ERROR_RECORDS_PER_CODE) errors.records[code * DEVICE_ERROR_RECORDS_PER_CODE + index] = error;
+}
+
+/// the threads of a block add to the same row of trace counters (see TraceCounters.h)
+template <typename Acc>
+RAYX_FN_ACC inline void selectTraceCounterSlot(const Acc& __restrict acc, const ConstState& __restrict constState, MutableState& mutableState) {
+    const auto blockIndex = static_cast<int>(alpaka::getIdx<alpaka::Grid, alpaka::Blocks>(acc)[0]);
+    mutableState.counters = traceCounterSlot(mutableState.counters, blockIndex, constState.numElements);
+}
+
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
 struct TraceSequentialKernel {
     template <typename Acc>
     RAYX_FN_ACC void operator()(const Acc& __restrict acc, const ConstState constState, MutableState mutableState, const int n) const {
-        const auto gid = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
+        selectTraceCounterSlot(acc, constState, mutableState);
+        forEachThreadElem(acc, n, [&](const int gid) {
+            recordDeviceError(acc, mutableState.errors, traceSequential<RecordMask, ElementTypes>(gid, constState, mutableState));
+        });
+    }
+};
 
-        if (gid < n) traceSequential(gid, constState, mutableState);
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
+struct TraceSequentialPacketKernel {
+    template <typename Acc>
+    RAYX_FN_ACC void operator()(const Acc& __restrict acc, const ConstState constState, MutableState mutableState, const int n) const {
+        selectTraceCounterSlot(acc, constState, mutableState);
+        const auto numPackets = (n + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE;
+
+        forEachThreadElem(acc, numPackets, [&](const int packetIndex) {
+            const auto firstGid = packetIndex * RAY_PACKET_SIZE;
+            const auto numRays  = std::min(RAY_PACKET_SIZE, n - firstGid);
+            DeviceError errors[RAY_PACKET_SIZE];
+            traceSequentialPacket<RecordMask, ElementTypes>(firstGid, numRays, constState, mutableState, errors);
+            for (int lane = 0; lane < numRays; ++lane) recordDeviceError(acc, mutableState.errors, errors[lane]);
+        });
     }
 };
 
+template <RayAttrMask RecordMask, ElementTypeMask ElementTypes>
 struct TraceNonSequentialKernel {
     template <typename Acc>
     RAYX_FN_ACC void operator()(const Acc& __restrict acc, const ConstState constState, MutableState mutableState, const int n) const {
-        const auto gid = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
-
-        if (gid < n) traceNonSequential(gid, constState, mutableState);
+        selectTraceCounterSlot(acc, constState, mutableState);
+        forEachThreadElem(acc, n, [&](const int gid) {
+            recordDeviceError(acc, mutableState.errors, traceNonSequential<RecordMask, ElementTypes>(gid, constState, mutableState));
+        });
     }
 };
 
+/// calls `fn` with the first mask in `Masks` that contains `mask`, passed as std::integral_constant. used to select the specialization of the
+/// trace kernels for a record mask (TRACE_RECORD_MASKS) or for the element types of a beamline (TRACE_ELEMENT_TYPE_MASKS)
+template <const auto& Masks, int I = 0, typename Mask, typename Fn>
+void dispatchTraceMask(const Mask mask, Fn&& fn) {
+    constexpr Mask specializedMask = Masks[I];
+
+    if constexpr (I + 1 == static_cast<int>(std::size(Masks))) {
+        static_assert(specializedMask == Mask::All, "the last mask must contain all other masks");
+        fn(std::integral_constant<Mask, specializedMask>{});
+    } else {
+        if (contains(specializedMask, mask))
+            fn(std::integral_constant<Mask, specializedMask>{});
+        else
+            dispatchTraceMask<Masks, I + 1>(mask, std::forward<Fn>(fn));
+    }
+}
+
 struct ScatterCompactKernel {
     template <typename Acc, typename T>
     RAYX_FN_ACC void operator()(const Acc& __restrict acc, T* __restrict dst, const T* __restrict src, const int* __restrict prefix,
                                 const bool* __restrict flags, const int n) const {
-        const auto gid = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
+        forEachThreadElem(acc, n, [&](const int gid) {
+            if (flags[gid]) {
+                const auto index = prefix[gid];
+                dst[index]       = src[gid];
+            }
+        });
+    }
+};
 
-        if (gid < n && flags[gid]) {
-            const auto index = prefix[gid];
-            dst[index]       = src[gid];
+/// computes the compaction destinations `prefix` of the flagged events of a batch, so that the events are grouped by path (see
+/// OutputLayout::ByPath). the event slots of ray `gid` are `gid + slot * gridStride`. returns the offsets of the paths of the `numRays` rays
+inline std::vector<int64_t> groupEventsByPath(const bool* flags, int* prefix, const int numRays, const int numRecordSlots, const int gridStride) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    auto pathOffsets = std::vector<int64_t>(numRays + 1, 0);
+    for (int gid = 0; gid < numRays; ++gid) {
+        auto offset = static_cast<int>(pathOffsets[gid]);
+        for (int slot = 0; slot < numRecordSlots; ++slot) {
+            const auto i = gid + slot * gridStride;
+            prefix[i]    = offset;
+            offset += flags[i];
         }
+        pathOffsets[gid + 1] = offset;
     }
-};
+    return pathOffsets;
+}
 
 }  // unnamed namespace
 
@@ -72,6 +148,8 @@ struct Resources {
 
     /// mask for which elements to record events
     OptBuf<Acc, bool> d_objectRecordMask;
+    /// dense slot of each recorded object among the event slots of a ray (see ObjectIndexMask::recordSlots)
+    OptBuf<Acc, int> d_objectRecordSlots;
 
     // output events per tracing. required if 'events' is enabled in output config
     /// output events from tracer kernel
@@ -82,16 +160,31 @@ struct Resources {
     OptBuf<Acc, bool> d_eventStoreFlags;
     OptBuf<Acc, int> d_eventStoreFlagsPrefixSum;
 
+    /// states of the rays leaving the element of a RetracePlane. only allocated when capturing
+    RaysBuf<Acc> d_capturedRays;
+
+    // performance counters per tracing. only allocated if RAYX_TRACE_COUNTERS is defined
+    /// NUM_TRACE_COUNTER_SLOTS rows of counters, shared by the blocks of the trace kernels (see Shader/TraceCounters.h)
+    OptBuf<Acc, TraceCounter> d_traceCounters;
+
+    // errors per tracing (see Shader/DeviceError.h)
+    /// number of errors per error code
+    OptBuf<Acc, int> d_deviceErrorCounts;
+    /// the first errors per error code
+    OptBuf<Acc, DeviceError> d_deviceErrorRecords;
+
     /// holds configuration state of allocated resources. required to trace correctly
     struct BeamlineConfig {
         int numSources;
         int numElements;
+        /// surface and behaviour types occurring in the beamline
+        ElementTypeMask elementTypes;
     };
 
-    /// update resources
+    /// update resources. event buffers hold `numRecordSlots` events per ray. allocations are accounted in `memoryTracker`
     template <typename Queue>
-    BeamlineConfig update(Queue q, const Group& group, int maxEvents, int numRaysBatchAtMost, const ObjectIndexMask& objectRecordMask,
-                          const RayAttrMask attrRecordMask) {
+    BeamlineConfig update(Queue q, const Group& group, int numRecordSlots, int numRaysBatchAtMost, const ObjectIndexMask& objectRecordMask,
+                          const RayAttrMask attrRecordMask, MemoryTracker& memoryTracker) {
         RAYX_PROFILE_FUNCTION_STDOUT();
 
         const auto platformHost = alpaka::PlatformCpu{};
@@ -103,8 +196,8 @@ struct Resources {
         const auto& materialTable     = materialTables.materials;
         const auto numMaterialIndices = static_cast<int>(materialIndices.size());
         const auto materialTableSize  = static_cast<int>(materialTable.size());
-        allocBuf(q, d_materialIndices, materialIndices.size());
-        allocBuf(q, d_materialTable, materialTable.size());
+        allocBuf(q, d_materialIndices, numMaterialIndices, memoryTracker, MemoryCategory::Materials);
+        allocBuf(q, d_materialTable, materialTableSize, memoryTracker, MemoryCategory::Materials);
         alpaka::memcpy(q, *d_materialIndices, alpaka::createView(devHost, materialIndices, numMaterialIndices));
         alpaka::memcpy(q, *d_materialTable, alpaka::createView(devHost, materialTable, materialTableSize));
 
@@ -115,7 +208,9 @@ struct Resources {
         std::transform(elementsAndTransforms.begin(), elementsAndTransforms.end(), elements.begin(),
                        [](const OpticalElementAndTransform& e) { return e.element; });
         const auto numElements = static_cast<int>(elements.size());
-        allocBuf(q, d_elements, numElements);
+        auto elementTypes      = ElementTypeMask::None;
+        for (const auto& element : elements) elementTypes |= getElementTypeMask(element.m_surface, element.m_behaviour);
+        allocBuf(q, d_elements, numElements, memoryTracker, MemoryCategory::Beamline);
         alpaka::memcpy(q, *d_elements, alpaka::createView(devHost, elements, numElements));
 
         const auto sources    = group.getSources();
@@ -134,31 +229,61 @@ struct Resources {
         });
         std::transform(elementsAndTransforms.begin(), elementsAndTransforms.end(), h_objectTransforms.begin() + numSources,
                        [](const OpticalElementAndTransform& e) { return e.transform; });
-        allocBuf(q, d_objectTransforms, numObjects);
+        allocBuf(q, d_objectTransforms, numObjects, memoryTracker, MemoryCategory::Beamline);
         alpaka::memcpy(q, *d_objectTransforms, alpaka::createView(devHost, h_objectTransforms, numObjects), numObjects);
 
         // object record mask
-        allocBuf(q, d_objectRecordMask, numObjects);
+        allocBuf(q, d_objectRecordMask, numObjects, memoryTracker, MemoryCategory::Beamline);
         auto h_objectRecordMask = std::make_unique<bool[]>(numObjects);
         for (int i = 0; i < numObjects; ++i) { h_objectRecordMask[i] = objectRecordMask.shouldRecordObject(i); }
         alpaka::memcpy(q, *d_objectRecordMask, alpaka::createView(devHost, h_objectRecordMask.get(), numObjects));
 
-        const auto numEventsBatchAtMost                     = numRaysBatchAtMost * maxEvents;
-        const auto numEventsBatchAtMostAccountForGridStride = nextMultiple(numRaysBatchAtMost, GRID_STRIDE_MULTIPLE) * maxEvents;
+        // object record slots
+        allocBuf(q, d_objectRecordSlots, numObjects, memoryTracker, MemoryCategory::Beamline);
+        const auto h_objectRecordSlots = objectRecordMask.recordSlots();
+        alpaka::memcpy(q, *d_objectRecordSlots, alpaka::createView(devHost, h_objectRecordSlots, numObjects));
+
+        const auto numEventsBatchAtMostAccountForGridStride =
+            checkedBufferSize(nextMultiple(numRaysBatchAtMost, GRID_STRIDE_MULTIPLE), numRecordSlots, "events");
 
-        // output events and compacted output events
-        allocRaysBuf(q, attrRecordMask, d_eventsBatch, numEventsBatchAtMostAccountForGridStride);
-        allocRaysBuf(q, attrRecordMask, d_compactEventsBatch, numEventsBatchAtMost);
+        // output events. the compacted output events are only needed for the transfer to the host, see traceBatches
+        allocRaysBuf(q, attrRecordMask, d_eventsBatch, numEventsBatchAtMostAccountForGridStride, memoryTracker, MemoryCategory::Events);
 
         // event storage flags, used for compaction of events
-        allocBuf(q, d_eventStoreFlags, numEventsBatchAtMostAccountForGridStride);
-        allocBuf(q, d_eventStoreFlagsPrefixSum, numEventsBatchAtMostAccountForGridStride);
+        allocBuf(q, d_eventStoreFlags, numEventsBatchAtMostAccountForGridStride, memoryTracker, MemoryCategory::CompactionFlags);
+        allocBuf(q, d_eventStoreFlagsPrefixSum, numEventsBatchAtMostAccountForGridStride, memoryTracker, MemoryCategory::CompactionFlags);
+
+        allocBuf(q, d_deviceErrorCounts, NUM_DEVICE_ERROR_CODES, memoryTracker, MemoryCategory::DeviceErrors);
+        allocBuf(q, d_deviceErrorRecords, NUM_DEVICE_ERROR_CODES * DEVICE_ERROR_RECORDS_PER_CODE, memoryTracker, MemoryCategory::DeviceErrors);
+
+#ifdef RAYX_TRACE_COUNTERS
+        allocBuf(q, d_traceCounters, NUM_TRACE_COUNTER_SLOTS * numTraceCounterColumns(numElements), memoryTracker, MemoryCategory::TraceCounters);
+#endif
 
         return {
-            .numSources  = numSources,
-            .numElements = numElements,
+            .numSources   = numSources,
+            .numElements  = numElements,
+            .elementTypes = elementTypes,
         };
     }
+
+    /// releases buffers larger than `maxRetainedBytes`. they are allocated again by the next update
+    void trim(const int64_t maxRetainedBytes, MemoryTracker& memoryTracker) {
+        trimBuf(d_materialIndices, maxRetainedBytes, memoryTracker, MemoryCategory::Materials);
+        trimBuf(d_materialTable, maxRetainedBytes, memoryTracker, MemoryCategory::Materials);
+        trimBuf(d_objectTransforms, maxRetainedBytes, memoryTracker, MemoryCategory::Beamline);
+        trimBuf(d_elements, maxRetainedBytes, memoryTracker, MemoryCategory::Beamline);
+        trimBuf(d_objectRecordMask, maxRetainedBytes, memoryTracker, MemoryCategory::Beamline);
+        trimBuf(d_objectRecordSlots, maxRetainedBytes, memoryTracker, MemoryCategory::Beamline);
+        trimRaysBuf(d_eventsBatch, maxRetainedBytes, memoryTracker, MemoryCategory::Events);
+        trimRaysBuf(d_compactEventsBatch, maxRetainedBytes, memoryTracker, MemoryCategory::CompactEvents);
+        trimBuf(d_eventStoreFlags, maxRetainedBytes, memoryTracker, MemoryCategory::CompactionFlags);
+        trimBuf(d_eventStoreFlagsPrefixSum, maxRetainedBytes, memoryTracker, MemoryCategory::CompactionFlags);
+        trimRaysBuf(d_capturedRays, maxRetainedBytes, memoryTracker, MemoryCategory::RayStates);
+        trimBuf(d_traceCounters, maxRetainedBytes, memoryTracker, MemoryCategory::TraceCounters);
+        trimBuf(d_deviceErrorCounts, maxRetainedBytes, memoryTracker, MemoryCategory::DeviceErrors);
+        trimBuf(d_deviceErrorRecords, maxRetainedBytes, memoryTracker, MemoryCategory::DeviceErrors);
+    }
 };
 
 /**
@@ -179,12 +304,15 @@ struct Resources {
  * 2. Execute the mega-kernel tracing function.
  * 3. Compact recorded events to optimize memory transfers.
  * 4. Transfer compacted recorded events back to the host.
- * 5. Aggregate results from all batches into a final Rays object for output.
+ * 5. Hand the results of each batch to the Tracer, which aggregates the batches of all devices into a final Rays object.
  */
 template <typename AccTag>
 class MegaKernelTracer : public DeviceTracer {
   public:
-    explicit MegaKernelTracer(int deviceIndex) : m_deviceIndex(deviceIndex) {}
+    /// allocations of this tracer are accounted in `memoryTracker`, and the work divisions of its kernels are tuned by `workDivTuner`. both may be
+    /// shared with other device tracers
+    MegaKernelTracer(int deviceIndex, std::shared_ptr<MemoryTracker> memoryTracker, std::shared_ptr<WorkDivTuner> workDivTuner)
+        : m_deviceIndex(deviceIndex), m_memoryTracker(std::move(memoryTracker)), m_workDivTuner(std::move(workDivTuner)) {}
     MegaKernelTracer(const MegaKernelTracer&)            = delete;
     MegaKernelTracer(MegaKernelTracer&&)                 = default;
     MegaKernelTracer& operator=(const MegaKernelTracer&) = delete;
@@ -195,19 +323,59 @@ class MegaKernelTracer : public DeviceTracer {
     using Idx = int;
     using Acc = alpaka::TagToAcc<AccTag, Dim, Idx>;
 
+    /// on the cpu, one thread traces a packet of rays, which enables SIMD for the collision functions
+    static constexpr bool TRACE_RAY_PACKETS = std::is_same_v<AccTag, alpaka::TagCpuSerial> || std::is_same_v<AccTag, alpaka::TagCpuOmp2Blocks>;
+
     const int m_deviceIndex;
+    std::shared_ptr<MemoryTracker> m_memoryTracker;
+    std::shared_ptr<WorkDivTuner> m_workDivTuner;
     Resources<Acc> m_resources;
 
     using GenRaysAcc = GenRays<Acc>;
     GenRaysAcc m_genRaysResources;
 
   public:
-    virtual Rays trace(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
-                       const int maxEventsElements, const int maxBatchSize) override {
+    virtual void trace(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                       const EventFilter& eventFilter, const RecordMode recordMode, const OutputLayout layout,
+                       const std::optional<RetracePlane>& retracePlane, const int maxEventsElements, const int maxBatchSize, const double seed,
+                       BatchQueue& batchQueue, const std::function<void(TracedBatch&&)>& onBatchTraced) override {
+        RAYX_PROFILE_FUNCTION_STDOUT();
+
+        traceBatches(beamline, sequential, objectRecordMask, attrRecordMask, eventFilter, recordMode, layout, retracePlane, maxEventsElements,
+                     maxBatchSize, seed, batchQueue, onBatchTraced, nullptr);
+    }
+
+    virtual std::shared_ptr<DeviceRaysStorage> traceToDevice(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask,
+                                                             const EventFilter& eventFilter, const RecordMode recordMode, const int maxEventsElements,
+                                                             const int maxBatchSize, const double seed, BatchQueue& batchQueue,
+                                                             const std::function<void(TracedBatch&&)>& onBatchTraced) override {
         RAYX_PROFILE_FUNCTION_STDOUT();
 
+        const auto devAcc = alpaka::getDevByIdx(alpaka::Platform<Acc>{}, m_deviceIndex);
+        auto deviceOutput = std::make_shared<DeviceRaysBuf<Acc>>(devAcc, m_memoryTracker);
+
+        // all attributes are kept, so that the events can be the rays of a RayListSource
+        traceBatches(beamline, sequential, objectRecordMask, RayAttrMask::All, eventFilter, recordMode, OutputLayout::Events, std::nullopt,
+                     maxEventsElements, maxBatchSize, seed, batchQueue, onBatchTraced, deviceOutput.get());
+        return deviceOutput;
+    }
+
+    virtual void trimBuffers(const int64_t maxRetainedBufferBytes) override {
+        m_resources.trim(maxRetainedBufferBytes, *m_memoryTracker);
+        m_genRaysResources.trim(maxRetainedBufferBytes, *m_memoryTracker);
+    }
+
+  private:
+    /// traces the batches of `batchQueue`. if `deviceOutput` is set, the events are appended to it instead of being transferred to the host
+    void traceBatches(const Group& beamline, Sequential sequential, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                      const EventFilter& eventFilter, const RecordMode recordMode, const OutputLayout layout,
+                      const std::optional<RetracePlane>& retracePlane, const int maxEventsElements, const int maxBatchSize, const double seed,
+                      BatchQueue& batchQueue, const std::function<void(TracedBatch&&)>& onBatchTraced, DeviceRaysBuf<Acc>* deviceOutput) {
+
         const auto maxEventsSources = 1;
         const auto maxEvents        = maxEventsSources + maxEventsElements;
+        // at least one slot, so that the event buffers are never empty, even if no object is recorded
+        const auto numRecordSlots = std::max(1, getNumRecordSlots(recordMode, sequential, maxEvents, objectRecordMask.numRecordSlots()));
 
         const auto platformHost = alpaka::PlatformCpu{};
         const auto devHost      = alpaka::getDevByIdx(platformHost, 0);
@@ -216,14 +384,16 @@ class MegaKernelTracer : public DeviceTracer {
         using Queue             = alpaka::Queue<Acc, alpaka::Blocking>;
         auto q                  = Queue(devAcc);
 
-        const auto sourceConf   = m_genRaysResources.update(q, beamline, maxBatchSize);
-        const auto beamlineConf = m_resources.update(q, beamline, maxEvents, sourceConf.numRaysBatchAtMost, objectRecordMask, attrRecordMask);
+        const auto sourceConf   = m_genRaysResources.update(q, beamline, maxBatchSize, seed, *m_memoryTracker);
+        const auto beamlineConf =
+            m_resources.update(q, beamline, numRecordSlots, sourceConf.numRaysBatchAtMost, objectRecordMask, attrRecordMask, *m_memoryTracker);
 
         RAYX_VERB << "trace beamline:";
         RAYX_VERB << "\t- num sources: " << beamlineConf.numSources;
         RAYX_VERB << "\t- num elements: " << beamlineConf.numElements;
         RAYX_VERB << "\t- sequential: " << (sequential == Sequential::Yes ? "yes" : "no");
         RAYX_VERB << "\t- max events on elements: " << maxEventsElements;
+        RAYX_VERB << "\t- record slots per ray: " << numRecordSlots;
         RAYX_VERB << "\t- num rays: " << sourceConf.numRaysTotal;
         RAYX_VERB << "\t- max batch size: " << maxBatchSize;
         RAYX_VERB << "\t- batch size: " << sourceConf.numRaysBatchAtMost;
@@ -235,119 +405,226 @@ class MegaKernelTracer : public DeviceTracer {
         RAYX_VERB << "\t- device name: " << alpaka::getName(devAcc);
         RAYX_VERB << "\t- host device name: " << alpaka::getName(devHost);
 
+        // a RetracePlane either resumes from the captured ray states or captures them. in sequential tracing, the record slots of the objects up to
+        // the element come first, so the events recorded up to the element are a prefix of the events of a batch
+        const auto* resumeRayStates  = retracePlane ? retracePlane->rayStates : nullptr;
+        const auto captureRayStates  = retracePlane && !resumeRayStates;
+        auto numRecordSlotsUpToPlane = 0;
+        if (retracePlane) {
+            RAYX_VERB << "\t- " << (resumeRayStates ? "resume after" : "capture rays leaving") << " element: " << retracePlane->elementIndex;
+            const auto slots = objectRecordMask.recordSlots();
+            for (int i = 0; i <= objectRecordMask.numSources() + retracePlane->elementIndex; ++i)
+                numRecordSlotsUpToPlane = std::max(numRecordSlotsUpToPlane, slots[i] + 1);
+        }
+        if (captureRayStates)
+            allocRaysBuf(q, RayAttrMask::All, m_resources.d_capturedRays, sourceConf.numRaysBatchAtMost, *m_memoryTracker, MemoryCategory::RayStates);
+
+        // events kept on the device are compacted into the device output directly
+        if (!deviceOutput) {
+            const auto numEventsBatchAtMost = checkedBufferSize(sourceConf.numRaysBatchAtMost, numRecordSlots, "events");
+            allocRaysBuf(q, attrRecordMask, m_resources.d_compactEventsBatch, numEventsBatchAtMost, *m_memoryTracker, MemoryCategory::CompactEvents);
+        }
+
         const auto numRaysBatchAtMostAccountForGridStride   = nextMultiple(sourceConf.numRaysBatchAtMost, GRID_STRIDE_MULTIPLE);
-        const auto numEventsBatchAtMostAccountForGridStride = numRaysBatchAtMostAccountForGridStride * maxEvents;
-        auto h_compactEventsBatches                         = std::vector<Rays>(sourceConf.numBatches);
+        const auto numEventsBatchAtMostAccountForGridStride = checkedBufferSize(numRaysBatchAtMostAccountForGridStride, numRecordSlots, "events");
         auto h_eventStoreFlags                              = std::make_unique<bool[]>(numEventsBatchAtMostAccountForGridStride);
         auto h_eventStoreFlagsPrefixSum                     = std::vector<int>(numEventsBatchAtMostAccountForGridStride);
-        auto numEventsTotal                                 = 0;
+        auto numEventsTotal                                 = int64_t{0};
 
-        for (int batchIndex = 0; batchIndex < sourceConf.numBatches; ++batchIndex) {
+        const auto hostCompactionFlagsBytes = static_cast<int64_t>(numEventsBatchAtMostAccountForGridStride) * (sizeof(bool) + sizeof(int));
+        const auto hostCompactionFlags      = ScopedMemoryAllocation(*m_memoryTracker, MemoryCategory::HostCompactionFlags, hostCompactionFlagsBytes);
+
+        // a cancelled trace stops here, between batches
+        while (const auto nextBatchIndex = batchQueue.pop()) {
+            const auto batchIndex = *nextBatchIndex;
+            assert(batchIndex < sourceConf.numBatches);
             RAYX_VERB << "processing batch (" << (batchIndex + 1) << "/" << sourceConf.numBatches << ")";
 
-            // generate input rays for batch
-            auto batchConf = m_genRaysResources.genRaysBatch(devAcc, q, batchIndex);
+            // generate input rays for batch, or load the ray states to resume from
+            auto batchConf = resumeRayStates ? m_genRaysResources.loadRaysBatch(q, resumeRayStates->at(batchIndex))
+                                             : m_genRaysResources.genRaysBatch(devAcc, q, batchIndex, *m_workDivTuner);
 
             const auto numRaysBatchAccountForGridStride   = nextMultiple(batchConf.numRaysBatch, GRID_STRIDE_MULTIPLE);
-            const auto numEventsBatchAccountForGridStride = numRaysBatchAccountForGridStride * maxEvents;
+            const auto numEventsBatchAccountForGridStride = numRaysBatchAccountForGridStride * numRecordSlots;
 
-            // clear buffers
+            // clear buffers. the trace counters and errors are cleared by traceBatch
             alpaka::memset(q, *m_resources.d_eventStoreFlags, 0, numEventsBatchAccountForGridStride);
 
             // from here we need to account for grid stride in the output buffers of the trace function: uncompacte events and storedFlag
 
             // trace current batch
-            traceBatch(devAcc, q, beamlineConf.numSources, beamlineConf.numElements, maxEvents, sequential, attrRecordMask, batchConf,
+            traceBatch(devAcc, q, beamlineConf, maxEvents, sequential, recordMode, attrRecordMask, eventFilter, retracePlane, batchConf,
                        numRaysBatchAccountForGridStride);
 
             alpaka::memcpy(q, alpaka::createView(devHost, h_eventStoreFlags.get(), numEventsBatchAccountForGridStride),
                            *m_resources.d_eventStoreFlags, numEventsBatchAccountForGridStride);
-            const auto h_eventStoreFlagsPrefixSumEnd = std::exclusive_scan(
-                h_eventStoreFlags.get(), h_eventStoreFlags.get() + numEventsBatchAccountForGridStride, h_eventStoreFlagsPrefixSum.begin(), 0);
-            const auto numEventsBatch =
-                *(h_eventStoreFlagsPrefixSumEnd - 1);  // access the last element of the exclusive scan result to get the total count
+
+            // the compaction scatters every flagged event to its entry of the prefix sum. grouping the events by path only changes the prefix sum
+            auto pathOffsets    = std::vector<int64_t>();
+            auto numEventsBatch = 0;
+            if (layout == OutputLayout::ByPath) {
+                pathOffsets    = groupEventsByPath(h_eventStoreFlags.get(), h_eventStoreFlagsPrefixSum.data(), batchConf.numRaysBatch, numRecordSlots,
+                                                   numRaysBatchAccountForGridStride);
+                numEventsBatch = static_cast<int>(pathOffsets.back());
+            } else {
+                const auto h_eventStoreFlagsPrefixSumEnd = std::exclusive_scan(
+                    h_eventStoreFlags.get(), h_eventStoreFlags.get() + numEventsBatchAccountForGridStride, h_eventStoreFlagsPrefixSum.begin(), 0);
+                numEventsBatch = *(h_eventStoreFlagsPrefixSumEnd - 1);  // access the last element of the exclusive scan result to get the total count
+            }
+            const auto numEventsUpToPlane = numRecordSlotsUpToPlane < numRecordSlots
+                                                ? h_eventStoreFlagsPrefixSum[numRecordSlotsUpToPlane * numRaysBatchAccountForGridStride]
+                                                : numEventsBatch;
             alpaka::memcpy(q, *m_resources.d_eventStoreFlagsPrefixSum,
                            alpaka::createView(devHost, h_eventStoreFlagsPrefixSum, numEventsBatchAccountForGridStride),
                            numEventsBatchAccountForGridStride);
 
-            // TODO: here we could apply more filters by turning off storedFlags
+            // events rejected by the event filter were never flagged as stored by the trace kernel, so the compaction removes them
 
-            // compact events to remove unused events
-            compactEvents(devAcc, q, numEventsBatchAccountForGridStride, attrRecordMask);
+            // compact events to remove unused events. events kept on the device are appended to the device output
+            if (deviceOutput) {
+                const auto offset = deviceOutput->numEvents;
+                const auto size   = checkedBufferSize(static_cast<int64_t>(offset) + numEventsBatch, 1, "device rays");
+                deviceOutput->grow(q, size);
+                compactEvents(devAcc, q, numEventsBatchAccountForGridStride, attrRecordMask, deviceOutput->rays, offset);
+                deviceOutput->numEvents = size;
+            } else {
+                compactEvents(devAcc, q, numEventsBatchAccountForGridStride, attrRecordMask, m_resources.d_compactEventsBatch, 0);
+            }
 
             // end of acocunt for grid stride, because from here we use the compacted buffers
 
             numEventsTotal += numEventsBatch;
 
-            h_compactEventsBatches[batchIndex] = transferEventsBatch(devHost, q, numEventsBatch, attrRecordMask);
+            onBatchTraced(TracedBatch{
+                .batchIndex         = batchIndex,
+                .numRays            = batchConf.numRaysBatch,
+                .rays               = deviceOutput ? Rays() : transferEventsBatch(devHost, q, numEventsBatch, attrRecordMask),
+                .firstPathId        = static_cast<int64_t>(batchIndex) * sourceConf.numRaysBatchAtMost,
+                .pathOffsets        = std::move(pathOffsets),
+                .numEventsOnDevice  = deviceOutput ? numEventsBatch : 0,
+                .rayStates          = captureRayStates ? transferRayStates(devHost, q, batchConf.numRaysBatch) : Rays(),
+                .numEventsUpToPlane = captureRayStates ? numEventsUpToPlane : 0,
+                .counters           = transferTraceCounters(devHost, q, batchConf.numRaysBatch, beamlineConf.numElements),
+                .errors             = transferDeviceErrors(devHost, q),
+            });
 
             RAYX_VERB << "finished batch (" << (batchIndex + 1) << "/" << sourceConf.numBatches << ") with batch size = " << batchConf.numRaysBatch
                       << ", recorded " << numEventsBatch << " events";
         }
 
-        RAYX_VERB << "number of recorded events: " << numEventsTotal;
-
-        return Rays::concat(h_compactEventsBatches);
+        if (batchQueue.isCancelled()) RAYX_VERB << "trace cancelled on device " << m_deviceIndex;
+        RAYX_VERB << "number of recorded events on device " << m_deviceIndex << ": " << numEventsTotal;
     }
 
-  private:
     template <typename DevAcc, typename Queue>
-    void traceBatch(DevAcc devAcc, Queue q, int numSources, int numElements, int maxEvents, Sequential sequential, RayAttrMask attrRecordMask,
-                    GenRaysAcc::BatchConfig& batchConf, int numRaysBatchAccountForGridStride) {
+    void traceBatch(DevAcc devAcc, Queue q, const typename Resources<Acc>::BeamlineConfig& beamlineConf, int maxEvents, Sequential sequential,
+                    RecordMode recordMode, RayAttrMask attrRecordMask, const EventFilter& eventFilter,
+                    const std::optional<RetracePlane>& retracePlane, GenRaysAcc::BatchConfig& batchConf, int numRaysBatchAccountForGridStride) {
         RAYX_PROFILE_FUNCTION_STDOUT();
 
         const auto constState = ConstState{
             // constants
             .maxEvents              = maxEvents,
             .sequential             = sequential,
-            .numSources             = numSources,
-            .numElements            = numElements,
+            .recordMode             = recordMode,
+            .numSources             = beamlineConf.numSources,
+            .numElements            = beamlineConf.numElements,
             .outputEventsGridStride = numRaysBatchAccountForGridStride,
 
             // buffers
-            .objectTransforms = alpaka::getPtrNative(*m_resources.d_objectTransforms),
-            .elements         = alpaka::getPtrNative(*m_resources.d_elements),
-            .materialIndices  = alpaka::getPtrNative(*m_resources.d_materialIndices),
-            .materialTable    = alpaka::getPtrNative(*m_resources.d_materialTable),
-            .objectRecordMask = alpaka::getPtrNative(*m_resources.d_objectRecordMask),
-            .attrRecordMask   = attrRecordMask,
-            .rays             = raysBufToRaysPtr(batchConf.d_rays),
+            .objectTransforms  = alpaka::getPtrNative(*m_resources.d_objectTransforms),
+            .elements          = alpaka::getPtrNative(*m_resources.d_elements),
+            .materialIndices   = alpaka::getPtrNative(*m_resources.d_materialIndices),
+            .materialTable     = alpaka::getPtrNative(*m_resources.d_materialTable),
+            .objectRecordMask  = alpaka::getPtrNative(*m_resources.d_objectRecordMask),
+            .objectRecordSlots = alpaka::getPtrNative(*m_resources.d_objectRecordSlots),
+            .attrRecordMask    = attrRecordMask,
+            .eventFilter       = eventFilter,
+            .rays              = raysBufToRaysPtr(batchConf.d_rays),
+
+            // retrace plane
+            .resumeElementIndex  = retracePlane && retracePlane->rayStates ? retracePlane->elementIndex : -1,
+            .captureElementIndex = retracePlane && !retracePlane->rayStates ? retracePlane->elementIndex : -1,
         };
 
         const auto mutableState = MutableState{
             // buffers
-            .events      = raysBufToRaysPtr(m_resources.d_eventsBatch),
-            .storedFlags = alpaka::getPtrNative(*m_resources.d_eventStoreFlags),
+            .events       = raysBufToRaysPtr(m_resources.d_eventsBatch),
+            .storedFlags  = alpaka::getPtrNative(*m_resources.d_eventStoreFlags),
+            .counters     = m_resources.d_traceCounters ? alpaka::getPtrNative(*m_resources.d_traceCounters) : nullptr,
+            .capturedRays = raysBufToRaysPtr(m_resources.d_capturedRays),
+            .errors =
+                DeviceErrorsPtr{
+                    .counts  = alpaka::getPtrNative(*m_resources.d_deviceErrorCounts),
+                    .records = alpaka::getPtrNative(*m_resources.d_deviceErrorRecords),
+                },
         };
 
-        if (sequential == Sequential::Yes) {
-            RAYX_VERB << "execute TraceSequentialKernel";
-            execWithValidWorkDiv<Acc>(devAcc, q, batchConf.numRaysBatch, BlockSizeConstraint::None{}, TraceSequentialKernel{}, constState,
-                                      mutableState, batchConf.numRaysBatch);
-        } else {
-            RAYX_VERB << "execute TraceNonSequentialKernel";
-            execWithValidWorkDiv<Acc>(devAcc, q, batchConf.numRaysBatch, BlockSizeConstraint::None{}, TraceNonSequentialKernel{}, constState,
-                                      mutableState, batchConf.numRaysBatch);
-        }
+        // the trace kernels add to the trace counters and errors, so they are cleared after tuning, which may execute the kernel several times
+        const auto exec = [&](const std::string& kernelName, const int numElements, const auto& kernel) {
+            const auto launchConfig =
+                tuneLaunchConfig<Acc>(*m_workDivTuner, kernelName, devAcc, q, numElements, kernel, constState, mutableState, batchConf.numRaysBatch);
+            if (m_resources.d_traceCounters)
+                alpaka::memset(q, *m_resources.d_traceCounters, 0, NUM_TRACE_COUNTER_SLOTS * numTraceCounterColumns(beamlineConf.numElements));
+            alpaka::memset(q, *m_resources.d_deviceErrorCounts, 0, NUM_DEVICE_ERROR_CODES);
+            execWithValidWorkDiv<Acc>(devAcc, q, numElements, launchConfig, kernel, constState, mutableState, batchConf.numRaysBatch);
+        };
+
+        const auto traceKernels = [&]<RayAttrMask RecordMask, ElementTypeMask ElementTypes>() {
+            RAYX_VERB << "using trace kernel specialized on record mask: " << to_string(RecordMask);
+            RAYX_VERB << "using trace kernel specialized on element types: " << static_cast<uint32_t>(ElementTypes);
+
+            // the specializations differ in register pressure, so their work divisions are tuned separately
+            const auto specialization = "<" + std::to_string(static_cast<std::underlying_type_t<RayAttrMask>>(RecordMask)) + ", " +
+                                        std::to_string(static_cast<uint32_t>(ElementTypes)) + ">";
+
+            if (sequential == Sequential::Yes && TRACE_RAY_PACKETS) {
+                RAYX_VERB << "execute TraceSequentialPacketKernel";
+                const auto numPackets = (batchConf.numRaysBatch + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE;
+                exec("TraceSequentialPacketKernel" + specialization, numPackets, TraceSequentialPacketKernel<RecordMask, ElementTypes>{});
+            } else if (sequential == Sequential::Yes) {
+                RAYX_VERB << "execute TraceSequentialKernel";
+                exec("TraceSequentialKernel" + specialization, batchConf.numRaysBatch, TraceSequentialKernel<RecordMask, ElementTypes>{});
+            } else {
+                RAYX_VERB << "execute TraceNonSequentialKernel";
+                exec("TraceNonSequentialKernel" + specialization, batchConf.numRaysBatch, TraceNonSequentialKernel<RecordMask, ElementTypes>{});
+            }
+        };
+
+        // captured ray states must be complete, so all attributes are traced while capturing
+        const auto traceRecordMask = constState.captureElementIndex != -1 ? RayAttrMask::All : attrRecordMask;
+        dispatchTraceMask<TRACE_RECORD_MASKS>(traceRecordMask, [&]<RayAttrMask RecordMask>(std::integral_constant<RayAttrMask, RecordMask>) {
+            dispatchTraceMask<TRACE_ELEMENT_TYPE_MASKS>(
+                beamlineConf.elementTypes, [&]<ElementTypeMask ElementTypes>(std::integral_constant<ElementTypeMask, ElementTypes>) {
+                    traceKernels.template operator()<RecordMask, ElementTypes>();
+                });
+        });
     }
 
     template <typename DevAcc, typename Queue>
-    void compactEvents(DevAcc devAcc, Queue q, const int numEventsBatchAccountForGridStride, const RayAttrMask attrRecordMask) {
+    void compactEvents(DevAcc devAcc, Queue q, const int numEventsBatchAccountForGridStride, const RayAttrMask attrRecordMask, RaysBuf<Acc>& dstRays,
+                       const int dstOffset) {
         RAYX_PROFILE_FUNCTION_STDOUT();
 
         // TODO: compare performance to single scatter kernel execution handling all attributes
 
         auto execKernel = [&]<typename TOptBuf>(TOptBuf& compactAttrBuf, const TOptBuf& attrBuf) {
-            execWithValidWorkDiv<Acc>(devAcc, q, numEventsBatchAccountForGridStride, BlockSizeConstraint::None{}, ScatterCompactKernel{},
-                                      alpaka::getPtrNative(*compactAttrBuf), alpaka::getPtrNative(*attrBuf),
-                                      alpaka::getPtrNative(*m_resources.d_eventStoreFlagsPrefixSum),
-                                      alpaka::getPtrNative(*m_resources.d_eventStoreFlags), numEventsBatchAccountForGridStride);
+            const auto dst    = alpaka::getPtrNative(*compactAttrBuf) + dstOffset;
+            const auto src    = alpaka::getPtrNative(*attrBuf);
+            const auto prefix = alpaka::getPtrNative(*m_resources.d_eventStoreFlagsPrefixSum);
+            const auto flags  = alpaka::getPtrNative(*m_resources.d_eventStoreFlags);
+            const auto n      = numEventsBatchAccountForGridStride;
+
+            // the work division is tuned once for all attributes. tuning scatters the same events several times, which does not change the result
+            const auto launchConfig = tuneLaunchConfig<Acc>(*m_workDivTuner, "ScatterCompactKernel", devAcc, q, n, ScatterCompactKernel{}, dst, src,
+                                                            prefix, flags, n);
+            execWithValidWorkDiv<Acc>(devAcc, q, n, launchConfig, ScatterCompactKernel{}, dst, src, prefix, flags, n);
         };
 
 #define X(type, name, flag)                                                                  \
     if (contains(attrRecordMask, RayAttrMask::flag)) {                                       \
         RAYX_VERB << "execute ScatterCompactKernel for compaction of ray attribute: " #name; \
-        execKernel(m_resources.d_compactEventsBatch.name, m_resources.d_eventsBatch.name);   \
+        execKernel(dstRays.name, m_resources.d_eventsBatch.name);                            \
     }
 
         RAYX_X_MACRO_RAY_ATTR
@@ -356,6 +633,8 @@ class MegaKernelTracer : public DeviceTracer {
 
     template <typename DevHost, typename Queue>
     Rays transferEventsBatch(DevHost& devHost, Queue q, const int numEventsBatch, const RayAttrMask attrRecordMask) {
+        RAYX_PROFILE_FUNCTION_STDOUT();
+
         const auto transfer = [&]<typename T>(std::vector<T>& dst, const OptBuf<Acc, T>& d_compactEventsBatch) {
             // resize to fit source events and element events
             dst.resize(numEventsBatch);
@@ -374,6 +653,49 @@ class MegaKernelTracer : public DeviceTracer {
 
         return h_compactEventsBatch;
     }
+
+    /// transfers the states of the rays of a batch captured at a RetracePlane
+    template <typename DevHost, typename Queue>
+    Rays transferRayStates(DevHost& devHost, Queue q, const int numRaysBatch) {
+        RAYX_PROFILE_FUNCTION_STDOUT();
+
+        Rays h_rayStates;
+#define X(type, name, flag)                \
+    h_rayStates.name.resize(numRaysBatch); \
+    alpaka::memcpy(q, alpaka::createView(devHost, h_rayStates.name, numRaysBatch), *m_resources.d_capturedRays.name, numRaysBatch);
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+        return h_rayStates;
+    }
+
+    /// sums up the performance counters of a batch. std::nullopt if counters are disabled
+    template <typename DevHost, typename Queue>
+    std::optional<TraceCounters> transferTraceCounters(DevHost& devHost, Queue q, const int numRaysBatch, const int numElements) {
+        if (!m_resources.d_traceCounters) return std::nullopt;
+
+        const auto numCounters = NUM_TRACE_COUNTER_SLOTS * numTraceCounterColumns(numElements);
+        auto h_counters        = std::vector<TraceCounter>(numCounters);
+        alpaka::memcpy(q, alpaka::createView(devHost, h_counters, numCounters), *m_resources.d_traceCounters, numCounters);
+        return reduceTraceCounters(h_counters.data(), numRaysBatch, numElements);
+    }
+
+    /// transfers the error counts and the kept errors of a batch
+    template <typename DevHost, typename Queue>
+    DeviceErrors transferDeviceErrors(DevHost& devHost, Queue q) {
+        auto h_counts = std::array<int, NUM_DEVICE_ERROR_CODES>();
+        alpaka::memcpy(q, alpaka::createView(devHost, h_counts.data(), NUM_DEVICE_ERROR_CODES), *m_resources.d_deviceErrorCounts,
+                       NUM_DEVICE_ERROR_CODES);
+
+        // the records are only transferred if there are errors, which is rare
+        auto h_records = std::vector<DeviceError>();
+        if (std::any_of(h_counts.begin(), h_counts.end(), [](const int count) { return count != 0; })) {
+            const auto numRecords = NUM_DEVICE_ERROR_CODES * DEVICE_ERROR_RECORDS_PER_CODE;
+            h_records.resize(numRecords);
+            alpaka::memcpy(q, alpaka::createView(devHost, h_records, numRecords), *m_resources.d_deviceErrorRecords, numRecords);
+        }
+
+        return h_records.empty() ? DeviceErrors{} : reduceDeviceErrors(h_counts.data(), h_records.data());
+    }
 };
 
 }  // namespace rayx
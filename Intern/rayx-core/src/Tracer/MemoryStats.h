@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "Core.h"
+
+namespace rayx {
+
+/// categories of memory used by the tracer. device categories reside in the memory of the tracing device, which is host memory for cpu devices
+enum class MemoryCategory {
+    /// material tables (device)
+    Materials,
+    /// elements, object transforms and object record mask (device)
+    Beamline,
+    /// generated rays of a batch, ray lists and energy distributions of the sources (device)
+    Sources,
+    /// uncompacted events of a batch (device)
+    Events,
+    /// compacted events of a batch (device)
+    CompactEvents,
+    /// event store flags and their prefix sum, used for compaction (device)
+    CompactionFlags,
+    /// performance counters, only allocated if RAYX_TRACE_COUNTERS is defined (device)
+    TraceCounters,
+    /// errors reported by the trace kernels (device)
+    DeviceErrors,
+    /// states of the rays leaving the element of a RetraceCache, captured per batch (device)
+    RayStates,
+    /// events kept on the device by Tracer::traceToDevice, until the last DeviceRays referring to them is destroyed (device)
+    DeviceRays,
+    /// event store flags and their prefix sum, copied to the host for compaction (host)
+    HostCompactionFlags,
+    /// events of traced batches, held until the batches are passed on in order (host)
+    HostEventBatches,
+    /// events of the trace, concatenated from the batches, until they are returned to the caller (host)
+    HostRays,
+};
+
+constexpr int NUM_MEMORY_CATEGORIES = static_cast<int>(MemoryCategory::HostRays) + 1;
+
+inline std::string to_string(const MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::Materials:
+            return "materials";
+        case MemoryCategory::Beamline:
+            return "beamline";
+        case MemoryCategory::Sources:
+            return "sources";
+        case MemoryCategory::Events:
+            return "events";
+        case MemoryCategory::CompactEvents:
+            return "compact events";
+        case MemoryCategory::CompactionFlags:
+            return "compaction flags";
+        case MemoryCategory::TraceCounters:
+            return "trace counters";
+        case MemoryCategory::DeviceErrors:
+            return "device errors";
+        case MemoryCategory::RayStates:
+            return "ray states";
+        case MemoryCategory::DeviceRays:
+            return "device rays";
+        case MemoryCategory::HostCompactionFlags:
+            return "host compaction flags";
+        case MemoryCategory::HostEventBatches:
+            return "host event batches";
+        case MemoryCategory::HostRays:
+            return "host rays";
+    }
+    return "unknown";
+}
+
+struct RAYX_API MemoryUsage {
+    int64_t currentBytes = 0;
+    int64_t peakBytes    = 0;
+};
+
+/// memory used by a tracer, summed over all its devices
+struct RAYX_API MemoryStats {
+    std::array<MemoryUsage, NUM_MEMORY_CATEGORIES> categories = {};
+    /// usage of all categories together. the peak is the peak of the sum, which may be less than the sum of the peaks
+    MemoryUsage total;
+
+    const MemoryUsage& operator[](const MemoryCategory category) const { return categories[static_cast<int>(category)]; }
+};
+
+/**
+ * @brief Policy for releasing device buffers after a trace
+ * Device buffers are kept after a trace, so that the next trace can reuse them. Buffers only grow, so a large trace leaves large buffers behind,
+ * which are released by this policy.
+ */
+struct RAYX_API MemoryTrimPolicy {
+    /// buffers larger than this are released after a trace. std::nullopt keeps all buffers (default). 0 releases all buffers
+    std::optional<int64_t> maxRetainedBufferBytes = std::nullopt;
+};
+
+/// bookkeeping of the memory allocated by a tracer. shared by all devices of a tracer. thread-safe
+class MemoryTracker {
+  public:
+    void allocate(const MemoryCategory category, const int64_t bytes) {
+        const auto lock = std::lock_guard(m_mutex);
+        add(m_stats.categories[static_cast<int>(category)], bytes);
+        add(m_stats.total, bytes);
+    }
+
+    void release(const MemoryCategory category, const int64_t bytes) { allocate(category, -bytes); }
+
+    /// resets the peaks to the current usage, e.g. at the start of a trace
+    void resetPeaks() {
+        const auto lock = std::lock_guard(m_mutex);
+        for (auto& usage : m_stats.categories) usage.peakBytes = usage.currentBytes;
+        m_stats.total.peakBytes = m_stats.total.currentBytes;
+    }
+
+    MemoryStats stats() const {
+        const auto lock = std::lock_guard(m_mutex);
+        return m_stats;
+    }
+
+  private:
+    static void add(MemoryUsage& usage, const int64_t bytes) {
+        usage.currentBytes += bytes;
+        usage.peakBytes = std::max(usage.peakBytes, usage.currentBytes);
+    }
+
+    mutable std::mutex m_mutex;
+    MemoryStats m_stats;
+};
+
+/// accounts `bytes` in `memoryTracker` for the lifetime of this object, e.g. for host buffers local to a function
+class ScopedMemoryAllocation {
+  public:
+    ScopedMemoryAllocation(MemoryTracker& memoryTracker, const MemoryCategory category, const int64_t bytes)
+        : m_memoryTracker(memoryTracker), m_category(category), m_bytes(bytes) {
+        m_memoryTracker.allocate(m_category, m_bytes);
+    }
+    ~ScopedMemoryAllocation() { m_memoryTracker.release(m_category, m_bytes); }
+
+    ScopedMemoryAllocation(const ScopedMemoryAllocation&)            = delete;
+    ScopedMemoryAllocation& operator=(const ScopedMemoryAllocation&) = delete;
+
+  private:
+    MemoryTracker& m_memoryTracker;
+    const MemoryCategory m_category;
+    const int64_t m_bytes;
+};
+
+}  // namespace rayx
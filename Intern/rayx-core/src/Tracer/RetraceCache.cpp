@@ -0,0 +1,58 @@
+#include "RetraceCache.h"
+
+#include "Beamline/Beamline.h"
+#include "Design/DesignElement.h"
+#include "Design/DesignSource.h"
+#include "Hash.h"
+
+namespace rayx {
+
+void RetraceCache::clear() {
+    m_key.reset();
+    m_rayStates.clear();
+    m_eventsUpToElement.clear();
+}
+
+std::optional<uint64_t> RetraceCache::computeKey(const Group& group, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                                                 const EventFilter& eventFilter, const RecordMode recordMode, const double seed,
+                                                 const int maxBatchSize) const {
+    auto hasher = Hasher();
+    hasher.value(m_elementIndex).value(seed).value(maxBatchSize).value(attrRecordMask).value(recordMode);
+
+    // the members of EventFilter are hashed one by one, because the struct contains padding bytes
+    hasher.value(eventFilter.eventTypes).value(eventFilter.minEnergy).value(eventFilter.maxEnergy);
+    hasher.value(eventFilter.minOrder).value(eventFilter.maxOrder).value(eventFilter.minSourceId).value(eventFilter.maxSourceId);
+    hasher.value(eventFilter.positionBoxObjectId).value(eventFilter.positionMin).value(eventFilter.positionMax);
+
+    const auto sources = group.getSources();
+    hasher.value(sources.size());
+    for (const auto* source : sources) {
+        const auto sourceHash = source->m_elementParameters.hash();
+        if (!sourceHash) return std::nullopt;
+        hasher.value(*sourceHash);
+    }
+
+    // the transforms of the elements include the transforms of their groups
+    const auto elements         = group.getElements();
+    const auto compiledElements = group.compileElements();
+    for (int i = 0; i <= m_elementIndex; ++i) {
+        const auto elementHash = elements[i]->m_elementParameters.hash();
+        if (!elementHash) return std::nullopt;
+        hasher.value(*elementHash).value(compiledElements[i].transform.m_inTrans).value(compiledElements[i].transform.m_outTrans);
+    }
+
+    // events of objects after the element are not captured
+    const auto numObjectsUpToElement = objectRecordMask.numSources() + m_elementIndex + 1;
+    for (int i = 0; i < numObjectsUpToElement; ++i) hasher.value(objectRecordMask.shouldRecordObject(i));
+
+    return hasher.get();
+}
+
+bool RetraceCache::contains(const uint64_t key, const int batchBegin, const int batchEnd) const {
+    if (m_key != key) return false;
+    for (int batchIndex = batchBegin; batchIndex < batchEnd; ++batchIndex)
+        if (!m_rayStates.contains(batchIndex)) return false;
+    return true;
+}
+
+}  // namespace rayx
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+#include "Core.h"
+#include "ObjectMask.h"
+#include "Rays.h"
+#include "Shader/EventFilter.h"
+#include "Shader/InvocationState.h"
+
+namespace rayx {
+
+class Group;
+
+/**
+ * @brief Cache of the rays leaving an element in sequential tracing, to retrace only the elements after it (see TraceControl::retraceCache)
+ * A trace with an empty or outdated cache captures the state of each ray leaving the element, and the events recorded up to and including the
+ * element. A later trace of a beamline whose sources and elements up to the element are unchanged, with the same seed, batch size, record masks
+ * and event filter, loads the captured ray states instead of generating rays, and traces only the elements after the element. Its result is the
+ * same as tracing the whole beamline. Rays that finish before the element are captured with their final state, so their device errors and final
+ * event types are reported again. The other trace counters only count the retraced elements.
+ * Changes are detected by a hash of the design parameters and compiled transforms of the sources and elements up to the element. Files
+ * referenced by the design, e.g. energy distributions, are identified by their path, not by their content.
+ * Only used for Tracer::trace with Sequential::Yes and RecordMode::AllEvents or RecordMode::LastEventPerObject. The ray states hold all
+ * attributes of all rays in host memory.
+ */
+class RAYX_API RetraceCache {
+  public:
+    /// caches the rays leaving the element with index `elementIndex` among the elements of the beamline (see Group::getElements)
+    explicit RetraceCache(const int elementIndex) : m_elementIndex(elementIndex) {}
+
+    int elementIndex() const { return m_elementIndex; }
+
+    /// true if the last trace with this cache resumed from the cached rays, false if it traced the whole beamline
+    bool resumed() const { return m_resumed; }
+
+    /// discards the cached rays, so that the next trace captures them again
+    void clear();
+
+  private:
+    friend class Tracer;
+
+    /// hash of everything the captured rays and events depend on. std::nullopt if the design contains values that are not hashed (see
+    /// DesignMap::hash), so the cache can not detect changes
+    std::optional<uint64_t> computeKey(const Group& group, const ObjectIndexMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                                       const EventFilter& eventFilter, const RecordMode recordMode, const double seed, const int maxBatchSize) const;
+
+    /// true if the cache holds all batches in [batchBegin, batchEnd) captured with `key`
+    bool contains(const uint64_t key, const int batchBegin, const int batchEnd) const;
+
+    int m_elementIndex;
+    bool m_resumed = false;
+    std::optional<uint64_t> m_key;
+    /// per batch index, the state of each generated ray leaving the element (see ConstState::captureElementIndex)
+    std::map<int, Rays> m_rayStates;
+    /// per batch index, the events recorded up to and including the element
+    std::map<int, Rays> m_eventsUpToElement;
+};
+
+}  // namespace rayx
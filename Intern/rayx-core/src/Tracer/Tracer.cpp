@@ -1,19 +1,37 @@
 #include "Tracer.h"
 
 #include <algorithm>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <numeric>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(RAYX_OPENMP_ENABLED)
+#include <omp.h>
+#endif
+
+#include "BatchPlan.h"
 #include "MegaKernelTracer.h"
+#include "Random.h"
 
 namespace {
 
 using DeviceType  = rayx::DeviceConfig::DeviceType;
 using DeviceIndex = rayx::DeviceConfig::Device::Index;
 
-inline std::shared_ptr<rayx::DeviceTracer> createDeviceTracer(DeviceType deviceType, DeviceIndex deviceIndex) {
+inline std::shared_ptr<rayx::DeviceTracer> createDeviceTracer(DeviceType deviceType, DeviceIndex deviceIndex,
+                                                              std::shared_ptr<rayx::MemoryTracker> memoryTracker,
+                                                              std::shared_ptr<rayx::WorkDivTuner> workDivTuner) {
     switch (deviceType) {
         case DeviceType::GpuCuda:
 #if defined(RAYX_CUDA_ENABLED)
-            return std::make_shared<rayx::MegaKernelTracer<alpaka::TagGpuCudaRt>>(deviceIndex);
+            return std::make_shared<rayx::MegaKernelTracer<alpaka::TagGpuCudaRt>>(deviceIndex, std::move(memoryTracker), std::move(workDivTuner));
 #else
             RAYX_EXIT << "Failed to create Tracer with Cuda device. Cuda was disabled during build.";
             return nullptr;
@@ -25,30 +43,133 @@ inline std::shared_ptr<rayx::DeviceTracer> createDeviceTracer(DeviceType deviceT
             RAYX_WARN << "warning: rayx-core was compiled without OpenMP. The CPU tracer will run in a single thread.";
             using TagCpu = alpaka::TagCpuSerial;
 #endif
-            return std::make_shared<rayx::MegaKernelTracer<TagCpu>>(deviceIndex);
+            return std::make_shared<rayx::MegaKernelTracer<TagCpu>>(deviceIndex, std::move(memoryTracker), std::move(workDivTuner));
     }
 }
 
 int defaultNonSequentialMaxEvents(const int numObjects) { return rayx::defaultMaxEvents(numObjects); }
 
+/// pins the calling thread to `cpus`. threads spawned afterwards by OpenMP inherit the affinity, and memory allocated by them is placed on the
+/// NUMA node of the cpus (first touch)
+void pinCurrentThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) return;
+
+#if defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (const auto cpu : cpus) CPU_SET(cpu, &cpuSet);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) RAYX_WARN << "warning: failed to pin tracing thread to cpus";
+#else
+    RAYX_VERB << "pinning tracing threads to cpus is not supported on this platform";
+#endif
+
+#if defined(RAYX_OPENMP_ENABLED)
+    omp_set_num_threads(static_cast<int>(cpus.size()));
+#endif
+}
+
+/// memory held by the attribute vectors of `rays`
+int64_t raysBytes(const rayx::Rays& rays) {
+    auto bytes = int64_t{0};
+#define X(type, name, flag) bytes += static_cast<int64_t>(rays.name.capacity() * sizeof(type));
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+    return bytes;
+}
+
+/// memory held by `pathOffsets`, sized by its element type so it follows the type of the path offsets
+template <typename T>
+int64_t pathOffsetsBytes(const std::vector<T>& pathOffsets) {
+    return static_cast<int64_t>(pathOffsets.capacity() * sizeof(T));
+}
+
+int64_t raysByPathBytes(const rayx::RaysByPath& raysByPath) { return raysBytes(raysByPath.rays) + pathOffsetsBytes(raysByPath.pathOffsets); }
+
+int64_t tracedBatchBytes(const rayx::TracedBatch& tracedBatch) { return raysBytes(tracedBatch.rays) + pathOffsetsBytes(tracedBatch.pathOffsets); }
+
+/// prints a warning per error code reported by the trace kernels, naming the element of the first error
+void warnDeviceErrors(const rayx::DeviceErrors& errors, const std::vector<std::string>& elementNames) {
+    using rayx::DeviceErrorCode;
+
+    for (int i = 1; i < rayx::NUM_DEVICE_ERROR_CODES; ++i) {
+        const auto code    = static_cast<DeviceErrorCode>(i);
+        const auto numRays = errors.numRays(code);
+        if (numRays == 0) continue;
+
+        auto message = std::string();
+        switch (code) {
+            case DeviceErrorCode::FatalError:
+                message = "fatal error detected for one or more rays";
+                break;
+            case DeviceErrorCode::BeyondHorizon:
+                message = "one or more rays have gone beyond the horizon while refracting";
+                break;
+            case DeviceErrorCode::TooManyEvents:
+                message = "capacity of events exceeded. could not record all events! consider increasing max events";
+                break;
+            case DeviceErrorCode::InvalidObjectId:
+                message = "one or more input rays have an object_id out of bounds of the beamline and were not traced";
+                break;
+            case DeviceErrorCode::Uninitialized:
+                message = "one or more events in output are uninitialized";
+                break;
+            default:
+                message = rayx::to_string(code);
+        }
+
+        const auto first = std::find_if(errors.records.begin(), errors.records.end(), [&](const rayx::DeviceError& e) { return e.code == code; });
+        auto location    = std::string();
+        if (first != errors.records.end()) {
+            location = ", e.g. path_id " + std::to_string(first->rayIndex);
+            if (0 <= first->elementIndex && first->elementIndex < static_cast<int>(elementNames.size()))
+                location += " on element '" + elementNames[first->elementIndex] + "'";
+        }
+
+        RAYX_WARN << "warning: " << message << " (" << numRays << " rays" << location << ")";
+    }
+}
+
 }  // unnamed namespace
 
 namespace rayx {
 
 Tracer::Tracer(const DeviceConfig& deviceConfig) {
-    if (deviceConfig.enabledDevicesCount() != 1) RAYX_EXIT << "The number of selected devices must be exactly 1!";
+    if (deviceConfig.enabledDevicesCount() == 0) RAYX_EXIT << "At least one device must be selected!";
 
     for (const auto& device : deviceConfig.devices) {
         if (device.enable) {
             RAYX_VERB << "Creating tracer with device: " << device.name;
-            m_deviceTracer = createDeviceTracer(device.type, device.index);
-            break;
+            m_devices.push_back(DeviceInstance{
+                .tracer = createDeviceTracer(device.type, device.index, m_memoryTracker, m_workDivTuner),
+                .cpus   = device.cpus,
+            });
         }
     }
 }
 
-Rays Tracer::trace(const Group& group, const Sequential sequential, const ObjectMask& objectRecordMask, const RayAttrMask attrRecordMask,
-                   std::optional<int> maxEvents, std::optional<int> maxBatchSize) {
+std::shared_ptr<DeviceRaysStorage> Tracer::traceBatches(const Group& group, const Sequential sequential, const ObjectMask& objectRecordMask,
+                                                        const RayAttrMask attrRecordMask, std::optional<int> maxEvents,
+                                                        std::optional<int> maxBatchSize, std::optional<Shard> shard, const TraceControl& control,
+                                                        const OutputLayout layout, const bool keepOnDevice,
+                                                        const std::function<void(TracedBatch&&)>& onBatch) {
+    // the events of all batches are appended to one buffer on the device, in order of the batch index
+    if (keepOnDevice && m_devices.size() != 1)
+        RAYX_EXIT << "Tracer::traceToDevice: exactly one device must be enabled, got " << m_devices.size();
+
+    auto* retraceCache = control.retraceCache;
+    if (retraceCache) {
+        retraceCache->m_resumed = false;
+        if (retraceCache->elementIndex() < 0 || static_cast<int>(group.numElements()) <= retraceCache->elementIndex())
+            RAYX_EXIT << "Tracer::trace: retrace cache element index " << retraceCache->elementIndex() << " is out of range [0, "
+                      << group.numElements() << ")";
+
+        // the events recorded up to the element are a prefix of the events of a batch only in these modes
+        if (sequential != Sequential::Yes || control.recordMode == RecordMode::LastEvent || layout != OutputLayout::Events || keepOnDevice) {
+            RAYX_WARN << "warning: ignoring retrace cache. it is only used by Tracer::trace with Sequential::Yes and without RecordMode::LastEvent";
+            retraceCache = nullptr;
+        }
+    }
+
     const auto actualObjectRecordMask = objectRecordMask.toObjectIndexMask(group.numSources(), group.numElements());
 
     const auto actualMaxEvents =
@@ -59,9 +180,229 @@ Rays Tracer::trace(const Group& group, const Sequential sequential, const Object
 
     const auto actualMaxBatchSize = maxBatchSize ? *maxBatchSize : DEFAULT_BATCH_SIZE;
 
-    auto rays = m_deviceTracer->trace(group, sequential, actualObjectRecordMask, attrRecordMask, actualMaxEvents, actualMaxBatchSize);
+    // the seed is drawn once per trace and shared by all devices, so that the generated rays do not depend on the device a batch is traced on
+    const auto seed = control.seed ? *control.seed : randomDouble();
+
+    // a shard traces a contiguous range of batches
+    const auto numBatchesTotal = planBatches(numRaysTotal(group), actualMaxBatchSize).numBatches;
+    auto batchBegin            = 0;
+    auto batchEnd              = numBatchesTotal;
+    if (shard) {
+        if (shard->count < 1 || shard->index < 0 || shard->count <= shard->index)
+            RAYX_EXIT << "Tracer::trace: invalid shard " << shard->index << "/" << shard->count;
+
+        batchBegin = static_cast<int>(static_cast<int64_t>(numBatchesTotal) * shard->index / shard->count);
+        batchEnd   = static_cast<int>(static_cast<int64_t>(numBatchesTotal) * (shard->index + 1) / shard->count);
+        RAYX_VERB << "tracing shard " << shard->index << "/" << shard->count << ": batches [" << batchBegin << ", " << batchEnd << ") of "
+                  << numBatchesTotal;
+    }
+
+    batchBegin = std::clamp(control.firstBatchIndex, batchBegin, batchEnd);
+
+    // resume from the cached rays if they were captured for the same beamline up to the element, otherwise capture them
+    auto retracePlane = std::optional<RetracePlane>();
+    if (retraceCache) {
+        const auto key = retraceCache->computeKey(group, actualObjectRecordMask, attrRecordMask, control.eventFilter, control.recordMode, seed,
+                                                  actualMaxBatchSize);
+        if (!key) {
+            RAYX_WARN << "warning: ignoring retrace cache. the design contains values that can not be compared to the cached design";
+            retraceCache = nullptr;
+        } else if (retraceCache->contains(*key, batchBegin, batchEnd)) {
+            RAYX_VERB << "resuming trace after element " << retraceCache->elementIndex() << " from the retrace cache";
+            retraceCache->m_resumed = true;
+            retracePlane            = RetracePlane{.elementIndex = retraceCache->elementIndex(), .rayStates = &retraceCache->m_rayStates};
+        } else {
+            RAYX_VERB << "capturing the rays leaving element " << retraceCache->elementIndex() << " into the retrace cache";
+            if (retraceCache->m_key != key) retraceCache->clear();
+            retraceCache->m_key = key;
+            retracePlane        = RetracePlane{.elementIndex = retraceCache->elementIndex()};
+        }
+    }
+
+    auto batchIndices = std::vector<int>(batchEnd - batchBegin);
+    std::iota(batchIndices.begin(), batchIndices.end(), batchBegin);
+    auto batchQueue = BatchQueue(std::move(batchIndices), control.cancellationToken);
+
+    // devices finish batches in any order. batches are held back until all previous batches are done, so that the result is the same as
+    // tracing on a single device
+    std::mutex mutex;
+    auto pendingBatches = std::map<int, TracedBatch>();
+    auto nextBatchIndex = batchBegin;
+
+    const auto startTime = std::chrono::steady_clock::now();
+    m_traceCounters      = std::nullopt;
+    m_deviceErrors       = DeviceErrors{};
+    m_memoryTracker->resetPeaks();
+
+    auto progress = TraceProgress{
+        .batchesDone               = 0,
+        .batchesTotal              = batchEnd - batchBegin,
+        .raysTraced                = 0,
+        .eventsRecorded            = 0,
+        .elapsedSeconds            = 0.0,
+        .estimatedRemainingSeconds = 0.0,
+    };
+
+    const auto onBatchTraced = [&](TracedBatch&& tracedBatch) {
+        const auto lock = std::lock_guard(mutex);
+
+        // the events recorded up to the element of the retrace cache come first in a batch
+        if (retracePlane && retracePlane->rayStates) {
+            const auto& eventsUpToElement = retraceCache->m_eventsUpToElement.at(tracedBatch.batchIndex);
+            if (tracedBatch.rays.empty())
+                tracedBatch.rays = eventsUpToElement;
+            else if (!eventsUpToElement.empty())
+                tracedBatch.rays = Rays::concat({eventsUpToElement, tracedBatch.rays});
+        } else if (retracePlane) {
+            const auto numEventsUpToPlane = tracedBatch.numEventsUpToPlane;
+            retraceCache->m_eventsUpToElement[tracedBatch.batchIndex] =
+                tracedBatch.rays.filter([&](const int64_t i) { return i < numEventsUpToPlane; });
+            retraceCache->m_rayStates[tracedBatch.batchIndex] = std::move(tracedBatch.rayStates);
+        }
+
+        if (tracedBatch.counters) {
+            if (!m_traceCounters) m_traceCounters = TraceCounters{};
+            *m_traceCounters += *tracedBatch.counters;
+        }
+
+        if (!tracedBatch.errors.empty()) {
+            for (int code = 1; code < NUM_DEVICE_ERROR_CODES; ++code)
+                if (tracedBatch.errors.numRaysPerCode[code] != 0)
+                    RAYX_VERB << "batch " << tracedBatch.batchIndex << ": " << tracedBatch.errors.numRaysPerCode[code] << " rays with error '"
+                              << to_string(static_cast<DeviceErrorCode>(code)) << "'";
+            m_deviceErrors += tracedBatch.errors;
+        }
+
+        if (control.onProgress) {
+            ++progress.batchesDone;
+            progress.raysTraced += tracedBatch.numRays;
+            progress.eventsRecorded +=
+                tracedBatch.pathOffsets.empty() ? tracedBatch.rays.size() + tracedBatch.numEventsOnDevice : tracedBatch.pathOffsets.back();
+            progress.elapsedSeconds            = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            progress.estimatedRemainingSeconds = progress.elapsedSeconds / progress.batchesDone * (progress.batchesTotal - progress.batchesDone);
+            control.onProgress(progress);
+        }
+
+        // held back batches are accounted until they are passed on
+        m_memoryTracker->allocate(MemoryCategory::HostEventBatches, tracedBatchBytes(tracedBatch));
+        const auto batchIndex = tracedBatch.batchIndex;
+        pendingBatches.emplace(batchIndex, std::move(tracedBatch));
+
+        for (auto it = pendingBatches.begin(); it != pendingBatches.end() && it->first == nextBatchIndex; it = pendingBatches.erase(it)) {
+            m_memoryTracker->release(MemoryCategory::HostEventBatches, tracedBatchBytes(it->second));
+            onBatch(std::move(it->second));
+            ++nextBatchIndex;
+        }
+    };
+
+    auto deviceRays          = std::shared_ptr<DeviceRaysStorage>();
+    const auto traceOnDevice = [&](DeviceInstance& device) {
+        pinCurrentThread(device.cpus);
+        if (keepOnDevice) {
+            deviceRays = device.tracer->traceToDevice(group, sequential, actualObjectRecordMask, control.eventFilter, control.recordMode,
+                                                      actualMaxEvents, actualMaxBatchSize, seed, batchQueue, onBatchTraced);
+            return;
+        }
+        device.tracer->trace(group, sequential, actualObjectRecordMask, attrRecordMask, control.eventFilter, control.recordMode, layout, retracePlane,
+                             actualMaxEvents, actualMaxBatchSize, seed, batchQueue, onBatchTraced);
+    };
+
+    if (m_devices.size() == 1 && m_devices.front().cpus.empty()) {
+        traceOnDevice(m_devices.front());
+    } else {
+        // one thread per device. each thread takes batches from the queue until all batches are traced
+        auto futures = std::vector<std::future<void>>();
+        for (auto& device : m_devices) futures.push_back(std::async(std::launch::async, traceOnDevice, std::ref(device)));
+        for (auto& future : futures) future.get();
+    }
+
+    // batches traced after a gap are dropped, so that the result of a cancelled trace is a prefix of the result of the full trace
+    if (batchQueue.isCancelled())
+        RAYX_VERB << "trace cancelled after " << (nextBatchIndex - batchBegin) << " of " << (batchEnd - batchBegin) << " batches";
+
+    // release the dropped batches
+    for (const auto& [batchIndex, tracedBatch] : pendingBatches)
+        m_memoryTracker->release(MemoryCategory::HostEventBatches, tracedBatchBytes(tracedBatch));
+
+    warnDeviceErrors(m_deviceErrors, group.getElementNames());
+
+    if (m_memoryTrimPolicy.maxRetainedBufferBytes)
+        for (auto& device : m_devices) device.tracer->trimBuffers(*m_memoryTrimPolicy.maxRetainedBufferBytes);
+
+    return deviceRays;
+}
+
+Rays Tracer::trace(const Group& group, const Sequential sequential, const ObjectMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                   std::optional<int> maxEvents, std::optional<int> maxBatchSize, std::optional<Shard> shard, const TraceControl& control) {
+    // rays of traced batches are accounted until they are concatenated to the result
+    auto raysBatches           = std::vector<Rays>();
+    auto hostEventBatchesBytes = int64_t{0};
+
+    traceBatches(group, sequential, objectRecordMask, attrRecordMask, maxEvents, maxBatchSize, shard, control, OutputLayout::Events, false,
+                 [&](TracedBatch&& tracedBatch) {
+                     if (control.onBatch) {
+                         control.onBatch(tracedBatch.batchIndex, std::move(tracedBatch.rays));
+                     } else {
+                         const auto batchBytes = raysBytes(tracedBatch.rays);
+                         m_memoryTracker->allocate(MemoryCategory::HostEventBatches, batchBytes);
+                         hostEventBatchesBytes += batchBytes;
+                         raysBatches.push_back(std::move(tracedBatch.rays));
+                     }
+                 });
+
+    auto rays = Rays::concat(raysBatches);
     if (!rays.isValid()) RAYX_EXIT << "Tracer::trace: one or more recorded attributes have different number of items.";
+
+    // the result is accounted until it is returned to the caller. the batches are freed as soon as they are concatenated
+    const auto hostRays = ScopedMemoryAllocation(*m_memoryTracker, MemoryCategory::HostRays, raysBytes(rays));
+    raysBatches         = {};
+    m_memoryTracker->release(MemoryCategory::HostEventBatches, hostEventBatchesBytes);
     return rays;
 }
 
+RaysByPath Tracer::traceByPath(const Group& group, const Sequential sequential, const ObjectMask& objectRecordMask, const RayAttrMask attrRecordMask,
+                               std::optional<int> maxEvents, std::optional<int> maxBatchSize, std::optional<Shard> shard,
+                               const TraceControl& control) {
+    // path_id and path_event_id are implicit in this layout, so they are not recorded on the device
+    const auto deviceAttrRecordMask = exclude(attrRecordMask, RayAttrMask::PathId | RayAttrMask::PathEventId);
+
+    auto batches               = std::vector<RaysByPath>();
+    auto hostEventBatchesBytes = int64_t{0};
+
+    traceBatches(group, sequential, objectRecordMask, deviceAttrRecordMask, maxEvents, maxBatchSize, shard, control, OutputLayout::ByPath, false,
+                 [&](TracedBatch&& tracedBatch) {
+                     auto raysByPath        = RaysByPath();
+                     raysByPath.firstPathId = tracedBatch.firstPathId;
+                     raysByPath.pathOffsets = std::move(tracedBatch.pathOffsets);
+                     raysByPath.rays        = std::move(tracedBatch.rays);
+
+                     if (control.onBatchByPath) {
+                         control.onBatchByPath(tracedBatch.batchIndex, std::move(raysByPath));
+                     } else {
+                         const auto batchBytes = raysByPathBytes(raysByPath);
+                         m_memoryTracker->allocate(MemoryCategory::HostEventBatches, batchBytes);
+                         hostEventBatchesBytes += batchBytes;
+                         batches.push_back(std::move(raysByPath));
+                     }
+                 });
+
+    auto result = RaysByPath::concat(batches);
+    if (!result.isValid()) RAYX_EXIT << "Tracer::traceByPath: the recorded attributes do not match the path offsets.";
+
+    const auto hostRays = ScopedMemoryAllocation(*m_memoryTracker, MemoryCategory::HostRays, raysByPathBytes(result));
+    batches             = {};
+    m_memoryTracker->release(MemoryCategory::HostEventBatches, hostEventBatchesBytes);
+    return result;
+}
+
+DeviceRays Tracer::traceToDevice(const Group& group, const Sequential sequential, const ObjectMask& objectRecordMask, std::optional<int> maxEvents,
+                                  std::optional<int> maxBatchSize, const TraceControl& control) {
+    // the events stay on the device, only the path offsets and counters of the batches reach the host
+    auto storage = traceBatches(group, sequential, objectRecordMask, RayAttrMask::All, maxEvents, maxBatchSize, std::nullopt, control,
+                                OutputLayout::Events, true, [](TracedBatch&&) {});
+    return DeviceRays(std::move(storage));
+}
+
+void Tracer::setWorkDivTuningPolicy(const WorkDivTuningPolicy& policy) { m_workDivTuner->setPolicy(policy); }
+
 }  // namespace rayx
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -7,7 +8,11 @@
 #include "Core.h"
 #include "DeviceConfig.h"
 #include "DeviceTracer.h"
+#include "MemoryStats.h"
 #include "Rays.h"
+#include "RaysByPath.h"
+#include "RetraceCache.h"
+#include "WorkDivTuner.h"
 
 // Abstract Tracer base class.
 namespace rayx {
@@ -18,11 +23,65 @@ constexpr int DEFAULT_BATCH_SIZE = 100000;
 
 constexpr int defaultMaxEvents(const int numObjects) { return numObjects * 2 + 8; }
 
+/**
+ * @brief Selects a part of a trace, so that one trace can be distributed over several processes
+ * The rays of a trace are split into `count` contiguous ranges of ray path indices, aligned to batches. Shard `index` traces only the rays of its
+ * range, keeping their global path_id. Concatenating the results of all shards in order of their index yields the result of the unsharded trace,
+ * given the same seed and batch size.
+ */
+struct RAYX_API Shard {
+    int index;
+    int count;
+};
+
+/// progress of a running trace, passed to TraceControl::onProgress after each traced batch
+struct RAYX_API TraceProgress {
+    /// number of traced batches and total number of batches of this trace (excluding batches skipped by shard or TraceControl::firstBatchIndex)
+    int batchesDone;
+    int batchesTotal;
+    /// number of generated rays in the traced batches
+    int64_t raysTraced;
+    /// number of events recorded in the traced batches
+    int64_t eventsRecorded;
+    double elapsedSeconds;
+    /// extrapolated from the average time per batch so far
+    double estimatedRemainingSeconds;
+};
+
+/**
+ * @brief Controls the execution of a trace, e.g. to stream the results of a long trace to a file and to resume it after an interruption
+ * The rays generated for a batch only depend on the seed, the batch size and the batch index.
+ */
+struct RAYX_API TraceControl {
+    /// batches before this index are skipped. used to resume a trace
+    int firstBatchIndex = 0;
+    /// seed for the generated rays. Default: drawn from the global random number generator (see fixSeed)
+    std::optional<double> seed = std::nullopt;
+    /// called for each traced batch, in order of the batch index. if set, the rays of the batches are passed to this function instead of being
+    /// returned by Tracer::trace
+    std::function<void(int batchIndex, Rays&& rays)> onBatch = nullptr;
+    /// same as onBatch, for Tracer::traceByPath
+    std::function<void(int batchIndex, RaysByPath&& rays)> onBatchByPath = nullptr;
+    /// called after each traced batch. calls are serialized, but may happen on any of the tracing threads
+    std::function<void(const TraceProgress& progress)> onProgress = nullptr;
+    /// checked between batches. a cancelled trace stops early and Tracer::trace returns the batches completed so far, without gaps
+    const CancellationToken* cancellationToken = nullptr;
+    /// events rejected by this filter are discarded on the device, before they are transferred to the host. Default: all events are recorded
+    EventFilter eventFilter = {};
+    /// selects which of the recorded events are returned. the LastEvent modes keep one event per ray (and object), which requires much less
+    /// device memory and transfer than recording all events and filtering them afterwards (see RecordMode)
+    RecordMode recordMode = RecordMode::AllEvents;
+    /// if set, Tracer::trace resumes from the rays cached after an element, if the beamline up to that element is unchanged, and fills the cache
+    /// otherwise (see RetraceCache). must outlive the trace
+    RetraceCache* retraceCache = nullptr;
+};
+
 class RAYX_API Tracer {
   public:
     /**
      * @brief Construct a new Tracer object
-     * @param deviceConfig Configuration for the device to be used for tracing
+     * @param deviceConfig Configuration for the devices to be used for tracing. If several devices are enabled, the batches of a trace are
+     * distributed among them. The result does not depend on the number of devices
      */
     Tracer(const DeviceConfig& deviceConfig = DeviceConfig().enableBestDevice());
 
@@ -38,14 +97,86 @@ class RAYX_API Tracer {
      *  @param attrRecordMask Attributes to record for each ray
      *  @param maxEvents Optional maximum number of events to trace per ray (only used in non-sequential tracing)
      *  @param maxBatchSize Optional maximum batch size for tracing
+     *  @param shard Optional shard of the trace. Only the rays of this shard are traced
+     *  @param control Optional control of the trace execution (see TraceControl)
      *  @return A `Rays` struct containing the traced ray attributes, specified by `attrRecordMask` and filtered by `objectRecordMask`
      */
     Rays trace(const Group& group, const Sequential sequential = Sequential::No, const ObjectMask& objectRecordMask = ObjectMask::all(),
                const RayAttrMask attrRecordMask = RayAttrMask::All, std::optional<int> maxEvents = std::nullopt,
-               std::optional<int> maxBatchSize = std::nullopt);
+               std::optional<int> maxBatchSize = std::nullopt, std::optional<Shard> shard = std::nullopt, const TraceControl& control = {});
+
+    /**
+     *  @brief Trace rays through the given group, returning the events grouped by path (see RaysByPath)
+     *  The events are grouped by the compaction on the device, so the result needs no sorting. The parameters are the same as for trace(). The
+     *  path_id and path_event_id attributes are implicit in the result and never recorded, regardless of `attrRecordMask`
+     *  @return A `RaysByPath` struct containing one path per generated ray of the traced batches
+     */
+    RaysByPath traceByPath(const Group& group, const Sequential sequential = Sequential::No, const ObjectMask& objectRecordMask = ObjectMask::all(),
+                           const RayAttrMask attrRecordMask = RayAttrMask::All, std::optional<int> maxEvents = std::nullopt,
+                           std::optional<int> maxBatchSize = std::nullopt, std::optional<Shard> shard = std::nullopt,
+                           const TraceControl& control = {});
+
+    /**
+     *  @brief Trace rays through the given group, keeping the events in the memory of the device (see DeviceRays)
+     *  The result can be set as ray list of a RayListSource (DesignSource::setDeviceRayList), to trace the events through another beamline
+     *  without a round trip through the host. Typically used with RecordMode::LastEvent or an object record mask of the last element, so that
+     *  the events are the rays leaving the beamline. All attributes are recorded. Requires exactly one enabled device. The parameters are the
+     *  same as for trace(), TraceControl::onBatch is not called
+     *  @return A `DeviceRays` handle to the events on the device, in the same order as returned by trace()
+     */
+    DeviceRays traceToDevice(const Group& group, const Sequential sequential = Sequential::No, const ObjectMask& objectRecordMask = ObjectMask::all(),
+                             std::optional<int> maxEvents = std::nullopt, std::optional<int> maxBatchSize = std::nullopt,
+                             const TraceControl& control = {});
+
+    /**
+     * @brief Performance counters of the last trace, summed over all traced batches
+     * @return std::nullopt if rayx-core was built without the cmake option RAYX_TRACE_COUNTERS
+     */
+    const std::optional<TraceCounters>& getTraceCounters() const { return m_traceCounters; }
+
+    /**
+     * @brief Errors reported by the trace kernels during the last trace, summed over all traced batches
+     * Rays terminated with EventType::FatalError, EventType::BeyondHorizon or EventType::TooManyEvents, and input rays with an invalid object_id,
+     * are reported even if their events are not recorded. A warning is printed per error code at the end of a trace
+     */
+    const DeviceErrors& getDeviceErrors() const { return m_deviceErrors; }
+
+    /**
+     * @brief Memory used by the buffers of this tracer, per category (see MemoryCategory)
+     * Current usage includes the device buffers retained for the next trace. Peaks are reset at the start of each trace, so they are the peaks
+     * of the last trace
+     */
+    MemoryStats getMemoryStats() const { return m_memoryTracker->stats(); }
+
+    /// sets the policy for releasing device buffers after each trace. Default: all buffers are retained
+    void setMemoryTrimPolicy(const MemoryTrimPolicy& policy) { m_memoryTrimPolicy = policy; }
+
+    /// sets the policy for tuning the work division of the kernels. must not be called during a trace. Default: tuned on first use and kept in
+    /// memory (see WorkDivTuningPolicy)
+    void setWorkDivTuningPolicy(const WorkDivTuningPolicy& policy);
 
   private:
-    std::shared_ptr<DeviceTracer> m_deviceTracer;
+    /// traces the batches selected by `shard` and `control` on all devices and passes them to `onBatch` in order of the batch index. calls are
+    /// serialized. if `keepOnDevice` is set, the events are kept on the only device and returned, instead of being passed in the batches
+    std::shared_ptr<DeviceRaysStorage> traceBatches(const Group& group, const Sequential sequential, const ObjectMask& objectRecordMask,
+                                                    const RayAttrMask attrRecordMask, std::optional<int> maxEvents, std::optional<int> maxBatchSize,
+                                                    std::optional<Shard> shard, const TraceControl& control, const OutputLayout layout,
+                                                    const bool keepOnDevice, const std::function<void(TracedBatch&&)>& onBatch);
+
+    struct DeviceInstance {
+        std::shared_ptr<DeviceTracer> tracer;
+        /// cpus the tracing threads are pinned to (see DeviceConfig::partitionCpu)
+        std::vector<int> cpus;
+    };
+
+    std::vector<DeviceInstance> m_devices;
+    std::optional<TraceCounters> m_traceCounters;
+    DeviceErrors m_deviceErrors;
+    /// shared by all devices
+    std::shared_ptr<MemoryTracker> m_memoryTracker = std::make_shared<MemoryTracker>();
+    MemoryTrimPolicy m_memoryTrimPolicy;
+    /// shared by all devices
+    std::shared_ptr<WorkDivTuner> m_workDivTuner = std::make_shared<WorkDivTuner>();
 };
 
 }  // namespace rayx
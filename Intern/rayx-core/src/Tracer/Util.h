@@ -2,11 +2,15 @@
 
 #include <alpaka/alpaka.hpp>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include "Debug/Instrumentor.h"
+#include "DeviceRays.h"
+#include "MemoryStats.h"
 #include "Shader/Rand.h"
 #include "Shader/RaysPtr.h"
+#include "WorkDivTuner.h"
 
 namespace rayx {
 
@@ -46,30 +50,138 @@ inline int nextMultiple(const int value, const int divisor) {
     else
         return value + (divisor - remainder);  // next bigger multiple
 }
+
+/// device buffers are indexed with int and allocated with nextPowerOfTwo(size) elements, so the size of a buffer must not exceed 2^30
+constexpr int64_t MAX_BUFFER_SIZE = int64_t{1} << 30;
+
+/// size of a buffer holding `numPerItem` elements for each of `numItems` items. exits instead of silently overflowing, if the buffer could not be
+/// indexed with int
+inline int checkedBufferSize(const int64_t numItems, const int64_t numPerItem, const char* name) {
+    const auto size = numItems * numPerItem;
+    if (MAX_BUFFER_SIZE < size)
+        RAYX_EXIT << "error: the " << name << " buffer requires " << size << " elements, exceeding the maximum of " << MAX_BUFFER_SIZE
+                  << " elements. Reduce the batch size or the maximum number of events";
+    return static_cast<int>(size);
+}
+/// size of an allocated buffer in bytes, 0 if the buffer is not allocated
+template <typename Buf>
+inline int64_t bufBytes(const std::optional<Buf>& buf) {
+    using Elem = alpaka::Elem<Buf>;
+    return buf ? static_cast<int64_t>(alpaka::getExtents(*buf)[0]) * static_cast<int64_t>(sizeof(Elem)) : 0;
+}
+
 /// conditionally allocate buffer with specified minimum size.
 /// if the buffer already fulfills size requirements, this function does nothing.
-/// this function never shrinks a buffer.
+/// this function never shrinks a buffer (see trimBuf).
 /// actual allocation size is nextPowerOfTwo(size).
 /// this function is designed to optimize the repetitive use of the buffer with potentially different size requirements (e.g. tracing multiple
 /// beamlines one after the other)
+/// allocations are accounted in `memoryTracker` under `category`
 template <typename Queue, typename Buf>
-inline void allocBuf(Queue q, std::optional<Buf>& buf, const int size) {
+inline void allocBuf(Queue q, std::optional<Buf>& buf, const int size, MemoryTracker& memoryTracker, const MemoryCategory category) {
     using Idx  = alpaka::Idx<Buf>;
     using Elem = alpaka::Elem<Buf>;
 
     const auto shouldAlloc = !buf || alpaka::getExtents(*buf)[0] < size;
-    if (shouldAlloc) RAYX_VERB << (!buf ? "new alloc on device: " : "realloc on device: ") << nextPowerOfTwo(size * sizeof(Elem)) << " bytes";
-    if (shouldAlloc) buf = alpaka::allocAsyncBufIfSupported<Elem, Idx>(q, nextPowerOfTwo(size));
+    if (!shouldAlloc) return;
+
+    RAYX_VERB << (!buf ? "new alloc on device: " : "realloc on device: ") << nextPowerOfTwo(size) * sizeof(Elem) << " bytes";
+    memoryTracker.release(category, bufBytes(buf));
+    buf = alpaka::allocAsyncBufIfSupported<Elem, Idx>(q, nextPowerOfTwo(size));
+    memoryTracker.allocate(category, bufBytes(buf));
+}
+
+/// like allocBuf, but keeps the first `numKept` elements when the buffer is reallocated. used for buffers that are appended to
+template <typename Queue, typename Buf>
+inline void growBuf(Queue q, std::optional<Buf>& buf, const int size, const int numKept, MemoryTracker& memoryTracker, const MemoryCategory category) {
+    using Idx  = alpaka::Idx<Buf>;
+    using Elem = alpaka::Elem<Buf>;
+
+    const auto shouldAlloc = !buf || alpaka::getExtents(*buf)[0] < size;
+    if (!shouldAlloc) return;
+
+    RAYX_VERB << (!buf ? "new alloc on device: " : "grow on device: ") << nextPowerOfTwo(size) * sizeof(Elem) << " bytes";
+    auto grownBuf = std::optional<Buf>(alpaka::allocAsyncBufIfSupported<Elem, Idx>(q, nextPowerOfTwo(size)));
+    memoryTracker.allocate(category, bufBytes(grownBuf));
+    if (buf && 0 < numKept) alpaka::memcpy(q, *grownBuf, *buf, numKept);
+    memoryTracker.release(category, bufBytes(buf));
+    buf = std::move(grownBuf);
 }
 
 template <typename Queue, typename Acc>
-inline void allocRaysBuf(Queue q, const RayAttrMask attrMask, RaysBuf<Acc>& raysBuf, const int size) {
+inline void allocRaysBuf(Queue q, const RayAttrMask attrMask, RaysBuf<Acc>& raysBuf, const int size, MemoryTracker& memoryTracker,
+                         const MemoryCategory category) {
 #define X(type, name, flag) \
-    if (contains(attrMask, RayAttrMask::flag)) allocBuf(q, raysBuf.name, size);
+    if (contains(attrMask, RayAttrMask::flag)) allocBuf(q, raysBuf.name, size, memoryTracker, category);
     RAYX_X_MACRO_RAY_ATTR
 #undef X
 }
 
+/// releases the buffer if it is larger than `maxRetainedBytes`. the next call to allocBuf allocates it again
+template <typename Buf>
+inline void trimBuf(std::optional<Buf>& buf, const int64_t maxRetainedBytes, MemoryTracker& memoryTracker, const MemoryCategory category) {
+    const auto bytes = bufBytes(buf);
+    if (bytes <= maxRetainedBytes) return;
+
+    RAYX_VERB << "release on device: " << bytes << " bytes";
+    buf.reset();
+    memoryTracker.release(category, bytes);
+}
+
+template <typename Acc>
+inline void trimRaysBuf(RaysBuf<Acc>& raysBuf, const int64_t maxRetainedBytes, MemoryTracker& memoryTracker, const MemoryCategory category) {
+#define X(type, name, flag) trimBuf(raysBuf.name, maxRetainedBytes, memoryTracker, category);
+    RAYX_X_MACRO_RAY_ATTR
+#undef X
+}
+
+/// events kept on the device by MegaKernelTracer::traceToDevice, with all ray attributes. the compaction appends the events of each batch
+template <typename Acc>
+class DeviceRaysBuf : public DeviceRaysStorage {
+  public:
+    DeviceRaysBuf(alpaka::Dev<Acc> devAcc, std::shared_ptr<MemoryTracker> memoryTracker)
+        : m_devAcc(std::move(devAcc)), m_memoryTracker(std::move(memoryTracker)) {}
+    DeviceRaysBuf(const DeviceRaysBuf&)            = delete;
+    DeviceRaysBuf& operator=(const DeviceRaysBuf&) = delete;
+
+    ~DeviceRaysBuf() override { trimRaysBuf(rays, 0, *m_memoryTracker, MemoryCategory::DeviceRays); }
+
+    int64_t size() const override { return numEvents; }
+
+    Rays toHost() const override {
+        RAYX_PROFILE_FUNCTION_STDOUT();
+
+        const auto devHost = alpaka::getDevByIdx(alpaka::PlatformCpu{}, 0);
+        auto q             = alpaka::Queue<Acc, alpaka::Blocking>(m_devAcc);
+
+        Rays result;
+#define X(type, name, flag)       \
+    result.name.resize(numEvents); \
+    if (0 < numEvents) alpaka::memcpy(q, alpaka::createView(devHost, result.name, numEvents), *rays.name, numEvents);
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+        return result;
+    }
+
+    /// ensures capacity for `size` events, keeping the events appended so far
+    template <typename Queue>
+    void grow(Queue q, const int size) {
+#define X(type, name, flag) growBuf(q, rays.name, size, numEvents, *m_memoryTracker, MemoryCategory::DeviceRays);
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+    }
+
+    const alpaka::Dev<Acc>& devAcc() const { return m_devAcc; }
+
+    RaysBuf<Acc> rays;
+    /// device buffers are indexed with int, so the events of all batches fit into int (see checkedBufferSize)
+    int numEvents = 0;
+
+  private:
+    alpaka::Dev<Acc> m_devAcc;
+    std::shared_ptr<MemoryTracker> m_memoryTracker;
+};
+
 namespace BlockSizeConstraint {
 
 struct None {};
@@ -95,29 +207,49 @@ using Variant = std::variant<None, Exact, AtLeast, AtMost, InRange>;
 
 }  // namespace BlockSizeConstraint
 
+/// work division of a kernel launch. the number of blocks follows from the number of elements
+struct LaunchConfig {
+    BlockSizeConstraint::Variant blockSizeConstraint = BlockSizeConstraint::None{};
+    /// number of consecutive elements processed by each thread. kernels must iterate over their elements with forEachThreadElem
+    int elemsPerThread = 1;
+};
+
+/// calls `fn` with the index of each element of the calling thread, skipping indices not less than `n`
+template <typename Acc, typename Fn>
+RAYX_FN_ACC inline void forEachThreadElem(const Acc& __restrict acc, const int n, Fn&& fn) {
+    const auto gid            = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc)[0];
+    const auto elemsPerThread = alpaka::getWorkDiv<alpaka::Thread, alpaka::Elems>(acc)[0];
+    const auto begin          = gid * elemsPerThread;
+    const auto end            = std::min(begin + elemsPerThread, n);
+
+    for (auto i = begin; i < end; ++i) fn(i);
+}
+
 // TODO: maybe make a PR to alpaka for alpaka::Acc<Dev> to extract Acc from DevAcc (= Dev<Platform<Acc>>)
 template <typename Acc, typename DevAcc, typename Queue, typename Kernel, typename... Args>
-inline void execWithValidWorkDiv(DevAcc devAcc, Queue q, const int numElements, BlockSizeConstraint::Variant blockSizeConstraint,
-                                 const Kernel& kernel, Args&&... args) {
+inline void execWithValidWorkDiv(DevAcc devAcc, Queue q, const int numElements, const LaunchConfig& launchConfig, const Kernel& kernel,
+                                 Args&&... args) {
     const auto conf = alpaka::KernelCfg<Acc>{
         .gridElemExtent                        = numElements,
-        .threadElemExtent                      = 1,
+        .threadElemExtent                      = launchConfig.elemsPerThread,
         .blockThreadMustDivideGridThreadExtent = false,
     };
 
-    auto workDiv = alpaka::getValidWorkDiv(conf, devAcc, kernel, std::forward<Args>(args)...);
+    auto workDiv          = alpaka::getValidWorkDiv(conf, devAcc, kernel, std::forward<Args>(args)...);
+    const auto numThreads = ceilIntDivision(numElements, workDiv.m_threadElemExtent[0]);
     std::visit(
         [&]<typename BlockSizeConstraintType>(BlockSizeConstraintType constraint) {
             if constexpr (std::is_same_v<BlockSizeConstraintType, BlockSizeConstraint::Exact>) {
-                assert(workDiv.m_blockThreadExtent[0] <= constraint.value && "BlockSizeConstraint::Exact exceeds the capabilities this device");
+                assert(constraint.value <= static_cast<int>(alpaka::getAccDevProps<Acc>(devAcc).m_blockThreadCountMax) &&
+                       "BlockSizeConstraint::Exact exceeds the capabilities this device");
                 workDiv.m_blockThreadExtent = constraint.value;
-                workDiv.m_gridBlockExtent   = ceilIntDivision(numElements, constraint.value);
+                workDiv.m_gridBlockExtent   = ceilIntDivision(numThreads, constraint.value);
             }
 
             if constexpr (std::is_same_v<BlockSizeConstraintType, BlockSizeConstraint::AtMost>) {
                 if (constraint.value < workDiv.m_blockThreadExtent[0]) {
                     workDiv.m_blockThreadExtent = constraint.value;
-                    workDiv.m_gridBlockExtent   = ceilIntDivision(numElements, constraint.value);
+                    workDiv.m_gridBlockExtent   = ceilIntDivision(numThreads, constraint.value);
                 }
             }
 
@@ -129,17 +261,67 @@ inline void execWithValidWorkDiv(DevAcc devAcc, Queue q, const int numElements,
                 assert(constraint.atLeast <= workDiv.m_blockThreadExtent[0] && "BlockSizeConstraint::InRange exceeds capabilities of this device");
                 if (constraint.atMost < workDiv.m_blockThreadExtent[0]) {
                     workDiv.m_blockThreadExtent = constraint.atMost;
-                    workDiv.m_gridBlockExtent   = ceilIntDivision(numElements, constraint.atMost);
+                    workDiv.m_gridBlockExtent   = ceilIntDivision(numThreads, constraint.atMost);
                 }
             }
         },
-        blockSizeConstraint);
+        launchConfig.blockSizeConstraint);
 
     RAYX_VERB << "execute kernel with launch config: "
               << "blocks = " << workDiv.m_gridBlockExtent[0] << ", "
-              << "threads = " << workDiv.m_blockThreadExtent[0];
+              << "threads = " << workDiv.m_blockThreadExtent[0] << ", "
+              << "elements = " << workDiv.m_threadElemExtent[0];
+
+    // register and local memory usage of the kernel. useful to measure the effect of kernel specializations on occupancy
+    if (getDebugVerbose()) {
+        const auto attributes = alpaka::getFunctionAttributes<Acc>(devAcc, kernel, args...);
+        RAYX_VERB << "kernel function attributes: "
+                  << "registers = " << attributes.numRegs << ", "
+                  << "local memory = " << attributes.localSizeBytes << " bytes";
+    }
 
     alpaka::exec<Acc>(q, workDiv, kernel, std::forward<Args>(args)...);
 }
 
+/// candidates for the tuned work division on a device. block sizes are limited by the device. on devices with one thread per block (e.g. the
+/// cpu accelerators), only the number of elements per thread varies
+template <typename Acc, typename DevAcc>
+inline std::vector<TunedWorkDiv> workDivCandidates(DevAcc devAcc) {
+    const auto props             = alpaka::getAccDevProps<Acc>(devAcc);
+    const auto maxBlockSize      = std::min(static_cast<int>(props.m_blockThreadExtentMax[0]), static_cast<int>(props.m_blockThreadCountMax));
+    const auto maxElemsPerThread = static_cast<int>(props.m_threadElemExtentMax[0]);
+
+    auto blockSizes = std::vector<int>();
+    for (const auto blockSize : {32, 64, 128, 256, 512, 1024})
+        if (blockSize <= maxBlockSize) blockSizes.push_back(blockSize);
+    if (blockSizes.empty()) blockSizes.push_back(maxBlockSize);
+
+    auto candidates = std::vector<TunedWorkDiv>();
+    for (const auto blockSize : blockSizes)
+        for (const auto elemsPerThread : {1, 2, 4, 8})
+            if (elemsPerThread <= maxElemsPerThread) candidates.push_back({.blockSize = blockSize, .elemsPerThread = elemsPerThread});
+    return candidates;
+}
+
+/// launch config of `kernel` on this device, tuned by `workDivTuner` under the key of the accelerator, the device name and `kernelName`. the
+/// first call for a key may execute `kernel` several times with `args` to time the candidates (see WorkDivTuner::get). the queue must be blocking
+template <typename Acc, typename DevAcc, typename Queue, typename Kernel, typename... Args>
+inline LaunchConfig tuneLaunchConfig(WorkDivTuner& workDivTuner, const std::string& kernelName, DevAcc devAcc, Queue q, const int numElements,
+                                     const Kernel& kernel, const Args&... args) {
+    const auto key     = alpaka::getAccName<Acc>() + " | " + alpaka::getName(devAcc) + " | " + kernelName;
+    const auto workDiv = workDivTuner.get(key, numElements, workDivCandidates<Acc>(devAcc), [&](const TunedWorkDiv& candidate) {
+        const auto launchConfig = LaunchConfig{
+            .blockSizeConstraint = BlockSizeConstraint::Exact{candidate.blockSize},
+            .elemsPerThread      = candidate.elemsPerThread,
+        };
+        execWithValidWorkDiv<Acc>(devAcc, q, numElements, launchConfig, kernel, args...);
+    });
+
+    if (!workDiv) return LaunchConfig{};
+    return LaunchConfig{
+        .blockSizeConstraint = BlockSizeConstraint::Exact{workDiv->blockSize},
+        .elemsPerThread      = workDiv->elemsPerThread,
+    };
+}
+
 }  // namespace rayx
@@ -0,0 +1,163 @@
+#include "WorkDivTuner.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "Debug/Debug.h"
+#include "Debug/Instrumentor.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr auto CACHE_HEADER = "rayx-workdiv-cache 1";
+
+std::optional<fs::path> userCacheDirectory() {
+#if defined(_WIN32)
+    if (const auto* localAppData = std::getenv("LOCALAPPDATA")) return fs::path(localAppData);
+#else
+    if (const auto* xdgCacheHome = std::getenv("XDG_CACHE_HOME"); xdgCacheHome && *xdgCacheHome) return fs::path(xdgCacheHome);
+    if (const auto* home = std::getenv("HOME")) return fs::path(home) / ".cache";
+#endif
+    return std::nullopt;
+}
+
+/// entries of the cache file are lines of the form: key \t blockSize \t elemsPerThread. keys may contain spaces, e.g. in device names
+std::map<std::string, rayx::TunedWorkDiv> readCacheFile(const fs::path& filepath) {
+    auto entries = std::map<std::string, rayx::TunedWorkDiv>();
+
+    std::ifstream file(filepath);
+    if (!file) return entries;
+
+    std::string line;
+    if (!std::getline(file, line) || line != CACHE_HEADER) {
+        RAYX_WARN << "warning: ignoring work division cache file " << filepath << ", because it has an unknown format";
+        return entries;
+    }
+
+    while (std::getline(file, line)) {
+        const auto separator = line.find('\t');
+        auto workDiv         = rayx::TunedWorkDiv{};
+        auto ss              = std::stringstream(separator == std::string::npos ? "" : line.substr(separator + 1));
+        if (!(ss >> workDiv.blockSize >> workDiv.elemsPerThread) || workDiv.blockSize < 1 || workDiv.elemsPerThread < 1) {
+            RAYX_WARN << "warning: ignoring invalid entry in work division cache file " << filepath << ": " << line;
+            continue;
+        }
+        entries[line.substr(0, separator)] = workDiv;
+    }
+
+    return entries;
+}
+
+}  // unnamed namespace
+
+namespace rayx {
+
+std::optional<fs::path> defaultWorkDivCacheFilepath() {
+    const auto directory = userCacheDirectory();
+    if (!directory) return std::nullopt;
+    return *directory / "rayx" / "workdiv-cache.txt";
+}
+
+void WorkDivTuner::setPolicy(const WorkDivTuningPolicy& policy) {
+    const auto lock = std::lock_guard(m_mutex);
+    m_policy        = policy;
+
+    // the cache file may have changed
+    m_cacheLoaded = false;
+    m_cache.clear();
+}
+
+std::optional<TunedWorkDiv> WorkDivTuner::get(const std::string& key, const int numElements, const std::vector<TunedWorkDiv>& candidates,
+                                              const std::function<void(const TunedWorkDiv&)>& launch) {
+    const auto lookup = [&]() -> std::optional<TunedWorkDiv> {
+        if (!m_cacheLoaded) loadCache();
+        if (const auto it = m_cache.find(key); it != m_cache.end()) return it->second;
+        return std::nullopt;
+    };
+
+    {
+        const auto lock = std::lock_guard(m_mutex);
+        if (!m_policy.enable) return std::nullopt;
+        if (const auto workDiv = lookup()) return workDiv;
+        if (numElements < m_policy.minTuningElements || candidates.empty()) return std::nullopt;
+    }
+
+    // tuning runs are serialized. another device may have tuned the kernel while this one waited
+    const auto tuningLock = std::lock_guard(m_tuningMutex);
+    {
+        const auto lock = std::lock_guard(m_mutex);
+        if (const auto workDiv = lookup()) return workDiv;
+    }
+
+    RAYX_PROFILE_SCOPE_STDOUT("tune work division");
+    RAYX_VERB << "tuning work division of: " << key << " (" << candidates.size() << " candidates, " << numElements << " elements)";
+
+    // the first launch of a kernel may include one-time costs, e.g. loading the kernel module
+    launch(candidates.front());
+
+    auto best        = candidates.front();
+    auto bestSeconds = std::numeric_limits<double>::infinity();
+    for (const auto& candidate : candidates) {
+        const auto start = std::chrono::steady_clock::now();
+        launch(candidate);
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        RAYX_VERB << "\t- block size = " << candidate.blockSize << ", elements per thread = " << candidate.elemsPerThread << ": " << seconds
+                  << " s";
+        if (seconds < bestSeconds) {
+            best        = candidate;
+            bestSeconds = seconds;
+        }
+    }
+
+    RAYX_VERB << "tuned work division of: " << key << ": block size = " << best.blockSize << ", elements per thread = " << best.elemsPerThread;
+    const auto lock = std::lock_guard(m_mutex);
+    m_cache[key]    = best;
+    storeCache(key, best);
+    return best;
+}
+
+void WorkDivTuner::loadCache() {
+    m_cacheLoaded = true;
+
+    const auto& filepath = m_policy.cacheFilepath;
+    if (!filepath || filepath->empty()) return;
+
+    m_cache = readCacheFile(*filepath);
+    RAYX_VERB << "loaded " << m_cache.size() << " tuned work division(s) from: " << *filepath;
+}
+
+void WorkDivTuner::storeCache(const std::string& key, const TunedWorkDiv& workDiv) const {
+    const auto& filepath = m_policy.cacheFilepath;
+    if (!filepath || filepath->empty()) return;
+
+    // other processes may have added entries since the cache was loaded
+    auto entries = readCacheFile(*filepath);
+    entries[key] = workDiv;
+
+    auto error = std::error_code();
+    if (filepath->has_parent_path()) fs::create_directories(filepath->parent_path(), error);
+
+    const auto tmpFilepath = fs::path(filepath->string() + ".tmp");
+    {
+        std::ofstream file(tmpFilepath);
+        file << CACHE_HEADER << "\n";
+        for (const auto& [entryKey, entry] : entries) file << entryKey << "\t" << entry.blockSize << "\t" << entry.elemsPerThread << "\n";
+
+        file.flush();
+        if (!file) {
+            // the cache only saves tuning time, so the trace goes on without it
+            RAYX_WARN << "warning: unable to write work division cache file " << tmpFilepath;
+            return;
+        }
+    }
+
+    fs::rename(tmpFilepath, *filepath, error);
+    if (error) RAYX_WARN << "warning: unable to write work division cache file " << *filepath << ": " << error.message();
+}
+
+}  // namespace rayx
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Core.h"
+
+namespace rayx {
+
+/**
+ * @brief Policy for tuning the work division of the kernels
+ * On first use of a kernel on a device, a few block sizes and numbers of elements per thread are timed and the fastest is kept, keyed by
+ * accelerator, device name and kernel. Later traces reuse the kept work division without timing. If a cache file is set, the tuned work divisions
+ * are also reused by other tracers and processes.
+ */
+struct RAYX_API WorkDivTuningPolicy {
+    /// tune the work division of the kernels. if disabled, alpaka's default valid work division is used
+    bool enable = true;
+    /// file caching the tuned work divisions, e.g. defaultWorkDivCacheFilepath(). std::nullopt keeps the tuned work divisions in memory only
+    std::optional<std::filesystem::path> cacheFilepath = std::nullopt;
+    /// launches with fewer elements are not timed, because their duration is dominated by the launch overhead
+    int minTuningElements = 1 << 16;
+};
+
+/// rayx/workdiv-cache.txt in the user cache directory ($XDG_CACHE_HOME or ~/.cache, %LOCALAPPDATA% on Windows). std::nullopt if there is no user
+/// cache directory
+RAYX_API std::optional<std::filesystem::path> defaultWorkDivCacheFilepath();
+
+/// block size and number of elements per thread of a kernel launch
+struct TunedWorkDiv {
+    int blockSize;
+    int elemsPerThread;
+};
+
+/// keeps the tuned work divisions of all kernels and devices. shared by all devices of a tracer. thread-safe
+class WorkDivTuner {
+  public:
+    void setPolicy(const WorkDivTuningPolicy& policy);
+
+    /**
+     * @brief Get the work division for the kernel identified by `key`
+     * If `key` is not cached yet and the launch has at least minTuningElements elements, `launch` is timed for each of `candidates` and the
+     * fastest candidate is cached. `launch` must block until the kernel has finished and must not have side effects other than the outputs of
+     * the kernel, because it is called several times.
+     * @return std::nullopt if the default work division should be used
+     */
+    std::optional<TunedWorkDiv> get(const std::string& key, const int numElements, const std::vector<TunedWorkDiv>& candidates,
+                                    const std::function<void(const TunedWorkDiv&)>& launch);
+
+  private:
+    void loadCache();
+    void storeCache(const std::string& key, const TunedWorkDiv& workDiv) const;
+
+    /// guards the policy and the cache
+    std::mutex m_mutex;
+    /// serializes tuning runs, so that devices sharing a name do not tune concurrently and disturb each other's timings. lookups of tuned work
+    /// divisions do not wait for a tuning run
+    std::mutex m_tuningMutex;
+    WorkDivTuningPolicy m_policy;
+    bool m_cacheLoaded = false;
+    std::map<std::string, TunedWorkDiv> m_cache;
+};
+
+}  // namespace rayx
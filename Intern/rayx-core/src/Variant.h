@@ -91,7 +91,30 @@ class Variant : public Base {
         return variant::visit(std::forward<Visitor>(visitor), m_variant);
     }
 
+    /**
+     * @brief Visits the variant, considering only the alternatives T for which `Filter<T>::value` is true.
+     * The caller must ensure that the variant holds one of these alternatives. Code for the other alternatives is not instantiated, and if only a
+     * single alternative passes the filter, the visitor is called without any dispatch.
+     */
+    template <template <typename> typename Filter, typename Visitor>
+    RAYX_FN_ACC decltype(auto) visitFiltered(Visitor&& visitor) const {
+        static_assert((Filter<Ts>::value || ...), "at least one alternative must pass the filter");
+        return visitFilteredImpl<Filter, Ts...>(visitor);
+    }
+
   private:
+    template <template <typename> typename Filter, typename T, typename... Rest, typename Visitor>
+    RAYX_FN_ACC decltype(auto) visitFilteredImpl(Visitor& visitor) const {
+        if constexpr (!Filter<T>::value) {
+            return visitFilteredImpl<Filter, Rest...>(visitor);
+        } else if constexpr (!(Filter<Rest>::value || ...)) {
+            return visitor(variant::get<T>(m_variant));
+        } else {
+            if (is<T>()) return visitor(variant::get<T>(m_variant));
+            return visitFilteredImpl<Filter, Rest...>(visitor);
+        }
+    }
+
     variant::variant<Ts...> m_variant;
 };
 
@@ -19,6 +19,7 @@ constexpr int PADDING = 0;  // extra spaces on the left side in each cell for be
 // constexpr int MAX_CELL_SIZE_FLOAT  = 16 + PADDING;
 constexpr int MAX_CELL_SIZE_DOUBLE = 24 + PADDING;
 constexpr int MAX_CELL_SIZE_INT    = 11 + PADDING;
+constexpr int MAX_CELL_SIZE_INT64  = 20 + PADDING;
 constexpr int MAX_CELL_SIZE_UINT64 = 20 + PADDING;
 constexpr char DELIMITER           = ',';
 
@@ -35,6 +36,8 @@ std::string formatAsString(const double v) {
 
 std::string formatAsString(const int v) { return std::to_string(v); }
 
+std::string formatAsString(const int64_t v) { return std::to_string(v); }
+
 std::string formatAsString(const EventType v) { return EventTypeToString.at(v); }
 
 std::string formatAsString(const RandCounter v) { return std::to_string(v); }
@@ -52,6 +55,11 @@ int calcCellSize<int>(const std::string header) {
     return std::max(MAX_CELL_SIZE_INT, static_cast<int>(header.size()) + PADDING);
 }
 
+template <>
+int calcCellSize<int64_t>(const std::string header) {
+    return std::max(MAX_CELL_SIZE_INT64, static_cast<int>(header.size()) + PADDING);
+}
+
 template <>
 int calcCellSize<EventType>(const std::string header) {
     int maxSize = 0;
@@ -119,7 +127,7 @@ void writeCsvHeader(std::ostream& os, const RayAttrMask attr, const std::vector<
 #undef X
 }
 
-void writeCsvBodyLine(std::ostream& os, const int i, const RayAttrMask attr, const Rays& rays, const std::vector<int>& cellSizes) {
+void writeCsvBodyLine(std::ostream& os, const int64_t i, const RayAttrMask attr, const Rays& rays, const std::vector<int>& cellSizes) {
     const auto numAttr = countSetBits(attr);
     auto attrCount     = 0;
 
@@ -156,6 +164,11 @@ int readCell<int>(const std::string& cell) {
     return std::stoi(cell);
 }
 
+template <>
+int64_t readCell<int64_t>(const std::string& cell) {
+    return std::stoll(cell);
+}
+
 template <>
 EventType readCell<EventType>(const std::string& cell) {
     return StringToEventType.at(trimWhitespaces(cell));
@@ -250,7 +263,7 @@ void writeCsv(const fs::path& filepath, const Rays& rays) {
     file << '\n';
 
     const auto size = rays.size();
-    for (int i = 0; i < size; i++) {
+    for (int64_t i = 0; i < size; i++) {
         writeCsvBodyLine(file, i, attr, rays, cellSizes);
         file << '\n';
     }
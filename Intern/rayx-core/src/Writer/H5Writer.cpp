@@ -31,6 +31,11 @@ inline HighFive::DataType highfive_create_type_Complex() {
 HIGHFIVE_REGISTER_TYPE(rayx::EventType, highfive_create_type_EventType);
 HIGHFIVE_REGISTER_TYPE(rayx::complex::Complex, highfive_create_type_Complex);
 
+namespace {
+/// number of events per chunk of the extendable datasets created by createH5
+constexpr hsize_t H5_STREAMING_CHUNK_SIZE = 1 << 16;
+}  // unnamed namespace
+
 namespace rayx {
 
 // TODO: this function should not require, that attr is known beforehand. Mabye we should use attr only to further exclude attributes? Or provide an
@@ -44,6 +49,12 @@ Rays readH5Rays(const std::filesystem::path& filepath, const RayAttrMask attr) {
     try {
         auto file = HighFive::File(filepath.string(), HighFive::File::ReadOnly);
 
+        if (file.exist("rayx/path_offsets")) {
+            rays = readH5RaysByPath(filepath, attr).toRays();
+            rays.filterByAttrMask(attr);
+            return rays;
+        }
+
         auto loadData = [&file](const auto& address, auto& dst) {
             file.getDataSet(address).read(dst);
             _assert(0 < dst.size(),
@@ -77,6 +88,24 @@ std::vector<std::string> readH5ObjectNames(const std::filesystem::path& filepath
     return object_names;
 }
 
+RayAttrMask readH5RayAttrMask(const std::filesystem::path& filepath) {
+    RAYX_VERB << "reading ray attribute flags from " << filepath;
+
+    auto attr = RayAttrMask::None;
+
+    try {
+        auto file = HighFive::File(filepath.string(), HighFive::File::ReadOnly);
+
+#define X(type, name, flag) \
+    if (file.exist("rayx/events/" #name)) attr |= RayAttrMask::flag;
+
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to read h5 file: " << e.what(); }
+
+    return attr;
+}
+
 void writeH5(const std::filesystem::path& filepath, const std::vector<std::string>& object_names, const Rays& rays, const RayAttrMask attr,
              const bool overwrite) {
     RAYX_PROFILE_FUNCTION_STDOUT();
@@ -104,19 +133,110 @@ void writeH5(const std::filesystem::path& filepath, const std::vector<std::strin
     } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to write h5 file: " << e.what(); }
 }
 
-void appendH5(const std::filesystem::path& filepath, const Rays& rays, const RayAttrMask attr) {
-    // TODO: fix this function
-    assert(false && "unimplemented");
+RaysByPath readH5RaysByPath(const std::filesystem::path& filepath, const RayAttrMask attr) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+    RAYX_VERB << "reading rays grouped by path from " << filepath << " with attribute flags: " << to_string(attr);
+
+    RaysByPath rays;
+
+    try {
+        auto file = HighFive::File(filepath.string(), HighFive::File::ReadOnly);
 
+        if (!file.exist("rayx/path_offsets")) RAYX_EXIT << "file " << filepath << " does not store the rays grouped by path";
+        file.getDataSet("rayx/first_path_id").read(rays.firstPathId);
+        file.getDataSet("rayx/path_offsets").read(rays.pathOffsets);
+
+        // path_id and path_event_id are implicit
+        const auto storedAttr = exclude(attr, RayAttrMask::PathId | RayAttrMask::PathEventId);
+
+#define X(type, name, flag)                                                            \
+    if (contains(storedAttr, RayAttrMask::flag) && file.exist("rayx/events/" #name)) { \
+        RAYX_VERB << "reading ray attribute: " #name;                                  \
+        file.getDataSet("rayx/events/" #name).read(rays.rays.name);                    \
+    }
+
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to read h5 file: " << e.what(); }
+
+    if (!rays.isValid()) RAYX_EXIT << "the path offsets in " << filepath << " do not match the number of events";
+    return rays;
+}
+
+void writeH5ByPath(const std::filesystem::path& filepath, const std::vector<std::string>& object_names, const RaysByPath& rays,
+                   const RayAttrMask attr, const bool overwrite) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+    RAYX_VERB << "write rays grouped by path to " << filepath << " with attribute flags: " << to_string(attr);
+
+    // path_id and path_event_id are implicit
+    const auto storedAttr = exclude(attr, RayAttrMask::PathId | RayAttrMask::PathEventId);
+
+    if (rays.numEvents() != 0 && !contains(rays.rays.attrMask(), storedAttr))
+        RAYX_EXIT << "Cannot write rays to output file '" << filepath
+                  << "' because the rays do not contain all attributes specified in the attribute mask: " << to_string(attr)
+                  << ". The rays contain the following attributes: " << to_string(rays.attrMask());
+
+    try {
+        const auto flags = HighFive::File::ReadWrite | HighFive::File::Create | (overwrite ? HighFive::File::Truncate : HighFive::File::Excl);
+        auto file        = HighFive::File(filepath.string(), flags);
+
+#define X(type, name, flag)                                                                   \
+    RAYX_VERB << "write ray attribute: " #name " (" << rays.rays.name.size() << " elements)"; \
+    if (contains(storedAttr, RayAttrMask::flag)) file.createDataSet("rayx/events/" #name, rays.rays.name);
+
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+        file.createDataSet("rayx/first_path_id", rays.firstPathId);
+        file.createDataSet("rayx/path_offsets", rays.pathOffsets);
+        file.createDataSet("rayx/num_events", rays.numEvents());
+        file.createDataSet("rayx/object_names", object_names);
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to write h5 file: " << e.what(); }
+}
+
+void createH5(const std::filesystem::path& filepath, const std::vector<std::string>& object_names, const RayAttrMask attr, const bool overwrite) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+    RAYX_VERB << "create h5 file for streaming " << filepath << " with attribute flags: " << to_string(attr);
+
+    try {
+        const auto flags = HighFive::File::ReadWrite | HighFive::File::Create | (overwrite ? HighFive::File::Truncate : HighFive::File::Excl);
+        auto file        = HighFive::File(filepath.string(), flags);
+
+        // datasets need to be chunked to be extendable
+        auto props = HighFive::DataSetCreateProps();
+        props.add(HighFive::Chunking(std::vector<hsize_t>{H5_STREAMING_CHUNK_SIZE}));
+        const auto space = HighFive::DataSpace({0}, {HighFive::DataSpace::UNLIMITED});
+
+#define X(type, name, flag) \
+    if (contains(attr, RayAttrMask::flag)) file.createDataSet<type>("rayx/events/" #name, space, props);
+
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+        file.createDataSet("rayx/num_events", int64_t{0});
+        file.createDataSet("rayx/object_names", object_names);
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to write h5 file: " << e.what(); }
+}
+
+void appendH5(const std::filesystem::path& filepath, const Rays& rays, const RayAttrMask attr) {
     RAYX_PROFILE_FUNCTION_STDOUT();
     RAYX_VERB << "append rays to " << filepath << " with attribute flags: " << to_string(attr);
 
     if (!std::filesystem::is_regular_file(filepath))
         RAYX_EXIT << "Cannot append to output file '" << filepath << "' because it does not exist or is not a regular file.";
 
+    if (!contains(rays.attrMask(), attr))
+        RAYX_EXIT << "Cannot append rays to output file '" << filepath
+                  << "' because the rays do not contain all attributes specified in the attribute mask: " << to_string(attr)
+                  << ". The rays contain the following attributes: " << to_string(rays.attrMask());
+
     try {
         auto file = HighFive::File(filepath.string(), HighFive::File::ReadWrite);
 
+        auto numEventsDataSet = file.getDataSet("rayx/num_events");
+        auto numEvents        = int64_t{0};
+        numEventsDataSet.read(numEvents);
+
 #define X(type, name, flag)                                                               \
     RAYX_VERB << "append ray attribute: " #name " (" << rays.name.size() << " elements)"; \
     if (contains(attr, RayAttrMask::flag)) {                                              \
@@ -128,6 +248,30 @@ void appendH5(const std::filesystem::path& filepath, const Rays& rays, const Ray
 
         RAYX_X_MACRO_RAY_ATTR
 #undef X
+
+        numEventsDataSet.write(numEvents + rays.size());
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to write h5 file: " << e.what(); }
+}
+
+void truncateH5(const std::filesystem::path& filepath, const int64_t numEvents) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+    RAYX_VERB << "truncate " << filepath << " to " << numEvents << " events";
+
+    try {
+        auto file = HighFive::File(filepath.string(), HighFive::File::ReadWrite);
+
+#define X(type, name, flag)                                                                                                            \
+    if (file.exist("rayx/events/" #name)) {                                                                                            \
+        auto dataset = file.getDataSet("rayx/events/" #name);                                                                          \
+        if (dataset.getSpace().getDimensions()[0] < static_cast<size_t>(numEvents))                                                    \
+            RAYX_EXIT << "Cannot truncate ray attribute " #name " in " << filepath << ", it has less than " << numEvents << " events"; \
+        dataset.resize({static_cast<size_t>(numEvents)});                                                                              \
+    }
+
+        RAYX_X_MACRO_RAY_ATTR
+#undef X
+
+        file.getDataSet("rayx/num_events").write(numEvents);
     } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to write h5 file: " << e.what(); }
 }
 
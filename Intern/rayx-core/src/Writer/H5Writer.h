@@ -3,16 +3,33 @@
 #include <filesystem>
 
 #include "Rays.h"
+#include "RaysByPath.h"
 
 namespace rayx {
 
 #ifndef NO_H5
+/// reads files of both layouts. files written by writeH5ByPath are converted with RaysByPath::toRays
 RAYX_API Rays readH5Rays(const std::filesystem::path& filepath, const RayAttrMask attr = RayAttrMask::All);
 RAYX_API std::vector<std::string> readH5ObjectNames(const std::filesystem::path& filepath);
+/// returns the mask of the ray attributes stored in the file
+RAYX_API RayAttrMask readH5RayAttrMask(const std::filesystem::path& filepath);
 
 RAYX_API void writeH5(const std::filesystem::path& filepath, const std::vector<std::string>& object_names, const Rays& rays,
                       const RayAttrMask attr = RayAttrMask::All, const bool overwrite = true);
+
+// path layout: the events are stored grouped by path, with the dataset rayx/path_offsets (see RaysByPath) instead of the path_id and path_event_id
+// datasets
+RAYX_API RaysByPath readH5RaysByPath(const std::filesystem::path& filepath, const RayAttrMask attr = RayAttrMask::All);
+RAYX_API void writeH5ByPath(const std::filesystem::path& filepath, const std::vector<std::string>& object_names, const RaysByPath& rays,
+                            const RayAttrMask attr = RayAttrMask::All, const bool overwrite = true);
+
+// streaming: createH5 creates a file with empty, extendable datasets. appendH5 appends events to it, so that the rays of a trace do not need to be
+// kept in memory at once. reading the file yields the same rays as writing all events at once with writeH5
+RAYX_API void createH5(const std::filesystem::path& filepath, const std::vector<std::string>& object_names, const RayAttrMask attr = RayAttrMask::All,
+                       const bool overwrite = true);
 RAYX_API void appendH5(const std::filesystem::path& filepath, const Rays& rays, const RayAttrMask attr = RayAttrMask::All);
+/// discards all events after the first `numEvents` events of a file created by createH5
+RAYX_API void truncateH5(const std::filesystem::path& filepath, const int64_t numEvents);
 #endif
 
 }  // namespace rayx
@@ -1,3 +1,9 @@
+#include <filesystem>
+#include <map>
+#include <numeric>
+
+#include "RaysView.h"
+#include "Tracer/BatchPlan.h"
 #include "setupTests.h"
 
 namespace {
@@ -71,6 +77,48 @@ TEST_F(TestSuite, traceWithRayAttrMask) {
     EXPECT_EQ(rays.attrMask(), RayAttrMask::Energy) << to_string(rays.attrMask()) << " != " << to_string(RayAttrMask::Position);
 }
 
+TEST_F(TestSuite, traceWithSpecializedRecordMask) {
+    // smaller attribute masks select trace kernels that skip computations for unrecorded attributes. recorded attributes must not be affected
+    const auto attrMasks = {
+        RayAttrMask::Position,
+        RayAttrMask::Position | RayAttrMask::EventType | RayAttrMask::ObjectId,
+        RayAttrMask::Position | RayAttrMask::Direction | RayAttrMask::Energy,
+        RayAttrMask::Position | RayAttrMask::OpticalPathLength,
+    };
+
+    for (const auto sequential : {Sequential::No, Sequential::Yes}) {
+        fixSeed(FIXED_SEED);
+        const auto expected = traceRml(beamlineFilename, RayAttrMask::All, sequential);
+
+        for (const auto attrMask : attrMasks) {
+            fixSeed(FIXED_SEED);
+            const auto rays = traceRml(beamlineFilename, attrMask, sequential);
+            EXPECT_EQ(rays.attrMask(), attrMask);
+            compare(rays, expected, attrMask);
+        }
+    }
+}
+
+TEST_F(TestSuite, traceWithSpecializedRecordMaskWithoutRefractiveIndex) {
+    // the material of the mirror is not in the material table, so every ray hitting it terminates with a fatal error. this must not depend on
+    // whether the electric field is recorded
+    auto beamline = loadBeamline("PlaneMirror");
+    auto& mirror  = static_cast<DesignElement&>(*beamline.findNodeByObjectId(static_cast<int>(beamline.numSources())));
+    mirror.setMaterial(static_cast<Material>(141));
+
+    const auto attrMask = RayAttrMask::Position | RayAttrMask::EventType | RayAttrMask::PathId;
+    for (const auto sequential : {Sequential::No, Sequential::Yes}) {
+        fixSeed(FIXED_SEED);
+        const auto expected = tracer->trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All);
+        EXPECT_GT(tracer->getDeviceErrors().numRays(DeviceErrorCode::FatalError), 0);
+
+        fixSeed(FIXED_SEED);
+        const auto rays = tracer->trace(beamline, sequential, ObjectMask::all(), attrMask);
+        EXPECT_GT(tracer->getDeviceErrors().numRays(DeviceErrorCode::FatalError), 0);
+        compare(rays, expected, attrMask);
+    }
+}
+
 TEST_F(TestSuite, testObjectRecordMask) {
     const auto beamline = loadBeamline(beamlineFilename);
 
@@ -142,6 +190,452 @@ TEST_F(TestSuite, testObjectRecordMask) {
     }
 }
 
+TEST_F(TestSuite, traceSequentialWithDenseRecordSlots) {
+    const auto beamline     = loadBeamline(beamlineFilename);
+    const auto lastObjectId = static_cast<int>(beamline.numObjects()) - 1;
+
+    auto recordAllTracer = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+    fixSeed(FIXED_SEED);
+    const auto all = recordAllTracer.trace(beamline, Sequential::Yes, ObjectMask::all());
+
+    // recording only the last object yields its events, in a buffer of one slot per ray instead of one slot per object
+    auto recordLastTracer = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+    fixSeed(FIXED_SEED);
+    const auto last = recordLastTracer.trace(beamline, Sequential::Yes, ObjectMask::byIndices({lastObjectId}));
+
+    // path_event_id counts recorded events only, so it differs
+    compare(last, all.filterByObjectId(lastObjectId), RayAttrMask::All & ~RayAttrMask::PathEventId, 0.0);
+    EXPECT_LT(recordLastTracer.getMemoryStats()[MemoryCategory::Events].currentBytes,
+              recordAllTracer.getMemoryStats()[MemoryCategory::Events].currentBytes);
+}
+
+TEST_F(TestSuite, traceWithMultipleDevices) {
+    const auto beamline     = loadBeamline(beamlineFilename);
+    const auto maxBatchSize = 997;  // does not divide the number of rays, so the last batch is smaller
+
+    using DeviceType  = DeviceConfig::DeviceType;
+    auto singleTracer = Tracer(DeviceConfig(DeviceType::Cpu).enableBestDevice());
+
+    // the cpu partitions share cpus if there are fewer cpus than partitions, so this works on any machine
+    auto deviceConfig = DeviceConfig(DeviceType::Cpu).partitionCpu(3);
+    for (auto& device : deviceConfig.devices) device.enable = true;
+    auto multiTracer = Tracer(deviceConfig);
+
+    for (const auto sequential : {Sequential::No, Sequential::Yes}) {
+        fixSeed(FIXED_SEED);
+        const auto expected = singleTracer.trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize);
+
+        // trace twice, to make sure no state is carried over between traces
+        for (int i = 0; i < 2; ++i) {
+            fixSeed(FIXED_SEED);
+            const auto rays = multiTracer.trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize);
+            compare(rays, expected, RayAttrMask::All, 0.0);
+        }
+    }
+}
+
+TEST_F(TestSuite, traceShards) {
+    const auto beamline     = loadBeamline(beamlineFilename);
+    const auto maxBatchSize = 997;
+
+    fixSeed(FIXED_SEED);
+    const auto expected = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize);
+
+    // more shards than batches are allowed. such shards trace nothing
+    for (const auto numShards : {1, 3, 1000}) {
+        auto raysShards = std::vector<Rays>();
+        for (int i = 0; i < numShards; ++i) {
+            fixSeed(FIXED_SEED);
+            const auto shard = Shard{.index = i, .count = numShards};
+            auto rays        = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, shard);
+            if (!rays.empty()) raysShards.push_back(std::move(rays));
+        }
+
+        compare(Rays::concat(raysShards), expected, RayAttrMask::All, 0.0);
+    }
+}
+
+TEST_F(TestSuite, planBatchesBeyondIntRange) {
+    // three sources of 2^30 rays each exceed the range of int in total
+    auto beamline = Beamline();
+    for (int i = 0; i < 3; ++i) {
+        auto source = std::make_unique<DesignSource>("source" + std::to_string(i));
+        source->setType(ElementType::MatrixSource);
+        source->setNumberOfRays(1 << 30);
+        beamline.addChild(std::move(source));
+    }
+
+    const auto numRays = numRaysTotal(beamline);
+    EXPECT_EQ(numRays, int64_t{3} << 30);
+
+    const auto batchPlan = planBatches(numRays, 1 << 20);
+    EXPECT_EQ(batchPlan.numRaysTotal, int64_t{3} << 30);
+    EXPECT_EQ(batchPlan.numRaysBatchAtMost, 1 << 20);
+    EXPECT_EQ(batchPlan.numBatches, 3 << 10);
+
+    // a partial last batch is a batch of its own
+    const auto partialBatchPlan = planBatches(numRays + 1, 1 << 20);
+    EXPECT_EQ(partialBatchPlan.numBatches, (3 << 10) + 1);
+}
+
+TEST_F(TestSuite, traceResumeFromBatch) {
+    const auto beamline     = loadBeamline(beamlineFilename);
+    const auto maxBatchSize = 997;
+
+    fixSeed(FIXED_SEED);
+    const auto expected = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize);
+
+    fixSeed(FIXED_SEED);
+    const auto seed = randomDouble();
+
+    // first trace is interrupted after a few batches, the second trace resumes. batches must arrive in order
+    const auto numBatchesFirstTrace = 3;
+    auto raysBatches                = std::vector<Rays>();
+    auto onBatch                    = [&](const int batchIndex, Rays&& rays) {
+        EXPECT_EQ(batchIndex, static_cast<int>(raysBatches.size()));
+        raysBatches.push_back(std::move(rays));
+    };
+
+    const auto first = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, std::nullopt,
+                                     TraceControl{.seed = seed, .onBatch = onBatch});
+    EXPECT_TRUE(first.empty());
+    raysBatches.resize(numBatchesFirstTrace);
+
+    tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, std::nullopt,
+                  TraceControl{.firstBatchIndex = numBatchesFirstTrace, .seed = seed, .onBatch = onBatch});
+
+    compare(Rays::concat(raysBatches), expected, RayAttrMask::All, 0.0);
+}
+
+TEST_F(TestSuite, traceWithRetraceCache) {
+    auto beamline           = loadBeamline(beamlineFilename);
+    const auto lastObjectId = static_cast<int>(beamline.numObjects()) - 1;
+    auto& lastElement       = static_cast<DesignElement&>(*beamline.findNodeByObjectId(lastObjectId));
+    auto& firstElement      = static_cast<DesignElement&>(*beamline.findNodeByObjectId(static_cast<int>(beamline.numSources())));
+
+    // the cache captures the rays leaving the second to last element
+    auto cache   = RetraceCache(static_cast<int>(beamline.numElements()) - 2);
+    auto control = TraceControl{.seed = 42.0, .retraceCache = &cache};
+    auto trace   = [&](const TraceControl& traceControl) {
+        return tracer->trace(beamline, Sequential::Yes, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt, traceControl);
+    };
+
+    const auto expected         = trace(TraceControl{.seed = control.seed});
+    const auto expectedErrors   = tracer->getDeviceErrors();
+    const auto expectedCounters = tracer->getTraceCounters();
+    compare(trace(control), expected, RayAttrMask::All, 0.0);
+    EXPECT_FALSE(cache.resumed());
+    compare(trace(control), expected, RayAttrMask::All, 0.0);
+    EXPECT_TRUE(cache.resumed());
+
+    // rays that finished before the element are reported again by the resumed trace
+    EXPECT_EQ(tracer->getDeviceErrors().numRaysPerCode, expectedErrors.numRaysPerCode);
+    if (expectedCounters) EXPECT_EQ(tracer->getTraceCounters()->raysPerFinalEventType, expectedCounters->raysPerFinalEventType);
+
+    // a change after the element retraces only the elements after it
+    lastElement.setPosition(lastElement.getPosition() + glm::dvec4(0, 0, 10, 0));
+    const auto expectedMoved = trace(TraceControl{.seed = control.seed});
+    compare(trace(control), expectedMoved, RayAttrMask::All, 0.0);
+    EXPECT_TRUE(cache.resumed());
+
+    // a change before the element invalidates the cache, so the whole beamline is traced again
+    firstElement.setPosition(firstElement.getPosition() + glm::dvec4(0, 0, 10, 0));
+    const auto expectedFirstMoved = trace(TraceControl{.seed = control.seed});
+    compare(trace(control), expectedFirstMoved, RayAttrMask::All, 0.0);
+    EXPECT_FALSE(cache.resumed());
+    compare(trace(control), expectedFirstMoved, RayAttrMask::All, 0.0);
+    EXPECT_TRUE(cache.resumed());
+
+    // a different seed generates different rays, so the whole beamline is traced again
+    control.seed = 43.0;
+    trace(control);
+    EXPECT_FALSE(cache.resumed());
+}
+
+TEST_F(TestSuite, traceWithEventFilter) {
+    const auto beamline = loadBeamline(beamlineFilename);
+
+    fixSeed(FIXED_SEED);
+    const auto seed       = randomDouble();
+    const auto unfiltered = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt,
+                                          TraceControl{.seed = seed});
+
+    auto energies = unfiltered.energy;
+    std::ranges::sort(energies);
+    const auto medianEnergy = energies[energies.size() / 2];
+    const auto lastObjectId = static_cast<int>(beamline.numSources() + beamline.numElements()) - 1;
+
+    auto eventFilter                = EventFilter{};
+    eventFilter.eventTypes          = EventTypeMask::HitElement | EventTypeMask::Absorbed;
+    eventFilter.minEnergy           = medianEnergy;
+    eventFilter.positionBoxObjectId = lastObjectId;
+    eventFilter.positionMax.x       = 0.0;
+
+    // filtering on the device yields the same events as filtering on the host, including path_event_id
+    const auto expected = unfiltered.filter([&](const int i) {
+        const auto eventType = unfiltered.event_type[i];
+        if (eventType != EventType::HitElement && eventType != EventType::Absorbed) return false;
+        if (unfiltered.energy[i] < medianEnergy) return false;
+        return unfiltered.object_id[i] != lastObjectId || unfiltered.position_x[i] <= 0.0;
+    });
+    ASSERT_FALSE(expected.empty());
+    ASSERT_LT(expected.size(), unfiltered.size());
+
+    const auto rays = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt,
+                                    TraceControl{.seed = seed, .eventFilter = eventFilter});
+    compare(rays, expected, RayAttrMask::All, 0.0);
+}
+
+TEST_F(TestSuite, traceWithRecordMode) {
+    const auto beamline = loadBeamline(beamlineFilename);
+
+    for (const auto sequential : {Sequential::No, Sequential::Yes}) {
+        fixSeed(FIXED_SEED);
+        const auto seed = randomDouble();
+        const auto all  = tracer->trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt,
+                                        TraceControl{.seed = seed});
+
+        const auto lastEvent = tracer->trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt,
+                                             TraceControl{.seed = seed, .recordMode = RecordMode::LastEvent});
+        EXPECT_EQ(lastEvent.size(), all.numPaths());
+        compare(lastEvent.sortByPathIdAndPathEventId(), all.filterByLastEventInPath().sortByPathIdAndPathEventId(), RayAttrMask::All, 0.0);
+
+        // the last event of each path on each object
+        auto lastPathEventIds = std::map<std::pair<int, int>, int>();
+        for (int i = 0; i < all.size(); ++i) {
+            auto& lastPathEventId = lastPathEventIds.try_emplace({all.path_id[i], all.object_id[i]}, all.path_event_id[i]).first->second;
+            lastPathEventId       = std::max(lastPathEventId, all.path_event_id[i]);
+        }
+        const auto expected =
+            all.filter([&](const int i) { return lastPathEventIds.at({all.path_id[i], all.object_id[i]}) == all.path_event_id[i]; });
+
+        const auto lastEventPerObject = tracer->trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt,
+                                                      std::nullopt, TraceControl{.seed = seed, .recordMode = RecordMode::LastEventPerObject});
+        compare(lastEventPerObject.sortByPathIdAndPathEventId(), expected.sortByPathIdAndPathEventId(), RayAttrMask::All, 0.0);
+    }
+}
+
+TEST_F(TestSuite, traceByPath) {
+    const auto beamline     = loadBeamline(beamlineFilename);
+    const auto maxBatchSize = 997;  // does not divide the number of rays, so the last batch is smaller
+
+    auto numRays = 0;
+    for (const auto* source : beamline.getSources()) numRays += static_cast<int>(source->getNumberOfRays());
+
+    for (const auto sequential : {Sequential::No, Sequential::Yes}) {
+        fixSeed(FIXED_SEED);
+        const auto seed    = randomDouble();
+        const auto control = TraceControl{.seed = seed};
+        const auto all = tracer->trace(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, std::nullopt, control);
+        const auto byPath =
+            tracer->traceByPath(beamline, sequential, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, std::nullopt, control);
+
+        // one path per generated ray, without the implicit attributes
+        ASSERT_TRUE(byPath.isValid());
+        EXPECT_EQ(byPath.firstPathId, 0);
+        EXPECT_EQ(byPath.numPaths(), numRays);
+        EXPECT_EQ(byPath.numEvents(), all.size());
+        EXPECT_FALSE(byPath.rays.contains(RayAttrMask::PathId));
+
+        // all events are recorded, so the index of an event within its path is its path_event_id
+        const auto expected = all.sortByPathIdAndPathEventId();
+        compare(byPath.toRays(), expected, RayAttrMask::All, 0.0);
+        compare(RaysByPath::fromRays(all).toRays(), expected, RayAttrMask::All, 0.0);
+    }
+}
+
+TEST_F(TestSuite, traceProgressAndCancellation) {
+    const auto beamline     = loadBeamline(beamlineFilename);
+    const auto maxBatchSize = 997;
+    const auto seed         = randomDouble();
+
+    auto numRays = 0;
+    for (const auto* source : beamline.getSources()) numRays += static_cast<int>(source->getNumberOfRays());
+
+    // progress is reported once per batch
+    auto expectedBatches = std::vector<Rays>();
+    auto progressList    = std::vector<TraceProgress>();
+    tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, std::nullopt,
+                  TraceControl{
+                      .seed       = seed,
+                      .onBatch    = [&](const int, Rays&& rays) { expectedBatches.push_back(std::move(rays)); },
+                      .onProgress = [&](const TraceProgress& progress) { progressList.push_back(progress); },
+                  });
+
+    ASSERT_EQ(progressList.size(), expectedBatches.size());
+    for (size_t i = 0; i < progressList.size(); ++i) EXPECT_EQ(progressList[i].batchesDone, static_cast<int>(i + 1));
+    EXPECT_EQ(progressList.back().batchesTotal, static_cast<int>(expectedBatches.size()));
+    EXPECT_EQ(progressList.back().raysTraced, numRays);
+    EXPECT_EQ(progressList.back().eventsRecorded, Rays::concat(expectedBatches).size());
+    EXPECT_EQ(progressList.back().estimatedRemainingSeconds, 0.0);
+
+    // cancel after the second batch. the result contains the batches traced so far
+    const auto numBatchesBeforeCancel = 2;
+    ASSERT_LT(numBatchesBeforeCancel, static_cast<int>(expectedBatches.size()));
+
+    auto cancellationToken        = CancellationToken();
+    const auto cancelAfterBatches = [&](const TraceProgress& progress) {
+        if (progress.batchesDone == numBatchesBeforeCancel) cancellationToken.cancel();
+    };
+
+    const auto rays = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, maxBatchSize, std::nullopt,
+                                    TraceControl{.seed = seed, .onProgress = cancelAfterBatches, .cancellationToken = &cancellationToken});
+
+    EXPECT_TRUE(cancellationToken.isCancelled());
+    expectedBatches.resize(numBatchesBeforeCancel);
+    compare(rays, Rays::concat(expectedBatches), RayAttrMask::All, 0.0);
+}
+
+TEST_F(TestSuite, profilerNestedScopes) {
+    const auto benchFlag = BENCH_FLAG;
+    BENCH_FLAG           = true;
+    Profiler::get().clear();
+
+    const auto inner = [] { RAYX_PROFILE_SCOPE("inner"); };
+    {
+        RAYX_PROFILE_SCOPE("outer");
+        inner();
+        inner();
+    }
+    inner();
+
+    const auto stats = Profiler::get().summary();
+    BENCH_FLAG       = benchFlag;
+    Profiler::get().clear();
+
+    ASSERT_EQ(stats.size(), 3);
+    EXPECT_EQ(stats[0].path, "outer");
+    EXPECT_EQ(stats[0].count, 1);
+    EXPECT_EQ(stats[1].path, "outer/inner");
+    EXPECT_EQ(stats[1].depth, 1);
+    EXPECT_EQ(stats[1].count, 2);
+    EXPECT_LE(stats[1].minSeconds, stats[1].meanSeconds);
+    EXPECT_LE(stats[1].meanSeconds, stats[1].maxSeconds);
+    EXPECT_LE(stats[1].totalSeconds, stats[0].totalSeconds);
+    EXPECT_EQ(stats[2].path, "inner");
+    EXPECT_EQ(stats[2].count, 1);
+}
+
+TEST_F(TestSuite, traceCounters) {
+    const auto beamline = loadBeamline(beamlineFilename);
+    const auto rays     = tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::ObjectId | RayAttrMask::EventType);
+
+    const auto& counters = tracer->getTraceCounters();
+    if (!counters) GTEST_SKIP() << "rayx-core was built without RAYX_TRACE_COUNTERS";
+
+    auto numRays = 0;
+    for (const auto* source : beamline.getSources()) numRays += static_cast<int>(source->getNumberOfRays());
+
+    // every ray ends with exactly one event type
+    EXPECT_EQ(counters->numRays, numRays);
+    EXPECT_EQ(std::accumulate(counters->raysPerFinalEventType.begin(), counters->raysPerFinalEventType.end(), int64_t(0)), numRays);
+
+    // all objects are recorded, so every hit on an element is an event
+    const auto numSources = static_cast<int>(beamline.numSources());
+    const auto numHits    = std::ranges::count_if(rays.object_id, [&](const int objectId) { return objectId >= numSources; });
+    ASSERT_EQ(counters->hitsPerElement.size(), beamline.numElements());
+    EXPECT_EQ(std::accumulate(counters->hitsPerElement.begin(), counters->hitsPerElement.end(), int64_t(0)), numHits);
+    EXPECT_GE(counters->elementsTested, numHits);
+}
+
+TEST_F(TestSuite, deviceErrors) {
+    const auto beamline = loadBeamline(beamlineFilename);
+
+    // a regular trace reports no errors
+    tracer->trace(beamline, Sequential::No);
+    EXPECT_TRUE(tracer->getDeviceErrors().empty());
+
+    // with one event per ray, rays hitting more than one element exceed the max events
+    tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, 1);
+    const auto& errors = tracer->getDeviceErrors();
+    EXPECT_GT(errors.numRays(DeviceErrorCode::TooManyEvents), 0);
+    EXPECT_EQ(errors.numRays(DeviceErrorCode::FatalError), 0);
+    EXPECT_EQ(errors.numRays(DeviceErrorCode::InvalidObjectId), 0);
+    EXPECT_EQ(errors.numRays(DeviceErrorCode::Uninitialized), 0);
+    ASSERT_FALSE(errors.records.empty());
+    for (const auto& error : errors.records) {
+        EXPECT_EQ(error.code, DeviceErrorCode::TooManyEvents);
+        EXPECT_GE(error.rayIndex, 0);
+    }
+
+    // the records of many batches are merged, but kept at most DEVICE_ERROR_RECORDS_PER_CODE per error code
+    const auto numTooManyEvents = errors.numRays(DeviceErrorCode::TooManyEvents);
+    const auto maxBatchSize     = 97;
+    tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, 1, maxBatchSize);
+    const auto& batchedErrors = tracer->getDeviceErrors();
+    EXPECT_EQ(batchedErrors.numRays(DeviceErrorCode::TooManyEvents), numTooManyEvents);
+    EXPECT_EQ(std::ssize(batchedErrors.records), std::min<int64_t>(numTooManyEvents, DEVICE_ERROR_RECORDS_PER_CODE));
+}
+
+TEST_F(TestSuite, memoryStats) {
+    const auto beamline = loadBeamline(beamlineFilename);
+    auto memoryTracer   = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+
+    const auto rays  = memoryTracer.trace(beamline, Sequential::No);
+    const auto stats = memoryTracer.getMemoryStats();
+
+    // device buffers are retained for the next trace, host buffers are released at the end of the trace
+    EXPECT_GT(stats[MemoryCategory::Events].currentBytes, 0);
+    EXPECT_GT(stats[MemoryCategory::Sources].currentBytes, 0);
+    EXPECT_GT(stats[MemoryCategory::HostRays].peakBytes, 0);
+    EXPECT_EQ(stats[MemoryCategory::HostRays].currentBytes, 0);
+    EXPECT_EQ(stats[MemoryCategory::HostEventBatches].currentBytes, 0);
+    EXPECT_EQ(stats[MemoryCategory::HostCompactionFlags].currentBytes, 0);
+    EXPECT_GE(stats.total.peakBytes, stats.total.currentBytes);
+
+    auto sum = int64_t{0};
+    for (const auto& usage : stats.categories) sum += usage.currentBytes;
+    EXPECT_EQ(stats.total.currentBytes, sum);
+
+    // releasing all buffers after the trace leaves no memory behind, and the next trace allocates them again
+    memoryTracer.setMemoryTrimPolicy(MemoryTrimPolicy{.maxRetainedBufferBytes = 0});
+    fixSeed(FIXED_SEED);
+    const auto trimmedRays  = memoryTracer.trace(beamline, Sequential::No);
+    const auto trimmedStats = memoryTracer.getMemoryStats();
+    EXPECT_EQ(trimmedStats.total.currentBytes, 0);
+    EXPECT_GT(trimmedStats.total.peakBytes, 0);
+
+    fixSeed(FIXED_SEED);
+    const auto retracedRays = memoryTracer.trace(beamline, Sequential::No);
+    compare(retracedRays, trimmedRays, RayAttrMask::All, 0.0);
+
+    // events kept on the device are compacted into the device rays directly, without a compaction buffer
+    const auto deviceRays  = memoryTracer.traceToDevice(beamline, Sequential::No);
+    const auto deviceStats = memoryTracer.getMemoryStats();
+    EXPECT_GT(deviceStats[MemoryCategory::DeviceRays].currentBytes, 0);
+    EXPECT_EQ(deviceStats[MemoryCategory::CompactEvents].peakBytes, 0);
+}
+
+TEST_F(TestSuite, workDivTuning) {
+    const auto beamline      = loadBeamline(beamlineFilename);
+    const auto cacheFilepath = getBeamlineFilepath(beamlineFilename).replace_extension("workdiv-cache.txt");
+    std::filesystem::remove(cacheFilepath);
+
+    auto defaultTracer = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+    defaultTracer.setWorkDivTuningPolicy(WorkDivTuningPolicy{.enable = false});
+    auto tunedTracer = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+    tunedTracer.setWorkDivTuningPolicy(WorkDivTuningPolicy{.cacheFilepath = cacheFilepath, .minTuningElements = 1});
+
+    // the work division does not change the result, also when it is tuned during the trace
+    for (const auto sequential : {Sequential::No, Sequential::Yes}) {
+        fixSeed(FIXED_SEED);
+        const auto defaultRays = defaultTracer.trace(beamline, sequential);
+        fixSeed(FIXED_SEED);
+        const auto tunedRays = tunedTracer.trace(beamline, sequential);
+        compare(tunedRays, defaultRays, RayAttrMask::All, 0.0);
+    }
+
+    // the tuned work divisions are cached and reused by other tracers
+    ASSERT_TRUE(std::filesystem::exists(cacheFilepath));
+    auto cachedTracer = Tracer(DeviceConfig(DeviceConfig::DeviceType::Cpu).enableBestDevice());
+    cachedTracer.setWorkDivTuningPolicy(WorkDivTuningPolicy{.cacheFilepath = cacheFilepath});
+    fixSeed(FIXED_SEED);
+    const auto defaultRays = defaultTracer.trace(beamline, Sequential::No);
+    fixSeed(FIXED_SEED);
+    const auto cachedRays = cachedTracer.trace(beamline, Sequential::No);
+    compare(cachedRays, defaultRays, RayAttrMask::All, 0.0);
+}
+
 #ifndef NO_H5
 TEST_F(TestSuite, testH5) {
     const auto [beamline, raysOriginal] = loadBeamlineAndTrace(beamlineFilename);
@@ -166,6 +660,23 @@ TEST_F(TestSuite, testH5) {
         CHECK_EQ(rays, partialRaysOriginal);
     }
 }
+
+TEST_F(TestSuite, testH5ByPath) {
+    const auto [beamline, raysOriginal] = loadBeamlineAndTrace(beamlineFilename);
+    const auto h5Filepath               = getBeamlineFilepath(beamlineFilename).replace_extension("testH5ByPath.h5");
+    const auto raysByPathOriginal       = RaysByPath::fromRays(raysOriginal);
+
+    writeH5ByPath(h5Filepath, beamline.getObjectNames(), raysByPathOriginal);
+    EXPECT_FALSE(contains(readH5RayAttrMask(h5Filepath), RayAttrMask::PathId));
+
+    const auto raysByPath = readH5RaysByPath(h5Filepath);
+    EXPECT_EQ(raysByPath.firstPathId, raysByPathOriginal.firstPathId);
+    EXPECT_EQ(raysByPath.pathOffsets, raysByPathOriginal.pathOffsets);
+    CHECK_EQ(raysByPath.rays, raysByPathOriginal.rays);
+
+    // readH5Rays materializes path_id and path_event_id
+    CHECK_EQ(readH5Rays(h5Filepath), raysByPathOriginal.toRays());
+}
 #endif
 
 TEST_F(TestSuite, testCsv) {
@@ -187,6 +698,72 @@ TEST_F(TestSuite, testCsv) {
         const auto rays = readCsv(csvFilepath);
         CHECK_EQ(rays, partialRaysOriginal);
     }
+
+    // path ids beyond the range of int
+    {
+        auto largeRaysOriginal = std::move(raysOriginal.copy().filterByAttrMask(RayAttrMask::PathId | RayAttrMask::ObjectId));
+        for (auto& pathId : largeRaysOriginal.path_id) pathId += int64_t{1} << 40;
+        writeCsv(csvFilepath, largeRaysOriginal);
+        const auto rays = readCsv(csvFilepath);
+        CHECK_EQ(rays, largeRaysOriginal);
+    }
+}
+
+TEST_F(TestSuite, raysView) {
+    const auto rays       = traceRml(beamlineFilename);
+    const auto objectId   = rays.object_id.back();
+    const auto meanEnergy = std::accumulate(rays.energy.begin(), rays.energy.end(), 0.0) / static_cast<double>(rays.size());
+    const auto highEnergy = [&](const int64_t i) { return rays.energy[i] > meanEnergy; };
+    const auto attrMask   = RayAttrMask::Position | RayAttrMask::PathId | RayAttrMask::Energy;
+
+    // a chain on a view yields the same as materializing every step
+    auto expected = rays.filter(highEnergy).filterByObjectId(objectId).sortByPathIdAndPathEventId();
+    expected.filterByAttrMask(attrMask);
+    auto view = RaysView(rays).filter(highEnergy).filterByObjectId(objectId).sortByPathIdAndPathEventId().project(attrMask);
+    EXPECT_EQ(view.attrMask(), attrMask);
+    ASSERT_EQ(view.size(), expected.size());
+    CHECK_EQ(view.materialize(), expected);
+
+    // the events can be read from the view without materializing
+    for (int64_t i = 0; i < view.size(); ++i) {
+        EXPECT_EQ(view.path_id(i), expected.path_id[i]);
+        EXPECT_EQ(view.attr<RayAttrMask::Energy>(i), expected.energy[i]);
+        EXPECT_EQ(view.position(i), expected.position(static_cast<int>(i)));
+    }
+    EXPECT_EQ(view.count(highEnergy), view.size());
+
+    // the last events of the paths do not depend on the order of the events
+    const auto lastEvents = RaysView(rays).sortByObjectId().filterByLastEventInPath().sortByPathIdAndPathEventId().materialize();
+    CHECK_EQ(lastEvents, rays.filterByLastEventInPath().sortByPathIdAndPathEventId());
+
+    // a view without filter or sort materializes a copy
+    CHECK_EQ(RaysView(rays).materialize(), rays);
+}
+
+TEST_F(TestSuite, raysSort) {
+    // enough events to sort and gather in several threads
+    const auto numEvents = int64_t{1} << 18;
+    auto rays            = Rays();
+    rays.path_id.resize(numEvents);
+    rays.path_event_id.resize(numEvents);
+    rays.object_id.resize(numEvents);
+    RandCounter ctr = FIXED_SEED;
+    for (int64_t i = 0; i < numEvents; ++i) {
+        rays.path_id[i]       = (int64_t{1} << 40) + static_cast<int64_t>(squaresDoubleRNG(ctr) * numEvents);
+        rays.path_event_id[i] = static_cast<int32_t>(squaresDoubleRNG(ctr) * 16);
+        rays.object_id[i]     = static_cast<int32_t>(squaresDoubleRNG(ctr) * 100) - 1;
+    }
+
+    // the radix sort is stable, so events with the same object_id keep their order
+    const auto byObjectId = rays.sort([&](const int64_t lhs, const int64_t rhs) {
+        return std::pair(rays.object_id[lhs], lhs) < std::pair(rays.object_id[rhs], rhs);
+    });
+    CHECK_EQ(rays.sortByObjectId(), byObjectId);
+
+    const auto byPath = rays.sort([&](const int64_t lhs, const int64_t rhs) {
+        return std::tuple(rays.path_id[lhs], rays.path_event_id[lhs], lhs) < std::tuple(rays.path_id[rhs], rays.path_event_id[rhs], rhs);
+    });
+    CHECK_EQ(rays.sortByPathIdAndPathEventId(), byPath);
 }
 
 TEST_F(TestSuite, testBeamlineBijectionBetweenObjectAndObjectId) {
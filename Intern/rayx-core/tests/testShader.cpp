@@ -3,6 +3,8 @@
 
 #include "Shader/ApplySlopeError.h"
 #include "Shader/Approx.h"
+#include "Shader/Collision.h"
+#include "Shader/CollisionPacket.h"
 #include "Shader/Crystal.h"
 #include "Shader/LineDensity.h"
 #include "Shader/Rand.h"
@@ -1496,3 +1498,165 @@ TEST_F(TestSuite, testComputeEta) {
         CHECK_EQ(eta.imag(), tc.expected.imag());
     }
 }
+
+TEST_F(TestSuite, testCollisionPacket) {
+    // sphere with radius 100, touching the origin
+    const auto quadric = Surface::Quadric{
+        .m_icurv = 1,
+        .m_a11   = 1,
+        .m_a12   = 0,
+        .m_a13   = 0,
+        .m_a14   = 0,
+        .m_a22   = 1,
+        .m_a23   = 0,
+        .m_a24   = -100,
+        .m_a33   = 1,
+        .m_a34   = 0,
+        .m_a44   = 0,
+    };
+
+    const auto surfaces = std::vector<Surface>{Surface::Plane{}, quadric};
+    const auto cutouts  = std::vector<Cutout>{
+        Cutout::Unlimited{},
+        Cutout::Rect{.m_width = 20, .m_length = 40},
+        Cutout::Elliptical{.m_diameter_x = 30, .m_diameter_z = 20},
+        Cutout::Trapezoid{.m_widthA = 10, .m_widthB = 30, .m_length = 20},
+    };
+
+    constexpr int N = RAY_PACKET_SIZE;
+    RandCounter ctr = 42;
+
+    for (const auto& surface : surfaces) {
+        for (const auto& cutout : cutouts) {
+            for (int i = 0; i < 100; ++i) {
+                RayPacket<N> rays;
+                for (int lane = 0; lane < N; ++lane) {
+                    const auto position  = glm::dvec3(squaresDoubleRNG(ctr) * 40 - 20, squaresDoubleRNG(ctr) * 10 - 5, squaresDoubleRNG(ctr) * 40 - 20);
+                    const auto direction = glm::normalize(
+                        glm::dvec3(squaresDoubleRNG(ctr) * 2 - 1, squaresDoubleRNG(ctr) * 2 - 1, squaresDoubleRNG(ctr) * 2 - 1));
+                    rays.set(lane, position, direction);
+                }
+
+                CollisionPacket<N> col;
+                findCollisionInElementCoordsWithoutSlopeErrorPacket(rays, surface, cutout, col);
+
+                for (int lane = 0; lane < N; ++lane) {
+                    const auto expected = findCollisionInElementCoordsWithoutSlopeError(rays.position(lane), rays.direction(lane), surface, cutout, false);
+
+                    CHECK(col.found[lane] == expected.has_value())
+                    if (!expected) continue;
+
+                    CHECK_EQ(col.hitpoint(lane), expected->hitpoint)
+                    CHECK_EQ(col.normal(lane), expected->normal)
+                }
+            }
+        }
+    }
+}
+
+TEST_F(TestSuite, testElementTypeMask) {
+    CHECK(getElementTypeMask(Surface::Plane{}, Behaviour::Mirror{}) == (ElementTypeMask::SurfacePlane | ElementTypeMask::BehaviourMirror));
+    CHECK(getElementTypeMask(Surface::Toroid{}, Behaviour::ImagePlane{}) ==
+          (ElementTypeMask::SurfaceToroid | ElementTypeMask::BehaviourImagePlane));
+    CHECK(contains(TRACE_ELEMENT_TYPE_MASKS[0], getElementTypeMask(Surface::Quadric{}, Behaviour::Grating{})));
+    CHECK(!contains(TRACE_ELEMENT_TYPE_MASKS[0], getElementTypeMask(Surface::Cubic{}, Behaviour::Mirror{})));
+    CHECK(!contains(TRACE_ELEMENT_TYPE_MASKS[0], getElementTypeMask(Surface::Plane{}, Behaviour::Crystal{})));
+
+    // a filtered visit only dispatches to the types passing the filter
+    using Filter         = ElementTypeFilter<ElementTypeMask::SurfacePlane | ElementTypeMask::SurfaceToroid>;
+    const auto visitType = []<typename T>(const T&) { return elementTypeFlag<T>(); };
+
+    const Surface plane  = Surface::Plane{};
+    const Surface toroid = Surface::Toroid{};
+    CHECK(plane.visitFiltered<Filter::template Filter>(visitType) == ElementTypeMask::SurfacePlane);
+    CHECK(toroid.visitFiltered<Filter::template Filter>(visitType) == ElementTypeMask::SurfaceToroid);
+}
+
+TEST_F(TestSuite, testToroidCollisionHalley) {
+    const auto toroid = Surface::Toroid{
+        .m_longRadius  = 10470.4917,
+        .m_shortRadius = 315.723959,
+        .m_toroidType  = ToroidType::Concave,
+    };
+
+    // height of the toroid above the XZ plane, on the side of the vertex
+    const auto toroidHeight = [&](const double x, const double z) {
+        const double rx = toroid.m_longRadius - toroid.m_shortRadius + glm::sqrt(toroid.m_shortRadius * toroid.m_shortRadius - x * x);
+        return toroid.m_longRadius - glm::sqrt(rx * rx - z * z);
+    };
+
+    RandCounter ctr           = 42;
+    int numIterationsNewton   = 0;
+    int numIterationsHalley   = 0;
+    int totalIterationsNewton = 0;
+    int totalIterationsHalley = 0;
+
+    for (int i = 0; i < 100; ++i) {
+        // grazing incidence onto the vertex region of the toroid
+        const double x       = squaresDoubleRNG(ctr) * 20 - 10;
+        const double z       = squaresDoubleRNG(ctr) * 200 - 100;
+        const auto target    = glm::dvec3(x, toroidHeight(x, z), z);
+        const double angle   = glm::radians(2 + squaresDoubleRNG(ctr) * 2);
+        const auto direction = glm::normalize(glm::dvec3(squaresDoubleRNG(ctr) * 0.002 - 0.001, -glm::sin(angle), glm::cos(angle)));
+        const auto position  = target - direction * 100.0;
+
+        const auto newton = getToroidCollisionNewton(position, direction, toroid, false, numIterationsNewton);
+        const auto halley = getToroidCollisionHalley(position, direction, toroid, false, numIterationsHalley);
+        CHECK(newton);
+        CHECK(halley);
+        totalIterationsNewton += numIterationsNewton;
+        totalIterationsHalley += numIterationsHalley;
+
+        // the newton method stops at a tolerance of 1e-4
+        CHECK_EQ(halley->hitpoint, newton->hitpoint, 1e-3);
+        CHECK_EQ(halley->normal, newton->normal, 1e-6);
+
+        // the hitpoint of halley's method lies on the toroid
+        CHECK_EQ(halley->hitpoint, target, 1e-9);
+    }
+
+    CHECK(totalIterationsHalley < totalIterationsNewton);
+}
+
+TEST_F(TestSuite, testCollisionMixedPrecision) {
+    for (const auto* filename : {"PlaneMirror", "SphereMirrorDefault", "Ellipsoid", "CylinderDefault", "Cone", "PlaneGratingDeviationDefault",
+                                 "ToroidGrating", "paraboloid_matrix_IP", "allBeamlineObjects"}) {
+        const auto beamline              = loadBeamline(filename);
+        const auto elementsAndTransforms = beamline.compileElements();
+        const auto numElements           = static_cast<int>(elementsAndTransforms.size());
+
+        auto elements         = std::vector<OpticalElement>();
+        auto objectTransforms = std::vector<ObjectTransform>();
+        for (const auto& e : elementsAndTransforms) {
+            elements.push_back(e.element);
+            objectTransforms.push_back(e.transform);
+        }
+
+        RandCounter ctr = 42;
+        for (int i = 0; i < 1000; ++i) {
+            // rays from random directions, aimed at a random point near the center of an element
+            const auto& transform  = objectTransforms[i % numElements];
+            const auto localTarget = glm::dvec4(squaresDoubleRNG(ctr) * 20 - 10, 0, squaresDoubleRNG(ctr) * 20 - 10, 1);
+            const auto target      = glm::dvec3(transform.m_outTrans * localTarget);
+            const auto direction   = glm::normalize(glm::dvec3(squaresDoubleRNG(ctr), squaresDoubleRNG(ctr), squaresDoubleRNG(ctr)) - 0.5);
+            const auto position    = target - direction * 100.0;
+
+            auto randDouble     = Rand(RandCounter{13});
+            auto randMixed      = Rand(RandCounter{13});
+            const auto expected = findCollisionWithElements<ElementTypeMask::All>(position, direction, elements.data(), objectTransforms.data(), 0,
+                                                                                  numElements, randDouble);
+            const auto actual   = findCollisionWithElementsMixedPrecision<ElementTypeMask::All>(position, direction, elements.data(),
+                                                                                                objectTransforms.data(), 0, numElements, randMixed);
+
+            CHECK(expected.has_value() == actual.has_value());
+            if (!expected) continue;
+
+            EXPECT_EQ(actual->elementIndex, expected->elementIndex);
+            CHECK_EQ(actual->point.hitpoint, expected->point.hitpoint, 1e-8);
+
+            // the random numbers of the slope error may differ
+            const auto& slopeError = elements[expected->elementIndex].m_slopeError;
+            if (slopeError.m_sag == 0 && slopeError.m_mer == 0) CHECK_EQ(actual->point.normal, expected->point.normal, 1e-10);
+        }
+    }
+}
@@ -276,3 +276,33 @@ TEST_F(TestSuite, testRayListSource) {
     auto allAttrExceptPathEventId = exclude(RayAttrMask::All, RayAttrMask::PathEventId);
     compare(rays.filterByObjectId(0), inputRays, allAttrExceptPathEventId, DEFAULT_TOLERANCE);
 }
+
+TEST_F(TestSuite, testDeviceRayListSource) {
+    // the same seed generates the same rays on the host and on the device
+    auto control = TraceControl{};
+    control.seed = 42.0;
+
+    auto matrixSourceBeamline = loadBeamline("MatrixSource");
+    auto expectedNumRayPaths  = matrixSourceBeamline.numRayPaths();
+    auto inputRays            = tracer->trace(matrixSourceBeamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt,
+                                              std::nullopt, control);
+    auto deviceRays = tracer->traceToDevice(matrixSourceBeamline, Sequential::No, ObjectMask::all(), std::nullopt, std::nullopt, control);
+    EXPECT_EQ(deviceRays.size(), expectedNumRayPaths);
+    compare(deviceRays.toHost(), inputRays, RayAttrMask::All, 0.0);
+
+    // chain the beamlines through the host and through the device
+    const auto traceChained = [&](auto setRayList) {
+        auto rayListSource = std::make_unique<DesignSource>("testRayListSource");
+        rayListSource->setType(ElementType::RayListSource);
+        setRayList(*rayListSource);
+        rayListSource->setNumberOfRays(expectedNumRayPaths);
+        auto beamline = loadBeamline("NoSource");
+        beamline.addChild(std::move(rayListSource));
+        return tracer->trace(beamline, Sequential::No, ObjectMask::all(), RayAttrMask::All, std::nullopt, std::nullopt, std::nullopt, control);
+    };
+    auto expected = traceChained([&](DesignSource& source) { source.setRayList(inputRays.copy()); });
+    auto rays     = traceChained([&](DesignSource& source) { source.setDeviceRayList(deviceRays); });
+
+    EXPECT_EQ(rays.filterByObjectId(2).size(), expectedNumRayPaths);
+    compare(rays, expected, RayAttrMask::All, 0.0);
+}
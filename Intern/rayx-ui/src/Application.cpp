@@ -38,7 +38,10 @@ Application::Application(uint32_t width, uint32_t height, const char* name, int
     init();
 }
 
-Application::~Application() = default;
+Application::~Application() {
+    // do not wait for a running simulation to finish
+    m_Simulator.cancelSimulation();
+}
 
 void Application::init() {
     RAYX_PROFILE_FUNCTION_STDOUT();
@@ -148,16 +151,26 @@ void Application::run() {
                 break;
 
             case State::InitializeSimulation:
-                m_simulationFuture       = std::async(std::launch::async, std::bind(&Simulator::runSimulation, &m_Simulator));
-                m_State                  = State::Simulating;
-                m_UIParams.runSimulation = false;
+                m_simulationFuture         = std::async(std::launch::async, std::bind(&Simulator::runSimulation, &m_Simulator));
+                m_State                    = State::Simulating;
+                m_UIParams.runSimulation   = false;
+                m_UIParams.simulationState = {.running = true, .progress = std::nullopt, .cancelRequested = false};
                 break;
 
             case State::Simulating:
+                m_UIParams.simulationState.progress = m_Simulator.getProgress();
+                if (m_UIParams.simulationState.cancelRequested) m_Simulator.cancelSimulation();
+
                 if (m_simulationFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-                    m_raysFuture =
-                        std::async(std::launch::async, &Application::loadRays, this, m_RMLPath, m_Beamline->numSources(), m_Beamline->numElements());
-                    m_State = State::LoadingRays;
+                    m_UIParams.simulationState = {};
+                    if (m_simulationFuture.get()) {
+                        m_raysFuture = std::async(std::launch::async, &Application::loadRays, this, m_RMLPath, m_Beamline->numSources(),
+                                                  m_Beamline->numElements());
+                        m_State      = State::LoadingRays;
+                    } else {
+                        // cancelled. keep the current scene
+                        m_State = State::Running;
+                    }
                 }
                 break;
             case State::LoadingRays:
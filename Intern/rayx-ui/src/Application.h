@@ -101,7 +101,7 @@ class Application {
     std::future<void> m_buildRayCacheFuture;
     std::future<std::vector<Scene::RenderObjectInput>> m_getRObjInputsFuture;
     // TODO: Should be in Simulator
-    std::future<void> m_simulationFuture;
+    std::future<bool> m_simulationFuture;
 
     void init();
 
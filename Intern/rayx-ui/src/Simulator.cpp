@@ -7,16 +7,30 @@
 // constructor
 Simulator::Simulator() { m_seq = rayx::Sequential::No; }
 
-void Simulator::runSimulation() {
+bool Simulator::runSimulation() {
     if (!m_readyForSimulation) {
         RAYX_EXIT << "Simulator is not ready for simulation!";
-        return;
+        return false;
     }
     // Run rayx core
     if (!m_maxEvents) { m_maxEvents = rayx::defaultMaxEvents(m_Beamline.numObjects()); }
 
-    const auto rays       = m_Tracer->trace(m_Beamline, m_seq, rayx::ObjectMask::allElements(), rayx::RayAttrMask::All, static_cast<int>(m_maxEvents),
-                                            static_cast<int>(m_max_batch_size));
+    const auto control = rayx::TraceControl{
+        .onProgress =
+            [this](const rayx::TraceProgress& progress) {
+                const auto lock = std::lock_guard(m_progressMutex);
+                m_progress      = progress;
+            },
+        .cancellationToken = &m_cancellationToken,
+    };
+
+    const auto rays = m_Tracer->trace(m_Beamline, m_seq, rayx::ObjectMask::allElements(), rayx::RayAttrMask::All, static_cast<int>(m_maxEvents),
+                                      static_cast<int>(m_max_batch_size), std::nullopt, control);
+    if (m_cancellationToken.isCancelled()) {
+        RAYX_LOG << "Simulation cancelled.";
+        return false;
+    }
+
     const auto bundleHist = convertRaysToBundleHistory(rays.copy(), m_Beamline.numSources());
 
     bool notEnoughEvents = false;
@@ -43,6 +57,14 @@ void Simulator::runSimulation() {
 #else
     rayx::writeCsv(path, rays);
 #endif
+    return true;
+}
+
+void Simulator::cancelSimulation() { m_cancellationToken.cancel(); }
+
+std::optional<rayx::TraceProgress> Simulator::getProgress() const {
+    const auto lock = std::lock_guard(m_progressMutex);
+    return m_progress;
 }
 
 void Simulator::setSimulationParameters(const std::filesystem::path& RMLPath, const rayx::Beamline& beamline,
@@ -67,6 +89,10 @@ void Simulator::setSimulationParameters(const std::filesystem::path& RMLPath, co
         rayx::randomSeed();
     }
     m_readyForSimulation = true;
+
+    m_cancellationToken.reset();
+    const auto lock = std::lock_guard(m_progressMutex);
+    m_progress      = std::nullopt;
 }
 
 std::vector<std::string> Simulator::getAvailableDevices() {
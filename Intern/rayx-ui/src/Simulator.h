@@ -1,5 +1,8 @@
 #pragma once
 
+#include <mutex>
+#include <optional>
+
 #include "Beamline/Beamline.h"
 #include "BundleHistory.h"
 #include "Tracer/Tracer.h"
@@ -8,7 +11,13 @@
 class Simulator {
   public:
     Simulator();
-    void runSimulation();
+    /// traces the beamline and writes the rays next to the RML file. returns false if the simulation was cancelled, in which case nothing is
+    /// written
+    bool runSimulation();
+    /// requests the running simulation to stop after the batches currently being traced. thread-safe
+    void cancelSimulation();
+    /// progress of the running simulation, or std::nullopt if no batch has been traced yet. thread-safe
+    std::optional<rayx::TraceProgress> getProgress() const;
     void setSimulationParameters(const std::filesystem::path& RMLPath, const rayx::Beamline& beamline, const UISimulationInfo& simulationInfo);
     std::vector<std::string> getAvailableDevices();
 
@@ -23,6 +32,11 @@ class Simulator {
     rayx::DeviceConfig m_deviceConfig;  ///< List of available devices. Selection of device for tracing
     bool m_readyForSimulation = false;
 
+    // during Simulation
+    rayx::CancellationToken m_cancellationToken;
+    mutable std::mutex m_progressMutex;
+    std::optional<rayx::TraceProgress> m_progress;
+
     // after Simulation
     BundleHistory m_rays;  ///< Ray cache
 };
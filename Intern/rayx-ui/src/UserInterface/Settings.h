@@ -11,6 +11,7 @@
 #include "Debug/Debug.h"
 #include "Design/DesignElement.h"
 #include "Design/DesignSource.h"
+#include "Tracer/Tracer.h"
 
 // TODO: Divide this into passed and returned parameters
 
@@ -47,6 +48,15 @@ struct UISimulationInfo {
           seed(seed) {}
 };
 
+/**
+ * State of a running simulation, shown in the UI
+ */
+struct UISimulationState {
+    bool running = false;
+    std::optional<rayx::TraceProgress> progress;
+    bool cancelRequested = false;
+};
+
 enum class SelectedType { None = -1, LightSource = 0, OpticalElement = 1, Group = 2 };
 
 struct UIBeamlineInfo {
@@ -69,6 +79,7 @@ struct UIParameters {
     bool runSimulation;
     bool simulationSettingsReady;
     UISimulationInfo simulationInfo;
+    UISimulationState simulationState;
     UIBeamlineInfo beamlineInfo;
 
     UIParameters(CameraController& camController, const std::vector<std::string>& availableDevices)
@@ -89,6 +100,7 @@ struct UIParameters {
               availableDevices,
               0,
           }),
+          simulationState(),
           beamlineInfo() {}
 
     void updatePath(const std::filesystem::path& path) {
@@ -340,7 +340,7 @@ void UIHandler::showSceneEditorWindow(UIParameters& uiParams) {
             // TODO: Popup
         }
     }
-    if (uiParams.rmlPath != "") {
+    if (uiParams.rmlPath != "" && !uiParams.simulationState.running) {
         ImGui::SameLine();
         if (ImGui::Button("Trace current file")) {
             uiParams.showH5NotExistPopup = false;
@@ -354,6 +354,23 @@ void UIHandler::showSceneEditorWindow(UIParameters& uiParams) {
         ImGui::EndDisabled();
     }
 
+    if (uiParams.simulationState.running) {
+        const auto& progress = uiParams.simulationState.progress;
+        if (progress) {
+            ImGui::ProgressBar(static_cast<float>(progress->batchesDone) / static_cast<float>(std::max(progress->batchesTotal, 1)));
+            ImGui::Text("Batch %d/%d, %lld rays, %lld events, %.0f s remaining", progress->batchesDone, progress->batchesTotal,
+                        static_cast<long long>(progress->raysTraced), static_cast<long long>(progress->eventsRecorded),
+                        progress->estimatedRemainingSeconds);
+        } else {
+            ImGui::ProgressBar(0.0f, ImVec2(-FLT_MIN, 0), "Starting simulation...");
+        }
+
+        // the simulation stops after the batches currently being traced
+        ImGui::BeginDisabled(uiParams.simulationState.cancelRequested);
+        if (ImGui::Button("Cancel Simulation")) uiParams.simulationState.cancelRequested = true;
+        ImGui::EndDisabled();
+    }
+
     ImGui::Separator();
 
     m_BeamlineDesignHandler.showBeamlineDesignWindow(uiParams.beamlineInfo);
@@ -10,6 +10,7 @@
 
 #include "Application.h"
 #include "Debug/Debug.h"
+#include "Debug/Instrumentor.h"
 
 extern "C" {
 SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[]) {
@@ -40,5 +41,7 @@ void SDL_AppQuit(void* appstate, SDL_AppResult result) {
     RAYX_VERB << "SDL_AppQuit: quitting application with code: " << result;
     delete static_cast<Application*>(appstate);
     SDL_Quit();  // Clean up SDL subsystems
+
+    if (rayx::BENCH_FLAG) rayx::Profiler::get().printSummary(std::cout);
 }
 }
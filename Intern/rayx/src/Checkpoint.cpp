@@ -0,0 +1,131 @@
+#include "Checkpoint.h"
+
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "Debug/Debug.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr auto CHECKPOINT_HEADER = "rayx-checkpoint 1";
+
+template <typename T>
+std::string optionalToString(const std::optional<T>& value) {
+    return value ? std::to_string(*value) : "none";
+}
+
+std::optional<int> optionalFromString(const std::string& str) {
+    if (str == "none") return std::nullopt;
+    return std::stoi(str);
+}
+
+template <typename T>
+std::string join(const std::vector<T>& values) {
+    std::stringstream ss;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i != 0) ss << " ";
+        ss << values[i];
+    }
+    return ss.str();
+}
+
+template <typename T>
+std::vector<T> split(const std::string& str) {
+    std::vector<T> values;
+    std::stringstream ss(str);
+    T value;
+    while (ss >> value) values.push_back(value);
+    return values;
+}
+
+}  // unnamed namespace
+
+fs::path checkpointPath(const fs::path& outputPath) { return fs::path(outputPath.string() + ".checkpoint"); }
+
+void writeCheckpoint(const fs::path& filepath, const Checkpoint& checkpoint) {
+    const auto tmpFilepath = fs::path(filepath.string() + ".tmp");
+
+    {
+        std::ofstream file(tmpFilepath);
+        if (!file) RAYX_EXIT << "error: unable to write checkpoint file " << tmpFilepath;
+
+        // the seed is stored as hexadecimal floating point number, which is exact
+        file << CHECKPOINT_HEADER << "\n";
+        file << "input " << fs::absolute(checkpoint.inputPath).string() << "\n";
+        file << "output " << fs::absolute(checkpoint.outputPath).string() << "\n";
+        file << "sequential " << (checkpoint.sequential ? 1 : 0) << "\n";
+        file << "last_event " << (checkpoint.lastEvent ? 1 : 0) << "\n";
+        file << "max_events " << optionalToString(checkpoint.maxEvents) << "\n";
+        file << "batch_size " << optionalToString(checkpoint.batchSize) << "\n";
+        file << "number_of_rays " << optionalToString(checkpoint.numberOfRays) << "\n";
+        file << "record_indices " << join(checkpoint.objectRecordIndices) << "\n";
+        file << "attributes " << join(checkpoint.attrRecordMask) << "\n";
+        file << "shard " << (checkpoint.shard ? std::format("{}/{}", checkpoint.shard->index, checkpoint.shard->count) : "none") << "\n";
+        file << "seed " << std::format("{:a}", checkpoint.seed) << "\n";
+        file << "next_batch_index " << checkpoint.nextBatchIndex << "\n";
+        file << "num_events " << checkpoint.numEvents << "\n";
+
+        file.flush();
+        if (!file) RAYX_EXIT << "error: unable to write checkpoint file " << tmpFilepath;
+    }
+
+    fs::rename(tmpFilepath, filepath);
+}
+
+Checkpoint readCheckpoint(const fs::path& filepath) {
+    std::ifstream file(filepath);
+    if (!file) RAYX_EXIT << "error: unable to read checkpoint file " << filepath;
+
+    std::string line;
+    if (!std::getline(file, line) || line != CHECKPOINT_HEADER) RAYX_EXIT << "error: " << filepath << " is not a rayx checkpoint file";
+
+    // read key value pairs
+    auto values = std::map<std::string, std::string>();
+    while (std::getline(file, line)) {
+        const auto separator = line.find(' ');
+        values[line.substr(0, separator)] = separator == std::string::npos ? "" : line.substr(separator + 1);
+    }
+
+    const auto value = [&](const std::string& key) -> const std::string& {
+        const auto it = values.find(key);
+        if (it == values.end()) RAYX_EXIT << "error: checkpoint file " << filepath << " is missing the entry: " << key;
+        return it->second;
+    };
+
+    auto checkpoint = Checkpoint{
+        .inputPath           = value("input"),
+        .outputPath          = value("output"),
+        .sequential          = value("sequential") == "1",
+        .lastEvent           = value("last_event") == "1",
+        .maxEvents           = optionalFromString(value("max_events")),
+        .batchSize           = optionalFromString(value("batch_size")),
+        .numberOfRays        = optionalFromString(value("number_of_rays")),
+        .objectRecordIndices = split<int>(value("record_indices")),
+        .attrRecordMask      = split<std::string>(value("attributes")),
+        .shard               = std::nullopt,
+        .seed                = 0.0,
+        .nextBatchIndex      = std::stoi(value("next_batch_index")),
+        .numEvents           = std::stoll(value("num_events")),
+    };
+
+    const auto& seed = value("seed");
+    if (std::from_chars(seed.data(), seed.data() + seed.size(), checkpoint.seed, std::chars_format::hex).ec != std::errc())
+        RAYX_EXIT << "error: invalid seed in checkpoint file " << filepath << ": " << seed;
+
+    if (const auto& shard = value("shard"); shard != "none") {
+        auto index     = 0;
+        auto count     = 0;
+        auto separator = '\0';
+        auto ss        = std::stringstream(shard);
+        if (!(ss >> index >> separator >> count) || separator != '/')
+            RAYX_EXIT << "error: invalid shard in checkpoint file " << filepath << ": " << shard;
+        checkpoint.shard = rayx::Shard{.index = index, .count = count};
+    }
+
+    return checkpoint;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Tracer/Tracer.h"
+
+/// State of a checkpointed trace (see --checkpoint and --resume).
+/// Holds everything that determines the output of the trace, so that a resumed trace writes the same events as an uninterrupted one. The events
+/// of the completed batches are already in the output file.
+struct Checkpoint {
+    std::filesystem::path inputPath;
+    std::filesystem::path outputPath;
+    bool sequential;
+    bool lastEvent;
+    std::optional<int> maxEvents;
+    std::optional<int> batchSize;
+    std::optional<int> numberOfRays;
+    std::vector<int> objectRecordIndices;
+    std::vector<std::string> attrRecordMask;
+    std::optional<rayx::Shard> shard;
+    double seed;
+
+    /// index of the first batch that is not yet in the output file
+    int nextBatchIndex;
+    /// number of events in the output file after the completed batches. events beyond are discarded when resuming
+    int64_t numEvents;
+};
+
+/// the checkpoint file of an output file
+std::filesystem::path checkpointPath(const std::filesystem::path& outputPath);
+
+/// writes the checkpoint atomically, so that an interruption while writing leaves the previous checkpoint intact
+void writeCheckpoint(const std::filesystem::path& filepath, const Checkpoint& checkpoint);
+Checkpoint readCheckpoint(const std::filesystem::path& filepath);
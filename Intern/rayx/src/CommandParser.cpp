@@ -1,6 +1,7 @@
 #include "CommandParser.h"
 
 #include <CLI/CLI.hpp>
+#include <sstream>
 
 #include "Debug/Debug.h"
 #include "Debug/Instrumentor.h"
@@ -44,6 +45,10 @@ CliArgs parseCliArgs(const int argc, char const* const* const argv) {
     // other programs than tracing
     app.add_flag("-v,--version", args.version, "Show version information")->group(groupPrograms);
     app.add_option("-D,--dump", args.dump, "Dump the meta data of a file (RML or H5)")->group(groupPrograms);
+    app.add_flag("-M,--merge", args.merge,
+                 "Merge the H5 files of all shards of a trace (see --shard), given as input, into the file given by --output. Applies "
+                 "--sort-by-object-id")
+        ->group(groupPrograms);
 
     // tracing related options
     app.add_option("-i,--input", args.inputPaths, "Input RML files or directories (recursive search for RML files)");
@@ -59,16 +64,39 @@ CliArgs parseCliArgs(const int argc, char const* const* const argv) {
                  "--gpu are provided: Both will be enabled");
     app.add_flag("-X,--gpu", args.gpu, "Same as --cpu, but for GPU instead of CPU");
     app.add_flag("-l,--list-devices", args.listDevices, "List devices available for tracing. Affected by --cpu and --gpu")->group(groupPrograms);
-    app.add_option("-d,--device-index", args.deviceId,
-                   "Pick device via device index. Available devices are determined by --cpu and --gpu. Default: the best device will be picked "
-                   "automatically. Use --list-devices to see the available devices");
+    app.add_option("-d,--device-index", args.deviceIds,
+                   "Pick devices via device index. If several devices are picked, batches are distributed among them. Available devices are "
+                   "determined by --cpu and --gpu. Default: the best device will be picked automatically. Use --list-devices to see the available "
+                   "devices");
+    app.add_option("-P,--cpu-partitions", args.cpuPartitions,
+                   "Split the CPU device into this number of devices, each pinned to a disjoint set of cpus. Use 0 for one device per NUMA node. "
+                   "Default: all partitions are picked. Affects --list-devices and --device-index");
     app.add_flag("-c,--csv", args.csv, "Output stored as csv instead of H5 file");
     app.add_flag("-V,--verbose", args.verbose, "Dump more information");
     app.add_option("-m,--maxevents", args.maxEvents,
                    "Maximum number of events per ray. Default: A multiple of the number of objects to record events for");
+    app.add_flag("--last-event", args.lastEvent,
+                 "Record only the last event of each ray path. Requires less memory and transfer than recording all events. Combine with "
+                 "--record-indices to get the last event on the recorded objects");
     app.add_option("-b,--batch-size", args.batchSize, std::format("Batch size for tracing. Default: {}", rayx::DEFAULT_BATCH_SIZE));
     app.add_option("-n,--number-of-rays", args.numberOfRays, "Override the number of rays for all sources");
-    app.add_flag("-B,--benchmark", args.benchmark, "Dump benchmark durations");
+    std::optional<std::string> shard;
+    app.add_option("--shard", shard,
+                   "Trace only shard i of N (format: i/N, 0 <= i < N), to distribute one trace over several processes. All shards must use the same "
+                   "seed and batch size. Use --merge to combine the output files of all shards. Default output file: <input>.shard-i-of-N.h5");
+    app.add_flag("-C,--checkpoint", args.checkpoint,
+                 "Stream events to the H5 output file and write a checkpoint file (<output>.checkpoint) after each batch. An interrupted trace can "
+                 "be continued with --resume. The checkpoint file is removed when the trace is finished");
+    app.add_option("--resume", args.resume,
+                   "Continue an interrupted trace from its checkpoint file (see --checkpoint), using the arguments of the interrupted trace. The "
+                   "output is the same as for an uninterrupted trace");
+    app.add_flag("-B,--benchmark", args.benchmark,
+                 "Print a summary of the profiled scopes when finished: number of calls, total, min, mean and max durations per nested scope. "
+                 "Also prints current and peak memory usage of the tracer buffers, and the trace counters, if rayx-core was built with "
+                 "RAYX_TRACE_COUNTERS");
+    app.add_option("--profile", args.profile,
+                   "Write the profiled scopes of all threads to a Chrome trace JSON file, which can be opened in chrome://tracing or "
+                   "https://ui.perfetto.dev");
     app.add_flag("-O,--sort-by-object-id", args.sortByObjectId, "Sort rays by object_id before writing to output file");
     app.add_option("-R,--record-indices", args.objectRecordIndices,
                    "Record events only for specific sources / elements. Use --dump to list the objects of a beamline");
@@ -99,9 +127,33 @@ CliArgs parseCliArgs(const int argc, char const* const* const argv) {
 
     if (args.defaultSeed && args.seed) RAYX_EXIT << "Please do not provide '--default-seed' and '--seed' simultaneously'";
 
+    if (shard) {
+        auto index      = 0;
+        auto count      = 0;
+        auto separator  = '\0';
+        auto ss         = std::stringstream(*shard);
+        const auto isOk = (ss >> index >> separator >> count) && ss.eof() && separator == '/' && 0 <= index && index < count;
+        if (!isOk) RAYX_EXIT << "error: invalid value for --shard: '" << *shard << "'. expected format: i/N, with 0 <= i < N";
+
+        // all shards must generate the same rays, which requires the same seed
+        if (!args.seed && !args.defaultSeed) RAYX_EXIT << "error: --shard requires --seed or --default-seed";
+        if (args.sortByObjectId) RAYX_EXIT << "error: --sort-by-object-id can not be used with --shard. use it with --merge instead";
+
+        args.shard = rayx::Shard{.index = index, .count = count};
+    }
+
+    if (args.checkpoint || args.resume) {
+        if (args.csv) RAYX_EXIT << "error: --checkpoint and --resume require H5 output";
+        if (args.sortByObjectId) RAYX_EXIT << "error: --sort-by-object-id can not be used with --checkpoint or --resume";
+        if (args.append) RAYX_EXIT << "error: --append can not be used with --checkpoint or --resume";
+    }
+    if (args.resume && !args.inputPaths.empty()) RAYX_EXIT << "error: --resume takes the input from the checkpoint file. do not provide inputs";
+
     const bool isMoreThanOnePath    = args.inputPaths.size() > 1;
     const bool isFirstPathDirectory = args.inputPaths.size() == 1 && std::filesystem::is_directory(args.inputPaths[0]);
-    if (args.outputPath && (isMoreThanOnePath || isFirstPathDirectory)) {
+    if (args.merge) {
+        if (!args.outputPath) RAYX_EXIT << "error: --merge requires --output";
+    } else if (args.outputPath && (isMoreThanOnePath || isFirstPathDirectory)) {
         if (std::filesystem::is_directory(*args.outputPath)) {
             std::cout << "warning: specifying multiple input files and an output directory can lead to name collisions between output filenames"
                       << std::endl;
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include "Tracer/Tracer.h"
+
 struct CliArgs {
     bool csv         = false;  // -c --csv
     bool cpu         = false;  // -x --cpu
@@ -14,6 +16,9 @@ struct CliArgs {
     bool sequential  = false;  // -S --sequential
     bool verbose     = false;  // -V --verbose
     bool defaultSeed = false;  // -f, --default-seed
+    bool merge       = false;  // -M --merge
+    bool checkpoint  = false;  // -C --checkpoint
+    bool lastEvent   = false;  // --last-event
     // TODO: maybe we should allow custom sorting by attribute name?
     // TODO: maybe we can use this flag to even sort existing h5 files, that are given as input?
     bool sortByObjectId = false;              // -O --sort-by-object-id
@@ -25,7 +30,11 @@ struct CliArgs {
     std::optional<std::string> outputPath;    // -o --output
     std::optional<int> seed;                  // -s, --seed
     std::optional<int> batchSize;             // -b --batch-size
-    std::optional<int> deviceId;              // -d --device
+    std::vector<int> deviceIds;               // -d --device-index
+    std::optional<int> cpuPartitions;         // -P --cpu-partitions
+    std::optional<rayx::Shard> shard;         // --shard
+    std::optional<std::string> resume;        // --resume
+    std::optional<std::string> profile;       // --profile
     std::vector<int> objectRecordIndices;     // -R --record-indices
     std::vector<std::string> attrRecordMask;  // -A --attributes
 };
@@ -7,11 +7,13 @@
 
 #include <algorithm>
 #include <filesystem>
+#include <format>
 #include <memory>
 #include <stdexcept>
 #include <vector>
 
 #include "Beamline/StringConversion.h"
+#include "Checkpoint.h"
 #include "Debug/Debug.h"
 #include "Random.h"
 #include "Rml/Importer.h"
@@ -53,6 +55,43 @@ void dumpBeamline(const fs::path& filepath) {
     dumpBeamlineObjects(beamline.get());
 }
 
+/// prints the performance counters of a trace (see --benchmark and the cmake option RAYX_TRACE_COUNTERS)
+void printTraceCounters(const rayx::TraceCounters& counters, const std::vector<std::string>& objectNames, const int numSources) {
+    const auto perRay = [&](const int64_t n) { return counters.numRays ? static_cast<double>(n) / counters.numRays : 0.0; };
+
+    std::cout << "trace counters (" << counters.numRays << " rays):" << std::endl;
+    std::cout << "\t- elements tested: " << counters.elementsTested << " (" << perRay(counters.elementsTested) << " per ray)" << std::endl;
+    std::cout << "\t- toroid iterations: " << counters.toroidIterations << " (" << perRay(counters.toroidIterations) << " per ray)" << std::endl;
+    std::cout << "\t- cubic iterations: " << counters.cubicIterations << " (" << perRay(counters.cubicIterations) << " per ray)" << std::endl;
+
+    std::cout << "\t- rays by final event type:" << std::endl;
+    for (int i = 0; i < rayx::NUM_EVENT_TYPES; ++i) {
+        if (counters.raysPerFinalEventType[i] == 0) continue;
+        std::cout << "\t\t- " << rayx::EventTypeToString.at(static_cast<rayx::EventType>(i)) << ": " << counters.raysPerFinalEventType[i]
+                  << std::endl;
+    }
+
+    std::cout << "\t- hits per element:" << std::endl;
+    for (int i = 0; i < static_cast<int>(counters.hitsPerElement.size()); ++i) {
+        const auto objectIndex = numSources + i;
+        std::cout << "\t\t- [" << objectIndex << "] '" << objectNames[objectIndex] << "': " << counters.hitsPerElement[i] << std::endl;
+    }
+}
+
+/// prints current and peak memory usage of the tracer buffers (see --benchmark)
+void printMemoryStats(const rayx::MemoryStats& stats) {
+    const auto mib = [](const int64_t bytes) { return std::format("{:.2f} MiB", static_cast<double>(bytes) / (1024.0 * 1024.0)); };
+
+    std::cout << "tracer memory (current / peak):" << std::endl;
+    for (int i = 0; i < rayx::NUM_MEMORY_CATEGORIES; ++i) {
+        const auto& usage = stats.categories[i];
+        if (usage.peakBytes == 0) continue;
+        std::cout << "\t- " << rayx::to_string(static_cast<rayx::MemoryCategory>(i)) << ": " << mib(usage.currentBytes) << " / "
+                  << mib(usage.peakBytes) << std::endl;
+    }
+    std::cout << "\t- total: " << mib(stats.total.currentBytes) << " / " << mib(stats.total.peakBytes) << std::endl;
+}
+
 #ifndef NO_H5
 void scanGroup(const HighFive::Group& group, const int depth = 0, const std::string& path = "/") {
     size_t num_objs = group.getNumberObjects();
@@ -93,6 +132,45 @@ void dumpH5File(const fs::path& filepath) {
         scanGroup(file.getGroup("/"), 1);
     } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to read h5 file: " << e.what(); }
 }
+
+/// dataset storing index and count of the shard, that a file was written by (see --shard)
+constexpr auto H5_SHARD_DATASET = "rayx/shard";
+
+void writeH5Shard(const fs::path& filepath, const rayx::Shard& shard) {
+    try {
+        auto file       = HighFive::File(filepath.string(), HighFive::File::ReadWrite);
+        const auto data = std::vector<int>{shard.index, shard.count};
+        // the dataset exists already, if the file is appended to (see --append)
+        if (file.exist(H5_SHARD_DATASET))
+            file.getDataSet(H5_SHARD_DATASET).write(data);
+        else
+            file.createDataSet(H5_SHARD_DATASET, data);
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to write h5 file: " << e.what(); }
+}
+
+rayx::Shard readH5Shard(const fs::path& filepath) {
+    auto shard = std::vector<int>();
+
+    try {
+        auto file = HighFive::File(filepath.string(), HighFive::File::ReadOnly);
+        if (!file.exist(H5_SHARD_DATASET)) RAYX_EXIT << "error: " << filepath << " was not written by a shard. see --shard";
+        file.getDataSet(H5_SHARD_DATASET).read(shard);
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to read h5 file: " << e.what(); }
+
+    if (shard.size() != 2) RAYX_EXIT << "error: invalid shard information in " << filepath;
+    return rayx::Shard{.index = shard[0], .count = shard[1]};
+}
+
+int64_t readH5NumEvents(const fs::path& filepath) {
+    auto numEvents = int64_t{0};
+
+    try {
+        auto file = HighFive::File(filepath.string(), HighFive::File::ReadOnly);
+        file.getDataSet("rayx/num_events").read(numEvents);
+    } catch (const std::exception& e) { RAYX_EXIT << "exception caught while attempting to read h5 file: " << e.what(); }
+
+    return numEvents;
+}
 #endif
 
 }  // unnamed namespace
@@ -121,6 +199,9 @@ TerminalApp::TerminalApp(int argc, char** argv) {
     }
 
     m_cliArgs = parseCliArgs(argc, argv);
+
+    // enabled before run(), so that the whole run is profiled
+    rayx::BENCH_FLAG = m_cliArgs.benchmark || m_cliArgs.profile;
 }
 
 TerminalApp::~TerminalApp() { RAYX_VERB << "TerminalApp deleted!"; }
@@ -143,6 +224,15 @@ int TerminalApp::tracePath(const fs::path& path) {
 }
 
 void TerminalApp::traceRmlAndExportRays(const fs::path& inputFilepath) {
+    if (m_cliArgs.checkpoint) {
+#ifndef NO_H5
+        traceRmlWithCheckpoints(inputFilepath, std::nullopt);
+#else
+        RAYX_EXIT << "error: --checkpoint requires H5 output, but hdf5 was disabled during build.";
+#endif
+        return;
+    }
+
     using namespace std::chrono;
     const auto start_time = steady_clock::now();
 
@@ -197,7 +287,7 @@ rayx::Beamline TerminalApp::loadBeamline(const fs::path& filepath) {
     return beamline;
 }
 
-rayx::Rays TerminalApp::traceBeamline(const rayx::Beamline& beamline, const rayx::RayAttrMask attrRecordMask) {
+rayx::Rays TerminalApp::traceBeamline(const rayx::Beamline& beamline, const rayx::RayAttrMask attrRecordMask, const rayx::TraceControl& control) {
     RAYX_PROFILE_FUNCTION_STDOUT();
 
     // dump beamline objects
@@ -231,11 +321,20 @@ rayx::Rays TerminalApp::traceBeamline(const rayx::Beamline& beamline, const rayx
     // max batch size
     const auto maxBatchSize = m_cliArgs.batchSize;
 
-    // in order to validate the events later, we always want to get the event types
-    const auto attrRecordMaskTrace = attrRecordMask | rayx::RayAttrMask::EventType;
+    // record all events or only the last event of each ray path
+    auto traceControl       = control;
+    traceControl.recordMode = m_cliArgs.lastEvent ? rayx::RecordMode::LastEvent : rayx::RecordMode::AllEvents;
 
     // do the trace
-    auto rays = m_tracer->trace(beamline, sequential, objectRecordMask, attrRecordMaskTrace, maxEvents, maxBatchSize);
+    auto rays = m_tracer->trace(beamline, sequential, objectRecordMask, attrRecordMask, maxEvents, maxBatchSize, m_cliArgs.shard, traceControl);
+
+    if (m_cliArgs.benchmark) {
+        if (const auto& counters = m_tracer->getTraceCounters())
+            printTraceCounters(*counters, beamline.getObjectNames(), static_cast<int>(numSources));
+        else
+            RAYX_VERB << "no trace counters available. build with the cmake option RAYX_TRACE_COUNTERS to enable them";
+        printMemoryStats(m_tracer->getMemoryStats());
+    }
 
     if (m_cliArgs.sortByObjectId) {
         if (!(attrRecordMask & rayx::RayAttrMask::ObjectId))
@@ -244,30 +343,9 @@ rayx::Rays TerminalApp::traceBeamline(const rayx::Beamline& beamline, const rayx
         rays = rays.sortByObjectId();
     }
 
-    // validate using recorded attribute: event type
-    validateEvents(rays);
-
-    // return to the user-specified attribute record mask
-    rays.filterByAttrMask(attrRecordMask);
-
     return rays;
 }
 
-void TerminalApp::validateEvents(const rayx::Rays& rays) {
-    RAYX_PROFILE_FUNCTION_STDOUT();
-
-    const auto eventTypes =
-        std::ranges::fold_left(rays.event_type.begin(), rays.event_type.end(), rayx::EventTypeMask::None,
-                               [](rayx::EventTypeMask acc, const rayx::EventType eventType) { return acc | rayx::eventTypeToMask(eventType); });
-
-    if (!!(eventTypes & rayx::EventTypeMask::Uninitialized)) std::cout << "warning: one or more events in output are uninitialized" << std::endl;
-    if (!!(eventTypes & rayx::EventTypeMask::FatalError)) std::cout << "warning: fatal error detected for one or more events" << std::endl;
-    if (!!(eventTypes & rayx::EventTypeMask::BeyondHorizon))
-        std::cout << "warning: one or more events in output have gone beyond the horizon while refracting" << std::endl;
-    if (!!(eventTypes & rayx::EventTypeMask::TooManyEvents))
-        std::cout << "warning: capacity of events exceeded. could not record all events! consider increasing max events." << std::endl;
-}
-
 void TerminalApp::run() {
     RAYX_VERB << "TerminalApp running...";
 
@@ -300,9 +378,32 @@ void TerminalApp::run() {
         rayx::randomSeed();
     }
 
-    if (m_cliArgs.benchmark) {
-        RAYX_VERB << "Starting in Benchmark Mode.\n";
-        rayx::BENCH_FLAG = true;
+    if (rayx::BENCH_FLAG) RAYX_VERB << "Starting in Benchmark Mode.\n";
+
+    if (m_cliArgs.merge) {
+#ifndef NO_H5
+        mergeShards();
+#else
+        RAYX_EXIT << "error: unable to merge h5 files due to hdf5 was disabled during build.";
+#endif
+        return;
+    }
+
+    // a resumed trace continues with the arguments of the interrupted trace
+    auto resumeCheckpoint = std::optional<Checkpoint>();
+    if (m_cliArgs.resume) {
+        resumeCheckpoint              = readCheckpoint(*m_cliArgs.resume);
+        m_cliArgs.inputPaths          = {resumeCheckpoint->inputPath.string()};
+        m_cliArgs.outputPath          = resumeCheckpoint->outputPath.string();
+        m_cliArgs.sequential          = resumeCheckpoint->sequential;
+        m_cliArgs.lastEvent           = resumeCheckpoint->lastEvent;
+        m_cliArgs.maxEvents           = resumeCheckpoint->maxEvents;
+        m_cliArgs.batchSize           = resumeCheckpoint->batchSize;
+        m_cliArgs.numberOfRays        = resumeCheckpoint->numberOfRays;
+        m_cliArgs.objectRecordIndices = resumeCheckpoint->objectRecordIndices;
+        m_cliArgs.attrRecordMask      = resumeCheckpoint->attrRecordMask;
+        m_cliArgs.shard               = resumeCheckpoint->shard;
+        m_cliArgs.checkpoint          = true;
     }
 
     auto argToDeviceType = [&] {
@@ -313,42 +414,71 @@ void TerminalApp::run() {
 
     auto deviceType = argToDeviceType();
 
+    auto getDeviceConfig = [&] {
+        auto deviceConfig = rayx::DeviceConfig(deviceType);
+        if (m_cliArgs.cpuPartitions) deviceConfig.partitionCpu(*m_cliArgs.cpuPartitions ? std::optional(*m_cliArgs.cpuPartitions) : std::nullopt);
+        return deviceConfig;
+    };
+
     if (m_cliArgs.listDevices) {
-        rayx::DeviceConfig(deviceType).dumpDevices();
+        getDeviceConfig().dumpDevices();
         exit(0);
     }
 
     // Choose Hardware
     auto getDevice = [&] {
-        if (m_cliArgs.deviceId) {
-            return rayx::DeviceConfig(deviceType).enableDeviceByIndex(*m_cliArgs.deviceId);
-        } else {
-            return rayx::DeviceConfig(deviceType).enableBestDevice();
+        auto deviceConfig = getDeviceConfig();
+        if (!m_cliArgs.deviceIds.empty()) {
+            for (const auto deviceId : m_cliArgs.deviceIds) deviceConfig.enableDeviceByIndex(deviceId);
+            return deviceConfig;
         }
+
+        // pick all cpu partitions, if any
+        for (auto& device : deviceConfig.devices) device.enable = !device.cpus.empty();
+        if (deviceConfig.enabledDevicesCount() == 0) deviceConfig.enableBestDevice();
+        return deviceConfig;
     };
     m_tracer = std::make_unique<rayx::Tracer>(getDevice());
+    // the tuned work divisions are reused by later runs
+    m_tracer->setWorkDivTuningPolicy(rayx::WorkDivTuningPolicy{.cacheFilepath = rayx::defaultWorkDivCacheFilepath()});
 
     if (!m_cliArgs.inputPaths.size()) RAYX_EXIT << "Please provide an input RML file or directory. Use --help for more information";
 
     // trace and export
     auto rmlCounter = 0;
-    for (const auto path : m_cliArgs.inputPaths) rmlCounter += tracePath(path);
+    if (resumeCheckpoint) {
+#ifndef NO_H5
+        traceRmlWithCheckpoints(resumeCheckpoint->inputPath, resumeCheckpoint);
+        rmlCounter = 1;
+#endif
+    } else {
+        for (const auto path : m_cliArgs.inputPaths) rmlCounter += tracePath(path);
+    }
 
     std::cout << "Done. Processed " << rmlCounter << " RML file(s)" << std::endl;
 }
 
-fs::path TerminalApp::exportRays(const fs::path& inputFilepath, const std::vector<std::string>& objectNames, const rayx::Rays& rays,
-                                 const rayx::RayAttrMask attrRecordMask) {
-    RAYX_PROFILE_FUNCTION_STDOUT();
+void TerminalApp::exportProfile() const {
+    if (m_cliArgs.benchmark) rayx::Profiler::get().printSummary(std::cout);
 
-    if (rays.empty()) return {};
+    if (m_cliArgs.profile) {
+        try {
+            rayx::Profiler::get().writeChromeTrace(*m_cliArgs.profile);
+            std::cout << "Wrote profile to: " << *m_cliArgs.profile << std::endl;
+        } catch (const std::exception& e) { RAYX_EXIT << e.what(); }
+    }
+}
 
+fs::path TerminalApp::getOutputFilepath(const fs::path& inputFilepath) const {
     fs::path outputFilepath;
-    if (m_cliArgs.outputPath) {
+    if (m_cliArgs.outputPath && !fs::is_directory(*m_cliArgs.outputPath)) {
         outputFilepath = *m_cliArgs.outputPath;
-        if (fs::is_directory(outputFilepath)) outputFilepath /= inputFilepath.filename();
     } else {
-        outputFilepath = inputFilepath;
+        outputFilepath = m_cliArgs.outputPath ? fs::path(*m_cliArgs.outputPath) / inputFilepath.filename() : inputFilepath;
+        // keep the output files of the shards of a trace apart
+        if (m_cliArgs.shard)
+            outputFilepath.replace_filename(
+                std::format("{}.shard-{}-of-{}", inputFilepath.stem().string(), m_cliArgs.shard->index, m_cliArgs.shard->count));
     }
     outputFilepath.replace_extension(m_cliArgs.csv ? ".csv" : ".h5");
 
@@ -358,6 +488,19 @@ fs::path TerminalApp::exportRays(const fs::path& inputFilepath, const std::vecto
         RAYX_EXIT << "Output directory '" << parent.string() << "' does not exist. Create it first or use a different output path.";
     }
 
+    return outputFilepath;
+}
+
+fs::path TerminalApp::exportRays(const fs::path& inputFilepath, const std::vector<std::string>& objectNames, const rayx::Rays& rays,
+                                 const rayx::RayAttrMask attrRecordMask) {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    // a shard writes its output file even without events, so that merging the shards can tell an empty shard from a missing one
+    const auto isH5Shard = m_cliArgs.shard && !m_cliArgs.csv;
+    if (rays.empty() && !isH5Shard) return {};
+
+    const auto outputFilepath = getOutputFilepath(inputFilepath);
+
     if (m_cliArgs.csv) {
         rayx::writeCsv(outputFilepath, rays);
         const auto rays2 = rayx::readCsv(outputFilepath);
@@ -366,12 +509,120 @@ fs::path TerminalApp::exportRays(const fs::path& inputFilepath, const std::vecto
 #ifdef NO_H5
         RAYX_EXIT << "writeH5 called during NO_H5 (HDF5 disabled during build)";
 #else
-        if (m_cliArgs.append)
+        if (rays.empty()) {
+            if (!m_cliArgs.append || !fs::exists(outputFilepath)) rayx::createH5(outputFilepath, objectNames, attrRecordMask);
+        } else if (m_cliArgs.append)
             rayx::appendH5(outputFilepath, rays, attrRecordMask);
         else
             rayx::writeH5(outputFilepath, objectNames, rays, attrRecordMask);
+
+        if (m_cliArgs.shard) writeH5Shard(outputFilepath, *m_cliArgs.shard);
 #endif
     }
 
     return outputFilepath;
 }
+
+#ifndef NO_H5
+void TerminalApp::mergeShards() {
+    RAYX_PROFILE_FUNCTION_STDOUT();
+
+    if (m_cliArgs.inputPaths.empty()) RAYX_EXIT << "error: please provide the h5 files of the shards to merge";
+
+    // order the files by shard index, regardless of the order they are given in
+    auto shardFilepaths = std::vector<std::pair<rayx::Shard, fs::path>>();
+    for (const auto& inputPath : m_cliArgs.inputPaths) shardFilepaths.emplace_back(readH5Shard(inputPath), inputPath);
+    std::ranges::sort(shardFilepaths, {}, [](const auto& shardFilepath) { return shardFilepath.first.index; });
+
+    const auto numShards   = shardFilepaths.front().first.count;
+    const auto objectNames = rayx::readH5ObjectNames(shardFilepaths.front().second);
+    const auto attrMask    = rayx::readH5RayAttrMask(shardFilepaths.front().second);
+
+    for (size_t i = 0; i < shardFilepaths.size(); ++i) {
+        const auto& [shard, filepath] = shardFilepaths[i];
+        if (shard.count != numShards) RAYX_EXIT << "error: " << filepath << " belongs to a trace with a different number of shards";
+        if (shard.index < 0 || numShards <= shard.index) RAYX_EXIT << "error: invalid shard information in " << filepath;
+        if (0 < i && shard.index == shardFilepaths[i - 1].first.index) RAYX_EXIT << "error: shard " << shard.index << " is given more than once";
+        if (rayx::readH5ObjectNames(filepath) != objectNames) RAYX_EXIT << "error: " << filepath << " belongs to a different beamline";
+        if (rayx::readH5RayAttrMask(filepath) != attrMask) RAYX_EXIT << "error: " << filepath << " contains different ray attributes";
+    }
+
+    // every shard writes an output file, even without events. a missing file means that the shard did not finish
+    for (int index = 0; index < numShards; ++index)
+        if (static_cast<int>(shardFilepaths.size()) <= index || shardFilepaths[index].first.index != index)
+            RAYX_EXIT << "error: shard " << index << "/" << numShards << " is missing. all shards of a trace must be merged";
+
+    auto raysShards = std::vector<rayx::Rays>();
+    for (const auto& [shard, filepath] : shardFilepaths)
+        if (readH5NumEvents(filepath) != 0) raysShards.push_back(rayx::readH5Rays(filepath, attrMask));
+
+    auto rays = rayx::Rays::concat(raysShards);
+    if (m_cliArgs.sortByObjectId) {
+        if (!(attrMask & rayx::RayAttrMask::ObjectId)) RAYX_EXIT << "error: cannot sort by object_id, because object_id is not recorded";
+        rays = rays.sortByObjectId();
+    }
+
+    if (rays.empty())
+        rayx::createH5(*m_cliArgs.outputPath, objectNames, attrMask);
+    else
+        rayx::writeH5(*m_cliArgs.outputPath, objectNames, rays, attrMask);
+
+    std::cout << "Merged " << shardFilepaths.size() << " shard(s) with " << rays.size() << " events into: " << fs::absolute(*m_cliArgs.outputPath)
+              << std::endl;
+}
+
+void TerminalApp::traceRmlWithCheckpoints(const fs::path& inputFilepath, std::optional<Checkpoint> checkpoint) {
+    std::cout << "Processing: " << inputFilepath << std::endl;
+
+    const auto attrRecordMask = rayx::rayAttrStringsToRayAttrMask(m_cliArgs.attrRecordMask);
+    const auto beamline       = loadBeamline(inputFilepath);
+
+    if (checkpoint) {
+        std::cout << "Resuming at batch " << checkpoint->nextBatchIndex << " with " << checkpoint->numEvents << " events in "
+                  << checkpoint->outputPath << std::endl;
+
+        // events of a batch that was interrupted while being written are discarded
+        rayx::truncateH5(checkpoint->outputPath, checkpoint->numEvents);
+    } else {
+        // the seed is drawn like in Tracer::trace, so that the output is the same as without checkpoints
+        checkpoint = Checkpoint{
+            .inputPath           = inputFilepath,
+            .outputPath          = getOutputFilepath(inputFilepath),
+            .sequential          = m_cliArgs.sequential,
+            .lastEvent           = m_cliArgs.lastEvent,
+            .maxEvents           = m_cliArgs.maxEvents,
+            .batchSize           = m_cliArgs.batchSize,
+            .numberOfRays        = m_cliArgs.numberOfRays,
+            .objectRecordIndices = m_cliArgs.objectRecordIndices,
+            .attrRecordMask      = m_cliArgs.attrRecordMask,
+            .shard               = m_cliArgs.shard,
+            .seed                = rayx::randomDouble(),
+            .nextBatchIndex      = 0,
+            .numEvents           = 0,
+        };
+
+        rayx::createH5(checkpoint->outputPath, beamline.getObjectNames(), attrRecordMask);
+        if (m_cliArgs.shard) writeH5Shard(checkpoint->outputPath, *m_cliArgs.shard);
+        writeCheckpoint(checkpointPath(checkpoint->outputPath), *checkpoint);
+    }
+
+    // the events of each batch are appended to the output file, before the checkpoint is advanced past the batch
+    const auto control = rayx::TraceControl{
+        .firstBatchIndex = checkpoint->nextBatchIndex,
+        .seed            = checkpoint->seed,
+        .onBatch =
+            [&](const int batchIndex, rayx::Rays&& rays) {
+                rayx::appendH5(checkpoint->outputPath, rays, attrRecordMask);
+
+                checkpoint->nextBatchIndex = batchIndex + 1;
+                checkpoint->numEvents += rays.size();
+                writeCheckpoint(checkpointPath(checkpoint->outputPath), *checkpoint);
+            },
+    };
+
+    traceBeamline(beamline, attrRecordMask, control);
+
+    fs::remove(checkpointPath(checkpoint->outputPath));
+    std::cout << "Finished. Exported " << checkpoint->numEvents << " events to: " << checkpoint->outputPath << std::endl;
+}
+#endif
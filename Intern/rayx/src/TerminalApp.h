@@ -4,6 +4,7 @@
 #include <filesystem>
 
 #include "Beamline/Beamline.h"
+#include "Checkpoint.h"
 #include "CommandParser.h"
 #include "Debug/Instrumentor.h"
 #include "Rays.h"
@@ -17,12 +18,25 @@ class TerminalApp {
 
     void run();
 
+    /// prints the profile summary (see --benchmark) and writes the profile (see --profile). call after run() returned
+    void exportProfile() const;
+
   private:
     int tracePath(const std::filesystem::path& path);
     void traceRmlAndExportRays(const std::filesystem::path& path);
     rayx::Beamline loadBeamline(const std::filesystem::path& filepath);
-    rayx::Rays traceBeamline(const rayx::Beamline& beamline, const rayx::RayAttrMask attr);
-    void validateEvents(const rayx::Rays& rays);
+    rayx::Rays traceBeamline(const rayx::Beamline& beamline, const rayx::RayAttrMask attr, const rayx::TraceControl& control = {});
+
+#ifndef NO_H5
+    /// concatenates the h5 files written by the shards of a trace (see --shard)
+    void mergeShards();
+
+    /// traces with checkpoints (see --checkpoint). continues from `checkpoint` if given
+    void traceRmlWithCheckpoints(const std::filesystem::path& path, std::optional<Checkpoint> checkpoint);
+#endif
+
+    /// @returns the output filepath for an input file, determined by --output and --shard
+    std::filesystem::path getOutputFilepath(const std::filesystem::path& inputFilepath) const;
 
     /// write rays to file
     /// @returns the output filename (either .csv or .h5)
@@ -1,9 +1,12 @@
 #include "TerminalApp.h"
 
 int main(int argc, char** argv) {
-    RAYX_PROFILE_FUNCTION_STDOUT();
     TerminalApp app = TerminalApp(argc, argv);
-    app.run();
+    {
+        RAYX_PROFILE_FUNCTION_STDOUT();
+        app.run();
+    }
+    app.exportProfile();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -20,8 +20,8 @@ import sys
 import os
 import subprocess
 import tempfile
+import json
 from progress.bar import Bar
-import re
 import numpy as np
 import pandas as pd
 from datetime import datetime
@@ -42,18 +42,21 @@ rml_files = {
     "toroid.rml",
 }
 
-def parse_benchmark_results(result_string):
-    # Making \r optional to support both Windows and Linux
-    pattern = r"BENCH: ([\w\-\:\.]+): \r?\n([\de\-\.]+)s"
-    
-    matches = re.findall(pattern, result_string)
+def parse_benchmark_results(profile_path):
+    # the profile is written by rayx --profile in the Chrome trace event format. durations are in microseconds
+    with open(profile_path) as f:
+        profile = json.load(f)
 
     result_dict = {}
-    for name, time in matches:
+    for event in profile["traceEvents"]:
+        if event.get("ph") != "X":
+            continue
+        name = event["name"]
+        time = event["dur"] * 1e-6
         if name in result_dict:
-            result_dict[name] += float(time)
+            result_dict[name] += time
         else:
-            result_dict[name] = float(time)
+            result_dict[name] = time
 
     #print(result_dict)
     return result_dict
@@ -168,20 +171,20 @@ def main():
             resultBatch = []
             for i in range(numberOfRuns):
                 # print(f"Running {file} [{i}]")
-                with tempfile.TemporaryFile() as tempf:
+                with tempfile.TemporaryDirectory() as tempdir:
+                    profile_path = os.path.join(tempdir, "profile.json")
                     proc = subprocess.Popen(
                         [
                             path,
                             "-i",
                             path_to_input_dir + str(file),
-                            "--benchmark",
+                            "--profile",
+                            profile_path,
                         ],
-                        stdout=tempf,
+                        stdout=subprocess.DEVNULL,
                     )
                     proc.wait()
-                    tempf.seek(0)
-                    resultString = tempf.read().decode("utf-8")
-                    resultBatch.append(parse_benchmark_results(resultString))
+                    resultBatch.append(parse_benchmark_results(profile_path))
 
                 bar.next()
             results.append(resultBatch)